@@ -0,0 +1,445 @@
+/**
+ * @file mcp_bench.cpp
+ * @brief Load generator for MCP servers
+ *
+ * Opens N concurrent sessions, initializes each one and sends a weighted mix
+ * of tools/list, ping and tools/call, then reports throughput and latency
+ * percentiles per method. With --stub the server is started in-process with
+ * stub tools, so the numbers measure the transport and dispatch path without
+ * any backend latency.
+ */
+
+// mcp requirements
+#include "json.hpp"
+#include "mcp_server.h"
+#include "mcp_sse_client.h"
+#include "mcp_tool.h"
+
+// standard headers
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct BenchConfig{
+    // target server
+    std::string host = "localhost";
+    int port = 8889;
+    // "streamable" or "sse"
+    std::string transport = "streamable";
+    // message endpoint for streamable, SSE endpoint for sse
+    std::string endpoint;
+
+    // load shape
+    int sessions = 8;
+    int requests = 1000;   // per session, after warmup
+    int warmup = 20;       // per session, not measured
+    std::string mix = "tools/list=1,ping=1,tools/call=8";
+
+    // tools/call target
+    std::string tool = "echo";
+    std::string args = "{\"text\":\"ping\"}";
+
+    // run an in-process server with stub tools
+    bool stub = false;
+    int stub_delay_ms = 0;
+} config;
+
+bool parse_bool(const std::string& str) {
+    if (str == "true" || str == "1" || str == "yes") return true;
+    if (str == "false" || str == "0" || str == "no") return false;
+    throw std::invalid_argument("Invalid boolean: " + str);
+}
+
+static BenchConfig parse_config(int argc, char* argv[]) {
+    BenchConfig config;
+    for (int i = 1; i < argc; i++) {
+        // every option takes a value
+        if (strcmp(argv[i], "--help") != 0 && strcmp(argv[i], "-h") != 0 && i + 1 >= argc) {
+            std::cerr << "Error: " << argv[i] << " requires a value" << std::endl;
+            exit(1);
+        }
+
+        if (strcmp(argv[i], "--host") == 0) {
+            config.host = argv[++i];
+        } else if (strcmp(argv[i], "--port") == 0) {
+            config.port = std::stoi(argv[++i]);
+        } else if (strcmp(argv[i], "--transport") == 0) {
+            config.transport = argv[++i];
+            if (config.transport != "sse" && config.transport != "streamable") {
+                std::cerr << "Error: --transport should be either sse or streamable" << std::endl;
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--endpoint") == 0) {
+            config.endpoint = argv[++i];
+        } else if (strcmp(argv[i], "--sessions") == 0) {
+            config.sessions = std::max(1, std::stoi(argv[++i]));
+        } else if (strcmp(argv[i], "--requests") == 0) {
+            config.requests = std::max(1, std::stoi(argv[++i]));
+        } else if (strcmp(argv[i], "--warmup") == 0) {
+            config.warmup = std::max(0, std::stoi(argv[++i]));
+        } else if (strcmp(argv[i], "--mix") == 0) {
+            config.mix = argv[++i];
+        } else if (strcmp(argv[i], "--tool") == 0) {
+            config.tool = argv[++i];
+        } else if (strcmp(argv[i], "--args") == 0) {
+            config.args = argv[++i];
+        } else if (strcmp(argv[i], "--stub") == 0) {
+            config.stub = parse_bool(argv[++i]);
+        } else if (strcmp(argv[i], "--stub-delay-ms") == 0) {
+            config.stub_delay_ms = std::max(0, std::stoi(argv[++i]));
+        } else if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
+            std::cout << "Usage: " << argv[0] << " [OPTIONS]\n\n";
+            std::cout << "Target Options:\n";
+            std::cout << "  --host <host>            Server host (default: localhost)\n";
+            std::cout << "  --port <port>            Server port (default: 8889)\n";
+            std::cout << "  --transport <mode>       sse or streamable (default: streamable)\n";
+            std::cout << "  --endpoint <path>        Message endpoint (streamable, default: /mcp) or SSE endpoint (sse, default: /sse)\n\n";
+            std::cout << "Load Options:\n";
+            std::cout << "  --sessions <n>           Concurrent sessions, one thread each (default: 8)\n";
+            std::cout << "  --requests <n>           Measured requests per session (default: 1000)\n";
+            std::cout << "  --warmup <n>             Unmeasured requests per session (default: 20)\n";
+            std::cout << "  --mix <spec>             Weighted methods (default: tools/list=1,ping=1,tools/call=8)\n";
+            std::cout << "  --tool <name>            Tool for tools/call (default: echo)\n";
+            std::cout << "  --args <json>            Arguments for tools/call (default: {\"text\":\"ping\"})\n\n";
+            std::cout << "Stub Options:\n";
+            std::cout << "  --stub <bool>            Start an in-process server with stub tools on --port\n";
+            std::cout << "  --stub-delay-ms <ms>     Delay of the stub echo tool (default: 0)\n";
+            std::cout << "  --help, -h               Show this help message\n";
+            exit(0);
+        } else {
+            std::cerr << "Unknown option: " << argv[i] << std::endl;
+            std::cerr << "Use --help for usage information" << std::endl;
+            exit(1);
+        }
+    }
+
+    if (config.endpoint.empty()) {
+        config.endpoint = config.transport == "sse" ? "/sse" : "/mcp";
+    }
+    return config;
+}
+
+// parse "method=weight,method=weight"
+std::vector<std::pair<std::string, int>> parse_mix(const std::string& spec) {
+    std::vector<std::pair<std::string, int>> mix;
+    std::stringstream ss(spec);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        auto eq = item.find('=');
+        std::string method = item.substr(0, eq);
+        int weight = eq == std::string::npos ? 1 : std::stoi(item.substr(eq + 1));
+        if (method != "tools/list" && method != "ping" && method != "tools/call") {
+            throw std::invalid_argument("Unsupported method in --mix: " + method);
+        }
+        if (weight > 0) {
+            mix.emplace_back(method, weight);
+        }
+    }
+    if (mix.empty()) {
+        throw std::invalid_argument("Empty --mix");
+    }
+    return mix;
+}
+
+// One session's connection to the server
+class bench_driver {
+public:
+    virtual ~bench_driver() = default;
+
+    // open the session, returns false on failure
+    virtual bool initialize() = 0;
+
+    // send one request and wait for its response, returns false on failure
+    virtual bool send(const std::string& method) = 0;
+};
+
+// Streamable HTTP: one keep-alive connection, responses read from the POST body
+class streamable_driver : public bench_driver {
+public:
+    streamable_driver(const BenchConfig& config) : client_(config.host, config.port), endpoint_(config.endpoint) {
+        client_.set_keep_alive(true);
+        client_.set_tcp_nodelay(true);
+        client_.set_read_timeout(60, 0);
+
+        // bodies are built once; requests are sequential so reusing ids is safe
+        bodies_["ping"] = mcp::request::create("ping").to_json().dump();
+        bodies_["tools/list"] = mcp::request::create("tools/list").to_json().dump();
+        bodies_["tools/call"] = mcp::request::create("tools/call", {
+            {"name", config.tool},
+            {"arguments", mcp::json::parse(config.args)}
+        }).to_json().dump();
+    }
+
+    bool initialize() override {
+        mcp::json init = mcp::request::create("initialize", {
+            {"protocolVersion", mcp::MCP_VERSION},
+            {"clientInfo", {{"name", "mcp_bench"}, {"version", "0.0.1"}}},
+            {"capabilities", mcp::json::object()}
+        }).to_json();
+        auto res = client_.Post(endpoint_, {{"Accept", "application/json"}}, init.dump(), "application/json");
+        if (!res || res->status != 200) {
+            return false;
+        }
+
+        headers_ = {{"Accept", "application/json"}, {"Mcp-Session-Id", res->get_header_value("Mcp-Session-Id")}};
+        res = client_.Post(endpoint_, headers_, mcp::request::create_notification("initialized").to_json().dump(), "application/json");
+        return res && res->status == 202;
+    }
+
+    bool send(const std::string& method) override {
+        auto res = client_.Post(endpoint_, headers_, bodies_[method], "application/json");
+        if (!res || res->status != 200) {
+            return false;
+        }
+        // an error response has "error" at the top level
+        return res->body.find("\"error\":") == std::string::npos || !mcp::json::parse(res->body).contains("error");
+    }
+
+private:
+    httplib::Client client_;
+    std::string endpoint_;
+    httplib::Headers headers_;
+    std::map<std::string, std::string> bodies_;
+};
+
+// HTTP+SSE: requests are POSTed and responses arrive on the session's event stream
+class sse_driver : public bench_driver {
+public:
+    sse_driver(const BenchConfig& config)
+        : client_(config.host, config.port, config.endpoint), tool_(config.tool), args_(mcp::json::parse(config.args)) {
+        client_.set_timeout(60);
+    }
+
+    bool initialize() override {
+        return client_.initialize("mcp_bench", "0.0.1");
+    }
+
+    bool send(const std::string& method) override {
+        try {
+            if (method == "ping") {
+                return client_.ping();
+            } else if (method == "tools/list") {
+                client_.get_tools();
+            } else {
+                client_.call_tool(tool_, args_);
+            }
+            return true;
+        } catch (const std::exception&) {
+            return false;
+        }
+    }
+
+private:
+    mcp::sse_client client_;
+    std::string tool_;
+    mcp::json args_;
+};
+
+// Latencies of one session, in nanoseconds, keyed by method
+struct SessionResult {
+    std::map<std::string, std::vector<int64_t>> latencies;
+    size_t errors = 0;
+    bool initialized = false;
+    std::chrono::steady_clock::time_point finished;
+};
+
+// nearest-rank percentile of sorted samples
+int64_t percentile(const std::vector<int64_t>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t rank = static_cast<size_t>(std::ceil(p * sorted.size()));
+    return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+void print_row(const std::string& name, std::vector<int64_t>& samples) {
+    std::sort(samples.begin(), samples.end());
+    auto us = [](int64_t ns) { return static_cast<double>(ns) / 1000.0; };
+    std::cout << std::left << std::setw(12) << name << std::right
+              << std::setw(10) << samples.size()
+              << std::fixed << std::setprecision(1)
+              << std::setw(12) << us(percentile(samples, 0.50))
+              << std::setw(12) << us(percentile(samples, 0.99))
+              << std::setw(12) << us(percentile(samples, 0.999))
+              << std::setw(12) << us(samples.empty() ? 0 : samples.back()) << "\n";
+}
+
+// start a server exposing stub tools that do no backend work
+std::unique_ptr<mcp::server> start_stub_server(const BenchConfig& config) {
+    bool sse = config.transport == "sse";
+    auto server = std::make_unique<mcp::server>(config.host, config.port, "MCP Bench Stub", "0.0.1",
+        sse ? config.endpoint : "/sse", sse ? "/message" : config.endpoint,
+        sse ? mcp::transport_mode::sse : mcp::transport_mode::streamable_http);
+    server->set_capabilities({{"tools", mcp::json::object()}});
+
+    mcp::tool echo = mcp::tool_builder("echo")
+        .with_description("Echo the input, after --stub-delay-ms")
+        .with_string_param("text", "Text to echo", false)
+        .build();
+
+    int delay_ms = config.stub_delay_ms;
+    server->register_tool(echo, [delay_ms](const mcp::json& params, const std::string& /* session_id */, mcp::completion_handler done) {
+        mcp::json content = mcp::json::array({{{"type", "text"}, {"text", params.value("text", "")}}});
+        if (delay_ms == 0) {
+            done(std::move(content), nullptr);
+            return;
+        }
+        // simulated backend latency without holding a worker
+        mcp::executor::instance().post_after(std::chrono::milliseconds(delay_ms), [content, done]() {
+            done(content, nullptr);
+        });
+    });
+
+    server->start(false);
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    return server;
+}
+
+int main(int argc, char* argv[]){
+    config = parse_config(argc, argv);
+    mcp::set_log_level(mcp::log_level::error);
+
+    std::vector<std::pair<std::string, int>> mix;
+    try {
+        mix = parse_mix(config.mix);
+        if (!mcp::json::accept(config.args)) {
+            throw std::invalid_argument("--args is not valid JSON");
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    std::unique_ptr<mcp::server> stub;
+    if (config.stub) {
+        stub = start_stub_server(config);
+    }
+
+    std::vector<SessionResult> results(config.sessions);
+    std::vector<std::thread> threads;
+
+    // sessions initialize first, then all start measuring together
+    std::mutex start_mutex;
+    std::condition_variable start_cv;
+    int ready = 0;
+    bool go = false;
+    std::chrono::steady_clock::time_point started;
+
+    for (int s = 0; s < config.sessions; ++s) {
+        threads.emplace_back([&, s]() {
+            std::unique_ptr<bench_driver> driver;
+            if (config.transport == "sse") {
+                driver = std::make_unique<sse_driver>(config);
+            } else {
+                driver = std::make_unique<streamable_driver>(config);
+            }
+            SessionResult& result = results[s];
+            result.initialized = driver->initialize();
+
+            // weighted choice, seeded per session so runs are repeatable
+            std::mt19937 rng(static_cast<uint32_t>(s + 1));
+            std::vector<int> weights;
+            for (const auto& [method, weight] : mix) {
+                weights.push_back(weight);
+            }
+            std::discrete_distribution<size_t> pick(weights.begin(), weights.end());
+
+            if (result.initialized) {
+                for (int i = 0; i < config.warmup; ++i) {
+                    driver->send(mix[pick(rng)].first);
+                }
+            }
+
+            {
+                std::unique_lock<std::mutex> lock(start_mutex);
+                if (++ready == config.sessions) {
+                    go = true;
+                    started = std::chrono::steady_clock::now();
+                    start_cv.notify_all();
+                } else {
+                    start_cv.wait(lock, [&]() { return go; });
+                }
+            }
+
+            if (!result.initialized) {
+                return;
+            }
+
+            for (int i = 0; i < config.requests; ++i) {
+                const std::string& method = mix[pick(rng)].first;
+                auto begin = std::chrono::steady_clock::now();
+                bool ok = driver->send(method);
+                auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+                if (ok) {
+                    result.latencies[method].push_back(elapsed);
+                } else {
+                    result.errors++;
+                }
+            }
+            // closing the driver is not part of the measurement
+            result.finished = std::chrono::steady_clock::now();
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    auto finished = started;
+    for (const auto& result : results) {
+        finished = std::max(finished, result.finished);
+    }
+    double seconds = std::chrono::duration<double>(finished - started).count();
+
+    // merge sessions
+    std::map<std::string, std::vector<int64_t>> by_method;
+    std::vector<int64_t> all;
+    size_t errors = 0;
+    int failed_sessions = 0;
+    for (auto& result : results) {
+        if (!result.initialized) {
+            failed_sessions++;
+        }
+        errors += result.errors;
+        for (auto& [method, samples] : result.latencies) {
+            all.insert(all.end(), samples.begin(), samples.end());
+            auto& merged = by_method[method];
+            merged.insert(merged.end(), samples.begin(), samples.end());
+        }
+    }
+
+    std::cout << "Transport: " << config.transport << (config.stub ? " (stub tools)" : "")
+              << ", sessions: " << config.sessions << ", mix: " << config.mix << "\n";
+    if (failed_sessions > 0) {
+        std::cout << "Sessions that failed to initialize: " << failed_sessions << "\n";
+    }
+    std::cout << "Requests: " << all.size() << " ok, " << errors << " failed in "
+              << std::fixed << std::setprecision(3) << seconds << " s, throughput: "
+              << std::setprecision(1) << (seconds > 0 ? all.size() / seconds : 0.0) << " req/s\n\n";
+
+    std::cout << std::left << std::setw(12) << "method" << std::right
+              << std::setw(10) << "count" << std::setw(12) << "p50(us)" << std::setw(12) << "p99(us)"
+              << std::setw(12) << "p999(us)" << std::setw(12) << "max(us)" << "\n";
+    for (auto& [method, samples] : by_method) {
+        print_row(method, samples);
+    }
+    print_row("all", all);
+
+    if (stub) {
+        stub->stop();
+    }
+    return (errors > 0 || failed_sessions > 0) ? 1 : 0;
+}
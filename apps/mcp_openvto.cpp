@@ -12,24 +12,37 @@
 // mcp requirements
 #include "json.hpp"
 #include "mcp_server.h"
+#include "mcp_cancellation.h"
+#include "mcp_metrics.h"
+#include "mcp_task.h"
+#include "mcp_tracing.h"
 #include "mcp_tool.h"
 
 // standard headers
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <fstream>
+#include <memory>
+#include <mutex>
 #include <ostream>
 #include <stdexcept>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 // 3rd party headers
-#include <Eigen/Dense>
 #include "ollama.hpp"
 
 // utils
 #include "utils/csv_parser.h"
+#include "utils/catalog.h"
 #include "utils/couchbase_search.h"
 #include "utils/replicate_inference.h"
 #include "utils/open_browser.h"
+#include "utils/blob_store.h"
+#include "utils/tryon_jobs.h"
 
 struct Config{
     // couchbase configs
@@ -45,19 +58,56 @@ struct Config{
     // replicate configs
     std::string api_key;
     std::string version;
-
-    // replicate image outputs, save previous for regressive inference
-    std::string output_link;
+    // client-side limit on Replicate calls, under the account quota (600 predictions/min)
+    double replicate_rps = 10;
+    double replicate_burst = 10;
+    // tries per Replicate call, including the first
+    int replicate_attempts = 4;
+    // try on this many top search results in the background, 0 to disable
+    int speculative_tryons = 0;
+    // speculative predictions per session, each one is billed
+    int speculative_budget = 4;
+    // request deadlines in seconds, 0 for none; try-ons wait on a prediction
+    int request_timeout_s = 120;
+    int tryon_timeout_s = 300;
+    // admission control on the message endpoint, 0 for no limit
+    int max_queued = 256;
+    int max_in_flight = 512;
+    int max_session_in_flight = 16;
 
     // local file path for csv
     std::string csv_filepath;
     // uploaded human img link for base image
     // or use it as file path and read it in
     std::string img_link;
-    bool is_img_link_path;
+    bool is_img_link_path = false;
 
     // verbosity
-    bool verbose;
+    bool verbose = false;
+
+    // MCP transport: "sse" or "streamable"
+    std::string transport = "sse";
+
+    // optional log file, written alongside stderr
+    std::string log_file;
+
+    // serve Prometheus metrics on /metrics
+    bool metrics = false;
+
+    // record request spans and serve them on /trace
+    bool tracing = false;
+
+    // reload the local catalog when the CSV file changes
+    bool watch_catalog = false;
+    // expose admin/reload_catalog and the catalog mutation tools to MCP clients
+    bool catalog_admin = false;
+
+    // try-on output delivery: "browser", "headless" or "notify"
+    std::string output = "browser";
+
+    // local image cache, off unless a directory is given: cached inputs used twice are uploaded to replicate
+    std::string blob_dir;
+    uint64_t blob_cache_mb = 512;
 } config;
 
 enum FunctionalityAvailability{ //lol@name
@@ -155,6 +205,76 @@ static Config parse_config(int argc, char* argv[]) {
                 std::cerr << "Error: --version requires a value" << std::endl;
                 exit(1);
             }
+        } else if (strcmp(argv[i], "--replicate-rps") == 0) {
+            if (i + 1 < argc) {
+                config.replicate_rps = std::stod(argv[++i]);
+            } else {
+                std::cerr << "Error: --replicate-rps requires a value" << std::endl;
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--replicate-burst") == 0) {
+            if (i + 1 < argc) {
+                config.replicate_burst = std::stod(argv[++i]);
+            } else {
+                std::cerr << "Error: --replicate-burst requires a value" << std::endl;
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--replicate-attempts") == 0) {
+            if (i + 1 < argc) {
+                config.replicate_attempts = std::stoi(argv[++i]);
+            } else {
+                std::cerr << "Error: --replicate-attempts requires a value" << std::endl;
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--speculative-tryons") == 0) {
+            if (i + 1 < argc) {
+                config.speculative_tryons = std::stoi(argv[++i]);
+            } else {
+                std::cerr << "Error: --speculative-tryons requires a value" << std::endl;
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--speculative-budget") == 0) {
+            if (i + 1 < argc) {
+                config.speculative_budget = std::stoi(argv[++i]);
+            } else {
+                std::cerr << "Error: --speculative-budget requires a value" << std::endl;
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--request-timeout") == 0) {
+            if (i + 1 < argc) {
+                config.request_timeout_s = std::stoi(argv[++i]);
+            } else {
+                std::cerr << "Error: --request-timeout requires a value" << std::endl;
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--tryon-timeout") == 0) {
+            if (i + 1 < argc) {
+                config.tryon_timeout_s = std::stoi(argv[++i]);
+            } else {
+                std::cerr << "Error: --tryon-timeout requires a value" << std::endl;
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--max-queued") == 0) {
+            if (i + 1 < argc) {
+                config.max_queued = std::stoi(argv[++i]);
+            } else {
+                std::cerr << "Error: --max-queued requires a value" << std::endl;
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--max-in-flight") == 0) {
+            if (i + 1 < argc) {
+                config.max_in_flight = std::stoi(argv[++i]);
+            } else {
+                std::cerr << "Error: --max-in-flight requires a value" << std::endl;
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--max-session-in-flight") == 0) {
+            if (i + 1 < argc) {
+                config.max_session_in_flight = std::stoi(argv[++i]);
+            } else {
+                std::cerr << "Error: --max-session-in-flight requires a value" << std::endl;
+                exit(1);
+            }
         } else if (strcmp(argv[i], "--csv-filepath") == 0) {
             if (i + 1 < argc) {
                 config.csv_filepath = argv[++i];
@@ -183,6 +303,70 @@ static Config parse_config(int argc, char* argv[]) {
                 std::cerr << "Error: --verbose should be either 0/1 or true/false" << std::endl;
                 exit(1);
             }
+        } else if (strcmp(argv[i], "--transport") == 0) {
+            if (i + 1 < argc && (strcmp(argv[i + 1], "sse") == 0 || strcmp(argv[i + 1], "streamable") == 0)) {
+                config.transport = argv[++i];
+            } else {
+                std::cerr << "Error: --transport should be either sse or streamable" << std::endl;
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--log-file") == 0) {
+            if (i + 1 < argc) {
+                config.log_file = argv[++i];
+            } else {
+                std::cerr << "Error: --log-file requires a value" << std::endl;
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--metrics") == 0) {
+            if (i + 1 < argc) {
+                config.metrics = parse_bool(argv[++i]);
+            } else {
+                std::cerr << "Error: --metrics should be either 0/1 or true/false" << std::endl;
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--tracing") == 0) {
+            if (i + 1 < argc) {
+                config.tracing = parse_bool(argv[++i]);
+            } else {
+                std::cerr << "Error: --tracing should be either 0/1 or true/false" << std::endl;
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--watch-catalog") == 0) {
+            if (i + 1 < argc) {
+                config.watch_catalog = parse_bool(argv[++i]);
+            } else {
+                std::cerr << "Error: --watch-catalog should be either 0/1 or true/false" << std::endl;
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--catalog-admin") == 0) {
+            if (i + 1 < argc) {
+                config.catalog_admin = parse_bool(argv[++i]);
+            } else {
+                std::cerr << "Error: --catalog-admin should be either 0/1 or true/false" << std::endl;
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--output") == 0) {
+            if (i + 1 < argc && (strcmp(argv[i + 1], "browser") == 0 || strcmp(argv[i + 1], "headless") == 0
+                || strcmp(argv[i + 1], "notify") == 0)) {
+                config.output = argv[++i];
+            } else {
+                std::cerr << "Error: --output should be one of browser, headless or notify" << std::endl;
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--blob-dir") == 0) {
+            if (i + 1 < argc) {
+                config.blob_dir = argv[++i];
+            } else {
+                std::cerr << "Error: --blob-dir requires a value" << std::endl;
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--blob-cache-mb") == 0) {
+            if (i + 1 < argc) {
+                config.blob_cache_mb = std::stoull(argv[++i]);
+            } else {
+                std::cerr << "Error: --blob-cache-mb requires a value" << std::endl;
+                exit(1);
+            }
         } else if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
             std::cout << "Usage: " << argv[0] << " [OPTIONS]\n\n";
             std::cout << "Couchbase Options:\n";
@@ -196,13 +380,32 @@ static Config parse_config(int argc, char* argv[]) {
             std::cout << "  --search-field <field>   Couchbase search field name\n\n";
             std::cout << "Replicate Options:\n";
             std::cout << "  --api-key <key>          Replicate API key\n";
-            std::cout << "  --version <version>      Replicate model version\n\n";
+            std::cout << "  --version <version>      Replicate model version\n";
+            std::cout << "  --replicate-rps <n>      Replicate requests per second (default: 10)\n";
+            std::cout << "  --replicate-burst <n>    Replicate requests allowed back to back (default: 10)\n";
+            std::cout << "  --replicate-attempts <n> Tries per Replicate call on 429, 503 or connection errors (default: 4)\n";
+            std::cout << "  --speculative-tryons <n> Try on the top n local search results in the background (default: 0, off)\n";
+            std::cout << "  --speculative-budget <n> Speculative try-ons per session (default: 4)\n";
+            std::cout << "  --request-timeout <s>    Deadline of a request in seconds, 0 for none (default: 120)\n";
+            std::cout << "  --tryon-timeout <s>      Deadline of a try-on in seconds, 0 for none (default: 300)\n\n";
             std::cout << "File Options:\n";
-            std::cout << "  --csv_filepath <path>        Path to CSV file\n\n";
+            std::cout << "  --csv_filepath <path>        Path to CSV file\n";
+            std::cout << "  --watch-catalog <bool>       Reload the CSV file when it changes\n";
+            std::cout << "  --catalog-admin <bool>       Expose admin/reload_catalog and the upsert/delete garment tools\n\n";
             std::cout << "  --img_link <url>                Public URL to img\n\n";
             std::cout << "  --is-img-path <bool>             Boolean value (0/false or 1/true)\n\n";
             std::cout << "  --verbose <bool>             Boolean value (0/false or 1/true)\n\n";
             std::cout << "Other Options:\n";
+            std::cout << "  --transport <mode>       MCP transport: sse or streamable (default: sse)\n";
+            std::cout << "  --log-file <path>        Also append logs to this file\n";
+            std::cout << "  --metrics <bool>         Serve Prometheus metrics on /metrics\n";
+            std::cout << "  --tracing <bool>         Serve request traces on /trace (Chrome trace JSON)\n";
+            std::cout << "  --blob-dir <path>        Cache images in this directory; input images used twice are uploaded to Replicate (default: off)\n";
+            std::cout << "  --blob-cache-mb <mb>     Image cache size (default: 512)\n";
+            std::cout << "  --output <sink>          Try-on outputs: browser (open locally), headless, or notify (MCP notification to the client) (default: browser)\n";
+            std::cout << "  --max-queued <n>         Requests waiting for a worker before new ones get HTTP 503, 0 for no limit (default: 256)\n";
+            std::cout << "  --max-in-flight <n>      Requests being handled before new ones get HTTP 503, 0 for no limit (default: 512)\n";
+            std::cout << "  --max-session-in-flight <n> The same per session (default: 16)\n";
             std::cout << "  --help, -h               Show this help message\n";
             exit(0);
         } else {
@@ -250,17 +453,28 @@ std::vector<double> fetch_embedding_from_query(std::string& query, bool verbose)
         throw std::runtime_error("Ollama service is not running. Please start Ollama before using this functionality.");
     }
 
-    if (verbose){
-        ollama::show_requests(true);
-        ollama::show_replies(true);
+    mcp::span embed_span("ollama.embed");
+    auto& registry = mcp::metrics_registry::instance();
+    ollama::response response;
+    // a client of our own, so its timeouts are what is left of this request's deadline
+    mcp::cancellation_token cancel = mcp::cancellation_token::current();
+    int timeout_s = static_cast<int>(std::max<int64_t>(1, (cancel.remaining(std::chrono::seconds(120)).count() + 999) / 1000));
+    Ollama embedder;
+    embedder.setReadTimeout(timeout_s);
+    embedder.setWriteTimeout(timeout_s);
+    try {
+        mcp::scoped_timer timer(registry.get_histogram("mcp_backend_request_duration", "Backend call latency", {{"backend", "ollama"}}));
+        response = embedder.generate_embeddings("nomic-embed-text:latest", query);
+    } catch (...) {
+        registry.get_counter("mcp_backend_errors_total", "Failed backend calls", {{"backend", "ollama"}}).add();
+        throw;
     }
-
-    ollama::response response = ollama::generate_embeddings("nomic-embed-text:latest", query);
+    // the embedding cannot be interrupted, but the search after it can be skipped
+    cancel.throw_if_cancelled();
     nlohmann::json data = response.as_json();
 
     if (verbose){
-        std::cout << data["embeddings"].type_name(); // is array
-        std::cout << "Embeddings: " << data["embeddings"][0] << std::endl;
+        LOG_DEBUG("Embeddings (", data["embeddings"].type_name(), "): ", data["embeddings"][0].dump());
     }
 
     std::vector<double> vec = data["embeddings"][0];
@@ -270,16 +484,79 @@ std::vector<double> fetch_embedding_from_query(std::string& query, bool verbose)
     return vec;
 }
 
+// local catalog, loaded once and swapped on reload
+std::unique_ptr<csv::CatalogStore> catalog_store;
+
+// garment, human and try-on images by content hash, null if the cache is disabled
+std::unique_ptr<blob::BlobStore> blob_store;
+
+// who may read each cached image: catalog garments and the default human image are public,
+// other images only to the sessions that sent or received them
+struct BlobAccess{
+    std::mutex mutex;
+    // content hash -> its resource
+    std::unordered_map<std::string, std::shared_ptr<blob::BlobResource>> resources;
+    // URL not cached yet -> sessions to allow once it is, empty for every session
+    std::unordered_map<std::string, std::unordered_set<std::string>> pending;
+} blob_access;
+
+// let a session read the cached copy of an image, every session if session_id is empty
+void share_blob(const std::string& url, const std::string& session_id){
+    if (!blob_store || url.empty()){
+        return;
+    }
+    std::lock_guard<std::mutex> lock(blob_access.mutex);
+    auto it = blob_access.resources.find(blob_store->lookup(url));
+    if (it != blob_access.resources.end()){
+        it->second->allow(session_id);
+    } else {
+        blob_access.pending[url].insert(session_id);
+    }
+}
+
+// start try-ons of the top results in the background, defined with the try-on jobs below
+void speculate_tryons(const std::string& session_id, const std::vector<csv::CSVRow>& rows,
+    const std::vector<std::string>& attribute_names);
+
 // search locally using provided .CSV
-auto local_search(std::string& query, bool verbose=false){
-    // convert query to embedding
-    std::vector<double> query_vec = fetch_embedding_from_query(query, verbose);
-    // get datset
-    auto dataset = csv::parse_csv_with_scores(config.csv_filepath, query_vec);
-    auto res = csv::dataset_to_json(csv::get_top_k(dataset));
+// mode is "hybrid" (vector + keywords), "vector" or "lexical" (keywords only)
+auto local_search(std::string& query, int k=5, const std::string& filter="", const std::string& mode="hybrid",
+    const std::string& metric_name="cosine", bool verbose=false, const std::string& session_id=""){
+    if (mode != "hybrid" && mode != "vector" && mode != "lexical"){
+        throw std::invalid_argument("mode should be one of hybrid, vector or lexical");
+    }
+    csv::Metric metric = csv::parse_metric(metric_name);
 
-    nlohmann::json content = nlohmann::json::array();
-    content.push_back(nlohmann::json{{"type", "text"}, {"text", res}});
+    // search the current catalog, a concurrent reload does not affect this search
+    std::shared_ptr<const csv::Catalog> catalog = catalog_store->current();
+    // reject a bad filter before paying for the embedding
+    if (!filter.empty()){
+        csv::Filter::parse(filter, catalog->get_main()->columns);
+    }
+
+    std::vector<csv::CSVRow> results;
+    if (mode == "lexical"){
+        // keywords only, no round-trip to ollama
+        results = catalog->search_lexical(query, k, filter);
+    } else {
+        // convert query to embedding
+        std::vector<double> query_vec = fetch_embedding_from_query(query, verbose);
+        results = mode == "vector" ? catalog->search(query_vec, k, filter, metric)
+            : catalog->search_hybrid(query_vec, query, k, filter, metric);
+    }
+    // the user is likely to try one of these on next
+    if (blob_store){
+        for (const auto& row : results){
+            share_blob(row.link, "");
+            blob_store->prefetch(row.link);
+        }
+    }
+    speculate_tryons(session_id, results, catalog->attribute_names());
+    auto res = csv::dataset_to_json(results, catalog->attribute_names());
+
+    // moved into the content, the server serializes it once into the response frame
+    mcp::json content = mcp::json::array();
+    content.push_back(mcp::json{{"type", "text"}, {"text", std::move(res)}});
 
     return content;
 }
@@ -295,7 +572,7 @@ auto couchbase_vector_searcher(std::string& query, int k=5, bool verbose=false){
 
     std::string res = couchbase.vector_search(config.search_field, k);
     if (verbose){
-        std::cout << "Received from server:\n" << res << std::endl;
+        LOG_DEBUG("Received from server:\n", res);
     }
 
     nlohmann::json content = nlohmann::json::array();
@@ -305,23 +582,73 @@ auto couchbase_vector_searcher(std::string& query, int k=5, bool verbose=false){
 }
 
 // inference using replicate
-std::string replicate_inference(std::string& garm_img_link, std::string& garm_des, std::string& category, bool verbose){
-    ri::ReplicateInference styler(config.version);
+// images sent to replicate; one used often enough is uploaded once, so replicate stops fetching it from its origin
+struct ReplicateInputs{
+    std::mutex mutex;
+    // content hash -> replicate file URL, empty while the upload runs
+    std::unordered_map<std::string, std::string> uploaded;
+    // content hash -> number of predictions it was sent to, only for cached images and dropped on eviction
+    std::unordered_map<std::string, int> uses;
+} replicate_inputs;
+const int upload_after_uses = 2;
+
+// upload a cached image to replicate in the background, once
+void upload_input(const std::string& hash){
+    {
+        std::lock_guard<std::mutex> lock(replicate_inputs.mutex);
+        if (!replicate_inputs.uploaded.emplace(hash, "").second){
+            return;
+        }
+    }
+    mcp::executor::instance().post_blocking([hash](){
+        try {
+            std::string bytes;
+            if (!blob_store->get(hash, bytes)){
+                throw std::runtime_error("image is no longer cached");
+            }
+            std::string link = ri::upload_file(config.api_key, bytes, blob::sniff_mime(bytes), hash);
+            std::lock_guard<std::mutex> lock(replicate_inputs.mutex);
+            replicate_inputs.uploaded[hash] = link;
+            LOG_INFO("Uploaded image ", hash, " to replicate: ", link);
+        } catch (const std::exception& e) {
+            LOG_WARNING("Upload of image ", hash, " failed: ", e.what());
+            std::lock_guard<std::mutex> lock(replicate_inputs.mutex);
+            replicate_inputs.uploaded.erase(hash);
+        }
+    });
+}
 
-    styler.add_input("garm_img", garm_img_link);
-    styler.add_input("human_img", config.img_link);
-    styler.add_input("garment_des", garm_des);
-    styler.add_input("category", category);
+// the link to send to replicate for an input image: the uploaded copy if there is one
+std::string replicate_input(const std::string& url){
+    if (!blob_store){
+        return url;
+    }
+    std::string hash = blob_store->lookup(url);
+    if (hash.empty()){
+        blob_store->prefetch(url);
+        return url;
+    }
 
-    std::string res = styler.perform_inference(config.api_key);
-    return res;
+    int uses = 0;
+    {
+        std::lock_guard<std::mutex> lock(replicate_inputs.mutex);
+        auto it = replicate_inputs.uploaded.find(hash);
+        if (it != replicate_inputs.uploaded.end() && !it->second.empty()){
+            return it->second;
+        }
+        uses = ++replicate_inputs.uses[hash];
+    }
+    if (uses >= upload_after_uses){
+        upload_input(hash);
+    }
+    return url;
 }
 
 std::string replicate_inference_link(std::string& human_img_link, std::string& garm_img_link, std::string& garm_des, std::string& category, bool verbose){
     ri::ReplicateInference styler(config.version);
 
-    styler.add_input("garm_img", garm_img_link);
-    styler.add_input("human_img", human_img_link);
+    styler.add_input("garm_img", replicate_input(garm_img_link));
+    styler.add_input("human_img", replicate_input(human_img_link));
     styler.add_input("garment_des", garm_des);
     styler.add_input("category", category);
 
@@ -329,29 +656,142 @@ std::string replicate_inference_link(std::string& human_img_link, std::string& g
     return res;
 }
 
-void open_browser(std::string& link){
-    config.output_link = link; // adding previous output link during browser call
-    browser::openURL(link);
+// try-on predictions shared by their inputs, set up in main
+std::unique_ptr<vto::TryOnJobs> tryon_jobs;
+
+void speculate_tryons(const std::string& session_id, const std::vector<csv::CSVRow>& rows,
+    const std::vector<std::string>& attribute_names){
+    if (config.speculative_tryons <= 0 || config.img_link.empty() || session_id.empty() || !tryon_jobs){
+        return;
+    }
+
+    // the category column, if the catalog has one, says which body part the garment is for
+    auto column = std::find(attribute_names.begin(), attribute_names.end(), "category");
+    std::vector<vto::TryOnRequest> requests;
+    for (size_t i = 0; i < rows.size() && i < static_cast<size_t>(config.speculative_tryons); i++){
+        std::string category = "upper_body";
+        if (column != attribute_names.end()){
+            size_t index = column - attribute_names.begin();
+            const auto& attributes = rows[i].attributes;
+            if (index < attributes.size() && (attributes[index] == "lower_body" || attributes[index] == "dresses")){
+                category = attributes[index];
+            }
+        }
+        requests.push_back(vto::TryOnRequest{config.img_link, rows[i].link, rows[i].desc, category});
+    }
+    tryon_jobs->speculate(session_id, requests);
+}
+
+// try-on for a tool call: joins a matching job, cached or in flight, or starts one
+std::string tryon(const std::string& session_id, std::string& human_img_link, std::string& garm_img_link,
+    std::string& garm_des, std::string& category){
+    share_blob(human_img_link, session_id);
+    share_blob(garm_img_link, session_id);
+    return tryon_jobs->run(session_id, vto::TryOnRequest{human_img_link, garm_img_link, garm_des, category});
+}
+
+// per session, so concurrent users never continue each other's chains
+vto::TryOnHistory tryon_history;
+
+// how try-on outputs reach the user, set up in main
+std::unique_ptr<browser::OutputSink> output_sink;
+
+void open_browser(const std::string& session_id, std::string& link){
+    tryon_history.record(session_id, link); // adding previous output link during browser call
+    // replicate.delivery links expire, keep a copy
+    if (blob_store && link.rfind("http", 0) == 0){
+        share_blob(link, session_id);
+        blob_store->prefetch(link);
+    }
+    // returns at once, the tool result does not wait for the browser
+    output_sink->deliver(session_id, link);
 }
 
 mcp::json local_search_handler(const mcp::json& params, const std::string& session_id){
     std::string query = params["query"].get<std::string>();
     int k = params["k"].get<int>();
+    std::string filter = params.value("filter", "");
+    std::string mode = params.value("mode", "hybrid");
+    std::string metric = params.value("metric", "cosine");
     
-    std::cout << "Session ID: " << session_id << " Received query: " << query << std::endl;
-    std::cout << "Session ID: " << session_id << " Received k: " << k << std::endl;
+    LOG_INFO("Session ID: ", session_id, " Received query: ", query, " k: ", k, " filter: ", filter, " mode: ", mode, " metric: ", metric);
     
-    auto results = local_search(query, config.verbose);
-    
-    return results;
+    try {
+        return local_search(query, k, filter, mode, metric, config.verbose, session_id);
+    } catch (const std::invalid_argument& e) {
+        throw mcp::mcp_exception(mcp::error_code::invalid_params, e.what());
+    }
+}
+
+// add or replace garments in the local catalog, descriptions are embedded if no vector is given
+mcp::json upsert_garments_handler(const mcp::json& params, const std::string& session_id){
+    const auto& items = params["items"];
+    if (!items.is_array()){
+        throw mcp::mcp_exception(mcp::error_code::invalid_params, "items should be an array of garments");
+    }
+
+    std::vector<csv::CSVRow> rows;
+    for (const auto& item : items){
+        if (!item.contains("id") || !item.contains("link") || !item.contains("desc")){
+            throw mcp::mcp_exception(mcp::error_code::invalid_params, "Each garment needs an id, link and desc");
+        }
+        std::string desc = item["desc"].get<std::string>();
+        std::vector<double> vec;
+        if (item.contains("vector")){
+            vec = item["vector"].get<std::vector<double>>();
+        } else {
+            vec = fetch_embedding_from_query(desc, config.verbose);
+        }
+        rows.emplace_back(item.value("fname", ""), item["link"].get<std::string>(), item["id"].get<int>(),
+            desc, "nomic-embed-text", vec);
+
+        // attributes by name, in the catalog's column order
+        if (item.contains("attributes")){
+            std::vector<std::string> names = catalog_store->current()->attribute_names();
+            rows.back().attributes.resize(names.size());
+            for (const auto& [name, value] : item["attributes"].items()){
+                auto it = std::find(names.begin(), names.end(), name);
+                if (it == names.end()){
+                    throw mcp::mcp_exception(mcp::error_code::invalid_params, "Unknown attribute: " + name);
+                }
+                rows.back().attributes[it - names.begin()] = value.is_string() ? value.get<std::string>() : value.dump();
+            }
+        }
+    }
+
+    LOG_INFO("Session ID: ", session_id, " Upserting ", rows.size(), " garments");
+
+    std::shared_ptr<const csv::Catalog> catalog;
+    try {
+        catalog = catalog_store->upsert(rows);
+    } catch (const std::invalid_argument& e) {
+        throw mcp::mcp_exception(mcp::error_code::invalid_params, e.what());
+    }
+
+    std::string res = "Upserted " + std::to_string(rows.size()) + " garments, catalog version "
+        + std::to_string(catalog->get_version()) + " has " + std::to_string(catalog->size()) + " garments";
+    return nlohmann::json::array({nlohmann::json{{"type", "text"}, {"text", res}}});
+}
+
+// remove garments from the local catalog by id
+mcp::json delete_garments_handler(const mcp::json& params, const std::string& session_id){
+    std::vector<int> ids = params["ids"].get<std::vector<int>>();
+
+    LOG_INFO("Session ID: ", session_id, " Deleting ", ids.size(), " garments");
+
+    size_t before = catalog_store->current()->size();
+    auto catalog = catalog_store->remove(ids);
+
+    std::string res = "Deleted " + std::to_string(before - std::min(before, catalog->size())) + " garments, catalog version "
+        + std::to_string(catalog->get_version()) + " has " + std::to_string(catalog->size()) + " garments";
+    return nlohmann::json::array({nlohmann::json{{"type", "text"}, {"text", res}}});
 }
 
 mcp::json couchbase_search_handler(const mcp::json& params, const std::string& session_id){
     std::string query = params["query"].get<std::string>();
     int k = params["k"].get<int>();
     
-    std::cout << "Session ID: " << session_id << " Received query: " << query << std::endl;
-    std::cout << "Session ID: " << session_id << " Received k: " << k << std::endl;
+    LOG_INFO("Session ID: ", session_id, " Received query: ", query, " k: ", k);
     
     auto results = couchbase_vector_searcher(query, k, config.verbose);
     
@@ -359,7 +799,7 @@ mcp::json couchbase_search_handler(const mcp::json& params, const std::string& s
 }
 
 mcp::json replicate_handler(const mcp::json& params, const std::string& session_id){
-    std::cout << "Session ID: " << session_id << "\t Starting Replicate Inference..." << std::endl;
+    LOG_INFO("Session ID: ", session_id, " Starting Replicate Inference...");
     std::string garm_img = params["garm_img"].get<std::string>();
     // std::string human_img = config.img_link;
     std::string garment_des = params["garment_des"].get<std::string>();
@@ -368,42 +808,42 @@ mcp::json replicate_handler(const mcp::json& params, const std::string& session_
     if (params["lower_body"])
         category = "lower_body";
     
-    std::cout << "Received data\n" << "Garment img: " << garm_img << "\nHuman img: " << config.img_link << "\nGarment des: " << garment_des;
+    LOG_INFO("Received data, garment img: ", garm_img, " human img: ", config.img_link, " garment des: ", garment_des);
 
-    std::string res = replicate_inference(garm_img, garment_des, category, config.verbose);
+    std::string res = tryon(session_id, config.img_link, garm_img, garment_des, category);
     
     // open output in browser
-    open_browser(res);
+    open_browser(session_id, res);
 
     return res;
 }
 
 mcp::json replicate_handler_regressive(const mcp::json& params, const std::string& session_id){
-    std::cout << "Session ID: " << session_id << "\t Starting Replicate Inference RECURSIVE..." << std::endl;
+    LOG_INFO("Session ID: ", session_id, " Starting Replicate Inference RECURSIVE...");
     std::string garm_img = params["garm_img"].get<std::string>();
     // std::string human_img = config.img_link;
     std::string garment_des = params["garment_des"].get<std::string>();
     std::string category = "upper_body"; // default
-    std::string human_img = config.output_link;
-
-    // if (params["use_prev_output"])
-        // human_img = config.output_link;
+    std::string human_img = tryon_history.last(session_id);
+    if (human_img.empty()){
+        throw mcp::mcp_exception(mcp::error_code::invalid_params, "No previous try-on in this session, use perform_vton first");
+    }
 
     if (params["lower_body"])
         category = "lower_body";
     
-    std::cout << "Received data\n" << "Garment img: " << garm_img << "\nHuman img: " << config.img_link << "\nGarment des: " << garment_des;
+    LOG_INFO("Received data, garment img: ", garm_img, " human img: ", config.img_link, " garment des: ", garment_des);
 
-    std::string res = replicate_inference_link(human_img, garm_img, garment_des, category, config.verbose);
+    std::string res = tryon(session_id, human_img, garm_img, garment_des, category);
     
     // open output in browser
-    open_browser(res);
+    open_browser(session_id, res);
 
     return res;
 }
 
 mcp::json replicate_handler_link(const mcp::json& params, const std::string& session_id){
-    std::cout << "Session ID: " << session_id << "\t Starting Replicate Inference RECURSIVE..." << std::endl;
+    LOG_INFO("Session ID: ", session_id, " Starting Replicate Inference RECURSIVE...");
     std::string garm_img = params["garm_img"].get<std::string>();
     // std::string human_img = config.img_link;
     std::string garment_des = params["garment_des"].get<std::string>();
@@ -413,12 +853,12 @@ mcp::json replicate_handler_link(const mcp::json& params, const std::string& ses
     if (params["lower_body"])
         category = "lower_body";
     
-    std::cout << "Received data\n" << "Garment img: " << garm_img << "\nHuman img: " << config.img_link << "\nGarment des: " << garment_des;
+    LOG_INFO("Received data, garment img: ", garm_img, " human img: ", config.img_link, " garment des: ", garment_des);
 
-    std::string res = replicate_inference_link(human_img, garm_img, garment_des, category, config.verbose);
+    std::string res = tryon(session_id, human_img, garm_img, garment_des, category);
     
     // open output in browser
-    open_browser(res);
+    open_browser(session_id, res);
 
     return res;
 }
@@ -440,6 +880,19 @@ int main(int argc, char* argv[]){
     // parse config
     config = parse_config(argc, argv);
 
+    // logging: background writer keeps log I/O off the request path
+    mcp::logger::instance().set_async(true);
+    if (config.verbose) {
+        mcp::set_log_level(mcp::log_level::debug);
+    }
+    // the ollama logging switches are library wide, set once for every client
+    ollama::show_requests(config.verbose);
+    ollama::show_replies(config.verbose);
+    if (!config.log_file.empty() && !mcp::logger::instance().set_file(config.log_file)) {
+        std::cerr << "Error: cannot open log file " << config.log_file << std::endl;
+        exit(1);
+    }
+
     // check what's available and make corresponding tools available
     FunctionalityAvailability check = eval_availability(config);
     if (check == FunctionalityAvailability::NEEDS_CONFIG){
@@ -454,14 +907,159 @@ int main(int argc, char* argv[]){
     // if img link is supplied as a path
     config.img_link = fetch_url_from_txt(config.img_link);
 
-    mcp::server server("localhost", 8888);
+    ri::RetryPolicy retry;
+    retry.max_attempts = std::max(1, config.replicate_attempts);
+    ri::ReplicateClient::shared().configure(config.replicate_rps, config.replicate_burst, 8, retry);
+
+    mcp::server server("localhost", 8888, "MCP Server", "0.0.1", "/sse", "/message",
+        config.transport == "streamable" ? mcp::transport_mode::streamable_http : mcp::transport_mode::sse);
     server.set_server_info("MCP OpenVTO in C++", "0.0.1");
+    server.set_request_timeout(std::chrono::seconds(config.request_timeout_s));
+    for (const char* tool_name : {"perform_vton", "perform_vton_with_specified_link", "perform_vton_on_previous_vton"}){
+        server.set_tool_timeout(tool_name, std::chrono::seconds(config.tryon_timeout_s));
+    }
+    server.set_admission_limits(std::max(0, config.max_queued), std::max(0, config.max_in_flight), std::max(0, config.max_session_in_flight));
+    if (config.metrics) {
+        server.enable_metrics();
+    }
+    if (config.tracing) {
+        server.enable_tracing();
+    }
 
     mcp::json capabilities = {
         {"tools", mcp::json::object()} // add tools here
     };
+    if (config.output == "notify"){
+        // outputs are sent as log messages
+        capabilities["logging"] = mcp::json::object();
+    }
+    if (!config.blob_dir.empty()){
+        // cached images are readable as blob://<sha256> resources
+        capabilities["resources"] = mcp::json::object();
+    }
     server.set_capabilities(capabilities);
 
+    // predictions run on the blocking pool, each under its own cancellation
+    vto::TryOnLimits tryon_limits;
+    tryon_limits.budget = config.speculative_budget;
+    tryon_jobs = std::make_unique<vto::TryOnJobs>([](const vto::TryOnRequest& request){
+        vto::TryOnRequest inputs = request;
+        return replicate_inference_link(inputs.human_img, inputs.garm_img, inputs.garment_des, inputs.category, config.verbose);
+    }, tryon_limits);
+
+    // image cache
+    if (!config.blob_dir.empty()){
+        try {
+            blob_store = std::make_unique<blob::BlobStore>(config.blob_dir, config.blob_cache_mb << 20);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            exit(1);
+        }
+        // kept from an earlier run, nobody can see them until a session sends their URL again
+        for (const auto& hash : blob_store->hashes()){
+            auto resource = std::make_shared<blob::BlobResource>(*blob_store, hash, hash);
+            blob_access.resources[hash] = resource;
+            server.register_resource(blob::BlobResource::uri_for(hash), resource);
+        }
+        blob_store->set_callbacks(
+            [&server](const std::string& hash, const std::string& url){
+                std::shared_ptr<blob::BlobResource> added;
+                {
+                    std::lock_guard<std::mutex> lock(blob_access.mutex);
+                    auto& resource = blob_access.resources[hash];
+                    if (!resource){
+                        resource = added = std::make_shared<blob::BlobResource>(*blob_store, hash, url.empty() ? hash : url);
+                    }
+                    auto it = blob_access.pending.find(url);
+                    if (it != blob_access.pending.end()){
+                        for (const auto& session_id : it->second){
+                            resource->allow(session_id);
+                        }
+                        blob_access.pending.erase(it);
+                    }
+                }
+                if (added){
+                    server.register_resource(blob::BlobResource::uri_for(hash), added);
+                }
+            },
+            [&server](const std::string& hash){
+                server.unregister_resource(blob::BlobResource::uri_for(hash));
+                {
+                    std::lock_guard<std::mutex> lock(blob_access.mutex);
+                    blob_access.resources.erase(hash);
+                }
+                std::lock_guard<std::mutex> lock(replicate_inputs.mutex);
+                replicate_inputs.uses.erase(hash);
+            });
+        server.register_session_cleanup("blob://", [](const std::string& session_id){
+            std::lock_guard<std::mutex> lock(blob_access.mutex);
+            for (const auto& [hash, resource] : blob_access.resources){
+                resource->revoke(session_id);
+            }
+            for (auto it = blob_access.pending.begin(); it != blob_access.pending.end(); ){
+                it->second.erase(session_id);
+                it = it->second.empty() ? blob_access.pending.erase(it) : std::next(it);
+            }
+        });
+
+        // the default human image is in every first try-on: keep it and upload it once
+        mcp::executor::instance().post_blocking([](){
+            if (config.img_link.empty()){
+                return;
+            }
+            try {
+                share_blob(config.img_link, "");
+                std::string hash = blob_store->fetch(config.img_link);
+                blob_store->pin(hash);
+                upload_input(hash);
+            } catch (const std::exception& e) {
+                LOG_WARNING("Cannot cache the human image: ", e.what());
+            }
+        });
+    }
+
+    // try-on outputs
+    if (config.output == "headless"){
+        output_sink = std::make_unique<browser::HeadlessSink>();
+    } else if (config.output == "notify"){
+        output_sink = std::make_unique<browser::CallbackSink>([&server](const std::string& session_id, const std::string& url){
+            server.send_request(session_id, mcp::request::create_notification("message", {
+                {"level", "info"},
+                {"logger", "openvto"},
+                {"data", {{"type", "tryon_output"}, {"link", url}}}
+            }));
+        });
+    } else {
+        output_sink = std::make_unique<browser::LaunchSink>();
+    }
+
+    // load the local catalog up front, searches never parse the CSV
+    std::string filter_attributes = "none";
+    if (check == FunctionalityAvailability::ALL || check == FunctionalityAvailability::LOCAL){
+        catalog_store = std::make_unique<csv::CatalogStore>(config.csv_filepath);
+        try {
+            catalog_store->reload();
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            exit(1);
+        }
+
+        if (config.watch_catalog){
+            catalog_store->watch();
+        }
+
+        // the filter description lists the attributes so the LLM can use them
+        auto catalog = catalog_store->current();
+        const auto& columns = catalog->get_main()->columns;
+        if (!columns.empty()){
+            filter_attributes.clear();
+            for (const auto& column : columns){
+                filter_attributes += (filter_attributes.empty() ? "" : ", ") + column.name
+                    + (column.type == csv::AttributeType::Number ? " (number)" : " (text)");
+            }
+        }
+    }
+
     mcp::tool couchbase_search = mcp::tool_builder("couchbase_search")
     .with_description("Only to be performed if the user asks to perform a search on the Cloud/Couchbase. Performs a vector search on Couchbase for a given query to find the most suitable clothes. Your job is to return the results in a readable format so the user can select which clothes to perform Virtual Try-On on.")
     .with_string_param("query", "The refined query of the user. If it's something like Blue Jeans, ask the user for more detail and refine the query so that a more richer embedding can be used to perform a semantic search.", true)
@@ -472,6 +1070,19 @@ int main(int argc, char* argv[]){
     .with_description("This is the default search tool to search for relevant clothes from a database of CSV file. Performs a vector search over a CSV files for a given query to find the most suitable clothes. Your job is to return the results in a readable format so the user can select which clothes to perform Virtual Try-On on.")
     .with_string_param("query", "The refined query of the user. If it's something like Blue Jeans, ask the user for more detail and refine the query so that a more richer embedding can be used to perform a semantic search.", true)
     .with_number_param("k", "The top-k results to fetch from semantic search (default: 5).", true)
+    .with_string_param("filter", "Optional filter on garment attributes, applied before ranking so k results still come back, e.g. `category = lower_body AND price < 50 AND color IN (blue, black)`. Supports = != < <= > >= IN, AND, OR, NOT and parentheses; text comparisons ignore case. Available attributes: " + filter_attributes + ".", false)
+    .with_string_param("mode", "Optional ranking mode. `hybrid` (default) combines semantic similarity with keyword matches on descriptions and file names. `lexical` matches keywords only and is the fastest; use it for exact terms such as SKUs, brand names or file names. `vector` is semantic similarity only.", false)
+    .with_string_param("metric", "Optional vector similarity: `cosine` (default), `dot` or `l2`. Leave at the default unless the user asks otherwise.", false)
+    .build();
+
+    mcp::tool upsert_garments = mcp::tool_builder("upsert_garments")
+    .with_description("Add garments to the local catalog, or update them if a garment with the same id exists. Only to be called if the user explicitly asks to add or change garments in the catalog.")
+    .with_array_param("items", "Garments as objects with `id` (number), `link` (image link), `desc` (description), and optionally `fname`, `vector` (embedding) and `attributes` (object keyed by attribute name). The description is embedded if no vector is given.", "object", true)
+    .build();
+
+    mcp::tool delete_garments = mcp::tool_builder("delete_garments")
+    .with_description("Remove garments from the local catalog by id. Only to be called if the user explicitly asks to remove garments from the catalog.")
+    .with_array_param("ids", "Ids of the garments to remove", "number", true)
     .build();
 
     mcp::tool perform_vton = mcp::tool_builder("perform_vton")
@@ -500,6 +1111,30 @@ int main(int argc, char* argv[]){
     .with_boolean_param("lower_body", "If the user wants to Virtually Try On the garment on the lower part of the body. If this is true, `upper_body` should be false. Both cannot be true.", true)
     .build();
     
+    if (catalog_store){
+        if (config.catalog_admin){
+            // rebuilds in the background, searches keep using the old catalog until it is published
+            server.register_method("admin/reload_catalog", [](const mcp::json& params, const std::string& session_id, mcp::completion_handler done){
+                std::string path = params.value("path", "");
+                LOG_INFO("Session ID: ", session_id, " Reloading catalog ", path);
+                catalog_store->reload_async([done](std::shared_ptr<const csv::Catalog> catalog, std::exception_ptr error){
+                    if (error){
+                        done(nullptr, error);
+                        return;
+                    }
+                    done(mcp::json{
+                        {"version", catalog->get_version()},
+                        {"rows", catalog->size()},
+                        {"source", catalog->get_source()}
+                    }, nullptr);
+                }, path);
+            });
+
+            server.register_tool(upsert_garments, upsert_garments_handler);
+            server.register_tool(delete_garments, delete_garments_handler);
+        }
+    }
+
     // tool registry
     if (check == FunctionalityAvailability::ALL){
         server.register_tool(local_search, local_search_handler);
@@ -523,6 +1158,15 @@ int main(int argc, char* argv[]){
         server.register_tool(perform_vton_on_previous_vton, replicate_handler_regressive);
     }
 
+    // a closed session's try-on chain is dropped with it
+    server.register_session_cleanup("perform_vton_on_previous_vton", [](const std::string& session_id){
+        tryon_history.close(session_id);
+    });
+    // nobody is left to pick one of the speculative try-ons
+    server.register_session_cleanup("perform_vton", [](const std::string& session_id){
+        tryon_jobs->close_session(session_id);
+    });
+
     // Start server
     // std::cout << "Starting MCP server at localhost:8888..." << std::endl;
     // std::cout << "Press Ctrl+C to stop the server" << std::endl;
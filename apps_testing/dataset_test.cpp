@@ -5,9 +5,9 @@
 * @date 2025-06-24 00:03:10 Tuesday
 */
 
+#include <Eigen/Dense> // before ollama.hpp, glibc's <resolv.h> defines _res which clashes with Eigen
 #include "ollama.hpp"
 #include <iostream>
-#include <Eigen/Dense>
 #include "utils/csv_parser.h"
 
 int main(){
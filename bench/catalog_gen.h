@@ -0,0 +1,143 @@
+/**
+ * @file catalog_gen.h
+ * @brief Synthetic garment catalogs for the benchmarks
+ *
+ * Catalogs follow the layout produced by data-prep (fname, link, id, desc,
+ * embedding_model, vector) and are generated from a fixed seed, so every run
+ * and every machine benchmarks the same bytes. Catalog files are written to
+ * the temp directory once and reused.
+ */
+
+#ifndef MCP_BENCH_CATALOG_GEN_H
+#define MCP_BENCH_CATALOG_GEN_H
+
+#include "utils/csv_parser.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace catalog_gen {
+
+const uint32_t default_seed = 42;
+
+// Catalog sizes covered by the suite, filtered by max_cells()
+const int64_t row_counts[] = {1000, 10000, 100000, 1000000};
+const int64_t dim_counts[] = {384, 768, 1536};
+
+/**
+ * @brief Largest rows x dims catalog to generate
+ * @return MCP_BENCH_MAX_CELLS if set, otherwise 50M cells (about 400 MB of doubles)
+ */
+inline int64_t max_cells() {
+    const char* env = std::getenv("MCP_BENCH_MAX_CELLS");
+    return env ? std::atoll(env) : 50000000;
+}
+
+/**
+ * @brief Register every rows x dims pair that fits max_cells()
+ */
+inline void catalog_sizes(benchmark::internal::Benchmark* b) {
+    b->ArgNames({"rows", "dims"});
+    for (int64_t rows : row_counts) {
+        for (int64_t dims : dim_counts) {
+            if (rows * dims <= max_cells()) {
+                b->Args({rows, dims});
+            }
+        }
+    }
+}
+
+/**
+ * @brief Random embedding with components in [-1, 1)
+ */
+inline std::vector<double> make_vector(size_t dims, std::mt19937& rng) {
+    std::uniform_real_distribution<double> dist(-1.0, 1.0);
+    std::vector<double> vec(dims);
+    for (auto& v : vec) {
+        v = dist(rng);
+    }
+    return vec;
+}
+
+/**
+ * @brief Query embedding, independent of the catalog rows
+ */
+inline std::vector<double> make_query(size_t dims, uint32_t seed = default_seed) {
+    std::mt19937 rng(seed ^ 0x9e3779b9u);
+    return make_vector(dims, rng);
+}
+
+/**
+ * @brief Format one catalog line (without the newline)
+ */
+inline std::string make_line(size_t id, size_t dims, std::mt19937& rng) {
+    std::string line = "img_" + std::to_string(id) + ".jpg,https://example.com/img/" + std::to_string(id) + ".jpg," +
+        std::to_string(id) + ",\"Garment " + std::to_string(id) + ", cotton, regular fit\",nomic-embed-text,\"[";
+
+    char buf[32];
+    std::vector<double> vec = make_vector(dims, rng);
+    for (size_t i = 0; i < dims; ++i) {
+        int n = std::snprintf(buf, sizeof(buf), i == 0 ? "%.8f" : ", %.8f", vec[i]);
+        line.append(buf, n);
+    }
+    line += "]\"";
+    return line;
+}
+
+/**
+ * @brief Write a catalog file, or reuse the one written by an earlier run
+ * @return Path of the CSV file
+ */
+inline std::string write_catalog(size_t rows, size_t dims, uint32_t seed = default_seed) {
+    namespace fs = std::filesystem;
+    fs::path path = fs::temp_directory_path() /
+        ("mcp_bench_catalog_" + std::to_string(rows) + "x" + std::to_string(dims) + "_s" + std::to_string(seed) + ".csv");
+
+    std::error_code ec;
+    if (fs::exists(path, ec) && fs::file_size(path, ec) > 0) {
+        return path.string();
+    }
+
+    // write to a temporary name so an interrupted run never leaves a truncated catalog behind
+    fs::path partial = path;
+    partial += ".partial";
+    {
+        std::ofstream out(partial, std::ios::binary);
+        out << "fname,link,id,desc,embedding_model,vector\n";
+        std::mt19937 rng(seed);
+        for (size_t id = 0; id < rows; ++id) {
+            out << make_line(id, dims, rng) << '\n';
+        }
+    }
+    fs::rename(partial, path);
+    return path.string();
+}
+
+/**
+ * @brief In-memory catalog with random scores, as returned by parse_csv_with_scores
+ */
+inline std::vector<csv::CSVRow> make_dataset(size_t rows, size_t dims, uint32_t seed = default_seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> score(-1.0, 1.0);
+
+    std::vector<csv::CSVRow> dataset;
+    dataset.reserve(rows);
+    for (size_t id = 0; id < rows; ++id) {
+        std::string name = std::to_string(id);
+        dataset.emplace_back("img_" + name + ".jpg", "https://example.com/img/" + name + ".jpg", static_cast<int>(id),
+            "Garment " + name + ", cotton, regular fit", "nomic-embed-text", make_vector(dims, rng), score(rng));
+    }
+    return dataset;
+}
+
+} // namespace catalog_gen
+
+#endif // MCP_BENCH_CATALOG_GEN_H
@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+"""Compare two Google Benchmark JSON results and flag regressions.
+
+Usage:
+    python3 bench/compare.py baseline.json contender.json [--metric real_time]
+                             [--threshold 5] [--filter REGEX]
+
+Benchmarks are matched by name. When the runs used repetitions, the median
+aggregate is compared; otherwise repeated iterations of the same name are
+averaged. Times are normalized to nanoseconds. The exit status is 1 if any
+benchmark got slower by more than the threshold (in percent).
+"""
+
+import argparse
+import json
+import re
+import sys
+
+UNIT_TO_NS = {"ns": 1.0, "us": 1e3, "ms": 1e6, "s": 1e9}
+
+
+def load(path, metric, pattern):
+    with open(path) as f:
+        data = json.load(f)
+
+    medians = {}
+    samples = {}
+    for bench in data.get("benchmarks", []):
+        if bench.get("error_occurred"):
+            continue
+        name = bench.get("run_name", bench["name"])
+        if pattern and not pattern.search(name):
+            continue
+        value = bench[metric] * UNIT_TO_NS[bench.get("time_unit", "ns")]
+        if bench.get("run_type") == "aggregate":
+            if bench.get("aggregate_name") == "median":
+                medians[name] = value
+        else:
+            samples.setdefault(name, []).append(value)
+
+    results = {name: sum(values) / len(values) for name, values in samples.items()}
+    results.update(medians)
+    return data.get("context", {}), results
+
+
+def format_ns(ns):
+    for unit, scale in (("s", 1e9), ("ms", 1e6), ("us", 1e3)):
+        if ns >= scale:
+            return "%.2f %s" % (ns / scale, unit)
+    return "%.1f ns" % ns
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("baseline")
+    parser.add_argument("contender")
+    parser.add_argument("--metric", choices=("real_time", "cpu_time"), default="real_time")
+    parser.add_argument("--threshold", type=float, default=5.0, help="regression threshold in percent")
+    parser.add_argument("--filter", help="only compare benchmarks whose name matches this regex")
+    args = parser.parse_args()
+
+    pattern = re.compile(args.filter) if args.filter else None
+    base_context, base = load(args.baseline, args.metric, pattern)
+    new_context, new = load(args.contender, args.metric, pattern)
+
+    for key in ("catalog_seed", "catalog_max_cells"):
+        if base_context.get(key) != new_context.get(key):
+            print("warning: %s differs (%s vs %s)" % (key, base_context.get(key), new_context.get(key)))
+
+    names = [name for name in base if name in new]
+    if not names:
+        print("No common benchmarks")
+        return 1
+
+    width = max(len(name) for name in names)
+    print("%-*s %14s %14s %9s" % (width, "benchmark", "baseline", "contender", "change"))
+    regressions = 0
+    for name in names:
+        change = (new[name] - base[name]) / base[name] * 100.0 if base[name] > 0 else 0.0
+        flag = ""
+        if change > args.threshold:
+            flag = "  REGRESSION"
+            regressions += 1
+        elif change < -args.threshold:
+            flag = "  improved"
+        print("%-*s %14s %14s %+8.1f%%%s" % (width, name, format_ns(base[name]), format_ns(new[name]), change, flag))
+
+    for name in sorted(set(base) ^ set(new)):
+        print("only in %s: %s" % ("baseline" if name in base else "contender", name))
+
+    print("\n%d of %d benchmarks regressed by more than %.1f%% (%s)" % (regressions, len(names), args.threshold, args.metric))
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,189 @@
+/**
+ * @file csv_bench.cpp
+ * @brief Benchmarks for the local search path
+ *
+ * Covers line parsing, vector parsing, the full parse-and-score scan, top-k
+ * selection and serialization of results and tool definitions, over the
+ * synthetic catalogs from catalog_gen.h.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "catalog_gen.h"
+#include "mcp_tool.h"
+#include "utils/catalog.h"
+#include "utils/csv_reader.h"
+
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Catalog line and its vector column, for the per-line benchmarks
+struct sample_line {
+    std::string line;
+    std::string vector_field;
+};
+
+sample_line make_sample_line(size_t dims) {
+    std::mt19937 rng(catalog_gen::default_seed);
+    sample_line sample;
+    sample.line = catalog_gen::make_line(0, dims, rng);
+    sample.vector_field = csv::line_parser(sample.line)[5];
+    return sample;
+}
+
+} // namespace
+
+static void BM_LineParser(benchmark::State& state) {
+    sample_line sample = make_sample_line(state.range(0));
+
+    for (auto _ : state) {
+        auto row = csv::line_parser(sample.line);
+        benchmark::DoNotOptimize(row);
+    }
+    state.SetBytesProcessed(state.iterations() * sample.line.size());
+}
+BENCHMARK(BM_LineParser)->ArgName("dims")->Arg(384)->Arg(768)->Arg(1536);
+
+static void BM_ParseStrToVector(benchmark::State& state) {
+    sample_line sample = make_sample_line(state.range(0));
+
+    for (auto _ : state) {
+        auto vec = csv::parse_str_to_vector(sample.vector_field);
+        benchmark::DoNotOptimize(vec);
+    }
+    state.SetBytesProcessed(state.iterations() * sample.vector_field.size());
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ParseStrToVector)->ArgName("dims")->Arg(384)->Arg(768)->Arg(1536);
+
+static void BM_SplitRecord(benchmark::State& state) {
+    sample_line sample = make_sample_line(state.range(0));
+    std::vector<csv::Field> fields;
+
+    for (auto _ : state) {
+        size_t consumed = csv::split_record(sample.line, fields);
+        benchmark::DoNotOptimize(consumed);
+        benchmark::DoNotOptimize(fields.data());
+    }
+    state.SetBytesProcessed(state.iterations() * sample.line.size());
+}
+BENCHMARK(BM_SplitRecord)->ArgName("dims")->Arg(384)->Arg(768)->Arg(1536);
+
+static void BM_ParseVector(benchmark::State& state) {
+    sample_line sample = make_sample_line(state.range(0));
+    std::vector<double> vec;
+
+    for (auto _ : state) {
+        bool ok = csv::parse_vector(sample.vector_field, vec);
+        benchmark::DoNotOptimize(ok);
+        benchmark::DoNotOptimize(vec.data());
+    }
+    state.SetBytesProcessed(state.iterations() * sample.vector_field.size());
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ParseVector)->ArgName("dims")->Arg(384)->Arg(768)->Arg(1536);
+
+// Catalog ingestion over a memory map, in parallel chunks
+static void BM_ReadCatalog(benchmark::State& state) {
+    size_t rows = state.range(0);
+    size_t dims = state.range(1);
+    std::string path = catalog_gen::write_catalog(rows, dims);
+
+    for (auto _ : state) {
+        auto dataset = csv::read_catalog(path);
+        benchmark::DoNotOptimize(dataset);
+    }
+    state.SetBytesProcessed(state.iterations() * std::filesystem::file_size(path));
+    state.SetItemsProcessed(state.iterations() * rows);
+}
+BENCHMARK(BM_ReadCatalog)->Apply(catalog_gen::catalog_sizes)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Full local search scan: read, parse and score every row
+static void BM_ParseCsvWithScores(benchmark::State& state) {
+    size_t rows = state.range(0);
+    size_t dims = state.range(1);
+    std::string path = catalog_gen::write_catalog(rows, dims);
+    std::vector<double> query = catalog_gen::make_query(dims);
+
+    for (auto _ : state) {
+        auto dataset = csv::parse_csv_with_scores(path, query);
+        benchmark::DoNotOptimize(dataset);
+    }
+    state.SetBytesProcessed(state.iterations() * std::filesystem::file_size(path));
+    state.SetItemsProcessed(state.iterations() * rows);
+}
+BENCHMARK(BM_ParseCsvWithScores)->Apply(catalog_gen::catalog_sizes)->Unit(benchmark::kMillisecond);
+
+// Top-k over a scored catalog; get_top_k sorts in place, so each iteration gets a fresh copy
+static void BM_GetTopK(benchmark::State& state) {
+    size_t rows = state.range(0);
+    size_t dims = state.range(1);
+    const auto dataset = catalog_gen::make_dataset(rows, dims);
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto scratch = dataset;
+        state.ResumeTiming();
+
+        auto top = csv::get_top_k(scratch, 5);
+        benchmark::DoNotOptimize(top);
+    }
+    state.SetItemsProcessed(state.iterations() * rows);
+}
+BENCHMARK(BM_GetTopK)->Apply(catalog_gen::catalog_sizes)->Unit(benchmark::kMillisecond);
+
+// In-memory catalog search with a filter of decreasing selectivity: none, 25% and 1% of rows
+static void BM_CatalogSearchFiltered(benchmark::State& state) {
+    size_t rows = state.range(0);
+    size_t dims = 384;
+    auto dataset = catalog_gen::make_dataset(rows, dims);
+    for (auto& row : dataset) {
+        row.attributes = {"c" + std::to_string(row.id % 4), std::to_string(row.id % 100)};
+    }
+    csv::Catalog catalog(std::move(dataset), "bench", 1, {"category", "bucket"});
+    std::vector<double> query = catalog_gen::make_query(dims);
+
+    const char* filters[] = {"", "category = c0", "bucket < 1"};
+    std::string filter = filters[state.range(1)];
+    for (auto _ : state) {
+        auto top = catalog.search(query, 5, filter);
+        benchmark::DoNotOptimize(top);
+    }
+    state.SetItemsProcessed(state.iterations() * rows);
+}
+BENCHMARK(BM_CatalogSearchFiltered)->ArgNames({"rows", "filter"})
+    ->Args({100000, 0})->Args({100000, 1})->Args({100000, 2})->Unit(benchmark::kMillisecond);
+
+static void BM_DatasetToJson(benchmark::State& state) {
+    auto results = catalog_gen::make_dataset(state.range(0), 384);
+
+    size_t bytes = 0;
+    for (auto _ : state) {
+        std::string json = csv::dataset_to_json(results);
+        bytes = json.size();
+        benchmark::DoNotOptimize(json);
+    }
+    state.SetBytesProcessed(state.iterations() * bytes);
+}
+BENCHMARK(BM_DatasetToJson)->ArgName("k")->Arg(5)->Arg(50)->Arg(500);
+
+// A tool definition shaped like the OpenVTO try-on tools
+static void BM_ToolToJson(benchmark::State& state) {
+    mcp::tool vton = mcp::tool_builder("perform_vton")
+        .with_description("Perform Virtual Try-On using IDM-VTON Deep Learning model on a garment selected from search.")
+        .with_string_param("garm_img", "The image link of the selected garment", true)
+        .with_string_param("garment_des", "Description of garment e.g. Short Sleeve Round Neck T-shirt", true)
+        .with_boolean_param("upper_body", "Try the garment on the upper part of the body", true)
+        .with_boolean_param("lower_body", "Try the garment on the lower part of the body", true)
+        .build();
+
+    for (auto _ : state) {
+        mcp::json json = vton.to_json();
+        benchmark::DoNotOptimize(json);
+    }
+}
+BENCHMARK(BM_ToolToJson);
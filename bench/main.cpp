@@ -0,0 +1,30 @@
+/**
+ * @file main.cpp
+ * @brief Entry point for the benchmark suite
+ *
+ * Record a baseline with stable JSON output and compare a later run with it:
+ *
+ *   mcp_benchmarks --benchmark_repetitions=5 --benchmark_report_aggregates_only=true \
+ *       --benchmark_format=json --benchmark_out=baseline.json --benchmark_out_format=json
+ *   python3 bench/compare.py baseline.json contender.json
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "catalog_gen.h"
+
+#include <string>
+
+int main(int argc, char** argv) {
+    // Recorded in the JSON context so runs on different catalogs are not compared by mistake
+    benchmark::AddCustomContext("catalog_seed", std::to_string(catalog_gen::default_seed));
+    benchmark::AddCustomContext("catalog_max_cells", std::to_string(catalog_gen::max_cells()));
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
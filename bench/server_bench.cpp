@@ -0,0 +1,168 @@
+/**
+ * @file server_bench.cpp
+ * @brief Benchmarks for the server's request path
+ *
+ * Session lookups through a single mutex-guarded map are compared with the
+ * sharded registry, and end-to-end POST throughput is measured with one
+ * keep-alive client per benchmark thread.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "mcp_registry.h"
+#include "mcp_server.h"
+#include "mcp_tool.h"
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace mcp;
+
+namespace {
+
+const int kSessionCount = 1024;
+const int kMaxThreads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+
+std::vector<std::string> make_session_ids() {
+    std::vector<std::string> ids;
+    ids.reserve(kSessionCount);
+    for (int i = 0; i < kSessionCount; ++i) {
+        ids.push_back("session-" + std::to_string(i));
+    }
+    return ids;
+}
+
+// Previous layout: one map behind the server mutex
+struct locked_registry {
+    std::mutex mutex;
+    std::map<std::string, std::shared_ptr<event_dispatcher>> sessions;
+};
+
+locked_registry& get_locked_registry(const std::vector<std::string>& ids) {
+    static locked_registry registry;
+    static std::once_flag once;
+    std::call_once(once, [&]() {
+        for (const auto& id : ids) {
+            registry.sessions[id] = std::make_shared<event_dispatcher>();
+        }
+    });
+    return registry;
+}
+
+sharded_map<std::string, std::shared_ptr<event_dispatcher>>& get_sharded_registry(const std::vector<std::string>& ids) {
+    static sharded_map<std::string, std::shared_ptr<event_dispatcher>> registry;
+    static std::once_flag once;
+    std::call_once(once, [&]() {
+        for (const auto& id : ids) {
+            registry.insert_or_assign(id, std::make_shared<event_dispatcher>());
+        }
+    });
+    return registry;
+}
+
+// Server shared by every POST benchmark thread, intentionally never stopped
+// so the process exits without waiting on the maintenance thread
+server& get_bench_server() {
+    static server* bench_server = nullptr;
+    static std::once_flag once;
+    std::call_once(once, []() {
+        logger::instance().set_level(log_level::error);
+
+        bench_server = new server("localhost", 8090, "Bench Server", "0.0.1", "/sse", "/mcp", transport_mode::streamable_http);
+        tool echo_tool = tool_builder("echo")
+            .with_description("Echo the input")
+            .with_string_param("text", "Text to echo")
+            .build();
+        bench_server->register_tool(echo_tool, [](const json& params, const std::string& /* session_id */) -> json {
+            return json::array({{{"type", "text"}, {"text", params["text"]}}});
+        });
+        bench_server->start(false);
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    });
+    return *bench_server;
+}
+
+// Open a Streamable HTTP session on the bench server
+std::string open_session(httplib::Client& client) {
+    json init = request::create("initialize", {
+        {"protocolVersion", MCP_VERSION},
+        {"clientInfo", {{"name", "BenchClient"}, {"version", "1.0.0"}}},
+        {"capabilities", json::object()}
+    }).to_json();
+    auto res = client.Post("/mcp", {{"Accept", "application/json"}}, init.dump(), "application/json");
+    if (!res || res->status != 200) {
+        return "";
+    }
+
+    std::string session_id = res->get_header_value("Mcp-Session-Id");
+    client.Post("/mcp", {{"Accept", "application/json"}, {"Mcp-Session-Id", session_id}},
+                request::create_notification("initialized").to_json().dump(), "application/json");
+    return session_id;
+}
+
+} // namespace
+
+static void BM_SessionLookup_SingleMutex(benchmark::State& state) {
+    static const auto ids = make_session_ids();
+    auto& registry = get_locked_registry(ids);
+
+    size_t i = state.thread_index() * 7919;
+    for (auto _ : state) {
+        std::shared_ptr<event_dispatcher> dispatcher;
+        {
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            auto it = registry.sessions.find(ids[i++ % ids.size()]);
+            if (it != registry.sessions.end()) {
+                dispatcher = it->second;
+            }
+        }
+        benchmark::DoNotOptimize(dispatcher);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SessionLookup_SingleMutex)->ThreadRange(1, kMaxThreads)->UseRealTime();
+
+static void BM_SessionLookup_Sharded(benchmark::State& state) {
+    static const auto ids = make_session_ids();
+    auto& registry = get_sharded_registry(ids);
+
+    size_t i = state.thread_index() * 7919;
+    for (auto _ : state) {
+        std::shared_ptr<event_dispatcher> dispatcher;
+        registry.find(ids[i++ % ids.size()], dispatcher);
+        benchmark::DoNotOptimize(dispatcher);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SessionLookup_Sharded)->ThreadRange(1, kMaxThreads)->UseRealTime();
+
+static void BM_PostToolsCall(benchmark::State& state) {
+    get_bench_server();
+
+    // One keep-alive connection and session per thread
+    httplib::Client client("localhost", 8090);
+    client.set_keep_alive(true);
+    client.set_tcp_nodelay(true);
+    std::string session_id = open_session(client);
+    if (session_id.empty()) {
+        state.SkipWithError("Failed to open session");
+        return;
+    }
+
+    httplib::Headers headers = {{"Accept", "application/json"}, {"Mcp-Session-Id", session_id}};
+    std::string body = request::create("tools/call", {{"name", "echo"}, {"arguments", {{"text", "ping"}}}}).to_json().dump();
+
+    for (auto _ : state) {
+        auto res = client.Post("/mcp", headers, body, "application/json");
+        if (!res || res->status != 200) {
+            state.SkipWithError("Request failed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PostToolsCall)->ThreadRange(1, kMaxThreads)->UseRealTime();
@@ -0,0 +1,176 @@
+/**
+ * @file mcp_cancellation.h
+ * @brief Cooperative cancellation of running requests
+ *
+ * The server gives every request a cancellation_source and makes its token
+ * current on the thread that runs the handler (cancellation_scope), the same
+ * way the trace context is carried. Handlers poll the token between units of
+ * work or register a callback that aborts a blocking call, e.g. by stopping an
+ * HTTP client. Handlers that continue on another thread take the token with
+ * them. A request is cancelled by notifications/cancelled, or when its session
+ * or stream closes.
+ *
+ * A token may also carry a deadline. When it passes, the token is cancelled
+ * with error_code::request_timeout, and remaining() gives downstream calls
+ * what is left of the budget to use as their own timeouts.
+ */
+
+#ifndef MCP_CANCELLATION_H
+#define MCP_CANCELLATION_H
+
+#include "mcp_message.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace mcp {
+
+namespace detail {
+struct cancellation_state;
+} // namespace detail
+
+/**
+ * @class cancellation_token
+ * @brief Read side of a cancellation, cheap to copy
+ *
+ * A default-constructed token is never cancelled.
+ */
+class cancellation_token {
+public:
+    cancellation_token() = default;
+
+    /**
+     * @brief Get the token of the request running on the calling thread
+     * @return The current token, or a token that is never cancelled
+     */
+    static cancellation_token current();
+
+    bool is_cancelled() const;
+
+    // Reason given to cancel, empty while not cancelled
+    std::string reason() const;
+
+    // Error to answer with: request_cancelled, or request_timeout if the deadline passed
+    error_code code() const;
+
+    // When the token is cancelled by itself, time_point::max() if never
+    std::chrono::steady_clock::time_point deadline() const;
+
+    /**
+     * @brief Budget left for a downstream call
+     * @param limit The call's own timeout, returned when there is no deadline
+     * @return The smaller of limit and the time to the deadline, zero once it has passed
+     */
+    std::chrono::milliseconds remaining(std::chrono::milliseconds limit) const;
+
+    /**
+     * @brief Throw if cancelled
+     * @throws mcp_exception with code()
+     */
+    void throw_if_cancelled() const;
+
+    /**
+     * @brief Sleep unless cancelled first
+     * @param timeout Time to sleep
+     * @return True if the token was cancelled
+     */
+    bool wait_for(std::chrono::steady_clock::duration timeout) const;
+
+    /**
+     * @brief Register a callback run once on cancellation, from the cancelling thread
+     * @param fn The callback, run at once if already cancelled
+     * @return Id for remove(), 0 if fn already ran or the token cannot be cancelled
+     */
+    uint64_t on_cancel(std::function<void()> fn) const;
+
+    /**
+     * @brief Unregister a callback
+     * @param id Id from on_cancel()
+     * @note Waits for the callback if it is running on another thread
+     */
+    void remove(uint64_t id) const;
+
+private:
+    friend class cancellation_source;
+    explicit cancellation_token(std::shared_ptr<detail::cancellation_state> state) : state_(std::move(state)) {}
+
+    std::shared_ptr<detail::cancellation_state> state_;
+};
+
+/**
+ * @class cancellation_source
+ * @brief Write side of a cancellation
+ */
+class cancellation_source {
+public:
+    cancellation_source();
+
+    cancellation_token token() const;
+
+    /**
+     * @brief Cancel and run the registered callbacks
+     * @param reason Shown in the error of the cancelled request
+     * @param code Error the request is answered with
+     * @return False if it was already cancelled
+     */
+    bool cancel(const std::string& reason = "Request cancelled", error_code code = error_code::request_cancelled);
+
+    /**
+     * @brief Cancel with error_code::request_timeout at a point in time
+     * @param when The deadline, a timer on the executor fires it
+     */
+    void set_deadline(std::chrono::steady_clock::time_point when);
+
+    /**
+     * @brief Drop the deadline timer once the work is answered, so it does not wait in the executor
+     */
+    void complete();
+
+    bool is_cancelled() const;
+
+private:
+    std::shared_ptr<detail::cancellation_state> state_;
+};
+
+/**
+ * @class cancellation_scope
+ * @brief Makes a token current on the calling thread for a scope
+ */
+class cancellation_scope {
+public:
+    explicit cancellation_scope(cancellation_token token);
+    ~cancellation_scope();
+
+    cancellation_scope(const cancellation_scope&) = delete;
+    cancellation_scope& operator=(const cancellation_scope&) = delete;
+
+private:
+    cancellation_token previous_;
+};
+
+/**
+ * @class cancellation_callback
+ * @brief Registers a callback for a scope, e.g. to abort a blocking call
+ */
+class cancellation_callback {
+public:
+    cancellation_callback(const cancellation_token& token, std::function<void()> fn);
+    ~cancellation_callback();
+
+    cancellation_callback(const cancellation_callback&) = delete;
+    cancellation_callback& operator=(const cancellation_callback&) = delete;
+
+private:
+    cancellation_token token_;
+    uint64_t id_;
+};
+
+} // namespace mcp
+
+#endif // MCP_CANCELLATION_H
@@ -0,0 +1,82 @@
+/**
+ * @file mcp_json_writer.h
+ * @brief Streaming JSON writer that appends to a caller-owned buffer
+ *
+ * Values are written straight into the buffer as they are produced, with
+ * commas and escaping handled by the writer, so a response can be rendered
+ * in place, e.g. after the "data: " prefix of an SSE frame. Numbers are
+ * formatted with to_chars.
+ */
+
+#ifndef MCP_JSON_WRITER_H
+#define MCP_JSON_WRITER_H
+
+#include "mcp_message.h"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mcp {
+
+/**
+ * @class json_writer
+ * @brief Writes one JSON value, nesting tracked on a small stack
+ */
+class json_writer {
+public:
+    /**
+     * @brief Constructor
+     * @param out Buffer to append to, must outlive the writer
+     */
+    explicit json_writer(std::string& out);
+
+    json_writer& begin_object();
+    json_writer& end_object();
+    json_writer& begin_array();
+    json_writer& end_array();
+
+    /**
+     * @brief Write an object key, the next call writes its value
+     * @param name Key, escaped as needed
+     */
+    json_writer& key(std::string_view name);
+
+    json_writer& value(std::string_view text);
+    json_writer& value(const char* text);
+    json_writer& value(const std::string& text);
+    json_writer& value(int number);
+    json_writer& value(int64_t number);
+    json_writer& value(uint64_t number);
+    // non-finite numbers are written as null, as JSON has no literal for them
+    json_writer& value(double number);
+    json_writer& value(bool flag);
+    json_writer& null();
+
+    /**
+     * @brief Write a parsed JSON value, keys in their stored order
+     * @param document Value to write
+     */
+    json_writer& value(const json& document);
+
+    /**
+     * @brief Append a string literal with RFC 8259 escaping
+     * @param out Buffer to append to
+     * @param text Raw text, UTF-8 is passed through unchanged
+     */
+    static void escape(std::string& out, std::string_view text);
+
+private:
+    std::string& out_;
+    // per open object or array: whether it already has an element
+    std::vector<bool> has_items_;
+    bool after_key_ = false;
+
+    // comma before the next element, unless it is the value of a key
+    void separate();
+};
+
+} // namespace mcp
+
+#endif // MCP_JSON_WRITER_H
@@ -1,6 +1,12 @@
 /**
  * @file mcp_logger.h
  * @brief Simple logger
+ *
+ * Lines are written synchronously to stderr by default. In asynchronous mode
+ * the calling thread only formats the message and pushes it into a lock-free
+ * queue; a background writer adds the timestamp and writes lines in batches,
+ * flushing once per batch. An optional file sink receives the same lines
+ * without color codes.
  */
 
 #ifndef MCP_LOGGER_H
@@ -12,6 +18,13 @@
 #include <mutex>
 #include <chrono>
 #include <iomanip>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <utility>
 
 namespace mcp {
 
@@ -22,99 +35,125 @@ enum class log_level {
     error
 };
 
+namespace detail {
+class log_queue;
+} // namespace detail
+
 class logger {
 public:
     static logger& instance() {
         static logger instance;
         return instance;
     }
-    
+
+    ~logger();
+
     void set_level(log_level level) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        level_ = level;
+        level_.store(level, std::memory_order_relaxed);
     }
-    
+
+    /**
+     * @brief Check whether a level is enabled
+     * @param level The level to check
+     * @return True if messages at this level are written
+     */
+    bool enabled(log_level level) const {
+        return level >= level_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Switch between synchronous writes and the background writer
+     * @param async True to queue lines for the background writer
+     * @param capacity Queue capacity in lines (rounded up to a power of two), used when the queue is first created
+     * @note Lines that arrive while the queue is full are dropped and counted
+     */
+    void set_async(bool async, size_t capacity = 8192);
+
+    /**
+     * @brief Also write lines to a file
+     * @param path File to append to, empty to close the current file
+     * @return True if the file was opened (or closed)
+     */
+    bool set_file(const std::string& path);
+
+    /**
+     * @brief Wait until every queued line has been written
+     */
+    void flush();
+
     template<typename... Args>
     void debug(Args&&... args) {
         log(log_level::debug, std::forward<Args>(args)...);
     }
-    
+
     template<typename... Args>
     void info(Args&&... args) {
         log(log_level::info, std::forward<Args>(args)...);
     }
-    
+
     template<typename... Args>
     void warning(Args&&... args) {
         log(log_level::warning, std::forward<Args>(args)...);
     }
-    
+
     template<typename... Args>
     void error(Args&&... args) {
         log(log_level::error, std::forward<Args>(args)...);
     }
-    
+
 private:
-    logger() : level_(log_level::info) {}
-    
-    template<typename T>
-    void log_impl(std::stringstream& ss, T&& arg) {
-        ss << std::forward<T>(arg);
-    }
-    
-    template<typename T, typename... Args>
-    void log_impl(std::stringstream& ss, T&& arg, Args&&... args) {
-        ss << std::forward<T>(arg);
-        log_impl(ss, std::forward<Args>(args)...);
-    }
-    
+    logger();
+
     template<typename... Args>
     void log(log_level level, Args&&... args) {
-        if (level < level_) {
+        if (!enabled(level)) {
             return;
         }
-        
-        std::stringstream ss;
-        
-        // Add timestamp
-        auto now = std::chrono::system_clock::now();
-        auto now_c = std::chrono::system_clock::to_time_t(now);
-        auto now_tm = std::localtime(&now_c);
-        
-        ss << std::put_time(now_tm, "%Y-%m-%d %H:%M:%S") << " ";
-        
-        // Add log level and color
-        switch (level) {
-            case log_level::debug:
-                ss << "\033[36m[DEBUG]\033[0m ";  // Cyan
-                break;
-            case log_level::info:
-                ss << "\033[32m[INFO]\033[0m ";   // Green
-                break;
-            case log_level::warning:
-                ss << "\033[33m[WARNING]\033[0m "; // Yellow
-                break;
-            case log_level::error:
-                ss << "\033[31m[ERROR]\033[0m ";   // Red
-                break;
-        }
-        
-        // Add log content
-        log_impl(ss, std::forward<Args>(args)...);
-        
-        // Output log
-        std::lock_guard<std::mutex> lock(mutex_);
-        std::cerr << ss.str() << std::endl;
+
+        // Format the message on the calling thread, reusing a per-thread stream
+        std::ostringstream& ss = thread_stream();
+        (ss << ... << std::forward<Args>(args));
+        write(level, ss.str());
     }
-    
-    log_level level_;
+
+    // Per-thread stream, cleared on every call
+    static std::ostringstream& thread_stream();
+
+    // Write or queue a formatted message
+    void write(log_level level, std::string message);
+
+    // Background writer loop
+    void run_writer();
+
+    // Write a batch to stderr and the file sink
+    void write_out(const std::string& console, const std::string& file);
+
+    std::atomic<log_level> level_;
+
+    // Serializes sink writes and file changes
     std::mutex mutex_;
+    std::FILE* file_ = nullptr;
+
+    // Asynchronous mode
+    std::atomic<bool> async_{false};
+    std::unique_ptr<detail::log_queue> queue_;
+    std::thread writer_;
+    std::atomic<size_t> dropped_{0};
+
+    // Writer wake-up and flush handshake
+    std::mutex writer_mutex_;
+    std::condition_variable writer_cv_;
+    std::condition_variable flushed_cv_;
+    std::atomic<bool> writer_idle_{false};
+    bool writer_stop_ = false;
+    uint64_t flush_requested_ = 0;
+    uint64_t flush_completed_ = 0;
 };
 
-#define LOG_DEBUG(...) mcp::logger::instance().debug(__VA_ARGS__)
-#define LOG_INFO(...) mcp::logger::instance().info(__VA_ARGS__)
-#define LOG_WARNING(...) mcp::logger::instance().warning(__VA_ARGS__)
-#define LOG_ERROR(...) mcp::logger::instance().error(__VA_ARGS__)
+#define LOG_DEBUG(...) do { if (mcp::logger::instance().enabled(mcp::log_level::debug)) mcp::logger::instance().debug(__VA_ARGS__); } while (0)
+#define LOG_INFO(...) do { if (mcp::logger::instance().enabled(mcp::log_level::info)) mcp::logger::instance().info(__VA_ARGS__); } while (0)
+#define LOG_WARNING(...) do { if (mcp::logger::instance().enabled(mcp::log_level::warning)) mcp::logger::instance().warning(__VA_ARGS__); } while (0)
+#define LOG_ERROR(...) do { if (mcp::logger::instance().enabled(mcp::log_level::error)) mcp::logger::instance().error(__VA_ARGS__); } while (0)
 
 inline void set_log_level(log_level level) {
     mcp::logger::instance().set_level(level);
@@ -122,4 +161,4 @@ inline void set_log_level(log_level level) {
 
 } // namespace mcp
 
-#endif // MCP_LOGGER_H 
\ No newline at end of file
+#endif // MCP_LOGGER_H
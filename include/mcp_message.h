@@ -35,6 +35,9 @@ enum class error_code {
     method_not_found = -32601,      // Method not found
     invalid_params = -32602,        // Invalid method parameters
     internal_error = -32603,        // Internal JSON-RPC error
+    request_cancelled = -32800,     // Cancelled by the client or by closing its session
+    request_timeout = -32001,       // Deadline passed before the request completed
+    server_overloaded = -32002,     // Rejected by admission control, retry later
     server_error_start = -32000,    // Server error start
     server_error_end = -32099       // Server error end
 };
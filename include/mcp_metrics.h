@@ -0,0 +1,231 @@
+/**
+ * @file mcp_metrics.h
+ * @brief Counters, gauges and latency histograms with Prometheus text export
+ *
+ * Metrics are created on first use through the process-wide metrics_registry
+ * and updated with relaxed atomics. Histograms use log-linear (HDR-style)
+ * buckets with 16 sub-buckets per power of two, so recorded latencies keep
+ * about 6% relative precision from microseconds to days; they are exported
+ * as Prometheus summaries with fixed quantiles.
+ */
+
+#ifndef MCP_METRICS_H
+#define MCP_METRICS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace mcp {
+
+// Label name/value pairs, in the order they are exported
+using metric_labels = std::vector<std::pair<std::string, std::string>>;
+
+/**
+ * @class counter
+ * @brief Monotonically increasing count
+ */
+class counter {
+public:
+    void add(uint64_t n = 1) {
+        value_.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    uint64_t value() const {
+        return value_.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> value_{0};
+};
+
+/**
+ * @class gauge
+ * @brief Value that can go up and down
+ */
+class gauge {
+public:
+    void set(int64_t v) {
+        value_.store(v, std::memory_order_relaxed);
+    }
+
+    void add(int64_t n = 1) {
+        value_.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    void sub(int64_t n = 1) {
+        value_.fetch_sub(n, std::memory_order_relaxed);
+    }
+
+    int64_t value() const {
+        return value_.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<int64_t> value_{0};
+};
+
+/**
+ * @class histogram
+ * @brief Latency distribution in microseconds with log-linear buckets
+ */
+class histogram {
+public:
+    // 16 linear buckets below 16us, then 16 sub-buckets for each power of two up to 2^40us
+    static constexpr int sub_bucket_bits = 4;
+    static constexpr int sub_bucket_count = 1 << sub_bucket_bits;
+    static constexpr int max_exponent = 40;
+    static constexpr size_t bucket_count = sub_bucket_count + (max_exponent - sub_bucket_bits + 1) * sub_bucket_count;
+
+    /**
+     * @brief Record a value
+     * @param micros The value in microseconds
+     */
+    void record(uint64_t micros);
+
+    /**
+     * @brief Record a duration
+     * @param d The duration
+     */
+    template<typename Rep, typename Period>
+    void record(std::chrono::duration<Rep, Period> d) {
+        auto micros = std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+        record(static_cast<uint64_t>(micros < 0 ? 0 : micros));
+    }
+
+    /**
+     * @brief Estimate a quantile
+     * @param q Quantile in [0, 1]
+     * @return Estimated value in microseconds (midpoint of the bucket holding the quantile), 0 if empty
+     */
+    double quantile(double q) const;
+
+    uint64_t count() const {
+        return count_.load(std::memory_order_relaxed);
+    }
+
+    // Sum of recorded values in microseconds
+    uint64_t sum() const {
+        return sum_.load(std::memory_order_relaxed);
+    }
+
+    // Bucket helpers, exposed for tests
+    static size_t bucket_index(uint64_t micros);
+    static uint64_t bucket_lower_bound(size_t index);
+    static uint64_t bucket_upper_bound(size_t index);
+
+private:
+    std::array<std::atomic<uint64_t>, bucket_count> buckets_{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_{0};
+};
+
+/**
+ * @class scoped_timer
+ * @brief Records the time between construction and destruction into a histogram
+ */
+class scoped_timer {
+public:
+    explicit scoped_timer(histogram& h) : histogram_(h), start_(std::chrono::steady_clock::now()) {}
+
+    ~scoped_timer() {
+        histogram_.record(std::chrono::steady_clock::now() - start_);
+    }
+
+    scoped_timer(const scoped_timer&) = delete;
+    scoped_timer& operator=(const scoped_timer&) = delete;
+
+private:
+    histogram& histogram_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+/**
+ * @class metrics_registry
+ * @brief Process-wide set of named metrics
+ *
+ * Metrics are created on first lookup and live for the rest of the process,
+ * so the returned references can be cached. Looking up an existing metric
+ * only takes a shared lock.
+ */
+class metrics_registry {
+public:
+    /**
+     * @brief Get the process-wide registry
+     * @return The registry instance
+     */
+    static metrics_registry& instance();
+
+    /**
+     * @brief Get or create a counter
+     * @param name Metric name (e.g., "mcp_requests_total")
+     * @param help Help text, used when the metric is first created
+     * @param labels Label pairs identifying the series
+     * @return The counter
+     * @throws std::logic_error if the name is already used by another metric type
+     */
+    counter& get_counter(const std::string& name, const std::string& help, const metric_labels& labels = {});
+
+    /**
+     * @brief Get or create a gauge
+     * @param name Metric name
+     * @param help Help text, used when the metric is first created
+     * @param labels Label pairs identifying the series
+     * @return The gauge
+     * @throws std::logic_error if the name is already used by another metric type
+     */
+    gauge& get_gauge(const std::string& name, const std::string& help, const metric_labels& labels = {});
+
+    /**
+     * @brief Get or create a latency histogram
+     * @param name Metric name, exported with a "_seconds" unit
+     * @param help Help text, used when the metric is first created
+     * @param labels Label pairs identifying the series
+     * @return The histogram
+     * @throws std::logic_error if the name is already used by another metric type
+     */
+    histogram& get_histogram(const std::string& name, const std::string& help, const metric_labels& labels = {});
+
+    /**
+     * @brief Render every metric in the Prometheus text exposition format
+     * @return The exposition text
+     */
+    std::string serialize() const;
+
+private:
+    metrics_registry() = default;
+
+    enum class metric_type { counter, gauge, histogram };
+
+    struct series {
+        metric_labels labels;
+        std::unique_ptr<counter> counter_value;
+        std::unique_ptr<gauge> gauge_value;
+        std::unique_ptr<histogram> histogram_value;
+    };
+
+    struct family {
+        std::string help;
+        metric_type type;
+        std::map<std::string, series> series_by_labels;
+    };
+
+    series& get_series(const std::string& name, const std::string& help, metric_type type, const metric_labels& labels);
+
+    mutable std::shared_mutex mutex_;
+
+    // Ordered by name so the export is stable
+    std::map<std::string, family> families_;
+};
+
+} // namespace mcp
+
+#endif // MCP_METRICS_H
@@ -0,0 +1,271 @@
+/**
+ * @file mcp_registry.h
+ * @brief Concurrent containers used on the server's request path
+ *
+ * sharded_map holds per-session state; rcu_snapshot holds the method and tool
+ * tables, which are written at registration and read on every request.
+ */
+
+#ifndef MCP_REGISTRY_H
+#define MCP_REGISTRY_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <utility>
+
+namespace mcp {
+
+/**
+ * @class sharded_map
+ * @brief Hash map split into independently locked shards
+ *
+ * Each key lives in one shard guarded by its own shared mutex, so requests for
+ * different sessions do not contend and lookups of the same session only take
+ * a shared lock.
+ */
+template<typename Key, typename Value, size_t ShardCount = 16, typename Hash = std::hash<Key>>
+class sharded_map {
+    static_assert(ShardCount > 0, "sharded_map needs at least one shard");
+
+public:
+    /**
+     * @brief Copy the value stored for a key
+     * @param key The key
+     * @param out Receives the value if the key exists
+     * @return True if the key exists
+     */
+    bool find(const Key& key, Value& out) const {
+        const shard& s = shard_for(key);
+        std::shared_lock<std::shared_mutex> lock(s.mutex);
+        auto it = s.map.find(key);
+        if (it == s.map.end()) {
+            return false;
+        }
+        out = it->second;
+        return true;
+    }
+
+    /**
+     * @brief Read the value stored for a key in place, without copying it
+     * @param key The key
+     * @param fn Called with a const reference to the value, under the shard's shared lock
+     * @return True if the key exists
+     */
+    template<typename F>
+    bool visit(const Key& key, F&& fn) const {
+        const shard& s = shard_for(key);
+        std::shared_lock<std::shared_mutex> lock(s.mutex);
+        auto it = s.map.find(key);
+        if (it == s.map.end()) {
+            return false;
+        }
+        fn(it->second);
+        return true;
+    }
+
+    /**
+     * @brief Check whether a key exists
+     * @param key The key
+     * @return True if the key exists
+     */
+    bool contains(const Key& key) const {
+        const shard& s = shard_for(key);
+        std::shared_lock<std::shared_mutex> lock(s.mutex);
+        return s.map.find(key) != s.map.end();
+    }
+
+    /**
+     * @brief Insert a value or replace the existing one
+     * @param key The key
+     * @param value The value
+     */
+    void insert_or_assign(const Key& key, Value value) {
+        shard& s = shard_for(key);
+        std::unique_lock<std::shared_mutex> lock(s.mutex);
+        s.map[key] = std::move(value);
+    }
+
+    /**
+     * @brief Modify the value stored for a key in place, inserting a default one if needed
+     * @param key The key
+     * @param fn Called with a reference to the value under the shard's exclusive lock
+     */
+    template<typename F>
+    void update(const Key& key, F&& fn) {
+        shard& s = shard_for(key);
+        std::unique_lock<std::shared_mutex> lock(s.mutex);
+        fn(s.map[key]);
+    }
+
+    /**
+     * @brief Remove a key and move its value out
+     * @param key The key
+     * @param out Receives the value if the key existed
+     * @return True if the key existed
+     */
+    bool extract(const Key& key, Value& out) {
+        shard& s = shard_for(key);
+        std::unique_lock<std::shared_mutex> lock(s.mutex);
+        auto it = s.map.find(key);
+        if (it == s.map.end()) {
+            return false;
+        }
+        out = std::move(it->second);
+        s.map.erase(it);
+        return true;
+    }
+
+    /**
+     * @brief Remove a key
+     * @param key The key
+     * @return True if the key existed
+     */
+    bool erase(const Key& key) {
+        shard& s = shard_for(key);
+        std::unique_lock<std::shared_mutex> lock(s.mutex);
+        return s.map.erase(key) > 0;
+    }
+
+    /**
+     * @brief Remove a key if its value satisfies a predicate
+     * @param key The key
+     * @param pred Called with the value under the shard's exclusive lock
+     * @return True if the key was removed
+     */
+    template<typename F>
+    bool erase_if(const Key& key, F&& pred) {
+        shard& s = shard_for(key);
+        std::unique_lock<std::shared_mutex> lock(s.mutex);
+        auto it = s.map.find(key);
+        if (it == s.map.end() || !pred(it->second)) {
+            return false;
+        }
+        s.map.erase(it);
+        return true;
+    }
+
+    /**
+     * @brief Visit every entry, one shard at a time
+     * @param fn Called with each key and value under the shard's shared lock
+     */
+    template<typename F>
+    void for_each(F&& fn) const {
+        for (const shard& s : shards_) {
+            std::shared_lock<std::shared_mutex> lock(s.mutex);
+            for (const auto& [key, value] : s.map) {
+                fn(key, value);
+            }
+        }
+    }
+
+    /**
+     * @brief Remove every entry
+     * @param fn Called with each key and the moved-out value, outside the shard locks
+     */
+    template<typename F>
+    void drain(F&& fn) {
+        for (shard& s : shards_) {
+            std::unordered_map<Key, Value, Hash> taken;
+            {
+                std::unique_lock<std::shared_mutex> lock(s.mutex);
+                taken.swap(s.map);
+            }
+            for (auto& [key, value] : taken) {
+                fn(key, std::move(value));
+            }
+        }
+    }
+
+    /**
+     * @brief Count the entries
+     * @return Number of entries (not a consistent snapshot under concurrent writes)
+     */
+    size_t size() const {
+        size_t count = 0;
+        for (const shard& s : shards_) {
+            std::shared_lock<std::shared_mutex> lock(s.mutex);
+            count += s.map.size();
+        }
+        return count;
+    }
+
+private:
+    // Padded to a cache line so that locking one shard does not invalidate its neighbours
+    struct alignas(64) shard {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<Key, Value, Hash> map;
+    };
+
+    shard& shard_for(const Key& key) {
+        return shards_[hash_(key) % ShardCount];
+    }
+
+    const shard& shard_for(const Key& key) const {
+        return shards_[hash_(key) % ShardCount];
+    }
+
+    std::array<shard, ShardCount> shards_;
+    Hash hash_;
+};
+
+/**
+ * @class rcu_snapshot
+ * @brief Immutable value replaced as a whole on update
+ *
+ * Readers take a reference-counted pointer to the current version without
+ * locking. Writers copy the current version, modify the copy and publish it;
+ * readers holding the old version keep using it until they drop it.
+ */
+template<typename T>
+class rcu_snapshot {
+public:
+    rcu_snapshot() : current_(std::make_shared<const T>()) {}
+
+    /**
+     * @brief Get the current version
+     * @return Pointer to the current version, valid for as long as it is held
+     */
+    std::shared_ptr<const T> load() const {
+        return std::atomic_load_explicit(&current_, std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Publish a modified copy of the current version
+     * @param fn Called with the copy to modify
+     */
+    template<typename F>
+    void update(F&& fn) {
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        auto next = std::make_shared<T>(*load());
+        fn(*next);
+        std::shared_ptr<const T> published = std::move(next);
+        std::atomic_store_explicit(&current_, std::move(published), std::memory_order_release);
+    }
+
+    /**
+     * @brief Replace the current version with one built elsewhere
+     * @param next The new version
+     */
+    void publish(std::shared_ptr<const T> next) {
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        std::atomic_store_explicit(&current_, std::move(next), std::memory_order_release);
+    }
+
+private:
+    // Accessed only through the std::atomic_load/atomic_store overloads for shared_ptr, so the
+    // layout is the same whichever standard a translation unit is compiled with
+    std::shared_ptr<const T> current_;
+
+    // Serializes writers, readers never take it
+    std::mutex write_mutex_;
+};
+
+} // namespace mcp
+
+#endif // MCP_REGISTRY_H
@@ -53,6 +53,13 @@ public:
      * @return The URI as string
      */
     virtual std::string get_uri() const = 0;
+    
+    /**
+     * @brief Check if a session may list and read the resource
+     * @param session_id The session asking
+     * @return True if the session can see the resource, all resources are public by default
+     */
+    virtual bool visible_to(const std::string& /* session_id */) const { return true; }
 };
 
 /**
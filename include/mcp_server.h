@@ -14,12 +14,17 @@
 #include "mcp_tool.h"
 #include "mcp_thread_pool.h"
 #include "mcp_logger.h"
+#include "mcp_task.h"
+#include "mcp_registry.h"
+#include "mcp_cancellation.h"
 
 // Include the HTTP library
 #include "httplib.h"
 
 #include <string>
 #include <map>
+#include <unordered_map>
+#include <deque>
 #include <vector>
 #include <memory>
 #include <mutex>
@@ -29,21 +34,30 @@
 #include <condition_variable>
 #include <future>
 #include <atomic>
+#include <exception>
 
 
 namespace mcp {
 
 using method_handler = std::function<json(const json&, const std::string&)>;
 using tool_handler = method_handler;
+using completion_handler = std::function<void(json, std::exception_ptr)>;
+using async_method_handler = std::function<void(const json&, const std::string&, completion_handler)>;
+using async_tool_handler = async_method_handler;
+#ifdef MCP_HAS_COROUTINES
+using coroutine_tool_handler = std::function<task<json>(const json&, const std::string&)>;
+#endif
 using notification_handler = std::function<void(const json&, const std::string&)>;
 using auth_handler = std::function<bool(const std::string&, const std::string&)>;
 using session_cleanup_handler = std::function<void(const std::string&)>;
 
 class event_dispatcher {
 public:
-    event_dispatcher() {
-        message_.reserve(128); // Pre-allocate space for messages
-    }
+    /**
+     * @brief Constructor
+     * @param max_queued Events waiting for the stream; a consumer that falls this far behind is closed
+     */
+    explicit event_dispatcher(size_t max_queued = 1024) : max_queued_(max_queued) {}
     
     ~event_dispatcher() {
         close();
@@ -54,18 +68,12 @@ public:
             return false;
         }
         
-        std::string message_copy;
+        std::deque<std::string> messages;
         {
             std::unique_lock<std::mutex> lk(m_);
             
-            if (closed_.load(std::memory_order_acquire)) {
-                return false;
-            }
-            
-            int id = id_.load(std::memory_order_relaxed);
-            
             bool result = cv_.wait_for(lk, timeout, [&] { 
-                return cid_.load(std::memory_order_relaxed) == id || closed_.load(std::memory_order_acquire); 
+                return !queue_.empty() || closed_.load(std::memory_order_acquire); 
             });
             
             if (closed_.load(std::memory_order_acquire)) {
@@ -76,17 +84,13 @@ public:
                 return false;
             }
             
-            // Only copy the message if there is one
-            if (!message_.empty()) {
-                message_copy.swap(message_);
-            } else {
-                return true; // No message but condition satisfied
-            }
+            // Take every queued message, so events sent back-to-back are not lost
+            messages.swap(queue_);
         }
         
         try {
-            if (!message_copy.empty()) {
-                if (!sink->write(message_copy.data(), message_copy.size())) {
+            for (const auto& message : messages) {
+                if (!sink->write(message.data(), message.size())) {
                     close();
                     return false;
                 }
@@ -98,7 +102,7 @@ public:
         }
     }
 
-    bool send_event(const std::string& message) {
+    bool send_event(std::string message) {
         if (closed_.load(std::memory_order_acquire) || message.empty()) {
             return false;
         }
@@ -110,13 +114,13 @@ public:
                 return false;
             }
             
-            // Efficiently set the message and allocate space as needed
-            if (message.size() > message_.capacity()) {
-                message_.reserve(message.size() + 64); // Pre-allocate extra space to avoid frequent reallocations
+            // The client is not reading, drop the stream rather than buffer without limit
+            if (queue_.size() >= max_queued_) {
+                close();
+                return false;
             }
-            message_ = message;
             
-            cid_.store(id_.fetch_add(1, std::memory_order_relaxed), std::memory_order_relaxed);
+            queue_.push_back(std::move(message));
             cv_.notify_one(); // Notify waiting threads
             return true;
         } catch (...) {
@@ -141,6 +145,12 @@ public:
         return closed_.load(std::memory_order_acquire);
     }
     
+    // Number of events queued and not yet written to the stream
+    size_t pending() const {
+        std::lock_guard<std::mutex> lk(m_);
+        return queue_.size();
+    }
+    
     // Get the last activity time
     std::chrono::steady_clock::time_point last_activity() const {
         std::lock_guard<std::mutex> lk(m_);
@@ -156,13 +166,28 @@ public:
 private:
     mutable std::mutex m_;
     std::condition_variable cv_;
-    std::atomic<int> id_{0};
-    std::atomic<int> cid_{-1};
-    std::string message_;
+    std::deque<std::string> queue_;
+    size_t max_queued_;
     std::atomic<bool> closed_{false};
     std::chrono::steady_clock::time_point last_activity_{std::chrono::steady_clock::now()};
 };
 
+/**
+ * @brief Transport used by the server
+ *
+ * sse: HTTP+SSE transport (2024-11-05). Clients open a GET stream on the SSE
+ * endpoint and every response is delivered through it.
+ *
+ * streamable_http: Streamable HTTP transport (2025-03-26). Clients POST to the
+ * message endpoint and short requests are answered in the POST response body;
+ * requests still running after the direct response timeout are upgraded to a
+ * per-request SSE stream. The SSE endpoint stays available for older clients.
+ */
+enum class transport_mode {
+    sse,
+    streamable_http
+};
+
 /**
  * @class server
  * @brief Main MCP server class
@@ -180,13 +205,15 @@ public:
      * @param version The version of the server
      * @param sse_endpoint The endpoint for server-sent events
      * @param msg_endpoint The endpoint for messages
+     * @param mode The transport to serve on the message endpoint
      */
     server(const std::string& host = "localhost", 
         int port = 8080, 
         const std::string& name = "MCP Server",
         const std::string& version = "0.0.1",
         const std::string& sse_endpoint = "/sse",
-        const std::string& msg_endpoint = "/message");
+        const std::string& msg_endpoint = "/message",
+        transport_mode mode = transport_mode::sse);
     
     /**
      * @brief Destructor
@@ -230,6 +257,14 @@ public:
      * @param handler The function to call when the method is invoked
      */
     void register_method(const std::string& method, method_handler handler);
+
+    /**
+     * @brief Register an asynchronous method handler
+     * @param method The method name
+     * @param handler The function to call when the method is invoked
+     * @note The handler must call the completion handler exactly once, from any thread
+     */
+    void register_method(const std::string& method, async_method_handler handler);
     
     /**
      * @brief Register a notification handler
@@ -245,6 +280,12 @@ public:
      */
     void register_resource(const std::string& path, std::shared_ptr<resource> resource);
     
+    /**
+     * @brief Remove a resource
+     * @param path The path the resource was mounted at
+     */
+    void unregister_resource(const std::string& path);
+    
     /**
      * @brief Register a tool
      * @param tool The tool to register
@@ -252,10 +293,36 @@ public:
      */
     void register_tool(const tool& tool, tool_handler handler);
 
+    /**
+     * @brief Register an asynchronous tool
+     * @param tool The tool to register
+     * @param handler The function to call when the tool is invoked
+     * @note The handler must call the completion handler exactly once, from any thread
+     */
+    void register_tool(const tool& tool, async_tool_handler handler);
+
+#ifdef MCP_HAS_COROUTINES
+    /**
+     * @brief Register a coroutine tool
+     * @param tool The tool to register
+     * @param handler Coroutine returning the tool content
+     * @note The task is started on the calling worker and may resume on any executor thread
+     */
+    void register_tool(const tool& tool, coroutine_tool_handler handler) {
+        register_tool(tool, async_tool_handler([handler](const json& params, const std::string& session_id, completion_handler done) {
+            // Arguments must outlive the coroutine frame, which only holds references to them
+            auto args = std::make_shared<std::pair<json, std::string>>(params, session_id);
+            start_task(handler(args->first, args->second), [args, done](std::optional<json> result, std::exception_ptr error) {
+                done(result ? std::move(*result) : json(), error);
+            });
+        }));
+    }
+#endif
+
     /**
      * @brief Register a session cleanup handler
-     * @param key Tool or resource name to be cleaned up
-     * @param handler The function to call when the session is closed
+     * @param key Tool or resource name to be cleaned up, registering the same key again replaces the handler
+     * @param handler The function to call with the session ID when a session is closed
      */
     void register_session_cleanup(const std::string& key, session_cleanup_handler handler);
     
@@ -289,6 +356,55 @@ public:
      */
     bool set_mount_point(const std::string& mount_point, const std::string& dir, httplib::Headers headers = httplib::Headers());
 
+    /**
+     * @brief Set how long a Streamable HTTP request may run before it is upgraded to an SSE stream
+     * @param timeout Time to wait for a direct response
+     * @note Only used with transport_mode::streamable_http
+     */
+    void set_direct_response_timeout(std::chrono::milliseconds timeout);
+
+    /**
+     * @brief Set the deadline of requests, counted from their arrival
+     * @param timeout Time a request may take, 0 for none
+     * @note Requests past their deadline are answered with error_code::request_timeout,
+     *       handlers see what is left through cancellation_token::remaining()
+     */
+    void set_request_timeout(std::chrono::milliseconds timeout);
+
+    /**
+     * @brief Set the deadline of calls to one tool, overriding set_request_timeout()
+     * @param tool_name Name of the tool
+     * @param timeout Time a call may take, 0 for none
+     */
+    void set_tool_timeout(const std::string& tool_name, std::chrono::milliseconds timeout);
+
+    /**
+     * @brief Limit the work accepted on the message endpoint, 0 for no limit
+     * @param max_queued Requests waiting for a worker
+     * @param max_in_flight Requests accepted and not yet answered
+     * @param max_session_in_flight Requests accepted and not yet answered, per session
+     * @param retry_after Sent in the Retry-After header of rejected requests
+     * @note Requests over a limit are answered at once with HTTP 503 and error_code::server_overloaded,
+     *       notifications are always accepted. The limits are checked without reserving a slot, so
+     *       concurrent requests may go over them by up to the number of HTTP threads
+     */
+    void set_admission_limits(size_t max_queued, size_t max_in_flight, size_t max_session_in_flight,
+                              std::chrono::seconds retry_after = std::chrono::seconds(1));
+
+    /**
+     * @brief Serve metrics in the Prometheus text format
+     * @param endpoint Path of the metrics endpoint
+     * @note Call before start()
+     */
+    void enable_metrics(const std::string& endpoint = "/metrics");
+
+    /**
+     * @brief Record request spans and serve them as Chrome trace-event JSON
+     * @param endpoint Path of the trace endpoint; "?trace_id=N" returns one trace, "?slowest" the slowest request
+     * @note Call before start(). Enables the process-wide tracer.
+     */
+    void enable_tracing(const std::string& endpoint = "/trace");
+
 private:
     std::string host_;
     int port_;
@@ -303,20 +419,46 @@ private:
     std::unique_ptr<std::thread> server_thread_;
 
     // SSE thread
-    std::map<std::string, std::unique_ptr<std::thread>> sse_threads_;
+    sharded_map<std::string, std::unique_ptr<std::thread>> sse_threads_;
 
     // Event dispatcher for server-sent events
     event_dispatcher sse_dispatcher_;
     
     // Session-specific event dispatchers
-    std::map<std::string, std::shared_ptr<event_dispatcher>> session_dispatchers_;
+    sharded_map<std::string, std::shared_ptr<event_dispatcher>> session_dispatchers_;
 
     // Server-sent events endpoint
     std::string sse_endpoint_;
     std::string msg_endpoint_;
+
+    // Transport served on the message endpoint
+    transport_mode mode_;
+
+    // Streamable HTTP: time to wait before upgrading a request to an SSE stream
+    std::chrono::milliseconds direct_response_timeout_{200};
+
+    // Request deadlines, by default and per tool; 0 for none
+    std::chrono::milliseconds request_timeout_{0};
+    std::map<std::string, std::chrono::milliseconds> tool_timeouts_;
+
+    // Admission control; 0 for no limit
+    size_t max_queued_ = 0;
+    size_t max_in_flight_ = 0;
+    size_t max_session_in_flight_ = 0;
+    std::chrono::seconds retry_after_{1};
+
+    // Metrics endpoint, empty when disabled
+    std::string metrics_endpoint_;
+
+    // Trace endpoint, empty when disabled
+    std::string trace_endpoint_;
     
-    // Method handlers
-    std::map<std::string, method_handler> method_handlers_;
+    // Method handlers and tools, published as a whole on registration and read without locking
+    struct dispatch_table {
+        std::unordered_map<std::string, async_method_handler> methods;
+        std::map<std::string, std::pair<tool, async_tool_handler>> tools;
+    };
+    rcu_snapshot<dispatch_table> dispatch_;
     
     // Notification handlers
     std::map<std::string, notification_handler> notification_handlers_;
@@ -324,13 +466,11 @@ private:
     // Resources map (path -> resource)
     std::map<std::string, std::shared_ptr<resource>> resources_;
     
-    // Tools map (name -> handler)
-    std::map<std::string, std::pair<tool, tool_handler>> tools_;
-    
     // Authentication handler
     auth_handler auth_handler_;
     
-    // Mutex for thread safety
+    // Mutex for configuration (server info, resources, notification and cleanup handlers),
+    // sessions and dispatch tables have their own synchronization
     mutable std::mutex mutex_;
     
     // Running flag
@@ -340,7 +480,16 @@ private:
     thread_pool thread_pool_;
     
     // Map to track session initialization status (session_id -> initialized)
-    std::map<std::string, bool> session_initialized_;
+    sharded_map<std::string, bool> session_initialized_;
+
+    // Requests being processed, per session by serialized request ID, so they can be cancelled
+    sharded_map<std::string, std::map<std::string, std::shared_ptr<cancellation_source>>> in_flight_;
+
+    // Requests accepted and not yet answered, across sessions
+    std::atomic<size_t> requests_in_flight_{0};
+
+    // Requests admitted and not yet enqueued, per session
+    sharded_map<std::string, size_t> admitting_;
 
     // Handle SSE requests
     void handle_sse(const httplib::Request& req, httplib::Response& res);
@@ -348,11 +497,48 @@ private:
     // Handle incoming JSON-RPC requests
     void handle_jsonrpc(const httplib::Request& req, httplib::Response& res);
 
+    // Handle Streamable HTTP requests on the message endpoint
+    void handle_streamable_post(const httplib::Request& req, httplib::Response& res);
+    void handle_streamable_get(const httplib::Request& req, httplib::Response& res);
+    void handle_streamable_delete(const httplib::Request& req, httplib::Response& res);
+
+    // Handle metrics scrapes
+    void handle_metrics(const httplib::Request& req, httplib::Response& res);
+
+    // Handle trace exports
+    void handle_trace(const httplib::Request& req, httplib::Response& res);
+
+    // Process a request on the thread pool, carrying the caller's trace context; returns its cancellation source
+    std::shared_ptr<cancellation_source> enqueue_request(const request& req, const std::string& session_id, std::function<void(json)> reply);
+
+    // Check the admission limits for count more requests and reserve room for them until release,
+    // counts the ones shed
+    bool admit(const std::string& session_id, size_t count);
+
+    // Release the room admit reserved, once the requests are enqueued and counted as in flight
+    void release(const std::string& session_id, size_t count);
+
+    // Apply the notifications/cancelled entries of a batch that is not processed
+    void apply_cancellations(const std::string& session_id, const json& batch);
+
+    // Answer a request turned away by admission control
+    void reject_overloaded(httplib::Response& res, const json& id);
+
+    // Deadline budget of a request, 0 for none
+    std::chrono::milliseconds timeout_for(const request& req) const;
+
+    // Cancel the request named by a notifications/cancelled
+    void cancel_request(const std::string& session_id, const json& params);
+
     // Send a JSON-RPC message to a client
     void send_jsonrpc(const std::string& session_id, const json& message);
     
-    // Process a JSON-RPC request
-    json process_request(const request& req, const std::string& session_id);
+    // Process a JSON-RPC request, the response is passed to reply once the handler completes
+    void process_request(const request& req, const std::string& session_id, std::function<void(json)> reply);
+    
+    // Process a JSON-RPC batch concurrently, reply receives the array of responses once every entry completes.
+    // Returns the latest deadline of its requests, time_point::max() if one of them has none
+    std::chrono::steady_clock::time_point process_batch(const json& batch, const std::string& session_id, std::function<void(json)> reply);
     
     // Handle initialization request
     json handle_initialize(const request& req, const std::string& session_id);
@@ -0,0 +1,400 @@
+/**
+ * @file mcp_task.h
+ * @brief Executor and coroutine support for asynchronous handlers
+ *
+ * The executor is always available. The coroutine types (task, sleep_for,
+ * run_blocking, http_get, http_post) are only available when the library is
+ * built as C++20 (MCP_CXX20=ON) and the compiler supports coroutines.
+ */
+
+#ifndef MCP_TASK_H
+#define MCP_TASK_H
+
+#include "mcp_thread_pool.h"
+
+// Include the HTTP library
+#include "httplib.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#define MCP_HAS_COROUTINES 1
+#endif
+
+namespace mcp {
+
+/**
+ * @class executor
+ * @brief Shared scheduler for asynchronous handlers
+ *
+ * Continuations run on a small worker pool, timers fire from a single timer
+ * thread, and blocking calls (HTTP clients, file I/O) run on a separate pool
+ * so that they never hold a worker.
+ */
+class executor {
+public:
+    /**
+     * @brief Get the process-wide executor
+     * @return The executor instance
+     */
+    static executor& instance();
+
+    ~executor();
+
+    /**
+     * @brief Run a short task on the worker pool
+     * @param fn The task to run
+     */
+    void post(std::function<void()> fn);
+
+    /**
+     * @brief Run a short task on the worker pool after a delay
+     * @param delay Time to wait before running the task
+     * @param fn The task to run
+     * @return Identifies the timer for cancel_timer
+     */
+    uint64_t post_after(std::chrono::steady_clock::duration delay, std::function<void()> fn);
+
+    /**
+     * @brief Drop a timer that has not fired, releasing its task
+     * @param id Returned by post_after
+     * @return False if the timer already fired or was cancelled
+     */
+    bool cancel_timer(uint64_t id);
+
+    /**
+     * @brief Run a blocking task on the blocking pool
+     * @param fn The task to run
+     */
+    void post_blocking(std::function<void()> fn);
+
+private:
+    executor();
+
+    void run_timers();
+
+    // Worker pool for continuations
+    thread_pool workers_;
+
+    // Pool for blocking calls
+    thread_pool blocking_;
+
+    // Timer queue, ordered by due time and then by posting order
+    std::mutex timer_mutex_;
+    std::condition_variable timer_cv_;
+    std::map<std::pair<std::chrono::steady_clock::time_point, uint64_t>, std::function<void()>> timers_;
+    std::unordered_map<uint64_t, std::chrono::steady_clock::time_point> timer_due_;
+    uint64_t timer_seq_ = 1;
+    bool stop_ = false;
+    std::thread timer_thread_;
+};
+
+#ifdef MCP_HAS_COROUTINES
+
+template<typename T = void>
+class task;
+
+namespace detail {
+
+struct task_final_awaiter {
+    bool await_ready() const noexcept { return false; }
+
+    template<typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept {
+        auto continuation = h.promise().continuation;
+        return continuation ? continuation : std::noop_coroutine();
+    }
+
+    void await_resume() const noexcept {}
+};
+
+struct task_promise_base {
+    std::coroutine_handle<> continuation;
+    std::exception_ptr error;
+
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    task_final_awaiter final_suspend() const noexcept { return {}; }
+    void unhandled_exception() noexcept { error = std::current_exception(); }
+};
+
+template<typename T>
+struct task_promise : task_promise_base {
+    std::optional<T> value;
+
+    task<T> get_return_object() noexcept;
+
+    template<typename U>
+    void return_value(U&& v) {
+        value.emplace(std::forward<U>(v));
+    }
+
+    T result() {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        return std::move(*value);
+    }
+};
+
+template<>
+struct task_promise<void> : task_promise_base {
+    task<void> get_return_object() noexcept;
+
+    void return_void() const noexcept {}
+
+    void result() {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+};
+
+} // namespace detail
+
+/**
+ * @class task
+ * @brief Lazily started coroutine producing a value of type T
+ *
+ * A task does not run until it is awaited (or handed to start_task). When it
+ * finishes, the awaiting coroutine is resumed on the same thread.
+ */
+template<typename T>
+class task {
+public:
+    using promise_type = detail::task_promise<T>;
+
+    task(task&& other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+
+    task& operator=(task&& other) noexcept {
+        if (this != &other) {
+            if (handle_) {
+                handle_.destroy();
+            }
+            handle_ = std::exchange(other.handle_, {});
+        }
+        return *this;
+    }
+
+    task(const task&) = delete;
+    task& operator=(const task&) = delete;
+
+    ~task() {
+        if (handle_) {
+            handle_.destroy();
+        }
+    }
+
+    bool await_ready() const noexcept {
+        return !handle_ || handle_.done();
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        handle_.promise().continuation = awaiting;
+        return handle_;
+    }
+
+    T await_resume() {
+        return handle_.promise().result();
+    }
+
+private:
+    friend promise_type;
+
+    explicit task(std::coroutine_handle<promise_type> h) noexcept : handle_(h) {}
+
+    std::coroutine_handle<promise_type> handle_;
+};
+
+namespace detail {
+
+template<typename T>
+task<T> task_promise<T>::get_return_object() noexcept {
+    return task<T>(std::coroutine_handle<task_promise<T>>::from_promise(*this));
+}
+
+inline task<void> task_promise<void>::get_return_object() noexcept {
+    return task<void>(std::coroutine_handle<task_promise<void>>::from_promise(*this));
+}
+
+// Fire-and-forget coroutine used to drive a task from non-coroutine code
+struct detached_task {
+    struct promise_type {
+        detached_task get_return_object() const noexcept { return {}; }
+        std::suspend_never initial_suspend() const noexcept { return {}; }
+        std::suspend_never final_suspend() const noexcept { return {}; }
+        void return_void() const noexcept {}
+        void unhandled_exception() const noexcept { std::terminate(); }
+    };
+};
+
+} // namespace detail
+
+/**
+ * @brief Run a task to completion without awaiting it
+ * @param t The task to run
+ * @param on_done Called with the result (empty on error) and the exception, if any
+ * @note on_done must not throw
+ */
+template<typename T, typename F>
+detail::detached_task start_task(task<T> t, F on_done) {
+    static_assert(!std::is_void_v<T>, "start_task requires a task that produces a value");
+
+    std::optional<T> value;
+    std::exception_ptr error;
+    try {
+        value.emplace(co_await t);
+    } catch (...) {
+        error = std::current_exception();
+    }
+    on_done(std::move(value), error);
+}
+
+/**
+ * @class sleep_awaitable
+ * @brief Awaitable that resumes the coroutine on the executor after a delay
+ */
+class sleep_awaitable {
+public:
+    explicit sleep_awaitable(std::chrono::steady_clock::duration delay) : delay_(delay) {}
+
+    bool await_ready() const noexcept {
+        return delay_ <= std::chrono::steady_clock::duration::zero();
+    }
+
+    void await_suspend(std::coroutine_handle<> h) const {
+        executor::instance().post_after(delay_, [h]() { h.resume(); });
+    }
+
+    void await_resume() const noexcept {}
+
+private:
+    std::chrono::steady_clock::duration delay_;
+};
+
+/**
+ * @brief Suspend the calling coroutine without holding a thread
+ * @param delay Time to sleep
+ * @return Awaitable
+ */
+template<typename Rep, typename Period>
+sleep_awaitable sleep_for(const std::chrono::duration<Rep, Period>& delay) {
+    return sleep_awaitable(std::chrono::duration_cast<std::chrono::steady_clock::duration>(delay));
+}
+
+/**
+ * @class blocking_awaitable
+ * @brief Awaitable that runs a blocking call on the executor's blocking pool
+ *
+ * The awaiting coroutine is resumed on the worker pool once the call returns,
+ * so the blocking thread is released immediately.
+ */
+template<typename F>
+class blocking_awaitable {
+    using result_type = std::invoke_result_t<F&>;
+    using storage_type = std::conditional_t<std::is_void_v<result_type>, std::monostate, result_type>;
+
+public:
+    explicit blocking_awaitable(F fn) : fn_(std::move(fn)) {}
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> h) {
+        executor::instance().post_blocking([this, h]() {
+            try {
+                if constexpr (std::is_void_v<result_type>) {
+                    fn_();
+                    result_.emplace();
+                } else {
+                    result_.emplace(fn_());
+                }
+            } catch (...) {
+                error_ = std::current_exception();
+            }
+            executor::instance().post([h]() { h.resume(); });
+        });
+    }
+
+    result_type await_resume() {
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+        if constexpr (!std::is_void_v<result_type>) {
+            return std::move(*result_);
+        }
+    }
+
+private:
+    F fn_;
+    std::optional<storage_type> result_;
+    std::exception_ptr error_;
+};
+
+/**
+ * @brief Run a blocking call without holding a worker thread
+ * @param fn The call to run
+ * @return Awaitable producing the call's result
+ */
+template<typename F>
+blocking_awaitable<F> run_blocking(F fn) {
+    return blocking_awaitable<F>(std::move(fn));
+}
+
+/*
+ * http_get and http_post are not non-blocking I/O: each call makes a blocking
+ * httplib request on the blocking pool, which frees the worker but holds a
+ * blocking thread until the response arrives. At most as many calls as the
+ * pool has threads (at least 8, 4 per core) are in flight, and slow backends
+ * delay the other blocking work queued behind them. Bound the number of
+ * concurrent calls to a slow backend, e.g. with a rate limiter.
+ */
+
+/**
+ * @brief Awaitable HTTP GET
+ * @param base_url Scheme, host and port (e.g., "http://localhost:11434")
+ * @param path Request path
+ * @param headers Request headers
+ * @return Awaitable producing the httplib result
+ */
+inline auto http_get(const std::string& base_url, const std::string& path, const httplib::Headers& headers = {}) {
+    return run_blocking([base_url, path, headers]() {
+        httplib::Client client(base_url);
+        return client.Get(path, headers);
+    });
+}
+
+/**
+ * @brief Awaitable HTTP POST
+ * @param base_url Scheme, host and port (e.g., "https://api.replicate.com")
+ * @param path Request path
+ * @param headers Request headers
+ * @param body Request body
+ * @param content_type Content type of the body
+ * @return Awaitable producing the httplib result
+ */
+inline auto http_post(const std::string& base_url, const std::string& path, const httplib::Headers& headers,
+                      const std::string& body, const std::string& content_type = "application/json") {
+    return run_blocking([base_url, path, headers, body, content_type]() {
+        httplib::Client client(base_url);
+        return client.Post(path, headers, body, content_type);
+    });
+}
+
+#endif // MCP_HAS_COROUTINES
+
+} // namespace mcp
+
+#endif // MCP_TASK_H
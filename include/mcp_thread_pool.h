@@ -42,9 +42,12 @@ public:
                         
                         task = std::move(tasks_.front());
                         tasks_.pop();
+                        pending_.fetch_sub(1, std::memory_order_relaxed);
                     }
                     
+                    active_.fetch_add(1, std::memory_order_relaxed);
                     task();
+                    active_.fetch_sub(1, std::memory_order_relaxed);
                 }
             });
         }
@@ -92,12 +95,34 @@ public:
             }
             
             tasks_.emplace([task]() { (*task)(); });
+            pending_.fetch_add(1, std::memory_order_relaxed);
         }
         
         condition_.notify_one();
         return result;
     }
     
+    /**
+     * @brief Number of worker threads
+     */
+    size_t size() const {
+        return workers_.size();
+    }
+    
+    /**
+     * @brief Number of tasks waiting for a worker
+     */
+    size_t pending() const {
+        return pending_.load(std::memory_order_relaxed);
+    }
+    
+    /**
+     * @brief Number of workers currently running a task
+     */
+    size_t active() const {
+        return active_.load(std::memory_order_relaxed);
+    }
+    
 private:
     // Worker threads
     std::vector<std::thread> workers_;
@@ -111,6 +136,10 @@ private:
     
     // Stop flag
     std::atomic<bool> stop_;
+    
+    // Queue depth and busy workers, for metrics
+    std::atomic<size_t> pending_{0};
+    std::atomic<size_t> active_{0};
 };
 
 } // namespace mcp
@@ -0,0 +1,231 @@
+/**
+ * @file mcp_tracing.h
+ * @brief Request tracing with spans exported as Chrome trace-event JSON
+ *
+ * Each thread keeps its current span in a thread-local context, so scoped
+ * spans nest without locking and a span opened inside a handler becomes a
+ * child of the request it runs for. Work handed to another thread carries
+ * the context explicitly (trace_scope). Completed spans go into a per-thread
+ * ring buffer that only the exporter reads. When tracing is disabled a span
+ * costs one relaxed atomic load.
+ */
+
+#ifndef MCP_TRACING_H
+#define MCP_TRACING_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace mcp {
+
+// Position in a trace: the trace a span belongs to and the span itself
+struct trace_context {
+    uint64_t trace_id = 0;
+    uint64_t span_id = 0;
+
+    bool valid() const {
+        return trace_id != 0;
+    }
+};
+
+// A completed span
+struct span_record {
+    const char* name = "";
+    std::string detail;
+    uint64_t trace_id = 0;
+    uint64_t span_id = 0;
+    uint64_t parent_id = 0;
+    int64_t start_ns = 0;
+    int64_t end_ns = 0;
+    uint32_t thread = 0;
+};
+
+namespace detail {
+struct trace_buffer;
+struct buffer_holder;
+} // namespace detail
+
+/**
+ * @class tracer
+ * @brief Process-wide span collector
+ */
+class tracer {
+public:
+    /**
+     * @brief Get the process-wide tracer
+     * @return The tracer instance
+     */
+    static tracer& instance();
+
+    /**
+     * @brief Check whether spans are recorded
+     * @return True if tracing is enabled
+     */
+    static bool enabled() {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Start or stop recording spans
+     * @param enabled True to record spans
+     * @param capacity Spans kept per thread (the oldest are overwritten), used for buffers created afterwards
+     */
+    void set_enabled(bool enabled, size_t capacity = 4096);
+
+    /**
+     * @brief Nanoseconds since the tracer epoch
+     */
+    static int64_t now();
+
+    /**
+     * @brief Get the calling thread's current context
+     * @return The context, invalid if no span is open on this thread
+     */
+    static trace_context current();
+
+    /**
+     * @brief Allocate a span id
+     */
+    static uint64_t next_id();
+
+    /**
+     * @brief Store a completed span in the calling thread's buffer
+     * @param record The span
+     */
+    void record(span_record&& record);
+
+    /**
+     * @brief Copy the buffered spans
+     * @param trace_id Only return spans of this trace, 0 for all
+     * @return The spans, ordered by start time
+     */
+    std::vector<span_record> snapshot(uint64_t trace_id = 0) const;
+
+    /**
+     * @brief Render spans in the Chrome trace-event format
+     * @param spans The spans
+     * @return JSON document for chrome://tracing or Perfetto
+     */
+    static std::string to_chrome_json(const std::vector<span_record>& spans);
+
+    /**
+     * @brief Drop every buffered span
+     */
+    void clear();
+
+private:
+    friend struct detail::buffer_holder;
+
+    tracer() = default;
+
+    // The calling thread's buffer, created on first use
+    detail::trace_buffer& local_buffer();
+
+    // Hand the buffer of an exiting thread to the next new thread
+    void retire(const std::shared_ptr<detail::trace_buffer>& buffer);
+
+    inline static std::atomic<bool> enabled_{false};
+
+    std::atomic<size_t> capacity_{4096};
+
+    // Every buffer ever created; retired buffers are reused by new threads
+    mutable std::mutex mutex_;
+    std::vector<std::shared_ptr<detail::trace_buffer>> buffers_;
+    std::vector<std::shared_ptr<detail::trace_buffer>> retired_;
+    uint32_t next_thread_ = 1;
+};
+
+/**
+ * @class span
+ * @brief Span covering a scope on the calling thread
+ *
+ * The span becomes the thread's current context until it ends, so spans
+ * opened inside it are its children.
+ */
+class span {
+public:
+    /**
+     * @brief Open a span
+     * @param name Span name, must outlive the process (a string literal)
+     * @param detail Extra text shown with the span (e.g., a method or tool name)
+     */
+    explicit span(const char* name, const std::string& detail = std::string());
+
+    ~span() {
+        end();
+    }
+
+    span(const span&) = delete;
+    span& operator=(const span&) = delete;
+
+    /**
+     * @brief Close the span before the end of the scope
+     */
+    void end();
+
+private:
+    bool active_ = false;
+    trace_context previous_;
+    span_record record_;
+};
+
+/**
+ * @class async_span
+ * @brief Span that may end on another thread
+ *
+ * Unlike span it does not change the current context; use trace_scope with
+ * context() to make it the parent of work done on its behalf.
+ */
+class async_span {
+public:
+    async_span() = default;
+
+    /**
+     * @brief Open a span as a child of the calling thread's current context
+     * @param name Span name, must outlive the process (a string literal)
+     * @param detail Extra text shown with the span
+     */
+    explicit async_span(const char* name, const std::string& detail = std::string());
+
+    /**
+     * @brief Get the context for children of this span
+     * @return The span's context, invalid if tracing was disabled when it was opened
+     */
+    trace_context context() const {
+        return {record_.trace_id, record_.span_id};
+    }
+
+    /**
+     * @brief Close the span, later calls do nothing
+     */
+    void end();
+
+private:
+    bool active_ = false;
+    span_record record_;
+};
+
+/**
+ * @class trace_scope
+ * @brief Makes a context current on the calling thread for a scope
+ */
+class trace_scope {
+public:
+    explicit trace_scope(const trace_context& context);
+    ~trace_scope();
+
+    trace_scope(const trace_scope&) = delete;
+    trace_scope& operator=(const trace_scope&) = delete;
+
+private:
+    bool active_ = false;
+    trace_context previous_;
+};
+
+} // namespace mcp
+
+#endif // MCP_TRACING_H
@@ -0,0 +1,190 @@
+/**
+* @file blob_store.h
+* @brief Content-addressed image cache on disk: background downloads, size-bounded LRU, MCP resources
+* @date 2026-10-19 Monday
+*/
+
+#ifndef BLOB_STORE_H
+#define BLOB_STORE_H
+
+#include "mcp_resource.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace blob {
+
+    /**
+    * @brief SHA-256 of some bytes
+    * @param bytes The content
+    * @return 64 lowercase hex digits
+    */
+    std::string content_hash(std::string_view bytes);
+
+    // MIME type from the leading bytes (PNG, JPEG, WebP, GIF), application/octet-stream otherwise
+    std::string sniff_mime(std::string_view bytes);
+
+    // largest image downloaded, whatever the store's capacity
+    const uint64_t max_image_bytes = 20ull << 20;
+
+    /**
+    * @brief Download an image. Only public hosts are contacted: every address the host
+    * resolves to is checked, and the connection goes to a checked one, so a URL
+    * cannot reach loopback, private networks or the cloud metadata service.
+    * @param url http or https URL, redirects are followed and checked the same way
+    * @param max_bytes Larger bodies are rejected, by their Content-Length before any of it is read
+    * @return The body
+    * @throws std::runtime_error if the download fails, the host is not public or the response is not an image
+    */
+    std::string download(const std::string& url, uint64_t max_bytes);
+
+    /**
+    * @brief Blobs stored as files named by their hash. The least recently used
+    * unpinned blobs are deleted once the total size goes over the capacity.
+    * Survives restarts: the index is rebuilt from the directory.
+    */
+    class BlobStore{
+    private:
+        struct Entry{
+            uint64_t size;
+            // position in lru
+            std::list<std::string>::iterator position;
+            size_t pins = 0;
+        };
+
+        std::string directory;
+        uint64_t capacity;
+
+        std::mutex mutex;
+        std::condition_variable idle;
+        // most recently used first
+        std::list<std::string> lru;
+        std::unordered_map<std::string, Entry> entries;
+        uint64_t used = 0;
+        // source URL -> hash of what it served
+        std::unordered_map<std::string, std::string> sources;
+        // URLs being downloaded in the background
+        std::unordered_set<std::string> in_flight;
+
+        std::function<void(const std::string&, const std::string&)> on_add;
+        std::function<void(const std::string&)> on_evict;
+
+        std::string path_for(const std::string& hash) const;
+        // move an entry to the front, caller holds mutex
+        void touch(Entry& entry);
+        // delete blobs until the store fits, caller holds mutex
+        std::vector<std::string> evict();
+
+    public:
+        /**
+        * @brief Open or create a store
+        * @param directory Directory for the blobs, created if missing
+        * @param capacity Total size in bytes
+        * @throws std::runtime_error if the directory cannot be created
+        */
+        BlobStore(const std::string& directory, uint64_t capacity);
+
+        // waits for background downloads
+        ~BlobStore();
+
+        BlobStore(const BlobStore&) = delete;
+        BlobStore& operator=(const BlobStore&) = delete;
+
+        /**
+        * @brief Store bytes, a no-op if the content is already there
+        * @param bytes The content
+        * @param url Where it came from, empty if unknown
+        * @return The content hash
+        */
+        std::string put(std::string_view bytes, const std::string& url = "");
+
+        /**
+        * @brief Read a blob and mark it used
+        * @param hash Content hash
+        * @param bytes Receives the content
+        * @return false if the blob is not stored
+        */
+        bool get(const std::string& hash, std::string& bytes);
+
+        // hash of what a URL served, empty if it is not cached
+        std::string lookup(const std::string& url);
+
+        /**
+        * @brief Get a URL's content hash, downloading it if needed
+        * @param url Image URL
+        * @return The content hash
+        * @throws std::runtime_error if the download fails
+        */
+        std::string fetch(const std::string& url);
+
+        /**
+        * @brief Download a URL on the executor's blocking pool, unless it is cached
+        * or already being downloaded. Failures are logged.
+        * @param url Image URL
+        */
+        void prefetch(const std::string& url);
+
+        // a pinned blob is never evicted
+        void pin(const std::string& hash);
+        void unpin(const std::string& hash);
+
+        /**
+        * @brief Set the callbacks for blobs added and evicted, called without the store's lock
+        * @param added Called with the hash and source URL of a new blob, and again when another URL serves a stored one
+        * @param evicted Called with the hash of a deleted blob
+        */
+        void set_callbacks(std::function<void(const std::string&, const std::string&)> added,
+            std::function<void(const std::string&)> evicted);
+
+        // hashes of the stored blobs, most recently used first
+        std::vector<std::string> hashes();
+
+        // total size of the stored blobs in bytes
+        uint64_t size();
+    };
+
+    /**
+    * @brief MCP binary resource backed by a blob, read from disk on each read.
+    * Only the sessions it was shared with can list and read it, users' photos stay theirs.
+    */
+    class BlobResource : public mcp::resource{
+    private:
+        // the store outlives the server the resource is registered with
+        BlobStore& store;
+        std::string hash;
+        std::string name;
+
+        mutable std::mutex mutex;
+        std::unordered_set<std::string> sessions;
+        // visible to every session
+        bool shared = false;
+
+    public:
+        BlobResource(BlobStore& store, const std::string& hash, const std::string& name);
+
+        // let a session see the blob, every session if session_id is empty
+        void allow(const std::string& session_id);
+        // forget a closed session
+        void revoke(const std::string& session_id);
+
+        // "blob://<hash>"
+        static std::string uri_for(const std::string& hash);
+
+        mcp::json get_metadata() const override;
+        mcp::json read() const override;
+        bool is_modified() const override { return false; }
+        std::string get_uri() const override { return uri_for(hash); }
+        bool visible_to(const std::string& session_id) const override;
+    };
+
+}
+
+#endif // BLOB_STORE_H
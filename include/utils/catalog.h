@@ -0,0 +1,309 @@
+/**
+* @file catalog.h
+* @brief In-memory garment catalog, reloaded in the background and published with an atomic swap
+* @date 2026-10-19 Monday
+*/
+
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include "utils/csv_parser.h"
+#include "utils/catalog_filter.h"
+#include "utils/catalog_segment.h"
+#include "utils/lexical_index.h"
+#include "mcp_registry.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace csv {
+
+    // similarity used to rank vectors, higher is better for all of them
+    enum class Metric{
+        Cosine,
+        // raw inner product, depends on vector magnitude
+        Dot,
+        // scored as the negative Euclidean distance
+        L2
+    };
+
+    // "cosine", "dot" or "l2"
+    const char* metric_name(Metric metric);
+
+    /**
+    * @brief Parse a metric name
+    * @param name "cosine", "dot" or "l2"
+    * @return The metric
+    * @throws std::invalid_argument for other names
+    */
+    Metric parse_metric(const std::string& name);
+
+    // row added or replaced after the main segment was built
+    struct DeltaRow{
+        uint64_t seq;
+        CSVRow row;
+    };
+
+    /**
+    * @brief Immutable version of the catalog. Searches hold a shared_ptr to it,
+    * so a reload never changes a catalog that a search is still reading.
+    *
+    * A version is the main segment plus the changes made since it was built:
+    * an append-only delta of upserted rows and tombstones of deleted ids, both
+    * tagged with a sequence number. For each id the change with the highest
+    * sequence number wins over the main segment.
+    */
+    class Catalog{
+    private:
+        std::shared_ptr<const Segment> main;
+        std::vector<DeltaRow> delta;
+        // deleted id -> seq of the delete
+        std::unordered_map<int, uint64_t> tombstones;
+        // highest seq applied to this version
+        uint64_t last_seq = 0;
+        std::string source;
+        uint64_t version = 0;
+
+        // derived on construction: delta rows still visible, ids hidden in the main segment
+        std::vector<size_t> live_delta;
+        std::unordered_set<int> shadowed;
+        size_t live_rows = 0;
+
+        // scored row of the main segment or the delta, resolved to a CSVRow only if it makes the top k
+        struct Hit{
+            size_t index;
+            bool in_delta;
+            double score;
+        };
+        // scored rows, best first
+        using Ranked = std::vector<Hit>;
+
+        // parse the filter and evaluate it over the main segment, nullptr if there is none
+        std::unique_ptr<Filter> select(const std::string& filter, Bitmap& selected) const;
+        // whether main segment row i is visible and selected
+        bool is_live(size_t i, const Filter* filter, const Bitmap& selected) const;
+        Ranked rank_vector(const std::vector<double>& query_vector, Metric metric, const Filter* filter,
+            const Bitmap& selected, size_t n) const;
+        Ranked rank_lexical(const std::string& text, const Filter* filter, const Bitmap& selected, size_t n) const;
+        static Ranked top(Ranked candidates, size_t n);
+        std::vector<CSVRow> to_rows(const Ranked& ranked) const;
+
+    public:
+        // empty catalog, version 0
+        Catalog();
+
+        // constructor
+        Catalog(std::vector<CSVRow> rows, const std::string& source, uint64_t version,
+            const std::vector<std::string>& attribute_names = {});
+
+        // constructor from a main segment and the changes on top of it
+        Catalog(std::shared_ptr<const Segment> main, std::vector<DeltaRow> delta,
+            std::unordered_map<int, uint64_t> tombstones, uint64_t last_seq,
+            const std::string& source, uint64_t version);
+
+        /**
+        * @brief Parse a catalog file
+        * @param filepath Path to the CSV file
+        * @param version Version number of the new catalog
+        * @return The catalog
+        * @throws std::runtime_error if the file cannot be read or has no rows
+        */
+        static std::shared_ptr<const Catalog> load(const std::string& filepath, uint64_t version);
+
+        /**
+        * @brief Score every row against the query and return the best k. Rows
+        * that do not match the filter are skipped before they are scored, rows
+        * whose vector has another dimension are never returned.
+        * @param query_vector Query vector from ollama
+        * @param k Number of results
+        * @param filter Filter expression over the attribute columns, empty for none
+        * @param metric Similarity to rank by
+        * @return Top-k rows with scores, best first; vectors are left empty
+        * @throws std::invalid_argument if the filter does not parse
+        * @throws mcp::mcp_exception if the calling request is cancelled during the scan
+        */
+        std::vector<CSVRow> search(const std::vector<double>& query_vector, int k, const std::string& filter = "",
+            Metric metric = Metric::Cosine) const;
+
+        /**
+        * @brief BM25 search over descriptions and filenames, needs no embedding
+        * @param text Query text
+        * @param k Number of results
+        * @param filter Filter expression over the attribute columns, empty for none
+        * @return Top-k rows that contain a query term, best first, scored by BM25; vectors are left empty
+        * @throws std::invalid_argument if the filter does not parse
+        */
+        std::vector<CSVRow> search_lexical(const std::string& text, int k, const std::string& filter = "") const;
+
+        /**
+        * @brief Vector and BM25 search fused with reciprocal rank fusion
+        * @param query_vector Query vector from ollama
+        * @param text Query text
+        * @param k Number of results
+        * @param filter Filter expression over the attribute columns, empty for none
+        * @param metric Similarity for the vector ranking
+        * @return Top-k rows, best first, scored by fused rank; vectors are left empty
+        * @throws std::invalid_argument if the filter does not parse
+        * @throws mcp::mcp_exception if the calling request is cancelled during the scan
+        */
+        std::vector<CSVRow> search_hybrid(const std::vector<double>& query_vector, const std::string& text, int k,
+            const std::string& filter = "", Metric metric = Metric::Cosine) const;
+
+        /**
+        * @brief Copy of the visible rows, with changes applied
+        * @return Every live row, main segment first
+        */
+        std::vector<CSVRow> rows() const;
+
+        /**
+        * @brief Whether an id has a visible row
+        * @param id Garment id
+        * @return true if a search can return it
+        */
+        bool contains(int id) const;
+
+        // dimension of the catalog's vectors, 0 if empty
+        size_t dimension() const;
+
+        // names of the attribute columns
+        std::vector<std::string> attribute_names() const;
+
+        // number of changes waiting to be compacted into the main segment
+        size_t pending_changes() const { return delta.size() + tombstones.size(); }
+
+        size_t size() const { return live_rows; }
+        const std::string& get_source() const { return source; }
+        uint64_t get_version() const { return version; }
+        uint64_t get_last_seq() const { return last_seq; }
+        const std::shared_ptr<const Segment>& get_main() const { return main; }
+        const std::vector<DeltaRow>& get_delta() const { return delta; }
+        const std::unordered_map<int, uint64_t>& get_tombstones() const { return tombstones; }
+    };
+
+    /**
+    * @brief Owns the current catalog. Reloads build the new version off the
+    * request path; readers switch to it on their next call to current().
+    */
+    class CatalogStore{
+    private:
+        std::string filepath;
+        mcp::rcu_snapshot<Catalog> catalog;
+        std::atomic<uint64_t> next_version{1};
+        uint64_t next_seq = 1;
+
+        // one writer at a time: reloads, mutations and compaction publishes
+        std::mutex reload_mutex;
+
+        // compaction; compacting is cleared under compaction_mutex
+        size_t compaction_threshold = 1024;
+        std::atomic<bool> compacting{false};
+        std::mutex compaction_mutex;
+        std::condition_variable compaction_done;
+
+        // file watcher
+        std::thread watcher;
+        std::atomic<bool> watching{false};
+
+        // watcher loops, inotify returns false if it cannot be set up
+        bool watch_inotify();
+        void watch_polling();
+
+        // publish a copy of the current version with its changes replaced, caller holds reload_mutex
+        std::shared_ptr<const Catalog> publish_changes(const Catalog& base, std::vector<DeltaRow> delta,
+            std::unordered_map<int, uint64_t> tombstones);
+
+        // start a background compaction if enough changes have piled up
+        void maybe_compact(const Catalog& latest);
+
+        // threshold, max when disabled
+        size_t get_compaction_threshold();
+
+    public:
+        // constructor, does not load
+        explicit CatalogStore(const std::string& filepath);
+
+        // stops the watcher
+        ~CatalogStore();
+
+        CatalogStore(const CatalogStore&) = delete;
+        CatalogStore& operator=(const CatalogStore&) = delete;
+
+        /**
+        * @brief Get the current catalog
+        * @return The catalog, valid for as long as the caller holds it
+        */
+        std::shared_ptr<const Catalog> current() const;
+
+        /**
+        * @brief Build a new catalog from the file and publish it. Changes made
+        * through upsert() and remove() are dropped, the file is the source of truth.
+        * @param new_filepath File to load from now on, empty to reload the current file
+        * @return The published catalog
+        * @throws std::runtime_error if loading fails; the current catalog stays published
+        */
+        std::shared_ptr<const Catalog> reload(const std::string& new_filepath = "");
+
+        /**
+        * @brief Reload on the executor's blocking pool
+        * @param done Called with the published catalog, or with the error
+        * @param new_filepath File to load from now on, empty to reload the current file
+        */
+        void reload_async(std::function<void(std::shared_ptr<const Catalog>, std::exception_ptr)> done,
+            const std::string& new_filepath = "");
+
+        /**
+        * @brief Add rows, replacing any visible rows with the same ids
+        * @param rows Rows to add; their vectors must match the catalog's dimension
+        * @return The published catalog
+        * @throws std::invalid_argument if a vector has the wrong dimension
+        */
+        std::shared_ptr<const Catalog> upsert(const std::vector<CSVRow>& rows);
+
+        /**
+        * @brief Delete rows by id
+        * @param ids Garment ids, ids that are not in the catalog are ignored
+        * @return The published catalog
+        */
+        std::shared_ptr<const Catalog> remove(const std::vector<int>& ids);
+
+        /**
+        * @brief Merge the pending changes into a new main segment. The merge
+        * runs without blocking writers; changes made meanwhile are carried over.
+        * @return The published catalog, or the current one if there was nothing to do
+        */
+        std::shared_ptr<const Catalog> compact();
+
+        /**
+        * @brief Set how many pending changes trigger a background compaction
+        * @param threshold Number of delta rows and tombstones, 0 disables it
+        */
+        void set_compaction_threshold(size_t threshold);
+
+        /**
+        * @brief Reload whenever the catalog file is rewritten or replaced
+        * (inotify on Linux, modification time polling elsewhere)
+        */
+        void watch();
+
+        /**
+        * @brief Stop the file watcher
+        */
+        void stop_watching();
+
+        // current file path
+        std::string get_filepath();
+    };
+
+}
+
+#endif // CATALOG_H
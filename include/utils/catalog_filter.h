@@ -0,0 +1,146 @@
+/**
+* @file catalog_filter.h
+* @brief Typed attribute columns and filter expressions evaluated as bitmaps during the catalog scan
+* @date 2026-10-19 Monday
+*/
+
+#ifndef CATALOG_FILTER_H
+#define CATALOG_FILTER_H
+
+#include "utils/csv_parser.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace csv {
+
+    enum class AttributeType{
+        Number,
+        String
+    };
+
+    /**
+    * @brief One attribute of the main segment, stored column-wise. Strings
+    * are dictionary encoded (lowercased), numbers are NaN where missing.
+    */
+    struct AttributeColumn{
+        std::string name;
+        AttributeType type = AttributeType::String;
+        std::vector<double> numbers;
+        // index into dictionary, -1 where missing
+        std::vector<int32_t> codes;
+        std::vector<std::string> dictionary;
+
+        /**
+        * @brief Build the columns of a segment. A column is a number column if
+        * every non-empty value parses as a number, otherwise a string column.
+        * @param names Attribute names, in the order of CSVRow::attributes
+        * @param rows Rows of the segment
+        * @return One column per name
+        */
+        static std::vector<AttributeColumn> build(const std::vector<std::string>& names, const std::vector<CSVRow>& rows);
+    };
+
+    /**
+    * @brief Fixed-size set of row indices
+    */
+    class Bitmap{
+    private:
+        std::vector<uint64_t> words;
+        size_t bits = 0;
+
+    public:
+        Bitmap() = default;
+
+        // constructor, every bit set to value
+        Bitmap(size_t bits, bool value);
+
+        void set(size_t i) { words[i >> 6] |= uint64_t(1) << (i & 63); }
+        bool test(size_t i) const { return (words[i >> 6] >> (i & 63)) & 1; }
+        size_t size() const { return bits; }
+        size_t count() const;
+
+        Bitmap& operator&=(const Bitmap& other);
+        Bitmap& operator|=(const Bitmap& other);
+        // complement, bits past size() stay clear
+        void flip();
+
+        // index of the lowest set bit of a non-zero word
+        static size_t lowest_bit(uint64_t word){
+#if defined(__GNUC__) || defined(__clang__)
+            return static_cast<size_t>(__builtin_ctzll(word));
+#else
+            size_t n = 0;
+            while (!(word & 1)){
+                word >>= 1;
+                n++;
+            }
+            return n;
+#endif
+        }
+
+        /**
+        * @brief Call fn with the index of every set bit, in order
+        */
+        template <typename F>
+        void for_each(F&& fn) const {
+            for (size_t w = 0; w < words.size(); w++){
+                uint64_t word = words[w];
+                while (word){
+                    fn((w << 6) + lowest_bit(word));
+                    word &= word - 1;
+                }
+            }
+        }
+    };
+
+    /**
+    * @brief Parsed filter expression, bound to the attribute columns it was parsed against.
+    *
+    * Grammar (keywords are case-insensitive, string comparisons too):
+    *   expr       := term ("OR" term)*
+    *   term       := factor ("AND" factor)*
+    *   factor     := "NOT" factor | "(" expr ")" | comparison
+    *   comparison := name op value | name "IN" "(" value ("," value)* ")"
+    *   op         := "=" | "!=" | "<" | "<=" | ">" | ">="
+    *   value      := number | 'quoted' | "quoted" | bare_word
+    * e.g. category = lower_body AND price < 50 AND color IN (blue, black)
+    */
+    class Filter{
+    public:
+        struct Node;
+
+        /**
+        * @brief Parse an expression
+        * @param expression The filter expression
+        * @param columns Columns the names refer to
+        * @return The filter
+        * @throws std::invalid_argument on syntax errors, unknown names, or ordering comparisons on strings
+        */
+        static Filter parse(const std::string& expression, const std::vector<AttributeColumn>& columns);
+
+        /**
+        * @brief Evaluate over whole columns
+        * @param columns Columns of the segment, same schema as at parse time
+        * @param rows Number of rows in the segment
+        * @return Bitmap of the matching rows
+        */
+        Bitmap evaluate(const std::vector<AttributeColumn>& columns, size_t rows) const;
+
+        /**
+        * @brief Evaluate on a single row that is not in the columns (delta rows)
+        * @param columns Columns of the segment, for the attribute types
+        * @param row The row, attributes in column order
+        * @return true if the row matches
+        */
+        bool matches(const std::vector<AttributeColumn>& columns, const CSVRow& row) const;
+
+    private:
+        std::shared_ptr<const Node> root;
+    };
+
+}
+
+#endif // CATALOG_FILTER_H
@@ -0,0 +1,108 @@
+/**
+* @file catalog_segment.h
+* @brief Columnar main segment of the catalog: aligned float matrix, id column, string arena
+* @date 2026-10-19 Monday
+*/
+
+#ifndef CATALOG_SEGMENT_H
+#define CATALOG_SEGMENT_H
+
+#include "utils/csv_parser.h"
+#include "utils/catalog_filter.h"
+#include "utils/lexical_index.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace csv {
+
+    // text fields of a row, stored as offset columns into the arena
+    enum class TextField{
+        Fname = 0,
+        Link,
+        Desc
+    };
+
+    /**
+    * @brief Immutable main segment, laid out for the scan. Embeddings live in
+    * one contiguous float matrix, everything else in columns that are only
+    * read for the rows a search returns.
+    */
+    class Segment{
+    private:
+        size_t count = 0;
+        size_t dim = 0;
+        // floats per matrix row, padded so that every row starts on a 64-byte boundary
+        size_t row_stride = 0;
+        // the matrix comes from aligned operator new, which needs the matching delete
+        struct AlignedDelete{
+            void operator()(float* data) const;
+        };
+        std::unique_ptr<float[], AlignedDelete> matrix;
+
+        std::vector<int> row_ids;
+
+        // every text and attribute value, column after column
+        std::string arena;
+        // per text field, then per attribute: count + 1 offsets into the arena
+        std::vector<std::vector<uint64_t>> offsets;
+
+        // embedding models, interned
+        std::vector<std::string> models;
+        std::vector<uint32_t> model_codes;
+
+        // rows whose dimension differs from the segment's, kept as loaded and never ranked
+        std::unordered_map<size_t, std::vector<double>> odd_vectors;
+
+        std::string_view column_text(size_t column, size_t i) const;
+
+    public:
+        // length of each vector as loaded, keeps dot and L2 exact
+        std::vector<double> norms;
+        // matrix rows are unit length
+        bool normalized = false;
+        // number of rows per id
+        std::unordered_map<int, size_t> ids;
+        // attributes of the rows, typed for filtering
+        std::vector<AttributeColumn> columns;
+        // BM25 index over desc and fname
+        LexicalIndex lexical;
+
+        // constructor, takes the rows apart into columns
+        Segment(std::vector<CSVRow> rows, const std::vector<std::string>& attribute_names);
+
+        Segment(const Segment&) = delete;
+        Segment& operator=(const Segment&) = delete;
+
+        size_t size() const { return count; }
+        size_t dimension() const { return dim; }
+        size_t stride() const { return row_stride; }
+
+        /**
+        * @brief Unit vector of a row
+        * @param i Row index
+        * @return dimension() floats, 64-byte aligned, or nullptr if the row has another dimension
+        */
+        const float* vector(size_t i) const;
+
+        int id(size_t i) const { return row_ids[i]; }
+        std::string_view text(TextField field, size_t i) const { return column_text(static_cast<size_t>(field), i); }
+        std::string_view attribute(size_t column, size_t i) const { return column_text(3 + column, i); }
+        const std::string& embedding_model(size_t i) const { return models[model_codes[i]]; }
+
+        /**
+        * @brief Copy a row out of the columns
+        * @param i Row index
+        * @param with_vector Also copy the vector, scaled back to its loaded length
+        * @return The row, with an empty vector unless asked for
+        */
+        CSVRow row(size_t i, bool with_vector) const;
+    };
+
+}
+
+#endif // CATALOG_SEGMENT_H
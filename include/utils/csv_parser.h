@@ -5,6 +5,9 @@
 * @date 2025-06-23 17:04:26 Monday
 */
 
+#ifndef CSV_PARSER_H
+#define CSV_PARSER_H
+
 #include <string>
 #include <vector>
 
@@ -19,6 +22,8 @@ namespace csv {
         std::string embedding_model;
         std::vector<double> vector;
         double score;
+        // extra columns after the vector (category, price, ...), in header order
+        std::vector<std::string> attributes;
 
 
         // Struct constructor
@@ -44,6 +49,13 @@ namespace csv {
     */
     std::vector<CSVRow> parse_csv(const std::string& filepath);
 
+    /**
+    * @brief Reads the names of the attribute columns from the header
+    * @param filepath The string input to the path of the file
+    * @return Names of the columns after the vector column
+    */
+    std::vector<std::string> parse_attribute_names(const std::string& filepath);
+
     /**
     * @brief Reads a line in a CSV
     * @param line The string input
@@ -68,9 +80,10 @@ namespace csv {
     /**
     * @brief Converts dataset to a json string
     * @param dataset the incoming dataset (most likely going to be a subset from the get_top_k func)
-    * @return returns a json string
+    * @param attribute_names names of the rows' attributes, empty to leave attributes out
+    * @return returns a compact json string, descriptions and links escaped
     */
-    std::string dataset_to_json(const std::vector<CSVRow>& dataset);
+    std::string dataset_to_json(const std::vector<CSVRow>& dataset, const std::vector<std::string>& attribute_names = {});
 
    /**
    * @brief Gets top-k sorted results
@@ -80,4 +93,6 @@ namespace csv {
    */
    std::vector<CSVRow> get_top_k(std::vector<CSVRow>& dataset, int k=5);
 
-}
\ No newline at end of file
+}
+
+#endif // CSV_PARSER_H
@@ -0,0 +1,83 @@
+/**
+* @file csv_reader.h
+* @brief Fast catalog ingestion: memory-mapped file, zero-copy RFC 4180 tokenizer, from_chars float parsing, parallel chunks
+* @date 2026-10-19 Monday
+*/
+
+#ifndef CSV_READER_H
+#define CSV_READER_H
+
+#include "utils/csv_parser.h"
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace csv {
+
+    /**
+    * @brief Read-only view of a whole file, mmapped where available
+    */
+    class MappedFile{
+    private:
+        const char* data = nullptr;
+        size_t length = 0;
+        bool mapped = false;
+        // fallback when the file cannot be mapped
+        std::string buffer;
+
+    public:
+        /**
+        * @brief Open and map a file
+        * @param filepath Path to the file
+        * @throws std::runtime_error if the file cannot be opened
+        */
+        explicit MappedFile(const std::string& filepath);
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        std::string_view view() const { return std::string_view(data, length); }
+    };
+
+    // a field of a record, pointing into the file
+    struct Field{
+        std::string_view text;
+        // quoted field with "" escapes left in text
+        bool escaped = false;
+
+        // the field's value, with "" unescaped
+        std::string str() const;
+    };
+
+    /**
+    * @brief Split the record at the start of input into fields, without copying
+    * @param input Text starting at a record; quoted fields may contain commas, newlines and "" escapes
+    * @param fields Cleared and filled with the record's fields
+    * @return Number of bytes consumed, including the line ending
+    */
+    size_t split_record(std::string_view input, std::vector<Field>& fields);
+
+    /**
+    * @brief Parse a vector field such as "[0.1, -0.2, 3e-4]"
+    * @param text The field
+    * @param out Cleared and filled with the values
+    * @return false if a value does not parse
+    */
+    bool parse_vector(std::string_view text, std::vector<double>& out);
+
+    /**
+    * @brief Parse a catalog file (fname, link, id, desc, embedding_model, vector, attributes...)
+    * in parallel chunks over a memory map
+    * @param filepath Path to the CSV file
+    * @param threads Number of workers, 0 for one per core
+    * @return The rows, in file order
+    * @throws std::runtime_error on malformed rows, with their line number
+    */
+    std::vector<CSVRow> read_catalog(const std::string& filepath, unsigned threads = 0);
+
+}
+
+#endif // CSV_READER_H
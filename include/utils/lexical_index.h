@@ -0,0 +1,85 @@
+/**
+* @file lexical_index.h
+* @brief In-memory inverted index with BM25 scoring over garment descriptions and filenames
+* @date 2026-10-19 Monday
+*/
+
+#ifndef LEXICAL_INDEX_H
+#define LEXICAL_INDEX_H
+
+#include "utils/csv_parser.h"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace csv {
+
+    /**
+    * @brief BM25 index over the desc and fname of a segment's rows. Built once,
+    * read-only afterwards, so searches share it without locking.
+    */
+    class LexicalIndex{
+    private:
+        struct Posting{
+            uint32_t doc;
+            uint32_t tf;
+        };
+
+        // term -> documents containing it, in document order
+        std::unordered_map<std::string, std::vector<Posting>> postings;
+        // number of terms per document
+        std::vector<uint32_t> lengths;
+        double average_length = 0;
+
+        // term weight for a document of the given length
+        double term_score(double idf, uint32_t tf, uint32_t length) const;
+
+    public:
+        // BM25 parameters
+        static constexpr double k1 = 1.2;
+        static constexpr double b = 0.75;
+
+        LexicalIndex() = default;
+
+        // constructor, indexes every row
+        explicit LexicalIndex(const std::vector<CSVRow>& rows);
+
+        /**
+        * @brief Split text into lowercase terms. Hyphenated and underscored
+        * words are kept whole and also split, so "v-neck" matches "v-neck" and "v neck".
+        * @param text Text to split
+        * @return Terms, in order, with repeats
+        */
+        static std::vector<std::string> tokenize(const std::string& text);
+
+        /**
+        * @brief Inverse document frequency of a term
+        * @param term Lowercase term
+        * @return idf, 0 for terms that are not indexed
+        */
+        double idf(const std::string& term) const;
+
+        /**
+        * @brief Score every indexed document that contains a query term
+        * @param terms Query terms from tokenize()
+        * @return (document index, score) pairs, in document order
+        */
+        std::vector<std::pair<size_t, double>> score(const std::vector<std::string>& terms) const;
+
+        /**
+        * @brief Score a row that is not in the index with the index's statistics
+        * @param terms Query terms from tokenize()
+        * @param row Row to score
+        * @return BM25 score, 0 if no term matches
+        */
+        double score(const std::vector<std::string>& terms, const CSVRow& row) const;
+
+        size_t size() const { return lengths.size(); }
+    };
+
+}
+
+#endif // LEXICAL_INDEX_H
@@ -1,12 +1,69 @@
 /**
 * @file open_browser.h
-* @brief Opening the browser
+* @brief Opening the browser, and the sinks that deliver try-on outputs
 * @author Nikhil Kapila
 * @date 2025-06-26 18:45:22 Thursday
 */
 
+#ifndef OPEN_BROWSER_H
+#define OPEN_BROWSER_H
+
+#include <functional>
 #include <string>
 
 namespace browser{
-    void openURL(const std::string& url);
-}
\ No newline at end of file
+    /**
+    * @brief Check that a URL is an http or https link without spaces or control characters
+    * @param url URL to check
+    * @return True if openURL would open it
+    */
+    bool is_web_url(const std::string& url);
+
+    /**
+    * @brief Open a URL with the platform's default handler. The launcher is
+    * spawned without a shell, this blocks until it exits.
+    * @param url URL to open, only http and https links are opened
+    * @return False if the URL was refused or the launcher could not start
+    */
+    bool openURL(const std::string& url);
+
+    /**
+    * @brief Where try-on outputs go. deliver() is called on the request path
+    * and must return at once; slow work belongs on the executor's blocking pool.
+    */
+    class OutputSink{
+    public:
+        virtual ~OutputSink() = default;
+
+        /**
+        * @brief Hand over an output
+        * @param session_id Session the output belongs to
+        * @param url Link to the output image
+        */
+        virtual void deliver(const std::string& session_id, const std::string& url) = 0;
+    };
+
+    // opens the output in a local browser, off the request path
+    class LaunchSink : public OutputSink{
+    public:
+        void deliver(const std::string& session_id, const std::string& url) override;
+    };
+
+    // headless servers: the link in the tool result is all the user gets
+    class HeadlessSink : public OutputSink{
+    public:
+        void deliver(const std::string& session_id, const std::string& url) override;
+    };
+
+    // passes the output to a callback, e.g. a notification to the session's client
+    class CallbackSink : public OutputSink{
+    private:
+        std::function<void(const std::string&, const std::string&)> callback;
+
+    public:
+        explicit CallbackSink(std::function<void(const std::string&, const std::string&)> callback);
+        void deliver(const std::string& session_id, const std::string& url) override;
+    };
+}
+
+#endif // OPEN_BROWSER_H
@@ -10,9 +10,17 @@
 
 // making this generalizable/modular: https://en.cppreference.com/w/cpp/container/unordered_map.html
 
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
 #include <variant>
 #include <unordered_map>
+#include <vector>
+#include "httplib.h"
 #include "json.hpp"
+#include "mcp_cancellation.h"
 
 namespace ri {
     // https://www.geeksforgeeks.org/cpp/std-variant-in-cpp-17/
@@ -38,8 +46,129 @@ namespace ri {
         // print inputs -- for debugging
         void print_inputs();
 
-        // send request to replicate
+        /**
+        * @brief Run the prediction and wait for it
+        * @param api_key Replicate API key
+        * @return The prediction output
+        * @throws std::runtime_error if the request fails or the prediction did not succeed
+        * @throws mcp::mcp_exception if the calling request is cancelled or its deadline passes; the prediction is cancelled too
+        */
         std::string perform_inference(const std::string& api_key);
     };
 
+    /**
+    * @brief Token bucket: `rate` tokens per second, at most `burst` saved up.
+    * Callers are served in arrival order and never more than the rate allows.
+    */
+    class TokenBucket{
+    private:
+        std::mutex mutex;
+        double rate;
+        double burst;
+        // may go negative: callers already promised a future token
+        double tokens;
+        std::chrono::steady_clock::time_point last;
+
+    public:
+        TokenBucket(double rate, double burst);
+
+        void set_rate(double rate, double burst);
+
+        /**
+        * @brief Take a token, sleeping until it is available
+        * @return How long the caller waited
+        */
+        std::chrono::milliseconds acquire();
+
+        /**
+        * @brief Hand out no tokens for a while, e.g. after the server said to slow down
+        * @param delay How long to hold off
+        */
+        void pause(std::chrono::milliseconds delay);
+    };
+
+    struct RetryPolicy{
+        // including the first try
+        int max_attempts = 4;
+        std::chrono::milliseconds base_delay{500};
+        // a longer Retry-After is not waited for, the error is returned instead
+        std::chrono::milliseconds max_delay{30000};
+    };
+
+    /**
+    * @brief Exponential backoff with full jitter
+    * @param policy Delays to use
+    * @param attempt Number of failed tries so far, from 1
+    * @param jitter Uniform random number in [0, 1)
+    * @return Delay before the next try, up to min(max_delay, base_delay * 2^(attempt - 1))
+    */
+    std::chrono::milliseconds backoff_delay(const RetryPolicy& policy, int attempt, double jitter);
+
+    /**
+    * @brief Parse a Retry-After header given in seconds
+    * @param value Header value
+    * @return The delay, negative if the value is missing or not a number of seconds
+    */
+    std::chrono::milliseconds parse_retry_after(const std::string& value);
+
+    /**
+    * @brief Client for api.replicate.com shared by all calls: keeps TLS connections
+    * alive between requests, rate limits them, and retries throttled (429) and
+    * transient failures.
+    */
+    class ReplicateClient{
+    private:
+        std::string base_url;
+        std::mutex mutex;
+        // connected clients not in use, most recently used last
+        std::vector<std::unique_ptr<httplib::Client>> idle;
+        size_t max_idle = 8;
+        RetryPolicy policy;
+        TokenBucket limiter;
+
+        std::unique_ptr<httplib::Client> checkout();
+        void checkin(std::unique_ptr<httplib::Client> client);
+
+    public:
+        explicit ReplicateClient(const std::string& base_url);
+
+        ReplicateClient(const ReplicateClient&) = delete;
+        ReplicateClient& operator=(const ReplicateClient&) = delete;
+
+        // the client all Replicate calls go through
+        static ReplicateClient& shared();
+
+        /**
+        * @brief Change the limits, for calls made from now on
+        * @param rate Requests per second
+        * @param burst Requests allowed back to back after an idle period
+        * @param max_idle Connections kept open between calls
+        * @param policy Retries
+        */
+        void configure(double rate, double burst, size_t max_idle, const RetryPolicy& policy);
+
+        /**
+        * @brief Send a request, retrying 429, 503 and connection failures.
+        * @param send Sends the request on the given client, may be called more than once
+        * @param replayable Whether the request may be sent again after it possibly reached
+        * the server, i.e. on read errors and other 5xx. False for requests that cost money twice.
+        * @param cancel Closes the connection of the request in flight and stops retrying
+        * @return The last result, Error::Canceled if cancelled before the first try
+        */
+        httplib::Result request(const std::function<httplib::Result(httplib::Client&)>& send, bool replayable,
+            const mcp::cancellation_token& cancel = mcp::cancellation_token());
+    };
+
+    /**
+    * @brief Upload a file to Replicate, so predictions can use it without fetching it from its origin
+    * @param api_key Replicate API key
+    * @param bytes File content
+    * @param mime_type MIME type of the content
+    * @param filename Name to store it under
+    * @return URL of the uploaded file, usable as a prediction input
+    * @throws std::runtime_error if the upload fails
+    */
+    std::string upload_file(const std::string& api_key, const std::string& bytes, const std::string& mime_type,
+        const std::string& filename);
+
 }
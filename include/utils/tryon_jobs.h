@@ -0,0 +1,187 @@
+/**
+* @file tryon_jobs.h
+* @brief Try-on predictions shared by their inputs: speculative queue, per-session budget, result cache
+* @date 2026-10-19 Monday
+*/
+
+#ifndef TRYON_JOBS_H
+#define TRYON_JOBS_H
+
+#include "mcp_cancellation.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace vto {
+
+    /**
+    * @brief Inputs of one try-on prediction
+    */
+    struct TryOnRequest{
+        std::string human_img;
+        std::string garm_img;
+        std::string garment_des;
+        std::string category;
+
+        // the description is left out: the LLM rephrases it, and the model only uses it as a hint
+        std::string key() const;
+    };
+
+    struct TryOnLimits{
+        // speculative jobs running at once, behind the tool calls
+        int workers = 1;
+        // speculative predictions per session, each one is billed
+        int budget = 4;
+        // replicate.delivery links expire after an hour
+        std::chrono::steady_clock::duration ttl = std::chrono::minutes(50);
+        // finished results kept
+        size_t max_results = 256;
+    };
+
+    /**
+    * @brief Try-on predictions by their inputs. A tool call waits for a matching
+    * prediction that is already running, or reuses a finished one, so a
+    * speculative try-on of a search result answers the tool call at once.
+    *
+    * Every prediction runs on the executor's blocking pool under a cancellation
+    * source of its own, never under the token of a request that waits for it.
+    * It is cancelled once nobody needs it: its waiters have all gone and no
+    * session holds it speculatively, or its session moved on or closed before
+    * a tool call took it over.
+    */
+    class TryOnJobs{
+    public:
+        // runs a prediction, cancellation_token::current() is the job's token
+        using Runner = std::function<std::string(const TryOnRequest&)>;
+
+    private:
+        struct Job{
+            enum State{ QUEUED, RUNNING, DONE, FAILED, CANCELLED } state = QUEUED;
+            std::string key;
+            TryOnRequest request;
+            // session that asked for it speculatively, empty for tool calls and once a tool call takes it over
+            std::string session_id;
+            // holds one of the speculative workers
+            bool speculative_slot = false;
+            // tool calls waiting for the output
+            int waiters = 0;
+            mcp::cancellation_source cancel;
+            std::promise<std::string> promise;
+            std::shared_future<std::string> output = promise.get_future().share();
+            std::chrono::steady_clock::time_point finished;
+        };
+
+        Runner runner;
+        TryOnLimits limits;
+
+        std::mutex mutex;
+        std::condition_variable idle;
+        std::unordered_map<std::string, std::shared_ptr<Job>> by_key;
+        // speculative jobs not started yet, oldest first
+        std::deque<std::shared_ptr<Job>> queue;
+        int speculative_running = 0;
+        // jobs on the blocking pool, the destructor waits for them
+        int running = 0;
+        // speculative predictions charged to each session
+        std::unordered_map<std::string, int> spent;
+
+        // a job that can answer a request now or later, null if there is none; caller holds mutex
+        std::shared_ptr<Job> usable(const std::string& key);
+        // drop finished results, expired ones first, until the cache fits; caller holds mutex
+        void trim();
+        // run a job on the blocking pool; caller holds mutex
+        void start(const std::shared_ptr<Job>& job, bool speculative);
+        // run the prediction and publish the outcome
+        void execute(const std::shared_ptr<Job>& job);
+        // start queued speculative jobs while a worker is free
+        void pump();
+        // mark a job cancelled and forget it, the caller cancels its source without the lock; caller holds mutex
+        void drop(const std::shared_ptr<Job>& job);
+        // a tool call stops waiting, the last one out cancels a prediction nobody else holds
+        void leave(const std::shared_ptr<Job>& job);
+
+    public:
+        TryOnJobs(Runner runner, TryOnLimits limits = TryOnLimits());
+
+        // cancels every job and waits for the running ones
+        ~TryOnJobs();
+
+        TryOnJobs(const TryOnJobs&) = delete;
+        TryOnJobs& operator=(const TryOnJobs&) = delete;
+
+        /**
+        * @brief Replace a session's speculative try-ons, within its budget
+        * @param session_id The session
+        * @param requests Try-ons to run in the background, most likely first
+        */
+        void speculate(const std::string& session_id, const std::vector<TryOnRequest>& requests);
+
+        /**
+        * @brief Try-on for a tool call: joins a matching job, cached or in flight, or starts one.
+        * The session's other speculative try-ons are cancelled.
+        * @param session_id The calling session
+        * @param request The try-on
+        * @return The prediction output
+        * @throws mcp::mcp_exception if the calling request is cancelled; the prediction goes on for other waiters
+        * @throws std::runtime_error and others from the runner if the prediction failed
+        */
+        std::string run(const std::string& session_id, const TryOnRequest& request);
+
+        /**
+        * @brief Cancel a session's speculative try-ons, queued or running, that no tool call has taken over.
+        * Queued ones are refunded to the budget, running ones were billed already.
+        * @param session_id The session
+        * @param keep_key Key of a try-on to keep
+        */
+        void cancel_speculative(const std::string& session_id, const std::string& keep_key = "");
+
+        // cancel the session's speculative try-ons and forget its budget
+        void close_session(const std::string& session_id);
+
+        // speculative predictions charged to a session
+        int budget_spent(const std::string& session_id);
+    };
+
+    /**
+    * @brief Try-on outputs of each session, oldest first; the last one is the base
+    * of the session's next regressive try-on. Kept per session so that concurrent
+    * users never continue each other's chains.
+    */
+    class TryOnHistory{
+    private:
+        size_t max_entries;
+        std::mutex mutex;
+        std::unordered_map<std::string, std::vector<std::string>> chains;
+
+    public:
+        explicit TryOnHistory(size_t max_entries = 32);
+
+        /**
+        * @brief Append an output to a session's chain, the oldest one goes once the chain is full.
+        * A closing session cancels its requests before it drops its chain, so a cancelled
+        * caller never starts a new one.
+        * @param session_id The session
+        * @param link The try-on output
+        * @param cancel Token of the calling request
+        */
+        void record(const std::string& session_id, const std::string& link,
+            const mcp::cancellation_token& cancel = mcp::cancellation_token::current());
+
+        // latest output of the session, empty if it has none
+        std::string last(const std::string& session_id);
+
+        // drop a closed session's chain
+        void close(const std::string& session_id);
+    };
+
+}
+
+#endif // TRYON_JOBS_H
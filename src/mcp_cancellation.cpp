@@ -0,0 +1,237 @@
+/**
+ * @file mcp_cancellation.cpp
+ * @brief Implementation of cancellation tokens
+ */
+
+#include "mcp_cancellation.h"
+#include "mcp_task.h"
+
+#include <algorithm>
+#include <thread>
+
+namespace mcp {
+
+namespace detail {
+
+struct cancellation_state {
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool cancelled = false;
+    std::string reason;
+    error_code code = error_code::request_cancelled;
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+    std::map<uint64_t, std::function<void()>> callbacks;
+    uint64_t next_id = 1;
+    // Callback being run by cancel(), 0 if none
+    uint64_t running = 0;
+    std::thread::id running_thread;
+    // Executor timer of the deadline, 0 if none
+    uint64_t timer = 0;
+};
+
+} // namespace detail
+
+namespace {
+
+// Token of the request running on this thread
+thread_local cancellation_token current_token;
+
+// Cancel and run the callbacks on the calling thread
+bool cancel_state(const std::shared_ptr<detail::cancellation_state>& state, const std::string& reason, error_code code) {
+    std::unique_lock<std::mutex> lock(state->mutex);
+    if (state->cancelled) {
+        return false;
+    }
+    state->cancelled = true;
+    state->reason = reason;
+    state->code = code;
+    state->running_thread = std::this_thread::get_id();
+    state->cv.notify_all();
+
+    // Callbacks run without the lock, one at a time, so they may register or remove others
+    while (!state->callbacks.empty()) {
+        auto it = state->callbacks.begin();
+        state->running = it->first;
+        std::function<void()> fn = std::move(it->second);
+        state->callbacks.erase(it);
+        lock.unlock();
+        try {
+            fn();
+        } catch (...) {
+            // A failed abort leaves the handler to notice the token
+        }
+        lock.lock();
+        state->running = 0;
+        state->cv.notify_all();
+    }
+    state->running_thread = std::thread::id();
+    return true;
+}
+
+} // namespace
+
+cancellation_token cancellation_token::current() {
+    return current_token;
+}
+
+bool cancellation_token::is_cancelled() const {
+    if (!state_) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    return state_->cancelled;
+}
+
+std::string cancellation_token::reason() const {
+    if (!state_) {
+        return "";
+    }
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    return state_->reason;
+}
+
+error_code cancellation_token::code() const {
+    if (!state_) {
+        return error_code::request_cancelled;
+    }
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    return state_->code;
+}
+
+std::chrono::steady_clock::time_point cancellation_token::deadline() const {
+    if (!state_) {
+        return std::chrono::steady_clock::time_point::max();
+    }
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    return state_->deadline;
+}
+
+std::chrono::milliseconds cancellation_token::remaining(std::chrono::milliseconds limit) const {
+    auto when = deadline();
+    if (when == std::chrono::steady_clock::time_point::max()) {
+        return limit;
+    }
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(when - std::chrono::steady_clock::now());
+    return std::max(std::chrono::milliseconds(0), std::min(limit, left));
+}
+
+void cancellation_token::throw_if_cancelled() const {
+    if (!state_) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(state_->mutex);
+    if (state_->cancelled) {
+        error_code code = state_->code;
+        std::string reason = state_->reason;
+        lock.unlock();
+        throw mcp_exception(code, reason);
+    }
+}
+
+bool cancellation_token::wait_for(std::chrono::steady_clock::duration timeout) const {
+    if (!state_) {
+        std::this_thread::sleep_for(timeout);
+        return false;
+    }
+    std::unique_lock<std::mutex> lock(state_->mutex);
+    return state_->cv.wait_for(lock, timeout, [this] { return state_->cancelled; });
+}
+
+uint64_t cancellation_token::on_cancel(std::function<void()> fn) const {
+    if (!state_) {
+        return 0;
+    }
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        if (!state_->cancelled) {
+            uint64_t id = state_->next_id++;
+            state_->callbacks.emplace(id, std::move(fn));
+            return id;
+        }
+    }
+    fn();
+    return 0;
+}
+
+void cancellation_token::remove(uint64_t id) const {
+    if (!state_ || id == 0) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(state_->mutex);
+    if (state_->callbacks.erase(id) > 0) {
+        return;
+    }
+    // The callback may be using what the caller is about to destroy
+    if (state_->running_thread != std::this_thread::get_id()) {
+        state_->cv.wait(lock, [this, id] { return state_->running != id; });
+    }
+}
+
+cancellation_source::cancellation_source() : state_(std::make_shared<detail::cancellation_state>()) {
+}
+
+cancellation_token cancellation_source::token() const {
+    return cancellation_token(state_);
+}
+
+bool cancellation_source::cancel(const std::string& reason, error_code code) {
+    return cancel_state(state_, reason, code);
+}
+
+void cancellation_source::set_deadline(std::chrono::steady_clock::time_point when) {
+    uint64_t previous;
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        if (state_->cancelled) {
+            return;
+        }
+        state_->deadline = when;
+        previous = state_->timer;
+    }
+    if (previous != 0) {
+        executor::instance().cancel_timer(previous);
+    }
+    // The timer does not keep a finished request alive
+    std::weak_ptr<detail::cancellation_state> weak = state_;
+    uint64_t timer = executor::instance().post_after(when - std::chrono::steady_clock::now(), [weak]() {
+        if (auto state = weak.lock()) {
+            cancel_state(state, "Deadline exceeded", error_code::request_timeout);
+        }
+    });
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    state_->timer = timer;
+}
+
+void cancellation_source::complete() {
+    uint64_t timer;
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        timer = state_->timer;
+        state_->timer = 0;
+    }
+    if (timer != 0) {
+        executor::instance().cancel_timer(timer);
+    }
+}
+
+bool cancellation_source::is_cancelled() const {
+    return token().is_cancelled();
+}
+
+cancellation_scope::cancellation_scope(cancellation_token token) : previous_(current_token) {
+    current_token = std::move(token);
+}
+
+cancellation_scope::~cancellation_scope() {
+    current_token = std::move(previous_);
+}
+
+cancellation_callback::cancellation_callback(const cancellation_token& token, std::function<void()> fn)
+    : token_(token), id_(token.on_cancel(std::move(fn))) {
+}
+
+cancellation_callback::~cancellation_callback() {
+    token_.remove(id_);
+}
+
+} // namespace mcp
@@ -0,0 +1,189 @@
+/**
+ * @file mcp_json_writer.cpp
+ * @brief Implementation of the streaming JSON writer
+ */
+
+#include "mcp_json_writer.h"
+
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+
+namespace mcp {
+
+json_writer::json_writer(std::string& out) : out_(out) {
+}
+
+void json_writer::separate() {
+    if (after_key_) {
+        after_key_ = false;
+        return;
+    }
+    if (!has_items_.empty()) {
+        if (has_items_.back()) {
+            out_ += ',';
+        }
+        has_items_.back() = true;
+    }
+}
+
+json_writer& json_writer::begin_object() {
+    separate();
+    out_ += '{';
+    has_items_.push_back(false);
+    return *this;
+}
+
+json_writer& json_writer::end_object() {
+    has_items_.pop_back();
+    out_ += '}';
+    return *this;
+}
+
+json_writer& json_writer::begin_array() {
+    separate();
+    out_ += '[';
+    has_items_.push_back(false);
+    return *this;
+}
+
+json_writer& json_writer::end_array() {
+    has_items_.pop_back();
+    out_ += ']';
+    return *this;
+}
+
+json_writer& json_writer::key(std::string_view name) {
+    separate();
+    escape(out_, name);
+    out_ += ':';
+    after_key_ = true;
+    return *this;
+}
+
+json_writer& json_writer::value(std::string_view text) {
+    separate();
+    escape(out_, text);
+    return *this;
+}
+
+json_writer& json_writer::value(const char* text) {
+    return value(std::string_view(text));
+}
+
+json_writer& json_writer::value(const std::string& text) {
+    return value(std::string_view(text));
+}
+
+json_writer& json_writer::value(int number) {
+    return value(static_cast<int64_t>(number));
+}
+
+json_writer& json_writer::value(int64_t number) {
+    separate();
+    char buf[24];
+    auto result = std::to_chars(buf, buf + sizeof(buf), number);
+    out_.append(buf, result.ptr);
+    return *this;
+}
+
+json_writer& json_writer::value(uint64_t number) {
+    separate();
+    char buf[24];
+    auto result = std::to_chars(buf, buf + sizeof(buf), number);
+    out_.append(buf, result.ptr);
+    return *this;
+}
+
+json_writer& json_writer::value(double number) {
+    if (!std::isfinite(number)) {
+        return null();
+    }
+    separate();
+    char buf[32];
+#if defined(__cpp_lib_to_chars)
+    // shortest text that parses back to the same double
+    auto result = std::to_chars(buf, buf + sizeof(buf), number);
+    out_.append(buf, result.ptr);
+#else
+    int len = std::snprintf(buf, sizeof(buf), "%.17g", number);
+    out_.append(buf, static_cast<size_t>(len));
+#endif
+    return *this;
+}
+
+json_writer& json_writer::value(bool flag) {
+    separate();
+    out_ += flag ? "true" : "false";
+    return *this;
+}
+
+json_writer& json_writer::null() {
+    separate();
+    out_ += "null";
+    return *this;
+}
+
+json_writer& json_writer::value(const json& document) {
+    switch (document.type()) {
+        case json::value_t::object:
+            begin_object();
+            for (const auto& [name, item] : document.items()) {
+                key(name);
+                value(item);
+            }
+            return end_object();
+        case json::value_t::array:
+            begin_array();
+            for (const auto& item : document) {
+                value(item);
+            }
+            return end_array();
+        case json::value_t::string:
+            return value(std::string_view(document.get_ref<const std::string&>()));
+        case json::value_t::boolean:
+            return value(document.get<bool>());
+        case json::value_t::number_integer:
+            return value(document.get<int64_t>());
+        case json::value_t::number_unsigned:
+            return value(document.get<uint64_t>());
+        case json::value_t::number_float:
+            return value(document.get<double>());
+        default:
+            // null, and binary or discarded values, which have no JSON text
+            return null();
+    }
+}
+
+void json_writer::escape(std::string& out, std::string_view text) {
+    static const char hex[] = "0123456789abcdef";
+    out += '"';
+    // runs without special characters are appended in one piece
+    size_t run = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        out.append(text.data() + run, i - run);
+        run = i + 1;
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                out += "\\u00";
+                out += hex[c >> 4];
+                out += hex[c & 0xf];
+                break;
+        }
+    }
+    out.append(text.data() + run, text.size() - run);
+    out += '"';
+}
+
+} // namespace mcp
@@ -0,0 +1,327 @@
+/**
+ * @file mcp_logger.cpp
+ * @brief Implementation of the logger sinks and the background writer
+ */
+
+#include "mcp_logger.h"
+
+#include <ctime>
+
+namespace mcp {
+
+namespace detail {
+
+// A formatted message waiting for the background writer
+struct log_record {
+    log_level level = log_level::info;
+    std::chrono::system_clock::time_point time;
+    std::string message;
+};
+
+// Bounded multi-producer queue (Vyukov). Each cell carries a sequence number
+// that tells producers and the consumer whose turn it is, so neither side locks.
+class log_queue {
+public:
+    explicit log_queue(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        mask_ = size - 1;
+        cells_ = std::make_unique<cell[]>(size);
+        for (size_t i = 0; i < size; ++i) {
+            cells_[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bool try_push(log_record&& record) {
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        for (;;) {
+            cell& c = cells_[pos & mask_];
+            size_t seq = c.seq.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    c.record = std::move(record);
+                    c.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                // Full
+                return false;
+            } else {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Single consumer: the background writer
+    bool try_pop(log_record& record) {
+        cell& c = cells_[dequeue_pos_ & mask_];
+        size_t seq = c.seq.load(std::memory_order_acquire);
+        if (seq != dequeue_pos_ + 1) {
+            return false;
+        }
+        record = std::move(c.record);
+        c.seq.store(dequeue_pos_ + mask_ + 1, std::memory_order_release);
+        ++dequeue_pos_;
+        return true;
+    }
+
+private:
+    struct cell {
+        std::atomic<size_t> seq{0};
+        log_record record;
+    };
+
+    std::unique_ptr<cell[]> cells_;
+    size_t mask_ = 0;
+
+    // Producers and the consumer touch different cache lines
+    alignas(64) std::atomic<size_t> enqueue_pos_{0};
+    alignas(64) size_t dequeue_pos_ = 0;
+};
+
+} // namespace detail
+
+namespace {
+
+// Batches larger than this are written out before the queue is empty
+const size_t max_batch_bytes = 64 * 1024;
+
+const char* level_tag(log_level level, bool color) {
+    switch (level) {
+        case log_level::debug:
+            return color ? "\033[36m[DEBUG]\033[0m " : "[DEBUG] ";      // Cyan
+        case log_level::info:
+            return color ? "\033[32m[INFO]\033[0m " : "[INFO] ";        // Green
+        case log_level::warning:
+            return color ? "\033[33m[WARNING]\033[0m " : "[WARNING] ";  // Yellow
+        case log_level::error:
+            return color ? "\033[31m[ERROR]\033[0m " : "[ERROR] ";      // Red
+    }
+    return "";
+}
+
+// Format "YYYY-mm-dd HH:MM:SS " with localtime_r, reusing the last result within the same second
+void append_timestamp(std::string& out, std::chrono::system_clock::time_point time) {
+    thread_local std::time_t cached_second = -1;
+    thread_local char cached[32] = {0};
+
+    std::time_t now_c = std::chrono::system_clock::to_time_t(time);
+    if (now_c != cached_second) {
+        std::tm now_tm{};
+#ifdef _WIN32
+        localtime_s(&now_tm, &now_c);
+#else
+        localtime_r(&now_c, &now_tm);
+#endif
+        std::strftime(cached, sizeof(cached), "%Y-%m-%d %H:%M:%S ", &now_tm);
+        cached_second = now_c;
+    }
+    out.append(cached);
+}
+
+void append_line(std::string& out, log_level level, std::chrono::system_clock::time_point time, const std::string& message, bool color) {
+    append_timestamp(out, time);
+    out.append(level_tag(level, color));
+    out.append(message);
+    out.push_back('\n');
+}
+
+} // namespace
+
+logger::logger() : level_(log_level::info) {}
+
+logger::~logger() {
+    set_async(false);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (file_) {
+        std::fclose(file_);
+        file_ = nullptr;
+    }
+}
+
+std::ostringstream& logger::thread_stream() {
+    thread_local std::ostringstream ss;
+    ss.str(std::string());
+    ss.clear();
+    return ss;
+}
+
+void logger::set_async(bool async, size_t capacity) {
+    std::unique_lock<std::mutex> lock(writer_mutex_);
+
+    if (async) {
+        if (writer_.joinable()) {
+            return;
+        }
+        if (!queue_) {
+            queue_ = std::make_unique<detail::log_queue>(capacity);
+        }
+        writer_stop_ = false;
+        writer_ = std::thread([this]() { run_writer(); });
+        async_.store(true, std::memory_order_release);
+        return;
+    }
+
+    if (!writer_.joinable()) {
+        return;
+    }
+
+    // New lines go to the sinks directly, the writer drains what is already queued
+    async_.store(false, std::memory_order_release);
+    writer_stop_ = true;
+    writer_cv_.notify_one();
+
+    std::thread writer = std::move(writer_);
+    lock.unlock();
+    writer.join();
+}
+
+bool logger::set_file(const std::string& path) {
+    std::FILE* file = nullptr;
+    if (!path.empty()) {
+        file = std::fopen(path.c_str(), "a");
+        if (!file) {
+            return false;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (file_) {
+        std::fclose(file_);
+    }
+    file_ = file;
+    return true;
+}
+
+void logger::flush() {
+    std::unique_lock<std::mutex> lock(writer_mutex_);
+    if (!writer_.joinable()) {
+        return;
+    }
+
+    uint64_t target = ++flush_requested_;
+    writer_cv_.notify_one();
+    flushed_cv_.wait(lock, [this, target] { return flush_completed_ >= target || !writer_.joinable(); });
+}
+
+void logger::write(log_level level, std::string message) {
+    auto now = std::chrono::system_clock::now();
+
+    if (async_.load(std::memory_order_acquire)) {
+        if (!queue_->try_push(detail::log_record{level, now, std::move(message)})) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        // Only wake the writer when it is waiting, so a busy writer costs producers a relaxed load
+        if (writer_idle_.load(std::memory_order_relaxed) && writer_idle_.exchange(false, std::memory_order_acq_rel)) {
+            writer_cv_.notify_one();
+        }
+        return;
+    }
+
+    std::string console;
+    append_line(console, level, now, message, true);
+
+    std::string file;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (file_) {
+            append_line(file, level, now, message, false);
+        }
+    }
+    write_out(console, file);
+}
+
+void logger::write_out(const std::string& console, const std::string& file) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (!console.empty()) {
+        std::fwrite(console.data(), 1, console.size(), stderr);
+        std::fflush(stderr);
+    }
+
+    if (file_ && !file.empty()) {
+        std::fwrite(file.data(), 1, file.size(), file_);
+        std::fflush(file_);
+    }
+}
+
+void logger::run_writer() {
+    std::string console;
+    std::string file;
+    detail::log_record record;
+
+    for (;;) {
+        uint64_t flush_target = 0;
+        bool stop = false;
+        {
+            std::lock_guard<std::mutex> lock(writer_mutex_);
+            flush_target = flush_requested_;
+            stop = writer_stop_;
+        }
+
+        bool to_file = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            to_file = file_ != nullptr;
+        }
+
+        // Drain the queue, writing in batches
+        while (queue_->try_pop(record)) {
+            append_line(console, record.level, record.time, record.message, true);
+            if (to_file) {
+                append_line(file, record.level, record.time, record.message, false);
+            }
+
+            if (console.size() >= max_batch_bytes) {
+                write_out(console, file);
+                console.clear();
+                file.clear();
+            }
+        }
+
+        size_t dropped = dropped_.exchange(0, std::memory_order_relaxed);
+        if (dropped > 0) {
+            std::string message = std::to_string(dropped) + " log lines dropped, queue full";
+            append_line(console, log_level::warning, std::chrono::system_clock::now(), message, true);
+            if (to_file) {
+                append_line(file, log_level::warning, std::chrono::system_clock::now(), message, false);
+            }
+        }
+
+        if (!console.empty()) {
+            write_out(console, file);
+            console.clear();
+            file.clear();
+        }
+
+        std::unique_lock<std::mutex> lock(writer_mutex_);
+        if (flush_target > flush_completed_) {
+            flush_completed_ = flush_target;
+            flushed_cv_.notify_all();
+        }
+
+        if (stop) {
+            break;
+        }
+
+        // Sleep until woken by a producer, a flush or stop; the timeout covers a wake-up lost to the idle flag race
+        writer_idle_.store(true, std::memory_order_release);
+        writer_cv_.wait_for(lock, std::chrono::milliseconds(50), [this] {
+            return writer_stop_ || flush_requested_ > flush_completed_ || !writer_idle_.load(std::memory_order_acquire);
+        });
+        writer_idle_.store(false, std::memory_order_relaxed);
+    }
+
+    // Release anyone still waiting in flush()
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    flush_completed_ = flush_requested_;
+    flushed_cv_.notify_all();
+}
+
+} // namespace mcp
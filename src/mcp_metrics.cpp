@@ -0,0 +1,244 @@
+/**
+ * @file mcp_metrics.cpp
+ * @brief Implementation of the metrics registry and Prometheus export
+ */
+
+#include "mcp_metrics.h"
+
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+namespace mcp {
+
+namespace {
+
+int floor_log2(uint64_t v) {
+#if defined(__GNUC__) || defined(__clang__)
+    return 63 - __builtin_clzll(v);
+#else
+    int e = 0;
+    while (v >>= 1) {
+        ++e;
+    }
+    return e;
+#endif
+}
+
+// Escape a label value for the exposition format
+std::string escape_label(const std::string& value) {
+    std::string out;
+    out.reserve(value.size());
+    for (char c : value) {
+        switch (c) {
+            case '\\': out += "\\\\"; break;
+            case '"': out += "\\\""; break;
+            case '\n': out += "\\n"; break;
+            default: out += c; break;
+        }
+    }
+    return out;
+}
+
+// Render {name="value",...}, with an optional extra pair appended
+std::string render_labels(const metric_labels& labels, const std::string& extra_name = "", const std::string& extra_value = "") {
+    if (labels.empty() && extra_name.empty()) {
+        return "";
+    }
+
+    std::string out = "{";
+    bool first = true;
+    for (const auto& [name, value] : labels) {
+        if (!first) {
+            out += ",";
+        }
+        out += name + "=\"" + escape_label(value) + "\"";
+        first = false;
+    }
+    if (!extra_name.empty()) {
+        if (!first) {
+            out += ",";
+        }
+        out += extra_name + "=\"" + escape_label(extra_value) + "\"";
+    }
+    out += "}";
+    return out;
+}
+
+const double exported_quantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+} // namespace
+
+size_t histogram::bucket_index(uint64_t micros) {
+    if (micros < static_cast<uint64_t>(sub_bucket_count)) {
+        return static_cast<size_t>(micros);
+    }
+
+    int e = floor_log2(micros);
+    if (e > max_exponent) {
+        return bucket_count - 1;
+    }
+
+    size_t sub = static_cast<size_t>((micros >> (e - sub_bucket_bits)) & (sub_bucket_count - 1));
+    return sub_bucket_count + static_cast<size_t>(e - sub_bucket_bits) * sub_bucket_count + sub;
+}
+
+uint64_t histogram::bucket_lower_bound(size_t index) {
+    if (index < static_cast<size_t>(sub_bucket_count)) {
+        return index;
+    }
+
+    size_t e = (index - sub_bucket_count) / sub_bucket_count + sub_bucket_bits;
+    size_t sub = (index - sub_bucket_count) % sub_bucket_count;
+    return static_cast<uint64_t>(sub_bucket_count + sub) << (e - sub_bucket_bits);
+}
+
+uint64_t histogram::bucket_upper_bound(size_t index) {
+    if (index < static_cast<size_t>(sub_bucket_count)) {
+        return index + 1;
+    }
+
+    size_t e = (index - sub_bucket_count) / sub_bucket_count + sub_bucket_bits;
+    return bucket_lower_bound(index) + (static_cast<uint64_t>(1) << (e - sub_bucket_bits));
+}
+
+void histogram::record(uint64_t micros) {
+    buckets_[bucket_index(micros)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(micros, std::memory_order_relaxed);
+}
+
+double histogram::quantile(double q) const {
+    // Count from the buckets so the rank matches what is walked below
+    uint64_t total = 0;
+    for (const auto& bucket : buckets_) {
+        total += bucket.load(std::memory_order_relaxed);
+    }
+    if (total == 0) {
+        return 0.0;
+    }
+
+    q = q < 0.0 ? 0.0 : (q > 1.0 ? 1.0 : q);
+    uint64_t rank = static_cast<uint64_t>(std::ceil(q * static_cast<double>(total)));
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < bucket_count; ++i) {
+        seen += buckets_[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            return (static_cast<double>(bucket_lower_bound(i)) + static_cast<double>(bucket_upper_bound(i))) / 2.0;
+        }
+    }
+    return static_cast<double>(bucket_lower_bound(bucket_count - 1));
+}
+
+metrics_registry& metrics_registry::instance() {
+    static metrics_registry instance;
+    return instance;
+}
+
+metrics_registry::series& metrics_registry::get_series(const std::string& name, const std::string& help, metric_type type, const metric_labels& labels) {
+    std::string key = render_labels(labels);
+
+    // Fast path: the series already exists
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        auto family_it = families_.find(name);
+        if (family_it != families_.end()) {
+            if (family_it->second.type != type) {
+                throw std::logic_error("Metric " + name + " is already registered with another type");
+            }
+            auto series_it = family_it->second.series_by_labels.find(key);
+            if (series_it != family_it->second.series_by_labels.end()) {
+                return series_it->second;
+            }
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    auto family_it = families_.find(name);
+    if (family_it == families_.end()) {
+        family_it = families_.emplace(name, family{help, type, {}}).first;
+    } else if (family_it->second.type != type) {
+        throw std::logic_error("Metric " + name + " is already registered with another type");
+    }
+
+    auto& series_by_labels = family_it->second.series_by_labels;
+    auto series_it = series_by_labels.find(key);
+    if (series_it == series_by_labels.end()) {
+        series s;
+        s.labels = labels;
+        switch (type) {
+            case metric_type::counter:
+                s.counter_value = std::make_unique<counter>();
+                break;
+            case metric_type::gauge:
+                s.gauge_value = std::make_unique<gauge>();
+                break;
+            case metric_type::histogram:
+                s.histogram_value = std::make_unique<histogram>();
+                break;
+        }
+        series_it = series_by_labels.emplace(key, std::move(s)).first;
+    }
+    return series_it->second;
+}
+
+counter& metrics_registry::get_counter(const std::string& name, const std::string& help, const metric_labels& labels) {
+    return *get_series(name, help, metric_type::counter, labels).counter_value;
+}
+
+gauge& metrics_registry::get_gauge(const std::string& name, const std::string& help, const metric_labels& labels) {
+    return *get_series(name, help, metric_type::gauge, labels).gauge_value;
+}
+
+histogram& metrics_registry::get_histogram(const std::string& name, const std::string& help, const metric_labels& labels) {
+    return *get_series(name, help, metric_type::histogram, labels).histogram_value;
+}
+
+std::string metrics_registry::serialize() const {
+    std::ostringstream out;
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+
+    for (const auto& [name, fam] : families_) {
+        switch (fam.type) {
+            case metric_type::counter:
+                out << "# HELP " << name << " " << fam.help << "\n";
+                out << "# TYPE " << name << " counter\n";
+                for (const auto& [key, s] : fam.series_by_labels) {
+                    out << name << key << " " << s.counter_value->value() << "\n";
+                }
+                break;
+            case metric_type::gauge:
+                out << "# HELP " << name << " " << fam.help << "\n";
+                out << "# TYPE " << name << " gauge\n";
+                for (const auto& [key, s] : fam.series_by_labels) {
+                    out << name << key << " " << s.gauge_value->value() << "\n";
+                }
+                break;
+            case metric_type::histogram: {
+                // Recorded in microseconds, exported in seconds
+                std::string exported = name + "_seconds";
+                out << "# HELP " << exported << " " << fam.help << "\n";
+                out << "# TYPE " << exported << " summary\n";
+                for (const auto& [key, s] : fam.series_by_labels) {
+                    const histogram& h = *s.histogram_value;
+                    for (double q : exported_quantiles) {
+                        std::ostringstream qs;
+                        qs << q;
+                        out << exported << render_labels(s.labels, "quantile", qs.str()) << " " << h.quantile(q) / 1e6 << "\n";
+                    }
+                    out << exported << "_sum" << key << " " << static_cast<double>(h.sum()) / 1e6 << "\n";
+                    out << exported << "_count" << key << " " << h.count() << "\n";
+                }
+                break;
+            }
+        }
+    }
+
+    return out.str();
+}
+
+} // namespace mcp
@@ -7,12 +7,202 @@
  */
 
 #include "mcp_server.h"
+#include "mcp_json_writer.h"
+#include "mcp_metrics.h"
+#include "mcp_tracing.h"
+
+#include <cstring>
 
 namespace mcp {
 
-server::server(const std::string& host, int port, const std::string& name, const std::string& version, const std::string& sse_endpoint, const std::string& msg_endpoint)
-    : host_(host), port_(port), name_(name), version_(version), sse_endpoint_(sse_endpoint), msg_endpoint_(msg_endpoint) {
+namespace {
+
+// Adapt a synchronous handler to the completion-based form used for dispatch
+async_method_handler to_async_handler(method_handler handler) {
+    return [handler](const json& params, const std::string& session_id, completion_handler done) {
+        json result;
+        try {
+            result = handler(params, session_id);
+        } catch (...) {
+            done(json(), std::current_exception());
+            return;
+        }
+        done(std::move(result), nullptr);
+    };
+}
+
+// Convert an exception thrown while processing a request into a JSON-RPC error response
+json error_response(const json& id, std::exception_ptr error) {
+    try {
+        std::rethrow_exception(error);
+    } catch (const mcp_exception& e) {
+        // MCP exception
+        LOG_ERROR("MCP exception: ", e.what(), ", code: ", static_cast<int>(e.code()));
+        return response::create_error(
+            id,
+            e.code(),
+            e.what()
+        ).to_json();
+    } catch (const std::exception& e) {
+        // Other exceptions
+        LOG_ERROR("Exception while processing request: ", e.what());
+        return response::create_error(
+            id,
+            error_code::internal_error,
+            "Internal error: " + std::string(e.what())
+        ).to_json();
+    } catch (...) {
+        // Unknown exception
+        LOG_ERROR("Unknown exception while processing request");
+        return response::create_error(
+            id,
+            error_code::internal_error,
+            "Unknown internal error"
+        ).to_json();
+    }
+}
+
+// Build a request object from a parsed JSON-RPC message
+request parse_request(const json& req_json) {
+    request mcp_req;
+    mcp_req.jsonrpc = req_json["jsonrpc"].get<std::string>();
+    if (req_json.contains("id") && !req_json["id"].is_null()) {
+        mcp_req.id = req_json["id"];
+    }
+    mcp_req.method = req_json["method"].get<std::string>();
+    if (req_json.contains("params")) {
+        mcp_req.params = req_json["params"];
+    }
+    return mcp_req;
+}
+
+// Count an event handed to a session's SSE stream
+void record_sse_event(bool sent) {
+    static counter& sent_events = metrics_registry::instance().get_counter(
+        "mcp_sse_events_total", "Events queued on session streams", {{"result", "sent"}});
+    static counter& failed_events = metrics_registry::instance().get_counter(
+        "mcp_sse_events_total", "Events queued on session streams", {{"result", "failed"}});
+    (sent ? sent_events : failed_events).add();
+}
+
+// Series of one JSON-RPC method, resolved once so that answering a request does not look them up
+struct method_series {
+    histogram& duration;
+    counter& ok;
+    counter& error;
+};
+
+// Methods are bounded, the server labels unknown ones "other"
+method_series series_for(const std::string& method) {
+    static rcu_snapshot<std::unordered_map<std::string, method_series>> cache;
+    auto current = cache.load();
+    auto it = current->find(method);
+    if (it != current->end()) {
+        return it->second;
+    }
+    
+    auto& registry = metrics_registry::instance();
+    method_series series{
+        registry.get_histogram("mcp_request_duration", "Time from dispatch to response of a JSON-RPC request", {{"method", method}}),
+        registry.get_counter("mcp_requests_total", "JSON-RPC requests", {{"method", method}, {"status", "ok"}}),
+        registry.get_counter("mcp_requests_total", "JSON-RPC requests", {{"method", method}, {"status", "error"}})};
+    cache.update([&](std::unordered_map<std::string, method_series>& series_by_method) {
+        series_by_method.emplace(method, series);
+    });
+    return series;
+}
+
+// Record a POST on the message endpoint
+void record_http_request(const char* transport, int status, std::chrono::steady_clock::time_point start) {
+    auto& registry = metrics_registry::instance();
+    registry.get_histogram("mcp_http_request_duration", "Time to handle a POST on the message endpoint",
+        {{"transport", transport}}).record(std::chrono::steady_clock::now() - start);
+    registry.get_counter("mcp_http_requests_total", "POSTs on the message endpoint",
+        {{"transport", transport}, {"status", std::to_string(status)}}).add();
+}
+
+// Serialize a JSON-RPC message
+std::string to_json_text(const json& message) {
+    std::string text;
+    json_writer(text).value(message);
+    return text;
+}
+
+// Render a JSON-RPC message as an SSE event, serialized in place after the prefix
+std::string sse_frame(const json& message) {
+    std::string frame = "event: message\r\ndata: ";
+    json_writer(frame).value(message);
+    frame += "\r\n\r\n";
+    return frame;
+}
+
+// Queue a JSON-RPC message on a session's SSE stream
+void send_sse_message(event_dispatcher& dispatcher, const std::string& session_id, const json& message) {
+    bool sent = dispatcher.send_event(sse_frame(message));
+    record_sse_event(sent);
+    if (!sent) {
+        LOG_ERROR("Failed to send response via SSE: session_id=", session_id);
+    }
+}
+
+// Response to a Streamable HTTP request, filled in by whichever thread completes the handler
+struct pending_reply {
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool done = false;
+    std::string payload;
+
+    void set(std::string value) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            payload = std::move(value);
+            done = true;
+        }
+        cv.notify_all();
+    }
+
+    bool wait_for(std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lock(mutex);
+        return cv.wait_for(lock, timeout, [this] { return done; });
+    }
+
+    // Waits without a limit when when is time_point::max()
+    bool wait_until(std::chrono::steady_clock::time_point when) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (when == std::chrono::steady_clock::time_point::max()) {
+            cv.wait(lock, [this] { return done; });
+            return true;
+        }
+        return cv.wait_until(lock, when, [this] { return done; });
+    }
+};
+
+// How long a handler has after its deadline to answer before the server answers for it
+const std::chrono::seconds reply_grace(2);
+
+// Entries of a batch that expect a response, the ones admission control counts
+size_t count_requests(const json& batch) {
+    size_t count = 0;
+    for (const auto& entry : batch) {
+        if (entry.is_object() && entry.contains("method") && entry.contains("id") && !entry["id"].is_null()) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+bool is_cancellation(const json& entry) {
+    return entry.is_object() && !entry.contains("id") && entry.value("method", "") == "notifications/cancelled";
+}
+
+} // namespace
+
+server::server(const std::string& host, int port, const std::string& name, const std::string& version, const std::string& sse_endpoint, const std::string& msg_endpoint, transport_mode mode)
+    : host_(host), port_(port), name_(name), version_(version), sse_endpoint_(sse_endpoint), msg_endpoint_(msg_endpoint), mode_(mode) {
     http_server_ = std::make_unique<httplib::Server>();
+    
+    // Responses are written as separate header and body chunks, don't let Nagle hold the body back
+    http_server_->set_tcp_nodelay(true);
 }
 
 server::~server() {
@@ -29,18 +219,58 @@ bool server::start(bool blocking) {
     // Setup CORS handling
     http_server_->Options(".*", [](const httplib::Request& req, httplib::Response& res) {
         res.set_header("Access-Control-Allow-Origin", "*");
-        res.set_header("Access-Control-Allow-Methods", "GET, POST, OPTIONS");
-        res.set_header("Access-Control-Allow-Headers", "Content-Type");
+        res.set_header("Access-Control-Allow-Methods", "GET, POST, DELETE, OPTIONS");
+        res.set_header("Access-Control-Allow-Headers", "Content-Type, Accept, Mcp-Session-Id");
         res.status = 204; // No Content
     });
     
-    // Setup JSON-RPC endpoint
-    http_server_->Post(msg_endpoint_.c_str(), [this](const httplib::Request& req, httplib::Response& res) {
-        this->handle_jsonrpc(req, res);
-        LOG_INFO(req.remote_addr, ":", req.remote_port, " - \"POST ", req.path, " HTTP/1.1\" ", res.status);
-    });
+    if (mode_ == transport_mode::streamable_http) {
+        // Setup Streamable HTTP endpoint
+        http_server_->Post(msg_endpoint_.c_str(), [this](const httplib::Request& req, httplib::Response& res) {
+            auto start = std::chrono::steady_clock::now();
+            span http_span("http.post", "streamable_http");
+            this->handle_streamable_post(req, res);
+            http_span.end();
+            record_http_request("streamable_http", res.status, start);
+            LOG_INFO(req.remote_addr, ":", req.remote_port, " - \"POST ", req.path, " HTTP/1.1\" ", res.status);
+        });
+
+        http_server_->Get(msg_endpoint_.c_str(), [this](const httplib::Request& req, httplib::Response& res) {
+            this->handle_streamable_get(req, res);
+            LOG_INFO(req.remote_addr, ":", req.remote_port, " - \"GET ", req.path, " HTTP/1.1\" ", res.status);
+        });
 
-    // Setup SSE endpoint
+        http_server_->Delete(msg_endpoint_.c_str(), [this](const httplib::Request& req, httplib::Response& res) {
+            this->handle_streamable_delete(req, res);
+            LOG_INFO(req.remote_addr, ":", req.remote_port, " - \"DELETE ", req.path, " HTTP/1.1\" ", res.status);
+        });
+    } else {
+        // Setup JSON-RPC endpoint
+        http_server_->Post(msg_endpoint_.c_str(), [this](const httplib::Request& req, httplib::Response& res) {
+            auto start = std::chrono::steady_clock::now();
+            span http_span("http.post", "sse");
+            this->handle_jsonrpc(req, res);
+            http_span.end();
+            record_http_request("sse", res.status, start);
+            LOG_INFO(req.remote_addr, ":", req.remote_port, " - \"POST ", req.path, " HTTP/1.1\" ", res.status);
+        });
+    }
+
+    // Setup metrics endpoint
+    if (!metrics_endpoint_.empty()) {
+        http_server_->Get(metrics_endpoint_.c_str(), [this](const httplib::Request& req, httplib::Response& res) {
+            this->handle_metrics(req, res);
+        });
+    }
+
+    // Setup trace endpoint
+    if (!trace_endpoint_.empty()) {
+        http_server_->Get(trace_endpoint_.c_str(), [this](const httplib::Request& req, httplib::Response& res) {
+            this->handle_trace(req, res);
+        });
+    }
+
+    // Setup SSE endpoint (also kept in Streamable HTTP mode for older clients)
     http_server_->Get(sse_endpoint_.c_str(), [this](const httplib::Request& req, httplib::Response& res) {
         this->handle_sse(req, res);
         LOG_INFO(req.remote_addr, ":", req.remote_port, " - \"GET ", req.path, " HTTP/1.1\" ", res.status);
@@ -111,32 +341,22 @@ void server::stop() {
     std::vector<std::shared_ptr<event_dispatcher>> dispatchers_to_close;
     std::vector<std::unique_ptr<std::thread>> threads_to_join;
     
-    {
-        std::lock_guard<std::mutex> lock(mutex_);
-        
-        // Copy all dispatchers
-        dispatchers_to_close.reserve(session_dispatchers_.size());
-        for (const auto& [_, dispatcher] : session_dispatchers_) {
-            dispatchers_to_close.push_back(dispatcher);
-        }
-        
-        // Copy all threads
-        threads_to_join.reserve(sse_threads_.size());
-        for (auto& [_, thread] : sse_threads_) {
-            if (thread && thread->joinable()) {
-                threads_to_join.push_back(std::move(thread));
-            }
+    // Take all dispatchers and threads out of the registries
+    session_dispatchers_.drain([&](const std::string& /* session_id */, std::shared_ptr<event_dispatcher> dispatcher) {
+        dispatchers_to_close.push_back(std::move(dispatcher));
+    });
+    
+    sse_threads_.drain([&](const std::string& /* session_id */, std::unique_ptr<std::thread> thread) {
+        if (thread && thread->joinable()) {
+            threads_to_join.push_back(std::move(thread));
         }
-        
-        // Clear the maps
-        session_dispatchers_.clear();
-        sse_threads_.clear();
-        session_initialized_.clear();
-    }
+    });
+    
+    session_initialized_.drain([](const std::string& /* session_id */, bool /* initialized */) {});
     
     // Close all sessions
-    for (const auto& [session_id, _] : session_dispatchers_) {
-        close_session(session_id);
+    for (const auto& dispatcher : dispatchers_to_close) {
+        dispatcher->close();
     }
     
     // Give threads some time to handle close events
@@ -234,8 +454,13 @@ void server::set_capabilities(const json& capabilities) {
 }
 
 void server::register_method(const std::string& method, method_handler handler) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    method_handlers_[method] = handler;
+    register_method(method, to_async_handler(handler));
+}
+
+void server::register_method(const std::string& method, async_method_handler handler) {
+    dispatch_.update([&](dispatch_table& table) {
+        table.methods[method] = handler;
+    });
 }
 
 void server::register_notification(const std::string& method, notification_handler handler) {
@@ -244,130 +469,186 @@ void server::register_notification(const std::string& method, notification_handl
 }
 
 void server::register_resource(const std::string& path, std::shared_ptr<resource> resource) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    resources_[path] = resource;
-    
-    // Register methods for resource access
-    if (method_handlers_.find("resources/read") == method_handlers_.end()) {
-        method_handlers_["resources/read"] = [this](const json& params, const std::string& session_id) -> json {
-            if (!params.contains("uri")) {
-                throw mcp_exception(error_code::invalid_params, "Missing 'uri' parameter");
-            }
-            
-            std::string uri = params["uri"];
-            auto it = resources_.find(uri);
-            if (it == resources_.end()) {
-                throw mcp_exception(error_code::invalid_params, "Resource not found: " + uri);
-            }
-            
-            json contents = json::array();
-            contents.push_back(it->second->read());
-            
-            return json{
-                {"contents", contents}
-            };
-        };
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        resources_[path] = resource;
     }
     
-    if (method_handlers_.find("resources/list") == method_handlers_.end()) {
-        method_handlers_["resources/list"] = [this](const json& params, const std::string& session_id) -> json {
-            json resources = json::array();
+    // Register methods for resource access
+    dispatch_.update([this](dispatch_table& table) {
+        auto& method_handlers = table.methods;
         
-            for (const auto& [uri, res] : resources_) {
-                resources.push_back(res->get_metadata());
-            }
-            
-            json result = {
-                {"resources", resources}
-            };
-            
-            if (params.contains("cursor")) {
-                result["nextCursor"] = "";
-            }
-            
-            return result;
-        };
-    }
-    
-    if (method_handlers_.find("resources/subscribe") == method_handlers_.end()) {
-        method_handlers_["resources/subscribe"] = [this](const json& params, const std::string& session_id) -> json {
-            if (!params.contains("uri")) {
-                throw mcp_exception(error_code::invalid_params, "Missing 'uri' parameter");
-            }
-            
-            std::string uri = params["uri"];
-            auto it = resources_.find(uri);
-            if (it == resources_.end()) {
-                throw mcp_exception(error_code::invalid_params, "Resource not found: " + uri);
-            }
+        if (method_handlers.find("resources/read") == method_handlers.end()) {
+            method_handlers["resources/read"] = to_async_handler([this](const json& params, const std::string& session_id) -> json {
+                if (!params.contains("uri")) {
+                    throw mcp_exception(error_code::invalid_params, "Missing 'uri' parameter");
+                }
+                
+                std::string uri = params["uri"];
+                std::shared_ptr<mcp::resource> res;
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    auto it = resources_.find(uri);
+                    if (it == resources_.end() || !it->second->visible_to(session_id)) {
+                        throw mcp_exception(error_code::invalid_params, "Resource not found: " + uri);
+                    }
+                    res = it->second;
+                }
+                
+                json contents = json::array();
+                contents.push_back(res->read());
+                
+                return json{
+                    {"contents", contents}
+                };
+            });
+        }
+        
+        if (method_handlers.find("resources/list") == method_handlers.end()) {
+            method_handlers["resources/list"] = to_async_handler([this](const json& params, const std::string& session_id) -> json {
+                json resources = json::array();
             
-            return json::object();
-        };
-    }
-    
-    if (method_handlers_.find("resources/templates/list") == method_handlers_.end()) {
-        method_handlers_["resources/templates/list"] = [this](const json& params, const std::string& session_id) -> json {
-            return json::array();
-        };
-    }
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    for (const auto& [uri, res] : resources_) {
+                        if (res->visible_to(session_id)) {
+                            resources.push_back(res->get_metadata());
+                        }
+                    }
+                }
+                
+                json result = {
+                    {"resources", resources}
+                };
+                
+                if (params.contains("cursor")) {
+                    result["nextCursor"] = "";
+                }
+                
+                return result;
+            });
+        }
+        
+        if (method_handlers.find("resources/subscribe") == method_handlers.end()) {
+            method_handlers["resources/subscribe"] = to_async_handler([this](const json& params, const std::string& session_id) -> json {
+                if (!params.contains("uri")) {
+                    throw mcp_exception(error_code::invalid_params, "Missing 'uri' parameter");
+                }
+                
+                std::string uri = params["uri"];
+                std::lock_guard<std::mutex> lock(mutex_);
+                auto it = resources_.find(uri);
+                if (it == resources_.end() || !it->second->visible_to(session_id)) {
+                    throw mcp_exception(error_code::invalid_params, "Resource not found: " + uri);
+                }
+                
+                return json::object();
+            });
+        }
+        
+        if (method_handlers.find("resources/templates/list") == method_handlers.end()) {
+            method_handlers["resources/templates/list"] = to_async_handler([this](const json& params, const std::string& session_id) -> json {
+                return json::array();
+            });
+        }
+    });
 }
 
 void server::register_tool(const tool& tool, tool_handler handler) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    tools_[tool.name] = std::make_pair(tool, handler);
-    
-    // Register methods for tool listing and calling
-    if (method_handlers_.find("tools/list") == method_handlers_.end()) {
-        method_handlers_["tools/list"] = [this](const json& params, const std::string& session_id) -> json {
-            json tools_json = json::array();
-            for (const auto& [name, tool_pair] : tools_) {
-                tools_json.push_back(tool_pair.first.to_json());
-            }
-            return json{{"tools", tools_json}};
-        };
-    }
-    
-    if (method_handlers_.find("tools/call") == method_handlers_.end()) {
-        method_handlers_["tools/call"] = [this](const json& params, const std::string& session_id) -> json {
-            if (!params.contains("name")) {
-                throw mcp_exception(error_code::invalid_params, "Missing 'name' parameter");
-            }
-            
-            std::string tool_name = params["name"];
-            auto it = tools_.find(tool_name);
-            if (it == tools_.end()) {
-                throw mcp_exception(error_code::invalid_params, "Tool not found: " + tool_name);
-            }
-            
-            json tool_args = params.contains("arguments") ? params["arguments"] : json::array();
+    register_tool(tool, to_async_handler(handler));
+}
 
-            if (tool_args.is_string()) {
-                try {
-                    tool_args = json::parse(tool_args.get<std::string>());
-                } catch (const json::exception& e) {
-                    throw mcp_exception(error_code::invalid_params, "Invalid JSON arguments: " + std::string(e.what()));
+void server::register_tool(const tool& tool, async_tool_handler handler) {
+    dispatch_.update([&](dispatch_table& table) {
+        table.tools[tool.name] = std::make_pair(tool, handler);
+        
+        // Register methods for tool listing and calling
+        auto& method_handlers = table.methods;
+        
+        if (method_handlers.find("tools/list") == method_handlers.end()) {
+            method_handlers["tools/list"] = to_async_handler([this](const json& params, const std::string& session_id) -> json {
+                auto current = dispatch_.load();
+                json tools_json = json::array();
+                for (const auto& [name, tool_pair] : current->tools) {
+                    tools_json.push_back(tool_pair.first.to_json());
                 }
-            }
+                return json{{"tools", tools_json}};
+            });
+        }
+        
+        if (method_handlers.find("tools/call") == method_handlers.end()) {
+            method_handlers["tools/call"] = [this](const json& params, const std::string& session_id, completion_handler done) {
+                if (!params.contains("name")) {
+                    throw mcp_exception(error_code::invalid_params, "Missing 'name' parameter");
+                }
+                
+                std::string tool_name = params["name"];
+                async_tool_handler tool_handler;
+                {
+                    auto current = dispatch_.load();
+                    auto it = current->tools.find(tool_name);
+                    if (it == current->tools.end()) {
+                        throw mcp_exception(error_code::invalid_params, "Tool not found: " + tool_name);
+                    }
+                    tool_handler = it->second.second;
+                }
+                
+                json tool_args = params.contains("arguments") ? params["arguments"] : json::array();
 
-            json tool_result = {
-                {"isError", false}
-            };
+                if (tool_args.is_string()) {
+                    try {
+                        tool_args = json::parse(tool_args.get<std::string>());
+                    } catch (const json::exception& e) {
+                        throw mcp_exception(error_code::invalid_params, "Invalid JSON arguments: " + std::string(e.what()));
+                    }
+                }
 
-            try {
-                tool_result["content"] = it->second.second(tool_args, session_id);
-            } catch (const std::exception& e) {
-                tool_result["isError"] = true;
-                tool_result["content"] = json::array({
-                    {
-                        {"type", "text"},
-                        {"text", e.what()}
+                auto start = std::chrono::steady_clock::now();
+                async_span tool_span("tool", tool_name);
+                trace_scope scope(tool_span.context());
+                tool_handler(tool_args, session_id, [done, tool_name, start, tool_span](json content, std::exception_ptr error) mutable {
+                    tool_span.end();
+                    auto& registry = metrics_registry::instance();
+                    registry.get_histogram("mcp_tool_duration", "Tool handler run time",
+                        {{"tool", tool_name}}).record(std::chrono::steady_clock::now() - start);
+                    registry.get_counter("mcp_tool_calls_total", "Tool calls",
+                        {{"tool", tool_name}, {"status", error ? "error" : "ok"}}).add();
+
+                    json tool_result = {
+                        {"isError", false}
+                    };
+
+                    if (error) {
+                        std::string message = "Unknown error";
+                        try {
+                            std::rethrow_exception(error);
+                        } catch (const mcp_exception& e) {
+                            // A cancelled or timed out call is answered with the JSON-RPC error, not a tool result
+                            if (e.code() == error_code::request_cancelled || e.code() == error_code::request_timeout) {
+                                done(nullptr, error);
+                                return;
+                            }
+                            message = e.what();
+                        } catch (const std::exception& e) {
+                            message = e.what();
+                        } catch (...) {
+                        }
+                        tool_result["isError"] = true;
+                        tool_result["content"] = json::array({
+                            {
+                                {"type", "text"},
+                                {"text", message}
+                            }
+                        });
+                    } else {
+                        tool_result["content"] = std::move(content);
                     }
-                });
-            }
 
-            return tool_result;
-        };
-    }
+                    done(std::move(tool_result), nullptr);
+                });
+            };
+        }
+    });
 }
 
 void server::register_session_cleanup(const std::string& key, session_cleanup_handler handler) {
@@ -375,11 +656,16 @@ void server::register_session_cleanup(const std::string& key, session_cleanup_ha
     session_cleanup_handler_[key] = handler;
 }
 
-std::vector<tool> server::get_tools() const {
+void server::unregister_resource(const std::string& path) {
     std::lock_guard<std::mutex> lock(mutex_);
+    resources_.erase(path);
+}
+
+std::vector<tool> server::get_tools() const {
+    auto current = dispatch_.load();
     std::vector<tool> tools;
     
-    for (const auto& [name, tool_pair] : tools_) {
+    for (const auto& [name, tool_pair] : current->tools) {
         tools.push_back(tool_pair.first);
     }
     
@@ -408,10 +694,7 @@ void server::handle_sse(const httplib::Request& req, httplib::Response& res) {
     session_dispatcher->update_activity();
     
     // Add session dispatcher to mapping table
-    {
-        std::lock_guard<std::mutex> lock(mutex_);
-        session_dispatchers_[session_id] = session_dispatcher;
-    }
+    session_dispatchers_.insert_or_assign(session_id, session_dispatcher);
     
     // Create session thread
     auto thread = std::make_unique<std::thread>([this, res, session_id, session_uri, session_dispatcher]() {
@@ -459,10 +742,7 @@ void server::handle_sse(const httplib::Request& req, httplib::Response& res) {
     });
     
     // Store thread
-    {
-        std::lock_guard<std::mutex> lock(mutex_);
-        sse_threads_[session_id] = std::move(thread);
-    }
+    sse_threads_.insert_or_assign(session_id, std::move(thread));
     
     // Setup chunked content provider
     res.set_chunked_content_provider("text/event-stream", [this, session_id, session_dispatcher](size_t /* offset */, httplib::DataSink& sink) {
@@ -517,24 +797,15 @@ void server::handle_jsonrpc(const httplib::Request& req, httplib::Response& res)
     std::string session_id = it != req.params.end() ? it->second : "";
 
     // Update session activity time
-    if (!session_id.empty()) {
-        std::shared_ptr<event_dispatcher> dispatcher;
-        {
-            std::lock_guard<std::mutex> lock(mutex_);
-            auto disp_it = session_dispatchers_.find(session_id);
-            if (disp_it != session_dispatchers_.end()) {
-                dispatcher = disp_it->second;
-            }
-        }
-        
-        if (dispatcher) {
-            dispatcher->update_activity();
-        }
+    std::shared_ptr<event_dispatcher> dispatcher;
+    if (!session_id.empty() && session_dispatchers_.find(session_id, dispatcher)) {
+        dispatcher->update_activity();
     }
     
     // Parse request
     json req_json;
     try {
+        span parse_span("json.parse");
         req_json = json::parse(req.body);
     } catch (const json::exception& e) {
         LOG_ERROR("Failed to parse JSON request: ", e.what());
@@ -544,36 +815,47 @@ void server::handle_jsonrpc(const httplib::Request& req, httplib::Response& res)
     }
     
     // Check if session exists
-    std::shared_ptr<event_dispatcher> dispatcher;
-    {
-        std::lock_guard<std::mutex> lock(mutex_);
-        auto disp_it = session_dispatchers_.find(session_id);
-        if (disp_it == session_dispatchers_.end()) {
-            // Handle ping request
-            if (req_json["method"] == "ping") {
-                res.status = 202;
-                res.set_content("Accepted", "text/plain");
-                return;
-            }
-            LOG_ERROR("Session not found: ", session_id);
-            res.status = 404;
-            res.set_content("{\"error\":\"Session not found\"}", "application/json");
+    if (!dispatcher) {
+        // Handle ping request
+        if (req_json.is_object() && req_json.value("method", "") == "ping") {
+            res.status = 202;
+            res.set_content("Accepted", "text/plain");
+            return;
+        }
+        LOG_ERROR("Session not found: ", session_id);
+        res.status = 404;
+        res.set_content("{\"error\":\"Session not found\"}", "application/json");
+        return;
+    }
+    
+    // For batches, the entries are processed concurrently and all responses are sent in one SSE event
+    if (req_json.is_array()) {
+        // Only entries with an id are counted, cancellations in a shed batch still apply
+        size_t requests = count_requests(req_json);
+        if (requests > 0 && !admit(session_id, requests)) {
+            apply_cancellations(session_id, req_json);
+            reject_overloaded(res, nullptr);
             return;
         }
-        dispatcher = disp_it->second;
+        process_batch(req_json, session_id, [session_id, dispatcher](json responses) {
+            // A batch of notifications has nothing to send back
+            if (responses.is_array() && responses.empty()) {
+                return;
+            }
+            send_sse_message(*dispatcher, session_id, responses);
+        });
+        release(session_id, requests);
+        
+        // Return 202 Accepted
+        res.status = 202;
+        res.set_content("Accepted", "text/plain");
+        return;
     }
     
     // Create request object
     request mcp_req;
     try {
-        mcp_req.jsonrpc = req_json["jsonrpc"].get<std::string>();
-        if (req_json.contains("id") && !req_json["id"].is_null()) {
-            mcp_req.id = req_json["id"];
-        }
-        mcp_req.method = req_json["method"].get<std::string>();
-        if (req_json.contains("params")) {
-            mcp_req.params = req_json["params"];
-        }
+        mcp_req = parse_request(req_json);
     } catch (const std::exception& e) {
         LOG_ERROR("Failed to create request object: ", e.what());
         res.status = 400;
@@ -583,10 +865,13 @@ void server::handle_jsonrpc(const httplib::Request& req, httplib::Response& res)
     
     // If it is a notification (no ID), process it directly and return 202 status code
     if (mcp_req.is_notification()) {
-        // Process it asynchronously in the thread pool
-        thread_pool_.enqueue([this, mcp_req, session_id]() {
-            process_request(mcp_req, session_id);
-        });
+        if (mcp_req.method == "notifications/cancelled") {
+            // Not queued behind the work it cancels
+            process_request(mcp_req, session_id, [](json) {});
+        } else {
+            // Process it asynchronously in the thread pool
+            enqueue_request(mcp_req, session_id, [](json) {});
+        }
         
         // Return 202 Accepted
         res.status = 202;
@@ -594,33 +879,537 @@ void server::handle_jsonrpc(const httplib::Request& req, httplib::Response& res)
         return;
     }
     
+    // Excess requests are turned away before they are queued
+    if (!admit(session_id, 1)) {
+        reject_overloaded(res, mcp_req.id);
+        return;
+    }
+    
     // For requests with ID, process it asynchronously in the thread pool and return the result via SSE
-    thread_pool_.enqueue([this, mcp_req, session_id, dispatcher]() {
-        // Process the request
-        json response_json = process_request(mcp_req, session_id);
-        
+    // The response may be produced on another thread by async handlers
+    enqueue_request(mcp_req, session_id, [session_id, dispatcher](json response_json) {
         // Send response via SSE
-        std::stringstream ss;
-        ss << "event: message\r\ndata: " << response_json.dump() << "\r\n\r\n";
-        bool result = dispatcher->send_event(ss.str());
-        
-        if (!result) {
-            LOG_ERROR("Failed to send response via SSE: session_id=", session_id);
-        }
+        send_sse_message(*dispatcher, session_id, response_json);
     });
+    release(session_id, 1);
     
     // Return 202 Accepted
     res.status = 202;
     res.set_content("Accepted", "text/plain");
 }
 
-json server::process_request(const request& req, const std::string& session_id) {
-    // Check if it is a notification
-    if (req.is_notification()) {
-        if (req.method == "notifications/initialized") {
-            set_session_initialized(session_id, true);
+void server::handle_streamable_post(const httplib::Request& req, httplib::Response& res) {
+    // Setup response headers
+    res.set_header("Access-Control-Allow-Origin", "*");
+    res.set_header("Access-Control-Expose-Headers", "Mcp-Session-Id");
+    
+    // Clients of the HTTP+SSE transport carry the session in the query string
+    if (req.has_param("session_id")) {
+        handle_jsonrpc(req, res);
+        return;
+    }
+    
+    // Parse request
+    json req_json;
+    try {
+        span parse_span("json.parse");
+        req_json = json::parse(req.body);
+    } catch (const json::exception& e) {
+        LOG_ERROR("Failed to parse JSON request: ", e.what());
+        res.status = 400;
+        res.set_content("{\"error\":\"Invalid JSON\"}", "application/json");
+        return;
+    }
+    
+    // Responses to server-initiated requests need no reply
+    bool is_batch = req_json.is_array();
+    if (req_json.is_object() && !req_json.contains("method") && (req_json.contains("result") || req_json.contains("error"))) {
+        res.status = 202;
+        return;
+    }
+    
+    // Create request object
+    request mcp_req;
+    if (!is_batch) {
+        try {
+            mcp_req = parse_request(req_json);
+        } catch (const std::exception& e) {
+            LOG_ERROR("Failed to create request object: ", e.what());
+            res.status = 400;
+            res.set_content("{\"error\":\"Invalid request format\"}", "application/json");
+            return;
+        }
+    }
+    
+    // Sessions are created by initialize and identified by the Mcp-Session-Id header afterwards,
+    // initialize cannot be part of a batch
+    std::string session_id = req.get_header_value("Mcp-Session-Id");
+    bool creates_session = !is_batch && mcp_req.method == "initialize" && session_id.empty();
+    if (!creates_session && (is_batch || mcp_req.method != "ping")) {
+        if (session_id.empty()) {
+            res.status = 400;
+            res.set_content("{\"error\":\"Missing Mcp-Session-Id header\"}", "application/json");
+            return;
+        }
+        
+        std::shared_ptr<event_dispatcher> dispatcher;
+        if (!session_dispatchers_.find(session_id, dispatcher)) {
+            LOG_ERROR("Session not found: ", session_id);
+            res.status = 404;
+            res.set_content("{\"error\":\"Session not found\"}", "application/json");
+            return;
+        }
+        dispatcher->update_activity();
+    }
+    
+    // Excess requests are turned away before they are queued or create a session,
+    // only entries with an id are counted and cancellations in a shed batch still apply
+    size_t requests = is_batch ? count_requests(req_json) : (mcp_req.is_notification() ? 0 : 1);
+    if (requests > 0 && !admit(session_id, requests)) {
+        if (is_batch) {
+            apply_cancellations(session_id, req_json);
+        }
+        reject_overloaded(res, is_batch ? json(nullptr) : mcp_req.id);
+        return;
+    }
+    // The room is released under the session the client sent, initialize sends none
+    std::string admitted_as = session_id;
+    if (creates_session) {
+        session_id = generate_session_id();
+        
+        auto session_dispatcher = std::make_shared<event_dispatcher>();
+        session_dispatcher->update_activity();
+        session_dispatchers_.insert_or_assign(session_id, session_dispatcher);
+        res.set_header("Mcp-Session-Id", session_id);
+    }
+    
+    // Notifications are processed before they are acknowledged, so that a
+    // request sent right after notifications/initialized sees the session as initialized
+    if (!is_batch && mcp_req.is_notification()) {
+        process_request(mcp_req, session_id, [](json) {});
+        res.status = 202;
+        return;
+    }
+    
+    auto reply = std::make_shared<pending_reply>();
+    std::shared_ptr<cancellation_source> cancellation;
+    auto deadline = std::chrono::steady_clock::time_point::max();
+    if (is_batch) {
+        // A batch of notifications leaves the payload empty
+        deadline = process_batch(req_json, session_id, [reply](json responses) {
+            reply->set(responses.is_array() && responses.empty() ? std::string() : to_json_text(responses));
+        });
+    } else {
+        cancellation = enqueue_request(mcp_req, session_id, [reply](json response_json) {
+            reply->set(to_json_text(response_json));
+        });
+        deadline = cancellation->token().deadline();
+    }
+    release(admitted_as, requests);
+    
+    // A handler that ignores its deadline is answered for after a grace period, so it cannot hold this thread
+    auto give_up = deadline == std::chrono::steady_clock::time_point::max() ? deadline : deadline + reply_grace;
+    json reply_id = is_batch ? json(nullptr) : mcp_req.id;
+    auto timed_out = [reply_id]() {
+        return to_json_text(response::create_error(reply_id, error_code::request_timeout, "Request timed out").to_json());
+    };
+    
+    // Clients that cannot read a stream always get the response in the body
+    bool accepts_stream = req.get_header_value("Accept").find("text/event-stream") != std::string::npos;
+    if (!accepts_stream && !reply->wait_until(give_up)) {
+        LOG_WARNING("No reply by the deadline, answering for the handler: session_id=", session_id);
+        res.status = 200;
+        res.set_content(timed_out(), "application/json");
+        return;
+    }
+    
+    // Short requests are answered directly
+    std::chrono::milliseconds direct_response_timeout;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        direct_response_timeout = direct_response_timeout_;
+    }
+    if (!accepts_stream || reply->wait_for(direct_response_timeout)) {
+        if (reply->payload.empty()) {
+            res.status = 202;
+            return;
+        }
+        res.status = 200;
+        res.set_content(reply->payload, "application/json");
+        return;
+    }
+    
+    // Long-running request: upgrade to a per-request SSE stream that carries only its response
+    res.set_header("Cache-Control", "no-cache");
+    res.set_chunked_content_provider("text/event-stream", [reply, give_up, timed_out](size_t /* offset */, httplib::DataSink& sink) {
+        bool ready = reply->wait_for(std::chrono::seconds(5));
+        if (!ready && std::chrono::steady_clock::now() < give_up) {
+            // Keep the connection alive while the handler is running
+            static const std::string keepalive = ": keepalive\r\n\r\n";
+            return sink.write(keepalive.data(), keepalive.size());
+        }
+        
+        std::string timeout_payload = ready ? std::string() : timed_out();
+        const std::string& payload = ready ? reply->payload : timeout_payload;
+        if (!payload.empty()) {
+            // The payload is written as is, between the event prefix and terminator
+            static const std::string prefix = "event: message\r\ndata: ";
+            static const std::string terminator = "\r\n\r\n";
+            if (!sink.write(prefix.data(), prefix.size()) || !sink.write(payload.data(), payload.size())
+                || !sink.write(terminator.data(), terminator.size())) {
+                return false;
+            }
+        }
+        sink.done();
+        return true;
+    }, [reply, cancellation](bool success) {
+        // The client went away before the response, nobody is left to read it
+        if (!success && cancellation && !reply->wait_for(std::chrono::milliseconds(0)) && cancellation->cancel("Client disconnected")) {
+            metrics_registry::instance().get_counter("mcp_requests_cancelled_total", "Requests cancelled while running or queued",
+                {{"cause", "disconnect"}}).add();
+        }
+    });
+}
+
+void server::handle_streamable_get(const httplib::Request& req, httplib::Response& res) {
+    res.set_header("Access-Control-Allow-Origin", "*");
+    
+    std::string session_id = req.get_header_value("Mcp-Session-Id");
+    std::shared_ptr<event_dispatcher> dispatcher;
+    if (!session_dispatchers_.find(session_id, dispatcher)) {
+        res.status = session_id.empty() ? 400 : 404;
+        res.set_content("{\"error\":\"Session not found\"}", "application/json");
+        return;
+    }
+    
+    // Stream for server-initiated messages (requests and notifications sent with send_request)
+    res.set_header("Cache-Control", "no-cache");
+    res.set_chunked_content_provider("text/event-stream", [dispatcher](size_t /* offset */, httplib::DataSink& sink) {
+        if (dispatcher->is_closed()) {
+            return false;
+        }
+        
+        dispatcher->update_activity();
+        if (!dispatcher->wait_event(&sink)) {
+            if (dispatcher->is_closed()) {
+                return false;
+            }
+            
+            // Nothing to send yet, keep the stream open
+            static const std::string keepalive = ": keepalive\r\n\r\n";
+            return sink.write(keepalive.data(), keepalive.size());
+        }
+        return true;
+    });
+}
+
+void server::handle_streamable_delete(const httplib::Request& req, httplib::Response& res) {
+    res.set_header("Access-Control-Allow-Origin", "*");
+    
+    std::string session_id = req.get_header_value("Mcp-Session-Id");
+    if (!session_dispatchers_.contains(session_id)) {
+        res.status = 404;
+        return;
+    }
+    
+    close_session(session_id);
+    res.status = 200;
+}
+
+std::chrono::steady_clock::time_point server::process_batch(const json& batch, const std::string& session_id, std::function<void(json)> reply) {
+    // An empty batch is answered with a single error
+    if (batch.empty()) {
+        reply(response::create_error(nullptr, error_code::invalid_request, "Empty batch").to_json());
+        return std::chrono::steady_clock::time_point::max();
+    }
+    
+    // Shared by the entries, the last one to complete sends the combined responses
+    struct batch_state {
+        std::mutex mutex;
+        json responses = json::array();
+        size_t remaining = 0;
+        std::function<void(json)> reply;
+    };
+    
+    auto state = std::make_shared<batch_state>();
+    state->remaining = batch.size();
+    state->reply = std::move(reply);
+    
+    auto complete = [state](json response_json) {
+        bool last = false;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (!response_json.is_null()) {
+                state->responses.push_back(std::move(response_json));
+            }
+            last = --state->remaining == 0;
+        }
+        
+        if (last) {
+            state->reply(std::move(state->responses));
+        }
+    };
+    
+    // Without any request, notifications alone have no deadline either
+    auto latest = std::chrono::steady_clock::time_point::min();
+    for (const auto& entry : batch) {
+        // Responses to server-initiated requests need no reply
+        if (entry.is_object() && !entry.contains("method") && (entry.contains("result") || entry.contains("error"))) {
+            complete(nullptr);
+            continue;
+        }
+        
+        request mcp_req;
+        try {
+            mcp_req = parse_request(entry);
+        } catch (const std::exception& e) {
+            LOG_ERROR("Failed to create request object: ", e.what());
+            json id = entry.is_object() && entry.contains("id") ? entry["id"] : json(nullptr);
+            complete(response::create_error(id, error_code::invalid_request, "Invalid request format").to_json());
+            continue;
+        }
+        
+        // Not queued behind the work it cancels
+        if (mcp_req.is_notification() && mcp_req.method == "notifications/cancelled") {
+            process_request(mcp_req, session_id, [](json) {});
+            complete(nullptr);
+            continue;
+        }
+        
+        // Notifications are processed but produce no entry in the responses
+        bool notification = mcp_req.is_notification();
+        auto source = enqueue_request(mcp_req, session_id, [notification, complete](json response_json) {
+            complete(notification ? json(nullptr) : std::move(response_json));
+        });
+        latest = std::max(latest, source ? source->token().deadline() : std::chrono::steady_clock::time_point::max());
+    }
+    return latest == std::chrono::steady_clock::time_point::min() ? std::chrono::steady_clock::time_point::max() : latest;
+}
+
+std::shared_ptr<cancellation_source> server::enqueue_request(const request& req, const std::string& session_id, std::function<void(json)> reply) {
+    // Carry the caller's trace into the worker and record the time spent queued
+    trace_context context = tracer::current();
+    int64_t queued_at = context.valid() ? tracer::now() : 0;
+    
+    // Requests can be cancelled until they are answered, notifications cannot
+    std::shared_ptr<cancellation_source> source;
+    if (!req.is_notification()) {
+        source = std::make_shared<cancellation_source>();
+        std::string key = req.id.dump();
+        in_flight_.update(session_id, [&](std::map<std::string, std::shared_ptr<cancellation_source>>& requests) {
+            requests[key] = source;
+        });
+        requests_in_flight_.fetch_add(1, std::memory_order_relaxed);
+        std::chrono::milliseconds timeout = timeout_for(req);
+        if (timeout.count() > 0) {
+            source->set_deadline(std::chrono::steady_clock::now() + timeout);
+        }
+        reply = [this, session_id, key, source, reply = std::move(reply)](json response_json) {
+            in_flight_.update(session_id, [&](std::map<std::string, std::shared_ptr<cancellation_source>>& requests) {
+                auto it = requests.find(key);
+                if (it != requests.end() && it->second == source) {
+                    requests.erase(it);
+                }
+            });
+            in_flight_.erase_if(session_id, [](const std::map<std::string, std::shared_ptr<cancellation_source>>& requests) {
+                return requests.empty();
+            });
+            requests_in_flight_.fetch_sub(1, std::memory_order_relaxed);
+            source->complete();
+            reply(std::move(response_json));
+        };
+    }
+    
+    thread_pool_.enqueue([this, req, session_id, reply = std::move(reply), context, queued_at, source]() {
+        if (context.valid()) {
+            span_record wait;
+            wait.name = "queue.wait";
+            wait.trace_id = context.trace_id;
+            wait.span_id = tracer::next_id();
+            wait.parent_id = context.span_id;
+            wait.start_ns = queued_at;
+            wait.end_ns = tracer::now();
+            tracer::instance().record(std::move(wait));
+        }
+        
+        trace_scope scope(context);
+        if (!source) {
+            process_request(req, session_id, reply);
+            return;
+        }
+        
+        // Cancelled or past its deadline while queued: answer without running the handler
+        cancellation_token token = source->token();
+        if (!token.is_cancelled() && token.deadline() <= std::chrono::steady_clock::now()) {
+            // The deadline timer may not have fired yet
+            source->cancel("Deadline exceeded", error_code::request_timeout);
+        }
+        if (token.is_cancelled()) {
+            if (token.code() == error_code::request_timeout) {
+                metrics_registry::instance().get_counter("mcp_requests_shed_total", "Requests answered without running",
+                    {{"reason", "deadline"}}).add();
+            }
+            reply(response::create_error(req.id, token.code(), token.reason()).to_json());
+            return;
+        }
+        cancellation_scope cancel_scope(source->token());
+        process_request(req, session_id, reply);
+    });
+    return source;
+}
+
+bool server::admit(const std::string& session_id, size_t count) {
+    size_t max_queued, max_in_flight, max_session_in_flight;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        max_queued = max_queued_;
+        max_in_flight = max_in_flight_;
+        max_session_in_flight = max_session_in_flight_;
+    }
+    
+    // Room is reserved as it is checked, so concurrent callers cannot both take the last slot
+    std::string reason;
+    if (max_queued > 0 && thread_pool_.pending() + count > max_queued) {
+        reason = "queue_full";
+    } else if (requests_in_flight_.fetch_add(count, std::memory_order_relaxed) + count > max_in_flight && max_in_flight > 0) {
+        requests_in_flight_.fetch_sub(count, std::memory_order_relaxed);
+        reason = "in_flight";
+    } else {
+        admitting_.update(session_id, [&](size_t& reserved) {
+            size_t running = 0;
+            in_flight_.visit(session_id, [&running](const std::map<std::string, std::shared_ptr<cancellation_source>>& requests) {
+                running = requests.size();
+            });
+            if (max_session_in_flight > 0 && running + reserved + count > max_session_in_flight) {
+                reason = "session_in_flight";
+            } else {
+                reserved += count;
+            }
+        });
+        if (!reason.empty()) {
+            requests_in_flight_.fetch_sub(count, std::memory_order_relaxed);
+            admitting_.erase_if(session_id, [](size_t reserved) {
+                return reserved == 0;
+            });
+        }
+    }
+    if (reason.empty()) {
+        return true;
+    }
+    
+    LOG_DEBUG("Shedding ", count, " request(s) of session ", session_id, ": ", reason);
+    metrics_registry::instance().get_counter("mcp_requests_shed_total", "Requests answered without running",
+        {{"reason", reason}}).add(count);
+    return false;
+}
+
+void server::release(const std::string& session_id, size_t count) {
+    if (count == 0) {
+        return;
+    }
+    requests_in_flight_.fetch_sub(count, std::memory_order_relaxed);
+    admitting_.update(session_id, [count](size_t& reserved) {
+        reserved -= count;
+    });
+    admitting_.erase_if(session_id, [](size_t reserved) {
+        return reserved == 0;
+    });
+}
+
+void server::apply_cancellations(const std::string& session_id, const json& batch) {
+    for (const auto& entry : batch) {
+        if (is_cancellation(entry) && entry.contains("params")) {
+            cancel_request(session_id, entry["params"]);
+        }
+    }
+}
+
+void server::reject_overloaded(httplib::Response& res, const json& id) {
+    std::chrono::seconds retry_after;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        retry_after = retry_after_;
+    }
+    res.status = 503;
+    res.set_header("Retry-After", std::to_string(retry_after.count()));
+    res.set_content(to_json_text(response::create_error(id, error_code::server_overloaded, "Server overloaded, retry later").to_json()), "application/json");
+}
+
+std::chrono::milliseconds server::timeout_for(const request& req) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (req.method == "tools/call" && req.params.contains("name") && req.params["name"].is_string()) {
+        auto it = tool_timeouts_.find(req.params["name"].get<std::string>());
+        if (it != tool_timeouts_.end()) {
+            return it->second;
+        }
+    }
+    return request_timeout_;
+}
+
+void server::cancel_request(const std::string& session_id, const json& params) {
+    if (!params.is_object() || !params.contains("requestId")) {
+        return;
+    }
+    
+    std::string key = params["requestId"].dump();
+    std::shared_ptr<cancellation_source> source;
+    std::map<std::string, std::shared_ptr<cancellation_source>> requests;
+    if (in_flight_.find(session_id, requests)) {
+        auto it = requests.find(key);
+        if (it != requests.end()) {
+            source = it->second;
         }
-        return json::object();
+    }
+    
+    // The request may have completed already
+    if (!source) {
+        LOG_DEBUG("No running request to cancel: ", key);
+        return;
+    }
+    
+    std::string reason = params.contains("reason") && params["reason"].is_string() ? params["reason"].get<std::string>() : "Request cancelled";
+    LOG_INFO("Cancelling request ", key, " of session ", session_id, ": ", reason);
+    if (source->cancel(reason)) {
+        metrics_registry::instance().get_counter("mcp_requests_cancelled_total", "Requests cancelled while running or queued",
+            {{"cause", "client"}}).add();
+    }
+}
+
+void server::process_request(const request& req, const std::string& session_id, std::function<void(json)> reply) {
+    // Spans opened by the handler are children of the request span
+    async_span request_span("request", req.method);
+    trace_scope scope(request_span.context());
+    
+    // Time the request until its response is produced, labelled by method only for known methods
+    if (!req.is_notification()) {
+        bool known = req.method == "initialize" || req.method == "ping" || dispatch_.load()->methods.count(req.method) > 0;
+        reply = [reply = std::move(reply), series = series_for(known ? req.method : std::string("other")), start = std::chrono::steady_clock::now(), request_span](json response_json) mutable {
+            request_span.end();
+            series.duration.record(std::chrono::steady_clock::now() - start);
+            (response_json.contains("error") ? series.error : series.ok).add();
+            reply(std::move(response_json));
+        };
+        
+        // A handler that completes and then throws, or completes twice, is answered once
+        reply = [reply = std::move(reply), answered = std::make_shared<std::atomic<bool>>(false), method = req.method](json response_json) {
+            if (answered->exchange(true)) {
+                LOG_WARNING("Dropping another response to an answered request: ", method);
+                return;
+            }
+            reply(std::move(response_json));
+        };
+    }
+    
+    // Check if it is a notification
+    if (req.is_notification()) {
+        if (req.method == "notifications/initialized") {
+            set_session_initialized(session_id, true);
+        } else if (req.method == "notifications/cancelled") {
+            cancel_request(session_id, req.params);
+        }
+        request_span.end();
+        reply(json::object());
+        return;
     }
     
     // Process method call
@@ -629,74 +1418,58 @@ json server::process_request(const request& req, const std::string& session_id)
         
         // Special case: initialization
         if (req.method == "initialize") {
-            return handle_initialize(req, session_id);
+            reply(handle_initialize(req, session_id));
+            return;
         } else if (req.method == "ping") {
-            return response::create_success(req.id, json::object()).to_json();
+            reply(response::create_success(req.id, json::object()).to_json());
+            return;
         }
 
         if (!is_session_initialized(session_id)) {
             LOG_WARNING("Session not initialized: ", session_id);
-            return response::create_error(
+            reply(response::create_error(
                 req.id,
                 error_code::invalid_request,
                 "Session not initialized"
-            ).to_json();
+            ).to_json());
+            return;
         }
         
         // Find registered method handler
-        method_handler handler;
+        async_method_handler handler;
         {
-            std::lock_guard<std::mutex> lock(mutex_);
-            auto it = method_handlers_.find(req.method);
-            if (it != method_handlers_.end()) {
+            auto current = dispatch_.load();
+            auto it = current->methods.find(req.method);
+            if (it != current->methods.end()) {
                 handler = it->second;
             }
         }
         
         if (handler) {
-            // Call handler
+            // Call handler on the current worker, async handlers complete later from their own threads
             LOG_INFO("Calling method handler: ", req.method);
-            auto future = thread_pool_.enqueue([handler, params = req.params, session_id]() -> json {
-                return handler(params, session_id);
+            handler(req.params, session_id, [id = req.id, method = req.method, reply](json result, std::exception_ptr error) {
+                if (error) {
+                    reply(error_response(id, error));
+                    return;
+                }
+                
+                // Create success response
+                LOG_INFO("Method call successful: ", method);
+                reply(response::create_success(id, result).to_json());
             });
-            json result = future.get();
-            
-            // Create success response
-            LOG_INFO("Method call successful: ", req.method);
-            return response::create_success(req.id, result).to_json();
+            return;
         }
         
         // Method not found
         LOG_WARNING("Method not found: ", req.method);
-        return response::create_error(
+        reply(response::create_error(
             req.id,
             error_code::method_not_found,
             "Method not found: " + req.method
-        ).to_json();
-    } catch (const mcp_exception& e) {
-        // MCP exception
-        LOG_ERROR("MCP exception: ", e.what(), ", code: ", static_cast<int>(e.code()));
-        return response::create_error(
-            req.id,
-            e.code(),
-            e.what()
-        ).to_json();
-    } catch (const std::exception& e) {
-        // Other exceptions
-        LOG_ERROR("Exception while processing request: ", e.what());
-        return response::create_error(
-            req.id,
-            error_code::internal_error,
-            "Internal error: " + std::string(e.what())
-        ).to_json();
+        ).to_json());
     } catch (...) {
-        // Unknown exception
-        LOG_ERROR("Unknown exception while processing request");
-        return response::create_error(
-            req.id,
-            error_code::internal_error,
-            "Unknown internal error"
-        ).to_json();
+        reply(error_response(req.id, std::current_exception()));
     }
 }
 
@@ -771,14 +1544,9 @@ void server::send_jsonrpc(const std::string& session_id, const json& message) {
 
     // Get session dispatcher
     std::shared_ptr<event_dispatcher> dispatcher;
-    {
-        std::lock_guard<std::mutex> lock(mutex_);
-        auto it = session_dispatchers_.find(session_id);
-        if (it == session_dispatchers_.end()) {
-            LOG_ERROR("Session not found: ", session_id);
-            return;
-        }
-        dispatcher = it->second;
+    if (!session_dispatchers_.find(session_id, dispatcher)) {
+        LOG_ERROR("Session not found: ", session_id);
+        return;
     }
     
     // Confirm dispatcher is still valid
@@ -788,9 +1556,8 @@ void server::send_jsonrpc(const std::string& session_id, const json& message) {
     }
     
     // Send message
-    std::stringstream ss;
-    ss << "event: message\r\ndata: " << message.dump() << "\r\n\r\n";
-    bool result = dispatcher->send_event(ss.str());
+    bool result = dispatcher->send_event(sse_frame(message));
+    record_sse_event(result);
     
     if (!result) {
         LOG_ERROR("Failed to send message to session: ", session_id);
@@ -808,9 +1575,8 @@ bool server::is_session_initialized(const std::string& session_id) const {
     }
     
     try {
-        std::lock_guard<std::mutex> lock(mutex_);
-        auto it = session_initialized_.find(session_id);
-        return (it != session_initialized_.end() && it->second);
+        bool initialized = false;
+        return session_initialized_.find(session_id, initialized) && initialized;
     } catch (const std::exception& e) {
         LOG_ERROR("Exception checking if session is initialized: ", e.what());
         return false;
@@ -825,14 +1591,12 @@ void server::set_session_initialized(const std::string& session_id, bool initial
     }
     
     try {
-        std::lock_guard<std::mutex> lock(mutex_);
         // Check if session still exists
-        auto it = session_dispatchers_.find(session_id);
-        if (it == session_dispatchers_.end()) {
+        if (!session_dispatchers_.contains(session_id)) {
             LOG_WARNING("Cannot set initialization state for non-existent session: ", session_id);
             return;
         }
-        session_initialized_[session_id] = initialized;
+        session_initialized_.insert_or_assign(session_id, initialized);
     } catch (const std::exception& e) {
         LOG_ERROR("Exception setting session initialization state: ", e.what());
     }
@@ -882,15 +1646,12 @@ void server::check_inactive_sessions() {
     
     std::vector<std::string> sessions_to_close;
     
-    {
-        std::lock_guard<std::mutex> lock(mutex_);
-        for (const auto& [session_id, dispatcher] : session_dispatchers_) {
-            if (now - dispatcher->last_activity() > timeout) {
-                // Exceeded idle time limit
-                sessions_to_close.push_back(session_id);
-            }
+    session_dispatchers_.for_each([&](const std::string& session_id, const std::shared_ptr<event_dispatcher>& dispatcher) {
+        if (now - dispatcher->last_activity() > timeout) {
+            // Exceeded idle time limit
+            sessions_to_close.push_back(session_id);
         }
-    }
+    });
     
     // Close inactive sessions
     for (const auto& session_id : sessions_to_close) {
@@ -904,37 +1665,124 @@ bool server::set_mount_point(const std::string& mount_point, const std::string&
     return http_server_->set_mount_point(mount_point, dir, headers);
 }
 
+void server::set_direct_response_timeout(std::chrono::milliseconds timeout) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    direct_response_timeout_ = timeout;
+}
+
+void server::set_request_timeout(std::chrono::milliseconds timeout) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    request_timeout_ = timeout;
+}
+
+void server::set_tool_timeout(const std::string& tool_name, std::chrono::milliseconds timeout) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tool_timeouts_[tool_name] = timeout;
+}
+
+void server::set_admission_limits(size_t max_queued, size_t max_in_flight, size_t max_session_in_flight, std::chrono::seconds retry_after) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    max_queued_ = max_queued;
+    max_in_flight_ = max_in_flight;
+    max_session_in_flight_ = max_session_in_flight;
+    retry_after_ = retry_after;
+}
+
+void server::enable_metrics(const std::string& endpoint) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    metrics_endpoint_ = endpoint;
+}
+
+void server::handle_metrics(const httplib::Request& /* req */, httplib::Response& res) {
+    auto& registry = metrics_registry::instance();
+    
+    // Gauges are sampled when scraped
+    int64_t sessions = 0;
+    int64_t pending_events = 0;
+    session_dispatchers_.for_each([&](const std::string& /* session_id */, const std::shared_ptr<event_dispatcher>& dispatcher) {
+        ++sessions;
+        pending_events += static_cast<int64_t>(dispatcher->pending());
+    });
+    registry.get_gauge("mcp_sessions_active", "Open sessions").set(sessions);
+    registry.get_gauge("mcp_sse_pending_events", "Events queued on session streams and not yet written").set(pending_events);
+    registry.get_gauge("mcp_thread_pool_threads", "Request thread pool size").set(static_cast<int64_t>(thread_pool_.size()));
+    registry.get_gauge("mcp_thread_pool_queue_depth", "Requests waiting for a worker").set(static_cast<int64_t>(thread_pool_.pending()));
+    registry.get_gauge("mcp_thread_pool_active", "Workers running a request").set(static_cast<int64_t>(thread_pool_.active()));
+    
+    res.set_content(registry.serialize(), "text/plain; version=0.0.4");
+}
+
+void server::enable_tracing(const std::string& endpoint) {
+    tracer::instance().set_enabled(true);
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    trace_endpoint_ = endpoint;
+}
+
+void server::handle_trace(const httplib::Request& req, httplib::Response& res) {
+    auto& collector = tracer::instance();
+    uint64_t trace_id = 0;
+    
+    if (req.has_param("trace_id")) {
+        try {
+            trace_id = std::stoull(req.get_param_value("trace_id"));
+        } catch (const std::exception&) {
+            res.status = 400;
+            res.set_content("{\"error\":\"Invalid trace_id\"}", "application/json");
+            return;
+        }
+    } else if (req.has_param("slowest")) {
+        // Pick the request span that took longest
+        int64_t longest = -1;
+        for (const auto& record : collector.snapshot()) {
+            if (std::strcmp(record.name, "request") == 0 && record.end_ns - record.start_ns > longest) {
+                longest = record.end_ns - record.start_ns;
+                trace_id = record.trace_id;
+            }
+        }
+        if (trace_id == 0) {
+            res.status = 404;
+            res.set_content("{\"error\":\"No requests traced\"}", "application/json");
+            return;
+        }
+    }
+    
+    res.set_content(tracer::to_chrome_json(collector.snapshot(trace_id)), "application/json");
+}
+
 void server::close_session(const std::string& session_id) {
      // Clean up resources safely
     try {
-        for (const auto& [key, handler] : session_cleanup_handler_) {
-            handler(key);
+        std::map<std::string, session_cleanup_handler> cleanup_handlers;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            cleanup_handlers = session_cleanup_handler_;
+        }
+        
+        // Stop the session's running requests before its state is cleaned up
+        std::map<std::string, std::shared_ptr<cancellation_source>> requests;
+        if (in_flight_.extract(session_id, requests)) {
+            for (const auto& [id, source] : requests) {
+                if (source->cancel("Session closed")) {
+                    metrics_registry::instance().get_counter("mcp_requests_cancelled_total", "Requests cancelled while running or queued",
+                        {{"cause", "session_closed"}}).add();
+                }
+            }
+        }
+        
+        for (const auto& [key, handler] : cleanup_handlers) {
+            handler(session_id);
         }
 
-        // Copy resources to be processed
+        // Take the session's resources out of the registries
         std::shared_ptr<event_dispatcher> dispatcher_to_close;
         std::unique_ptr<std::thread> thread_to_release;
         
-        {
-            std::lock_guard<std::mutex> lock(mutex_);
-            
-            // Get dispatcher pointer
-            auto dispatcher_it = session_dispatchers_.find(session_id);
-            if (dispatcher_it != session_dispatchers_.end()) {
-                dispatcher_to_close = dispatcher_it->second;
-                session_dispatchers_.erase(dispatcher_it);
-            }
-            
-            // Get thread pointer
-            auto thread_it = sse_threads_.find(session_id);
-            if (thread_it != sse_threads_.end()) {
-                thread_to_release = std::move(thread_it->second);
-                sse_threads_.erase(thread_it);
-            }
-            
-            // Clean up initialization status
-            session_initialized_.erase(session_id);
-        }
+        session_dispatchers_.extract(session_id, dispatcher_to_close);
+        sse_threads_.extract(session_id, thread_to_release);
+        
+        // Clean up initialization status
+        session_initialized_.erase(session_id);
         
         // Close dispatcher outside the lock
         if (dispatcher_to_close && !dispatcher_to_close->is_closed()) {
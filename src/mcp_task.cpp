@@ -0,0 +1,107 @@
+/**
+ * @file mcp_task.cpp
+ * @brief Implementation of the shared executor
+ */
+
+#include "mcp_task.h"
+#include "mcp_tracing.h"
+
+#include <algorithm>
+
+namespace mcp {
+
+namespace {
+
+// Run a task under the caller's trace context, so that spans opened by continuations join the request's trace
+std::function<void()> with_trace_context(std::function<void()> fn) {
+    trace_context context = tracer::current();
+    if (!context.valid()) {
+        return fn;
+    }
+    return [context, fn = std::move(fn)]() {
+        trace_scope scope(context);
+        fn();
+    };
+}
+
+} // namespace
+
+executor& executor::instance() {
+    static executor instance;
+    return instance;
+}
+
+executor::executor()
+    : workers_(std::max<size_t>(2, std::thread::hardware_concurrency())),
+      blocking_(std::max<size_t>(8, 4 * std::thread::hardware_concurrency())) {
+    timer_thread_ = std::thread([this]() { run_timers(); });
+}
+
+executor::~executor() {
+    {
+        std::lock_guard<std::mutex> lock(timer_mutex_);
+        stop_ = true;
+    }
+    timer_cv_.notify_all();
+
+    if (timer_thread_.joinable()) {
+        timer_thread_.join();
+    }
+}
+
+void executor::post(std::function<void()> fn) {
+    workers_.enqueue(with_trace_context(std::move(fn)));
+}
+
+uint64_t executor::post_after(std::chrono::steady_clock::duration delay, std::function<void()> fn) {
+    uint64_t id;
+    {
+        std::lock_guard<std::mutex> lock(timer_mutex_);
+        id = timer_seq_++;
+        auto when = std::chrono::steady_clock::now() + delay;
+        timers_.emplace(std::make_pair(when, id), with_trace_context(std::move(fn)));
+        timer_due_.emplace(id, when);
+    }
+    timer_cv_.notify_one();
+    return id;
+}
+
+bool executor::cancel_timer(uint64_t id) {
+    std::lock_guard<std::mutex> lock(timer_mutex_);
+    auto it = timer_due_.find(id);
+    if (it == timer_due_.end()) {
+        return false;
+    }
+    timers_.erase(std::make_pair(it->second, id));
+    timer_due_.erase(it);
+    return true;
+}
+
+void executor::post_blocking(std::function<void()> fn) {
+    blocking_.enqueue(with_trace_context(std::move(fn)));
+}
+
+void executor::run_timers() {
+    std::unique_lock<std::mutex> lock(timer_mutex_);
+    while (!stop_) {
+        if (timers_.empty()) {
+            timer_cv_.wait(lock, [this] { return stop_ || !timers_.empty(); });
+            continue;
+        }
+
+        auto first = timers_.begin();
+        auto when = first->first.first;
+        if (std::chrono::steady_clock::now() < when) {
+            timer_cv_.wait_until(lock, when);
+            continue;
+        }
+
+        // Never run user code on the timer thread
+        std::function<void()> fn = std::move(first->second);
+        timer_due_.erase(first->first.second);
+        timers_.erase(first);
+        workers_.enqueue(std::move(fn));
+    }
+}
+
+} // namespace mcp
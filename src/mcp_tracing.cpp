@@ -0,0 +1,240 @@
+/**
+ * @file mcp_tracing.cpp
+ * @brief Implementation of the span collector and the Chrome trace export
+ */
+
+#include "mcp_tracing.h"
+#include "mcp_message.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace mcp {
+
+namespace detail {
+
+// Ring of completed spans written by one thread. The mutex is only contended
+// while the exporter copies the buffer.
+struct trace_buffer {
+    explicit trace_buffer(size_t capacity, uint32_t thread) : records(std::max<size_t>(capacity, 1)), thread(thread) {}
+
+    std::mutex mutex;
+    std::vector<span_record> records;
+    size_t next = 0;
+    size_t count = 0;
+    uint32_t thread;
+};
+
+// Owns a thread's buffer and hands it back to the tracer when the thread exits
+struct buffer_holder {
+    std::shared_ptr<trace_buffer> buffer;
+
+    ~buffer_holder() {
+        if (buffer) {
+            tracer::instance().retire(buffer);
+        }
+    }
+};
+
+} // namespace detail
+
+namespace {
+
+// The calling thread's innermost open span
+thread_local trace_context current_context;
+
+const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+std::atomic<uint64_t> last_id{0};
+
+} // namespace
+
+tracer& tracer::instance() {
+    static tracer instance;
+    return instance;
+}
+
+void tracer::set_enabled(bool enabled, size_t capacity) {
+    capacity_.store(capacity, std::memory_order_relaxed);
+    enabled_.store(enabled, std::memory_order_relaxed);
+}
+
+int64_t tracer::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+trace_context tracer::current() {
+    return current_context;
+}
+
+uint64_t tracer::next_id() {
+    return last_id.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+detail::trace_buffer& tracer::local_buffer() {
+    thread_local detail::buffer_holder holder;
+    if (!holder.buffer) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!retired_.empty()) {
+            holder.buffer = std::move(retired_.back());
+            retired_.pop_back();
+        } else {
+            holder.buffer = std::make_shared<detail::trace_buffer>(capacity_.load(std::memory_order_relaxed), next_thread_++);
+            buffers_.push_back(holder.buffer);
+        }
+    }
+    return *holder.buffer;
+}
+
+void tracer::retire(const std::shared_ptr<detail::trace_buffer>& buffer) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    retired_.push_back(buffer);
+}
+
+void tracer::record(span_record&& record) {
+    detail::trace_buffer& buffer = local_buffer();
+    record.thread = buffer.thread;
+
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    buffer.records[buffer.next] = std::move(record);
+    buffer.next = (buffer.next + 1) % buffer.records.size();
+    buffer.count = std::min(buffer.count + 1, buffer.records.size());
+}
+
+std::vector<span_record> tracer::snapshot(uint64_t trace_id) const {
+    std::vector<std::shared_ptr<detail::trace_buffer>> buffers;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        buffers = buffers_;
+    }
+
+    std::vector<span_record> spans;
+    for (const auto& buffer : buffers) {
+        std::lock_guard<std::mutex> lock(buffer->mutex);
+        size_t size = buffer->records.size();
+        size_t first = (buffer->next + size - buffer->count) % size;
+        for (size_t i = 0; i < buffer->count; ++i) {
+            const span_record& record = buffer->records[(first + i) % size];
+            if (trace_id == 0 || record.trace_id == trace_id) {
+                spans.push_back(record);
+            }
+        }
+    }
+
+    std::sort(spans.begin(), spans.end(), [](const span_record& a, const span_record& b) {
+        return a.start_ns < b.start_ns;
+    });
+    return spans;
+}
+
+std::string tracer::to_chrome_json(const std::vector<span_record>& spans) {
+    json events = json::array();
+    for (const auto& record : spans) {
+        json args = {
+            {"trace_id", record.trace_id},
+            {"span_id", record.span_id},
+            {"parent_id", record.parent_id}
+        };
+        if (!record.detail.empty()) {
+            args["detail"] = record.detail;
+        }
+
+        // Complete events, timestamps in microseconds
+        events.push_back({
+            {"name", record.name},
+            {"cat", "mcp"},
+            {"ph", "X"},
+            {"ts", static_cast<double>(record.start_ns) / 1000.0},
+            {"dur", static_cast<double>(record.end_ns - record.start_ns) / 1000.0},
+            {"pid", 1},
+            {"tid", record.thread},
+            {"args", std::move(args)}
+        });
+    }
+
+    return json{{"traceEvents", std::move(events)}, {"displayTimeUnit", "ms"}}.dump();
+}
+
+void tracer::clear() {
+    std::vector<std::shared_ptr<detail::trace_buffer>> buffers;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        buffers = buffers_;
+    }
+
+    for (const auto& buffer : buffers) {
+        std::lock_guard<std::mutex> lock(buffer->mutex);
+        buffer->next = 0;
+        buffer->count = 0;
+    }
+}
+
+span::span(const char* name, const std::string& detail) {
+    if (!tracer::enabled()) {
+        return;
+    }
+
+    active_ = true;
+    previous_ = current_context;
+    record_.name = name;
+    record_.detail = detail;
+    record_.span_id = tracer::next_id();
+    record_.trace_id = previous_.valid() ? previous_.trace_id : record_.span_id;
+    record_.parent_id = previous_.span_id;
+    record_.start_ns = tracer::now();
+    current_context = {record_.trace_id, record_.span_id};
+}
+
+void span::end() {
+    if (!active_) {
+        return;
+    }
+
+    active_ = false;
+    record_.end_ns = tracer::now();
+    current_context = previous_;
+    tracer::instance().record(std::move(record_));
+}
+
+async_span::async_span(const char* name, const std::string& detail) {
+    if (!tracer::enabled()) {
+        return;
+    }
+
+    active_ = true;
+    trace_context parent = current_context;
+    record_.name = name;
+    record_.detail = detail;
+    record_.span_id = tracer::next_id();
+    record_.trace_id = parent.valid() ? parent.trace_id : record_.span_id;
+    record_.parent_id = parent.span_id;
+    record_.start_ns = tracer::now();
+}
+
+void async_span::end() {
+    if (!active_) {
+        return;
+    }
+
+    active_ = false;
+    record_.end_ns = tracer::now();
+    tracer::instance().record(std::move(record_));
+}
+
+trace_scope::trace_scope(const trace_context& context) {
+    if (!context.valid()) {
+        return;
+    }
+
+    active_ = true;
+    previous_ = current_context;
+    current_context = context;
+}
+
+trace_scope::~trace_scope() {
+    if (active_) {
+        current_context = previous_;
+    }
+}
+
+} // namespace mcp
@@ -0,0 +1,558 @@
+/**
+* @file blob_store.cpp
+* @brief Content-addressed image cache on disk: background downloads, size-bounded LRU, MCP resources
+* @date 2026-10-19 Monday
+*/
+
+#include "utils/blob_store.h"
+#include "httplib.h"
+#include "mcp_logger.h"
+#include "mcp_task.h"
+#include "mcp_tracing.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+namespace blob {
+
+    namespace {
+        const uint32_t sha256_k[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+        };
+
+        uint32_t rotr(uint32_t x, int n){
+            return (x >> n) | (x << (32 - n));
+        }
+
+        void sha256_block(std::array<uint32_t, 8>& state, const unsigned char* block){
+            uint32_t w[64];
+            for (int i = 0; i < 16; i++){
+                w[i] = (uint32_t(block[4 * i]) << 24) | (uint32_t(block[4 * i + 1]) << 16)
+                    | (uint32_t(block[4 * i + 2]) << 8) | uint32_t(block[4 * i + 3]);
+            }
+            for (int i = 16; i < 64; i++){
+                uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+                uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+                w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+            }
+
+            uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+            uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+            for (int i = 0; i < 64; i++){
+                uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+                uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+                h = g; g = f; f = e; e = d + t1;
+                d = c; c = b; b = a; a = t1 + t2;
+            }
+            state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+            state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+        }
+
+        bool is_hash(const std::string& name){
+            return name.size() == 64 && std::all_of(name.begin(), name.end(), [](char c){
+                return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f');
+            });
+        }
+
+        // unique suffix for files being written
+        std::atomic<uint64_t> write_counter{0};
+
+        const int max_redirects = 5;
+
+        // not loopback, private, link-local (cloud metadata), shared, benchmarking, multicast or reserved
+        bool is_public_v4(uint32_t ip){
+            uint32_t a = ip >> 24, b = (ip >> 16) & 0xff, c = (ip >> 8) & 0xff;
+            return !(a == 0 || a == 10 || a == 127 || a >= 224
+                || (a == 100 && (b & 0xc0) == 64)
+                || (a == 169 && b == 254)
+                || (a == 172 && (b & 0xf0) == 16)
+                || (a == 192 && b == 168)
+                || (a == 192 && b == 0 && c == 0)
+                || (a == 198 && (b & 0xfe) == 18));
+        }
+
+        bool is_public_v6(const unsigned char* ip){
+            // ::ffff:a.b.c.d is an IPv4 address
+            static const unsigned char mapped[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+            if (std::equal(mapped, mapped + 12, ip)){
+                return is_public_v4((uint32_t(ip[12]) << 24) | (uint32_t(ip[13]) << 16) | (uint32_t(ip[14]) << 8) | ip[15]);
+            }
+            // global unicast 2000::/3 only, which leaves out ::1, fc00::/7, fe80::/10 and multicast
+            return (ip[0] & 0xe0) == 0x20;
+        }
+
+        // an address of host to connect to, if every address it resolves to is public
+        std::string public_address(const std::string& host, const std::string& url){
+            addrinfo hints{};
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_STREAM;
+            addrinfo* found = nullptr;
+            if (getaddrinfo(host.c_str(), nullptr, &hints, &found) != 0 || !found){
+                throw std::runtime_error("Download of " + url + " failed: cannot resolve " + host);
+            }
+            std::string address;
+            bool allowed = true;
+            for (addrinfo* it = found; it; it = it->ai_next){
+                char text[INET6_ADDRSTRLEN] = {0};
+                if (it->ai_family == AF_INET){
+                    auto* v4 = reinterpret_cast<sockaddr_in*>(it->ai_addr);
+                    allowed = allowed && is_public_v4(ntohl(v4->sin_addr.s_addr));
+                    inet_ntop(AF_INET, &v4->sin_addr, text, sizeof(text));
+                } else if (it->ai_family == AF_INET6){
+                    auto* v6 = reinterpret_cast<sockaddr_in6*>(it->ai_addr);
+                    allowed = allowed && is_public_v6(v6->sin6_addr.s6_addr);
+                    inet_ntop(AF_INET6, &v6->sin6_addr, text, sizeof(text));
+                } else {
+                    continue;
+                }
+                if (address.empty()){
+                    address = text;
+                }
+            }
+            freeaddrinfo(found);
+            if (!allowed || address.empty()){
+                throw std::runtime_error("Download of " + url + " refused: " + host + " is not a public address");
+            }
+            return address;
+        }
+    }
+
+    std::string content_hash(std::string_view bytes){
+        std::array<uint32_t, 8> state = {
+            0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+        };
+
+        size_t full = bytes.size() / 64 * 64;
+        for (size_t i = 0; i < full; i += 64){
+            sha256_block(state, reinterpret_cast<const unsigned char*>(bytes.data() + i));
+        }
+
+        // padding: a one bit, zeros, then the length in bits
+        unsigned char tail[128] = {0};
+        size_t rest = bytes.size() - full;
+        std::copy(bytes.begin() + full, bytes.end(), tail);
+        tail[rest] = 0x80;
+        size_t tail_size = rest < 56 ? 64 : 128;
+        uint64_t bits = static_cast<uint64_t>(bytes.size()) * 8;
+        for (int i = 0; i < 8; i++){
+            tail[tail_size - 1 - i] = static_cast<unsigned char>(bits >> (8 * i));
+        }
+        for (size_t i = 0; i < tail_size; i += 64){
+            sha256_block(state, tail + i);
+        }
+
+        static const char hex[] = "0123456789abcdef";
+        std::string digest;
+        digest.reserve(64);
+        for (uint32_t word : state){
+            for (int shift = 28; shift >= 0; shift -= 4){
+                digest += hex[(word >> shift) & 0xf];
+            }
+        }
+        return digest;
+    }
+
+    std::string sniff_mime(std::string_view bytes){
+        auto starts_with = [&bytes](std::string_view prefix, size_t offset = 0){
+            return bytes.size() >= offset + prefix.size() && bytes.substr(offset, prefix.size()) == prefix;
+        };
+        if (starts_with("\x89PNG\r\n\x1a\n")) return "image/png";
+        if (starts_with("\xff\xd8\xff")) return "image/jpeg";
+        if (starts_with("RIFF") && starts_with("WEBP", 8)) return "image/webp";
+        if (starts_with("GIF87a") || starts_with("GIF89a")) return "image/gif";
+        return "application/octet-stream";
+    }
+
+    std::string download(const std::string& url, uint64_t max_bytes){
+        mcp::span download_span("blob.download", url);
+
+        // redirects are followed here rather than by httplib, so every hop is checked
+        std::string current = url;
+        for (int hop = 0; hop <= max_redirects; hop++){
+            // scheme://host[:port] and the rest
+            size_t scheme_end = current.find("://");
+            std::string scheme = current.substr(0, scheme_end);
+            std::transform(scheme.begin(), scheme.end(), scheme.begin(), [](unsigned char c){ return std::tolower(c); });
+            if (scheme_end == std::string::npos || (scheme != "http" && scheme != "https")){
+                throw std::runtime_error("Only http and https images are downloaded: " + current);
+            }
+            size_t path_start = current.find_first_of("/?#", scheme_end + 3);
+            std::string authority = current.substr(scheme_end + 3, path_start == std::string::npos ? std::string::npos : path_start - scheme_end - 3);
+            std::string host = authority;
+            if (!host.empty() && host[0] == '['){
+                // [v6 address]:port
+                host = host.substr(1, host.find(']') == std::string::npos ? std::string::npos : host.find(']') - 1);
+            } else if (host.find(':') != std::string::npos){
+                host = host.substr(0, host.find(':'));
+            }
+            if (host.empty() || authority.find('@') != std::string::npos){
+                throw std::runtime_error("Not an image URL: " + current);
+            }
+            std::string origin = scheme + "://" + authority;
+            std::string path = path_start == std::string::npos ? "/" : current.substr(path_start);
+            if (path[0] != '/'){
+                path = "/" + path;
+            }
+            path = path.substr(0, path.find('#'));
+
+            httplib::Client client(origin);
+            // connect to the address that was checked, not to whatever a second lookup returns
+            client.set_hostname_addr_map({{host, public_address(host, current)}});
+            client.set_connection_timeout(10, 0);
+            client.set_read_timeout(60, 0);
+
+            std::string body;
+            std::string refused;
+            auto result = client.Get(path, [&refused, max_bytes](const httplib::Response& response){
+                // redirects and errors are handled below
+                if (response.status != 200){
+                    return true;
+                }
+                std::string type = response.get_header_value("Content-Type");
+                std::transform(type.begin(), type.end(), type.begin(), [](unsigned char c){ return std::tolower(c); });
+                if (type.rfind("image/", 0) != 0){
+                    refused = "not an image (" + type + ")";
+                    return false;
+                }
+                if (response.has_header("Content-Length")
+                    && std::strtoull(response.get_header_value("Content-Length").c_str(), nullptr, 10) > max_bytes){
+                    refused = "larger than " + std::to_string(max_bytes) + " bytes";
+                    return false;
+                }
+                return true;
+            }, [&body, max_bytes](const char* data, size_t length){
+                body.append(data, length);
+                return body.size() <= max_bytes;
+            });
+            if (!refused.empty()){
+                throw std::runtime_error("Download of " + current + " refused: " + refused);
+            }
+            if (!result){
+                throw std::runtime_error("Download of " + current + " failed: " + httplib::to_string(result.error()));
+            }
+            if (result->status >= 300 && result->status < 400 && result->has_header("Location")){
+                std::string location = result->get_header_value("Location");
+                if (location.find("://") != std::string::npos){
+                    current = location;
+                } else {
+                    current = origin + (location.rfind("/", 0) == 0 ? location : "/" + location);
+                }
+                continue;
+            }
+            if (result->status != 200){
+                throw std::runtime_error("Download of " + current + " failed: HTTP " + std::to_string(result->status));
+            }
+            return body;
+        }
+        throw std::runtime_error("Download of " + url + " failed: too many redirects");
+    }
+
+    BlobStore::BlobStore(const std::string& directory, uint64_t capacity) : directory(directory), capacity(capacity) {
+        std::error_code ec;
+        fs::create_directories(directory, ec);
+        if (ec){
+            throw std::runtime_error("Cannot create blob directory " + directory + ": " + ec.message());
+        }
+
+        // rebuild the index, most recently written first
+        std::vector<std::pair<fs::file_time_type, std::string>> found;
+        for (const auto& file : fs::directory_iterator(directory)){
+            std::string name = file.path().filename().string();
+            if (!file.is_regular_file()){
+                continue;
+            }
+            if (!is_hash(name)){
+                // left over from an interrupted write
+                if (name.size() > 8 && name.compare(name.size() - 8, 8, ".partial") == 0){
+                    fs::remove(file.path(), ec);
+                }
+                continue;
+            }
+            found.emplace_back(file.last_write_time(), name);
+        }
+        std::sort(found.begin(), found.end(), [](const auto& a, const auto& b){
+            return a.first > b.first;
+        });
+        for (const auto& [time, hash] : found){
+            uint64_t size = fs::file_size(path_for(hash), ec);
+            lru.push_back(hash);
+            entries[hash] = Entry{size, std::prev(lru.end())};
+            used += size;
+        }
+
+        for (const auto& hash : evict()){
+            fs::remove(path_for(hash), ec);
+        }
+        LOG_INFO("Blob store ", directory, ": ", entries.size(), " blobs, ", used, " bytes");
+    }
+
+    BlobStore::~BlobStore(){
+        // background downloads refer to this store
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [this](){ return in_flight.empty(); });
+    }
+
+    std::string BlobStore::path_for(const std::string& hash) const {
+        return (fs::path(directory) / hash).string();
+    }
+
+    void BlobStore::touch(Entry& entry){
+        lru.splice(lru.begin(), lru, entry.position);
+    }
+
+    std::vector<std::string> BlobStore::evict(){
+        std::vector<std::string> evicted;
+        auto it = lru.end();
+        while (used > capacity && it != lru.begin()){
+            --it;
+            auto entry = entries.find(*it);
+            if (entry->second.pins > 0){
+                continue;
+            }
+            used -= entry->second.size;
+            evicted.push_back(*it);
+            entries.erase(entry);
+            it = lru.erase(it);
+        }
+        return evicted;
+    }
+
+    std::string BlobStore::put(std::string_view bytes, const std::string& url){
+        std::string hash = content_hash(bytes);
+        bool stored = false;
+        std::function<void(const std::string&, const std::string&)> source_callback;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = entries.find(hash);
+            if (it != entries.end()){
+                touch(it->second);
+                stored = true;
+                // another URL serving a stored blob is reported as well
+                if (!url.empty() && sources[url] != hash){
+                    sources[url] = hash;
+                    source_callback = on_add;
+                }
+            }
+        }
+        if (stored){
+            if (source_callback){
+                source_callback(hash, url);
+            }
+            return hash;
+        }
+
+        // written under a temporary name, so a crash never leaves a partial blob
+        std::string partial = path_for(hash) + "." + std::to_string(write_counter.fetch_add(1)) + ".partial";
+        {
+            std::ofstream out(partial, std::ios::binary);
+            out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+            if (!out){
+                throw std::runtime_error("Cannot write blob " + partial);
+            }
+        }
+
+        bool added = false;
+        bool new_source = false;
+        std::vector<std::string> evicted;
+        std::function<void(const std::string&, const std::string&)> added_callback;
+        std::function<void(const std::string&)> evicted_callback;
+        {
+            // files are renamed into place and deleted under the lock, so an entry always has its file
+            std::lock_guard<std::mutex> lock(mutex);
+            std::error_code ec;
+            fs::rename(partial, path_for(hash), ec);
+            if (ec){
+                fs::remove(partial, ec);
+                throw std::runtime_error("Cannot store blob " + hash);
+            }
+
+            added_callback = on_add;
+            evicted_callback = on_evict;
+            auto it = entries.find(hash);
+            if (it == entries.end()){
+                lru.push_front(hash);
+                entries[hash] = Entry{bytes.size(), lru.begin()};
+                used += bytes.size();
+                added = true;
+                evicted = evict();
+            } else {
+                touch(it->second);
+            }
+            if (!url.empty()){
+                new_source = sources[url] != hash;
+                sources[url] = hash;
+            }
+            for (const auto& old : evicted){
+                fs::remove(path_for(old), ec);
+            }
+        }
+
+        if ((added || new_source) && added_callback && !std::count(evicted.begin(), evicted.end(), hash)){
+            added_callback(hash, url);
+        }
+        for (const auto& old : evicted){
+            if (evicted_callback && old != hash){
+                evicted_callback(old);
+            }
+        }
+        return hash;
+    }
+
+    bool BlobStore::get(const std::string& hash, std::string& bytes){
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = entries.find(hash);
+            if (it == entries.end()){
+                return false;
+            }
+            touch(it->second);
+        }
+        std::ifstream in(path_for(hash), std::ios::binary);
+        if (!in){
+            return false;
+        }
+        std::ostringstream contents;
+        contents << in.rdbuf();
+        bytes = contents.str();
+        return true;
+    }
+
+    std::string BlobStore::lookup(const std::string& url){
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = sources.find(url);
+        if (it == sources.end()){
+            return "";
+        }
+        if (!entries.count(it->second)){
+            // evicted since
+            sources.erase(it);
+            return "";
+        }
+        return it->second;
+    }
+
+    std::string BlobStore::fetch(const std::string& url){
+        std::string hash = lookup(url);
+        if (!hash.empty()){
+            return hash;
+        }
+        return put(download(url, std::min(capacity, max_image_bytes)), url);
+    }
+
+    void BlobStore::prefetch(const std::string& url){
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = sources.find(url);
+            if ((it != sources.end() && entries.count(it->second)) || !in_flight.insert(url).second){
+                return;
+            }
+        }
+        mcp::executor::instance().post_blocking([this, url](){
+            try {
+                fetch(url);
+            } catch (const std::exception& e) {
+                LOG_WARNING("Prefetch failed: ", e.what());
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            in_flight.erase(url);
+            idle.notify_all();
+        });
+    }
+
+    void BlobStore::pin(const std::string& hash){
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(hash);
+        if (it != entries.end()){
+            it->second.pins++;
+        }
+    }
+
+    void BlobStore::unpin(const std::string& hash){
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(hash);
+        if (it != entries.end() && it->second.pins > 0){
+            it->second.pins--;
+        }
+    }
+
+    void BlobStore::set_callbacks(std::function<void(const std::string&, const std::string&)> added,
+        std::function<void(const std::string&)> evicted){
+        std::lock_guard<std::mutex> lock(mutex);
+        on_add = std::move(added);
+        on_evict = std::move(evicted);
+    }
+
+    std::vector<std::string> BlobStore::hashes(){
+        std::lock_guard<std::mutex> lock(mutex);
+        return std::vector<std::string>(lru.begin(), lru.end());
+    }
+
+    uint64_t BlobStore::size(){
+        std::lock_guard<std::mutex> lock(mutex);
+        return used;
+    }
+
+    BlobResource::BlobResource(BlobStore& store, const std::string& hash, const std::string& name)
+        : store(store), hash(hash), name(name) {
+    }
+
+    std::string BlobResource::uri_for(const std::string& hash){
+        return "blob://" + hash;
+    }
+
+    void BlobResource::allow(const std::string& session_id){
+        std::lock_guard<std::mutex> lock(mutex);
+        if (session_id.empty()){
+            shared = true;
+        } else {
+            sessions.insert(session_id);
+        }
+    }
+
+    void BlobResource::revoke(const std::string& session_id){
+        std::lock_guard<std::mutex> lock(mutex);
+        sessions.erase(session_id);
+    }
+
+    bool BlobResource::visible_to(const std::string& session_id) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return shared || sessions.count(session_id) > 0;
+    }
+
+    mcp::json BlobResource::get_metadata() const {
+        return {
+            {"uri", uri_for(hash)},
+            {"name", name},
+            {"description", "Cached image, addressed by its SHA-256"}
+        };
+    }
+
+    mcp::json BlobResource::read() const {
+        std::string bytes;
+        if (!store.get(hash, bytes)){
+            throw mcp::mcp_exception(mcp::error_code::invalid_params, "Blob was evicted: " + uri_for(hash));
+        }
+        return {
+            {"uri", uri_for(hash)},
+            {"mimeType", sniff_mime(bytes)},
+            {"blob", base64::encode(bytes.data(), bytes.size())}
+        };
+    }
+
+}
@@ -0,0 +1,657 @@
+/**
+* @file catalog.cpp
+* @brief In-memory garment catalog, reloaded in the background and published with an atomic swap
+* @date 2026-10-19 Monday
+*/
+
+#include "utils/catalog.h"
+#include "utils/csv_reader.h"
+#include <Eigen/Dense>
+#include "mcp_cancellation.h"
+#include "mcp_logger.h"
+#include "mcp_task.h"
+#include "mcp_tracing.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace csv {
+
+    namespace {
+        // a rewrite usually shows up as several events, reload once the file has been quiet this long
+        const auto settle_time = std::chrono::milliseconds(200);
+
+        // hybrid search: rank constant from the RRF paper, and how many results of each ranking are fused
+        const double rrf_k = 60.0;
+        const size_t fusion_depth = 100;
+    }
+
+    Catalog::Catalog() : main(std::make_shared<const Segment>(std::vector<CSVRow>{}, std::vector<std::string>{})) {
+    }
+
+    Catalog::Catalog(std::vector<CSVRow> rows, const std::string& source, uint64_t version,
+        const std::vector<std::string>& attribute_names)
+        : Catalog(std::make_shared<const Segment>(std::move(rows), attribute_names), {}, {}, 0, source, version) {
+    }
+
+    Catalog::Catalog(std::shared_ptr<const Segment> main, std::vector<DeltaRow> delta,
+        std::unordered_map<int, uint64_t> tombstones, uint64_t last_seq,
+        const std::string& source, uint64_t version)
+        : main(std::move(main)), delta(std::move(delta)), tombstones(std::move(tombstones)),
+          last_seq(last_seq), source(source), version(version) {
+        // newest change per id
+        std::unordered_map<int, uint64_t> latest = this->tombstones;
+        for (const auto& change : this->delta){
+            auto& seq = latest[change.row.id];
+            seq = std::max(seq, change.seq);
+        }
+
+        for (size_t i = 0; i < this->delta.size(); i++){
+            if (latest[this->delta[i].row.id] == this->delta[i].seq){
+                live_delta.push_back(i);
+            }
+        }
+
+        live_rows = this->main->size() + live_delta.size();
+        for (const auto& [id, seq] : latest){
+            shadowed.insert(id);
+            auto it = this->main->ids.find(id);
+            if (it != this->main->ids.end()){
+                live_rows -= it->second;
+            }
+        }
+    }
+
+    const char* metric_name(Metric metric){
+        switch (metric){
+            case Metric::Cosine: return "cosine";
+            case Metric::Dot: return "dot";
+            case Metric::L2: return "l2";
+        }
+        return "cosine";
+    }
+
+    Metric parse_metric(const std::string& name){
+        if (name == "cosine") return Metric::Cosine;
+        if (name == "dot") return Metric::Dot;
+        if (name == "l2") return Metric::L2;
+        throw std::invalid_argument("metric should be one of cosine, dot or l2");
+    }
+
+    std::shared_ptr<const Catalog> Catalog::load(const std::string& filepath, uint64_t version){
+        mcp::span load_span("catalog.load", filepath);
+
+        if (!std::ifstream(filepath)){
+            throw std::runtime_error("Cannot open catalog file: " + filepath);
+        }
+
+        // mmapped and parsed in parallel chunks
+        std::vector<CSVRow> rows = read_catalog(filepath);
+
+        // an empty file is most likely a half-written one
+        if (rows.empty()){
+            throw std::runtime_error("Catalog file has no rows: " + filepath);
+        }
+
+        return std::make_shared<const Catalog>(std::move(rows), filepath, version, parse_attribute_names(filepath));
+    }
+
+    std::unique_ptr<Filter> Catalog::select(const std::string& filter, Bitmap& selected) const {
+        if (filter.empty()){
+            return nullptr;
+        }
+        // evaluated column-wise before scoring, so a selective filter skips most of the scan
+        auto parsed = std::make_unique<Filter>(Filter::parse(filter, main->columns));
+        selected = parsed->evaluate(main->columns, main->size());
+        return parsed;
+    }
+
+    bool Catalog::is_live(size_t i, const Filter* filter, const Bitmap& selected) const {
+        if (filter && !selected.test(i)){
+            return false;
+        }
+        // rows replaced or deleted since the segment was built
+        return shadowed.empty() || !shadowed.count(main->id(i));
+    }
+
+    Catalog::Ranked Catalog::top(Ranked candidates, size_t n){
+        // only the top n are ordered
+        n = std::min(n, candidates.size());
+        std::partial_sort(candidates.begin(), candidates.begin() + n, candidates.end(),
+            [](const Hit& a, const Hit& b){
+                return a.score > b.score;
+            });
+        candidates.resize(n);
+        return candidates;
+    }
+
+    std::vector<CSVRow> Catalog::to_rows(const Ranked& ranked) const {
+        // only the results are copied out of the columns, the scan never touches their text
+        std::vector<CSVRow> results;
+        results.reserve(ranked.size());
+        for (const auto& hit : ranked){
+            if (hit.in_delta){
+                results.push_back(delta[hit.index].row);
+                results.back().vector.clear();
+            } else {
+                results.push_back(main->row(hit.index, false));
+            }
+            results.back().score = hit.score;
+        }
+        return results;
+    }
+
+    Catalog::Ranked Catalog::rank_vector(const std::vector<double>& query_vector, Metric metric, const Filter* filter,
+        const Bitmap& selected, size_t n) const {
+        // the query is normalized once, stored vectors already are
+        Eigen::Map<const Eigen::VectorXd> query(query_vector.data(), query_vector.size());
+        double query_norm = query.norm();
+        Eigen::VectorXd unit_query = query_norm > 0 ? Eigen::VectorXd(query / query_norm) : Eigen::VectorXd(query);
+        // the main segment is stored as floats, half the bytes per row of the scan
+        Eigen::VectorXf float_query = unit_query.cast<float>();
+        size_t dim = main->dimension();
+        bool main_matches = dim == query_vector.size();
+
+        Ranked candidates;
+        size_t expected = filter ? selected.count() + live_delta.size() : live_rows;
+        candidates.reserve(expected);
+
+        // every metric follows from the cosine and the two norms
+        auto score = [&](size_t index, bool in_delta, double cosine, double norm){
+            double value = cosine;
+            switch (metric){
+                case Metric::Cosine:
+                    break;
+                case Metric::Dot:
+                    value = cosine * norm * query_norm;
+                    break;
+                case Metric::L2:
+                    value = -std::sqrt(std::max(0.0, norm * norm + query_norm * query_norm - 2 * cosine * norm * query_norm));
+                    break;
+            }
+            // a NaN in a stored vector would otherwise rank, and earn fusion credit in hybrid search
+            if (std::isfinite(value)){
+                candidates.push_back(Hit{index, in_delta, value});
+            }
+        };
+
+        // a cancelled request stops the scan, checked once per 4096 rows
+        mcp::cancellation_token cancel = mcp::cancellation_token::current();
+        size_t visited = 0;
+        auto score_main = [&](size_t i){
+            if ((++visited & 4095) == 0){
+                cancel.throw_if_cancelled();
+            }
+            if (!is_live(i, nullptr, selected)){
+                return;
+            }
+            // rows from another embedding model are left out, not ranked last
+            const float* vec = main_matches ? main->vector(i) : nullptr;
+            if (!vec){
+                return;
+            }
+            // one dot product per row, rows are 64-byte aligned
+            double cosine = Eigen::Map<const Eigen::VectorXf, Eigen::Aligned64>(vec, dim).dot(float_query);
+            score(i, false, cosine, main->norms[i]);
+        };
+        if (filter){
+            selected.for_each(score_main);
+        } else {
+            for (size_t i = 0; i < main->size(); i++){
+                score_main(i);
+            }
+        }
+        // delta rows are few and not normalized yet
+        for (size_t i : live_delta){
+            const auto& row = delta[i].row;
+            if (filter && !filter->matches(main->columns, row)){
+                continue;
+            }
+            if (row.vector.size() != query_vector.size()){
+                continue;
+            }
+            Eigen::Map<const Eigen::VectorXd> vec(row.vector.data(), row.vector.size());
+            double norm = vec.norm();
+            score(i, true, norm > 0 ? vec.dot(unit_query) / norm : 0.0, norm);
+        }
+        return top(std::move(candidates), n);
+    }
+
+    Catalog::Ranked Catalog::rank_lexical(const std::string& text, const Filter* filter,
+        const Bitmap& selected, size_t n) const {
+        std::vector<std::string> terms = LexicalIndex::tokenize(text);
+        Ranked candidates;
+
+        // only documents containing a query term are visited
+        for (const auto& [doc, score] : main->lexical.score(terms)){
+            if (is_live(doc, filter, selected)){
+                candidates.push_back(Hit{doc, false, score});
+            }
+        }
+        for (size_t i : live_delta){
+            const auto& row = delta[i].row;
+            if (filter && !filter->matches(main->columns, row)){
+                continue;
+            }
+            double score = main->lexical.score(terms, row);
+            if (score > 0){
+                candidates.push_back(Hit{i, true, score});
+            }
+        }
+        return top(std::move(candidates), n);
+    }
+
+    std::vector<CSVRow> Catalog::search(const std::vector<double>& query_vector, int k, const std::string& filter,
+        Metric metric) const {
+        mcp::span search_span("catalog.search", filter);
+        Bitmap selected;
+        auto parsed = select(filter, selected);
+        return to_rows(rank_vector(query_vector, metric, parsed.get(), selected, std::max(k, 0)));
+    }
+
+    std::vector<CSVRow> Catalog::search_lexical(const std::string& text, int k, const std::string& filter) const {
+        mcp::span search_span("catalog.search_lexical", filter);
+        Bitmap selected;
+        auto parsed = select(filter, selected);
+        return to_rows(rank_lexical(text, parsed.get(), selected, std::max(k, 0)));
+    }
+
+    std::vector<CSVRow> Catalog::search_hybrid(const std::vector<double>& query_vector, const std::string& text, int k,
+        const std::string& filter, Metric metric) const {
+        mcp::span search_span("catalog.search_hybrid", filter);
+        Bitmap selected;
+        auto parsed = select(filter, selected);
+
+        // reciprocal rank fusion over the head of both rankings, raw scores are not comparable
+        size_t depth = std::max(static_cast<size_t>(std::max(k, 0)), fusion_depth);
+        // keyed by row index, with the low bit telling the delta from the main segment
+        std::unordered_map<size_t, double> fused;
+        for (const Ranked& ranked : {rank_vector(query_vector, metric, parsed.get(), selected, depth),
+                rank_lexical(text, parsed.get(), selected, depth)}){
+            for (size_t rank = 0; rank < ranked.size(); rank++){
+                fused[ranked[rank].index * 2 + ranked[rank].in_delta] += 1.0 / (rrf_k + rank + 1);
+            }
+        }
+
+        Ranked candidates;
+        candidates.reserve(fused.size());
+        for (const auto& [key, score] : fused){
+            candidates.push_back(Hit{key / 2, (key & 1) != 0, score});
+        }
+        return to_rows(top(std::move(candidates), std::max(k, 0)));
+    }
+
+    std::vector<CSVRow> Catalog::rows() const {
+        std::vector<CSVRow> result;
+        result.reserve(live_rows);
+        for (size_t i = 0; i < main->size(); i++){
+            if (!shadowed.count(main->id(i))){
+                // back to the vector as loaded, a rebuilt segment normalizes it again
+                result.push_back(main->row(i, true));
+            }
+        }
+        for (size_t i : live_delta){
+            result.push_back(delta[i].row);
+        }
+        return result;
+    }
+
+    bool Catalog::contains(int id) const {
+        for (size_t i : live_delta){
+            if (delta[i].row.id == id){
+                return true;
+            }
+        }
+        return !shadowed.count(id) && main->ids.count(id);
+    }
+
+    std::vector<std::string> Catalog::attribute_names() const {
+        std::vector<std::string> names;
+        for (const auto& column : main->columns){
+            names.push_back(column.name);
+        }
+        return names;
+    }
+
+    size_t Catalog::dimension() const {
+        if (main->size() > 0){
+            return main->dimension();
+        }
+        return live_delta.empty() ? 0 : delta[live_delta.front()].row.vector.size();
+    }
+
+    CatalogStore::CatalogStore(const std::string& filepath) : filepath(filepath) {
+    }
+
+    CatalogStore::~CatalogStore(){
+        stop_watching();
+        // a background compaction still refers to this store
+        std::unique_lock<std::mutex> lock(compaction_mutex);
+        compaction_done.wait(lock, [this](){ return !compacting; });
+    }
+
+    std::shared_ptr<const Catalog> CatalogStore::current() const {
+        return catalog.load();
+    }
+
+    std::string CatalogStore::get_filepath(){
+        std::lock_guard<std::mutex> lock(reload_mutex);
+        return filepath;
+    }
+
+    std::shared_ptr<const Catalog> CatalogStore::reload(const std::string& new_filepath){
+        std::lock_guard<std::mutex> lock(reload_mutex);
+        std::string path = new_filepath.empty() ? filepath : new_filepath;
+
+        auto start = std::chrono::steady_clock::now();
+        auto next = Catalog::load(path, next_version.fetch_add(1));
+
+        // searches that already hold the old version finish on it
+        catalog.publish(next);
+        filepath = path;
+
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        LOG_INFO("Catalog version ", next->get_version(), " published: ", next->size(), " rows from ", path, " in ", ms, " ms");
+        return next;
+    }
+
+    void CatalogStore::reload_async(std::function<void(std::shared_ptr<const Catalog>, std::exception_ptr)> done,
+        const std::string& new_filepath){
+        mcp::executor::instance().post_blocking([this, done, new_filepath](){
+            std::shared_ptr<const Catalog> next;
+            std::exception_ptr error;
+            try {
+                next = reload(new_filepath);
+            } catch (...) {
+                error = std::current_exception();
+            }
+            if (done){
+                done(next, error);
+            }
+        });
+    }
+
+    std::shared_ptr<const Catalog> CatalogStore::publish_changes(const Catalog& base, std::vector<DeltaRow> delta,
+        std::unordered_map<int, uint64_t> tombstones){
+        auto next = std::make_shared<const Catalog>(base.get_main(), std::move(delta), std::move(tombstones),
+            next_seq - 1, base.get_source(), next_version.fetch_add(1));
+        catalog.publish(next);
+        return next;
+    }
+
+    std::shared_ptr<const Catalog> CatalogStore::upsert(const std::vector<CSVRow>& rows){
+        std::shared_ptr<const Catalog> next;
+        {
+            std::lock_guard<std::mutex> lock(reload_mutex);
+            auto cur = current();
+
+            size_t dim = cur->dimension();
+            for (const auto& row : rows){
+                if (row.vector.empty() || (dim != 0 && row.vector.size() != dim)){
+                    throw std::invalid_argument("Row " + std::to_string(row.id) + " has a " + std::to_string(row.vector.size())
+                        + "-dimensional vector, the catalog uses " + std::to_string(dim));
+                }
+                dim = row.vector.size();
+            }
+
+            size_t attributes = cur->get_main()->columns.size();
+            for (const auto& row : rows){
+                if (row.attributes.size() > attributes){
+                    throw std::invalid_argument("Row " + std::to_string(row.id) + " has " + std::to_string(row.attributes.size())
+                        + " attributes, the catalog has " + std::to_string(attributes));
+                }
+            }
+
+            // appended, older rows with the same id are shadowed by the higher seq
+            std::vector<DeltaRow> delta = cur->get_delta();
+            delta.reserve(delta.size() + rows.size());
+            for (const auto& row : rows){
+                delta.push_back(DeltaRow{next_seq++, row});
+                delta.back().row.attributes.resize(attributes);
+            }
+            next = publish_changes(*cur, std::move(delta), cur->get_tombstones());
+        }
+        LOG_DEBUG("Catalog version ", next->get_version(), ": upserted ", rows.size(), " rows");
+        maybe_compact(*next);
+        return next;
+    }
+
+    std::shared_ptr<const Catalog> CatalogStore::remove(const std::vector<int>& ids){
+        std::shared_ptr<const Catalog> next;
+        size_t deleted = 0;
+        {
+            std::lock_guard<std::mutex> lock(reload_mutex);
+            auto cur = current();
+
+            auto tombstones = cur->get_tombstones();
+            for (int id : ids){
+                if (cur->contains(id)){
+                    tombstones[id] = next_seq++;
+                    deleted++;
+                }
+            }
+            if (deleted == 0){
+                return cur;
+            }
+            next = publish_changes(*cur, cur->get_delta(), std::move(tombstones));
+        }
+        LOG_DEBUG("Catalog version ", next->get_version(), ": deleted ", deleted, " rows");
+        maybe_compact(*next);
+        return next;
+    }
+
+    std::shared_ptr<const Catalog> CatalogStore::compact(){
+        mcp::span compact_span("catalog.compact");
+        auto base = current();
+        if (base->pending_changes() == 0){
+            return base;
+        }
+
+        // the expensive part runs on a snapshot, writers are not blocked
+        auto merged = std::make_shared<const Segment>(base->rows(), base->attribute_names());
+
+        std::lock_guard<std::mutex> lock(reload_mutex);
+        auto cur = current();
+        if (cur->get_main() != base->get_main()){
+            // a reload or another compaction replaced the main segment meanwhile
+            return cur;
+        }
+
+        // carry over the changes made after the snapshot
+        std::vector<DeltaRow> delta;
+        for (const auto& change : cur->get_delta()){
+            if (change.seq > base->get_last_seq()){
+                delta.push_back(change);
+            }
+        }
+        std::unordered_map<int, uint64_t> tombstones;
+        for (const auto& [id, seq] : cur->get_tombstones()){
+            if (seq > base->get_last_seq()){
+                tombstones[id] = seq;
+            }
+        }
+
+        auto next = std::make_shared<const Catalog>(merged, std::move(delta), std::move(tombstones),
+            cur->get_last_seq(), cur->get_source(), next_version.fetch_add(1));
+        catalog.publish(next);
+        LOG_INFO("Catalog version ", next->get_version(), " compacted: ", merged->size(), " rows, ",
+            next->pending_changes(), " changes carried over");
+        return next;
+    }
+
+    void CatalogStore::set_compaction_threshold(size_t threshold){
+        std::lock_guard<std::mutex> lock(reload_mutex);
+        compaction_threshold = threshold;
+    }
+
+    size_t CatalogStore::get_compaction_threshold(){
+        std::lock_guard<std::mutex> lock(reload_mutex);
+        return compaction_threshold == 0 ? std::numeric_limits<size_t>::max() : compaction_threshold;
+    }
+
+    void CatalogStore::maybe_compact(const Catalog& latest){
+        if (latest.pending_changes() < get_compaction_threshold() || compacting.exchange(true)){
+            return;
+        }
+        mcp::executor::instance().post_blocking([this](){
+            for (;;){
+                bool failed = false;
+                try {
+                    // changes made while compacting may already be over the threshold again
+                    while (compact()->pending_changes() >= get_compaction_threshold()){
+                    }
+                } catch (const std::exception& e) {
+                    LOG_ERROR("Catalog compaction failed: ", e.what());
+                    failed = true;
+                }
+
+                // a write published after the last check saw the flag set and left its changes to us;
+                // one published after the flag is cleared starts its own compaction
+                std::lock_guard<std::mutex> lock(compaction_mutex);
+                compacting = false;
+                if (failed || current()->pending_changes() < get_compaction_threshold() || compacting.exchange(true)){
+                    // the store may be destroyed once this is seen, nothing is touched after it
+                    compaction_done.notify_all();
+                    return;
+                }
+            }
+        });
+    }
+
+    void CatalogStore::watch(){
+        if (watching.exchange(true)){
+            return;
+        }
+        watcher = std::thread([this](){
+#ifdef __linux__
+            if (watch_inotify()){
+                return;
+            }
+#endif
+            watch_polling();
+        });
+    }
+
+    void CatalogStore::stop_watching(){
+        watching = false;
+        if (watcher.joinable()){
+            watcher.join();
+        }
+    }
+
+    bool CatalogStore::watch_inotify(){
+#ifdef __linux__
+        int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd < 0){
+            LOG_WARNING("inotify unavailable, polling the catalog file instead");
+            return false;
+        }
+
+        // watch the directory, so that files replaced by rename are seen too
+        std::string watched_path;
+        std::string name;
+        int wd = -1;
+        auto rewatch = [&](){
+            watched_path = get_filepath();
+            std::filesystem::path p(watched_path);
+            name = p.filename().string();
+            std::string dir = p.has_parent_path() ? p.parent_path().string() : ".";
+            if (wd >= 0){
+                inotify_rm_watch(fd, wd);
+            }
+            wd = inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+            if (wd < 0){
+                LOG_WARNING("Cannot watch catalog directory: ", dir);
+            }
+        };
+        rewatch();
+
+        bool pending = false;
+        auto last_event = std::chrono::steady_clock::now();
+        alignas(inotify_event) char buf[4096];
+
+        while (watching){
+            pollfd pfd{fd, POLLIN, 0};
+            if (poll(&pfd, 1, 100) > 0){
+                ssize_t len;
+                while ((len = read(fd, buf, sizeof(buf))) > 0){
+                    for (char* p = buf; p < buf + len;){
+                        auto* event = reinterpret_cast<inotify_event*>(p);
+                        if (event->len > 0 && name == event->name){
+                            pending = true;
+                            last_event = std::chrono::steady_clock::now();
+                        }
+                        p += sizeof(inotify_event) + event->len;
+                    }
+                }
+            }
+
+            if (pending && std::chrono::steady_clock::now() - last_event >= settle_time){
+                pending = false;
+                try {
+                    reload();
+                } catch (const std::exception& e) {
+                    LOG_ERROR("Catalog reload failed, keeping version ", current()->get_version(), ": ", e.what());
+                }
+            }
+
+            // follow the file if a reload switched to another path
+            if (get_filepath() != watched_path){
+                rewatch();
+            }
+        }
+
+        close(fd);
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    void CatalogStore::watch_polling(){
+        namespace fs = std::filesystem;
+        auto modified = [this](){
+            std::error_code ec;
+            auto time = fs::last_write_time(get_filepath(), ec);
+            return ec ? fs::file_time_type::min() : time;
+        };
+
+        auto last_seen = modified();
+        auto last_change = std::chrono::steady_clock::now();
+        bool pending = false;
+
+        while (watching){
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+            auto time = modified();
+            if (time != last_seen){
+                last_seen = time;
+                last_change = std::chrono::steady_clock::now();
+                pending = true;
+            }
+
+            if (pending && std::chrono::steady_clock::now() - last_change >= settle_time){
+                pending = false;
+                try {
+                    reload();
+                } catch (const std::exception& e) {
+                    LOG_ERROR("Catalog reload failed, keeping version ", current()->get_version(), ": ", e.what());
+                }
+                last_seen = modified();
+            }
+        }
+    }
+
+}
@@ -0,0 +1,473 @@
+/**
+* @file catalog_filter.cpp
+* @brief Typed attribute columns and filter expressions evaluated as bitmaps during the catalog scan
+* @date 2026-10-19 Monday
+*/
+
+#include "utils/catalog_filter.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace csv {
+
+    struct Filter::Node{
+        enum class Kind{ And, Or, Not, Compare, In };
+
+        Kind kind;
+        std::vector<std::shared_ptr<const Node>> children;
+
+        // Compare and In
+        size_t column = 0;
+        std::string op;
+        std::vector<double> numbers;
+        // lowercased
+        std::vector<std::string> texts;
+    };
+
+    namespace {
+
+        const double missing = std::numeric_limits<double>::quiet_NaN();
+
+        std::string trim(const std::string& value){
+            size_t start = value.find_first_not_of(" \t\r\n");
+            if (start == std::string::npos){
+                return "";
+            }
+            size_t end = value.find_last_not_of(" \t\r\n");
+            return value.substr(start, end - start + 1);
+        }
+
+        std::string lowercase(std::string value){
+            std::transform(value.begin(), value.end(), value.begin(),
+                [](unsigned char c){ return std::tolower(c); });
+            return value;
+        }
+
+        // NaN unless the whole value is a number
+        double to_number(const std::string& value){
+            std::string v = trim(value);
+            if (v.empty()){
+                return missing;
+            }
+            char* end = nullptr;
+            double number = std::strtod(v.c_str(), &end);
+            return *end == '\0' ? number : missing;
+        }
+
+        std::string attribute(const CSVRow& row, size_t column){
+            return column < row.attributes.size() ? trim(row.attributes[column]) : "";
+        }
+
+        // missing values never compare true, not even for !=
+        bool compare(const std::string& op, double a, double b){
+            if (std::isnan(a)){
+                return false;
+            }
+            if (op == "=") return a == b;
+            if (op == "!=") return a != b;
+            if (op == "<") return a < b;
+            if (op == "<=") return a <= b;
+            if (op == ">") return a > b;
+            return a >= b;
+        }
+
+        struct Token{
+            enum class Kind{ Word, Quoted, Op, LParen, RParen, Comma, End };
+            Kind kind;
+            std::string text;
+        };
+
+        std::vector<Token> tokenize(const std::string& expression){
+            std::vector<Token> tokens;
+            size_t i = 0;
+            while (i < expression.size()){
+                char c = expression[i];
+                if (std::isspace(static_cast<unsigned char>(c))){
+                    i++;
+                } else if (c == '(' || c == ')' || c == ','){
+                    tokens.push_back({c == '(' ? Token::Kind::LParen : c == ')' ? Token::Kind::RParen : Token::Kind::Comma, std::string(1, c)});
+                    i++;
+                } else if (c == '\'' || c == '"'){
+                    size_t end = expression.find(c, i + 1);
+                    if (end == std::string::npos){
+                        throw std::invalid_argument("Unterminated string in filter");
+                    }
+                    tokens.push_back({Token::Kind::Quoted, expression.substr(i + 1, end - i - 1)});
+                    i = end + 1;
+                } else if (c == '=' || c == '!' || c == '<' || c == '>'){
+                    std::string op(1, c);
+                    if (i + 1 < expression.size() && expression[i + 1] == '='){
+                        op += '=';
+                    }
+                    if (op == "!"){
+                        throw std::invalid_argument("Expected != in filter");
+                    }
+                    tokens.push_back({Token::Kind::Op, op == "==" ? "=" : op});
+                    i += op.size();
+                } else {
+                    size_t start = i;
+                    while (i < expression.size() && (std::isalnum(static_cast<unsigned char>(expression[i]))
+                        || expression[i] == '_' || expression[i] == '-' || expression[i] == '.' || expression[i] == '+')){
+                        i++;
+                    }
+                    if (i == start){
+                        throw std::invalid_argument(std::string("Unexpected character in filter: ") + c);
+                    }
+                    tokens.push_back({Token::Kind::Word, expression.substr(start, i - start)});
+                }
+            }
+            tokens.push_back({Token::Kind::End, ""});
+            return tokens;
+        }
+
+        class Parser{
+        private:
+            std::vector<Token> tokens;
+            size_t pos = 0;
+            const std::vector<AttributeColumn>& columns;
+
+            using NodePtr = std::shared_ptr<const Filter::Node>;
+            using Kind = Filter::Node::Kind;
+
+            const Token& peek() const { return tokens[pos]; }
+
+            bool keyword(const char* word){
+                if (peek().kind == Token::Kind::Word && lowercase(peek().text) == word){
+                    pos++;
+                    return true;
+                }
+                return false;
+            }
+
+            void expect(Token::Kind kind, const char* what){
+                if (peek().kind != kind){
+                    throw std::invalid_argument(std::string("Expected ") + what + " in filter"
+                        + (peek().text.empty() ? "" : " near '" + peek().text + "'"));
+                }
+                pos++;
+            }
+
+            NodePtr combine(Kind kind, NodePtr left, NodePtr right){
+                auto node = std::make_shared<Filter::Node>();
+                node->kind = kind;
+                node->children = {std::move(left), std::move(right)};
+                return node;
+            }
+
+            NodePtr expr(){
+                NodePtr node = term();
+                while (keyword("or")){
+                    node = combine(Kind::Or, node, term());
+                }
+                return node;
+            }
+
+            NodePtr term(){
+                NodePtr node = factor();
+                while (keyword("and")){
+                    node = combine(Kind::And, node, factor());
+                }
+                return node;
+            }
+
+            NodePtr factor(){
+                if (keyword("not")){
+                    auto node = std::make_shared<Filter::Node>();
+                    node->kind = Kind::Not;
+                    node->children = {factor()};
+                    return node;
+                }
+                if (peek().kind == Token::Kind::LParen){
+                    pos++;
+                    NodePtr node = expr();
+                    expect(Token::Kind::RParen, ")");
+                    return node;
+                }
+                return comparison();
+            }
+
+            // adds a literal in the representation of the column
+            void add_value(Filter::Node& node){
+                if (peek().kind != Token::Kind::Word && peek().kind != Token::Kind::Quoted){
+                    throw std::invalid_argument("Expected a value in filter");
+                }
+                std::string text = peek().text;
+                pos++;
+
+                const auto& column = columns[node.column];
+                if (column.type == AttributeType::Number){
+                    double number = to_number(text);
+                    if (std::isnan(number)){
+                        throw std::invalid_argument("Expected a number for " + column.name + ", got '" + text + "'");
+                    }
+                    node.numbers.push_back(number);
+                } else {
+                    node.texts.push_back(lowercase(trim(text)));
+                }
+            }
+
+            NodePtr comparison(){
+                if (peek().kind != Token::Kind::Word){
+                    throw std::invalid_argument("Expected an attribute name in filter");
+                }
+                std::string name = lowercase(peek().text);
+                pos++;
+
+                auto node = std::make_shared<Filter::Node>();
+                auto it = std::find_if(columns.begin(), columns.end(),
+                    [&name](const AttributeColumn& column){ return lowercase(column.name) == name; });
+                if (it == columns.end()){
+                    std::string known;
+                    for (const auto& column : columns){
+                        known += (known.empty() ? "" : ", ") + column.name;
+                    }
+                    throw std::invalid_argument("Unknown attribute '" + name + "' in filter, available: "
+                        + (known.empty() ? "none" : known));
+                }
+                node->column = it - columns.begin();
+
+                if (keyword("in")){
+                    node->kind = Kind::In;
+                    expect(Token::Kind::LParen, "(");
+                    add_value(*node);
+                    while (peek().kind == Token::Kind::Comma){
+                        pos++;
+                        add_value(*node);
+                    }
+                    expect(Token::Kind::RParen, ")");
+                    return node;
+                }
+
+                if (peek().kind != Token::Kind::Op){
+                    throw std::invalid_argument("Expected a comparison after " + it->name + " in filter");
+                }
+                node->kind = Kind::Compare;
+                node->op = peek().text;
+                pos++;
+                if (it->type == AttributeType::String && node->op != "=" && node->op != "!="){
+                    throw std::invalid_argument(it->name + " is not a number, only = != and IN apply");
+                }
+                add_value(*node);
+                return node;
+            }
+
+        public:
+            Parser(const std::string& expression, const std::vector<AttributeColumn>& columns)
+                : tokens(tokenize(expression)), columns(columns) {
+            }
+
+            NodePtr parse(){
+                NodePtr node = expr();
+                if (peek().kind != Token::Kind::End){
+                    throw std::invalid_argument("Unexpected '" + peek().text + "' in filter");
+                }
+                return node;
+            }
+        };
+
+        Bitmap evaluate_node(const Filter::Node& node, const std::vector<AttributeColumn>& columns, size_t rows){
+            using Kind = Filter::Node::Kind;
+            switch (node.kind){
+                case Kind::And: {
+                    Bitmap result = evaluate_node(*node.children[0], columns, rows);
+                    result &= evaluate_node(*node.children[1], columns, rows);
+                    return result;
+                }
+                case Kind::Or: {
+                    Bitmap result = evaluate_node(*node.children[0], columns, rows);
+                    result |= evaluate_node(*node.children[1], columns, rows);
+                    return result;
+                }
+                case Kind::Not: {
+                    Bitmap result = evaluate_node(*node.children[0], columns, rows);
+                    result.flip();
+                    return result;
+                }
+                default:
+                    break;
+            }
+
+            Bitmap result(rows, false);
+            const auto& column = columns[node.column];
+            if (column.type == AttributeType::Number){
+                for (size_t i = 0; i < rows; i++){
+                    double value = column.numbers[i];
+                    bool match = false;
+                    if (node.kind == Kind::In){
+                        match = std::find(node.numbers.begin(), node.numbers.end(), value) != node.numbers.end();
+                    } else {
+                        match = compare(node.op, value, node.numbers[0]);
+                    }
+                    if (match){
+                        result.set(i);
+                    }
+                }
+                return result;
+            }
+
+            // string columns compare dictionary codes through a lookup table
+            std::vector<char> accepted(column.dictionary.size(), 0);
+            for (const auto& text : node.texts){
+                auto it = std::find(column.dictionary.begin(), column.dictionary.end(), text);
+                if (it != column.dictionary.end()){
+                    accepted[it - column.dictionary.begin()] = 1;
+                }
+            }
+            if (node.kind == Kind::Compare && node.op == "!="){
+                for (auto& a : accepted){
+                    a = !a;
+                }
+            }
+            for (size_t i = 0; i < rows; i++){
+                int32_t code = column.codes[i];
+                if (code >= 0 && accepted[code]){
+                    result.set(i);
+                }
+            }
+            return result;
+        }
+
+        bool matches_node(const Filter::Node& node, const std::vector<AttributeColumn>& columns, const CSVRow& row){
+            using Kind = Filter::Node::Kind;
+            switch (node.kind){
+                case Kind::And:
+                    return matches_node(*node.children[0], columns, row) && matches_node(*node.children[1], columns, row);
+                case Kind::Or:
+                    return matches_node(*node.children[0], columns, row) || matches_node(*node.children[1], columns, row);
+                case Kind::Not:
+                    return !matches_node(*node.children[0], columns, row);
+                default:
+                    break;
+            }
+
+            std::string value = attribute(row, node.column);
+            if (columns[node.column].type == AttributeType::Number){
+                double number = to_number(value);
+                if (node.kind == Kind::In){
+                    return std::find(node.numbers.begin(), node.numbers.end(), number) != node.numbers.end();
+                }
+                return compare(node.op, number, node.numbers[0]);
+            }
+
+            if (value.empty()){
+                return false;
+            }
+            bool found = std::find(node.texts.begin(), node.texts.end(), lowercase(value)) != node.texts.end();
+            return node.kind == Kind::Compare && node.op == "!=" ? !found : found;
+        }
+
+    }
+
+    std::vector<AttributeColumn> AttributeColumn::build(const std::vector<std::string>& names, const std::vector<CSVRow>& rows){
+        std::vector<AttributeColumn> columns(names.size());
+        for (size_t j = 0; j < names.size(); j++){
+            auto& column = columns[j];
+            column.name = trim(names[j]);
+
+            // a number column needs at least one value, and only numbers
+            bool numeric = false;
+            for (const auto& row : rows){
+                std::string value = attribute(row, j);
+                if (value.empty()){
+                    continue;
+                }
+                numeric = !std::isnan(to_number(value));
+                if (!numeric){
+                    break;
+                }
+            }
+
+            if (numeric){
+                column.type = AttributeType::Number;
+                column.numbers.reserve(rows.size());
+                for (const auto& row : rows){
+                    column.numbers.push_back(to_number(attribute(row, j)));
+                }
+                continue;
+            }
+
+            column.type = AttributeType::String;
+            column.codes.reserve(rows.size());
+            // SKUs and brands can have as many values as rows, so values are interned by hash
+            std::unordered_map<std::string, int32_t> interned;
+            for (const auto& row : rows){
+                std::string value = lowercase(attribute(row, j));
+                if (value.empty()){
+                    column.codes.push_back(-1);
+                    continue;
+                }
+                auto [it, inserted] = interned.emplace(value, static_cast<int32_t>(column.dictionary.size()));
+                if (inserted){
+                    column.dictionary.push_back(std::move(value));
+                }
+                column.codes.push_back(it->second);
+            }
+        }
+        return columns;
+    }
+
+    Bitmap::Bitmap(size_t bits, bool value) : words((bits + 63) / 64, value ? ~uint64_t(0) : 0), bits(bits) {
+        if (value && (bits & 63)){
+            words.back() &= (uint64_t(1) << (bits & 63)) - 1;
+        }
+    }
+
+    size_t Bitmap::count() const {
+        size_t n = 0;
+        for (uint64_t word : words){
+#if defined(__GNUC__) || defined(__clang__)
+            n += static_cast<size_t>(__builtin_popcountll(word));
+#else
+            // clears the lowest set bit per step
+            for (; word; word &= word - 1){
+                n++;
+            }
+#endif
+        }
+        return n;
+    }
+
+    Bitmap& Bitmap::operator&=(const Bitmap& other){
+        for (size_t w = 0; w < words.size(); w++){
+            words[w] &= other.words[w];
+        }
+        return *this;
+    }
+
+    Bitmap& Bitmap::operator|=(const Bitmap& other){
+        for (size_t w = 0; w < words.size(); w++){
+            words[w] |= other.words[w];
+        }
+        return *this;
+    }
+
+    void Bitmap::flip(){
+        for (auto& word : words){
+            word = ~word;
+        }
+        if (bits & 63){
+            words.back() &= (uint64_t(1) << (bits & 63)) - 1;
+        }
+    }
+
+    Filter Filter::parse(const std::string& expression, const std::vector<AttributeColumn>& columns){
+        Filter filter;
+        filter.root = Parser(expression, columns).parse();
+        return filter;
+    }
+
+    Bitmap Filter::evaluate(const std::vector<AttributeColumn>& columns, size_t rows) const {
+        return evaluate_node(*root, columns, rows);
+    }
+
+    bool Filter::matches(const std::vector<AttributeColumn>& columns, const CSVRow& row) const {
+        return matches_node(*root, columns, row);
+    }
+
+}
@@ -0,0 +1,158 @@
+/**
+* @file catalog_segment.cpp
+* @brief Columnar main segment of the catalog: aligned float matrix, id column, string arena
+* @date 2026-10-19 Monday
+*/
+
+#include "utils/catalog_segment.h"
+#include "mcp_logger.h"
+
+#include <algorithm>
+#include <cmath>
+#include <new>
+
+namespace csv {
+
+    namespace {
+        const size_t alignment = 64;
+        const size_t floats_per_line = alignment / sizeof(float);
+        // fname, link, desc
+        const size_t text_fields = 3;
+    }
+
+    void Segment::AlignedDelete::operator()(float* data) const {
+        ::operator delete(data, std::align_val_t{alignment});
+    }
+
+    Segment::Segment(std::vector<CSVRow> rows, const std::vector<std::string>& attribute_names){
+        count = rows.size();
+        // the most common dimension, so one malformed row cannot hide all the others from vector search
+        std::unordered_map<size_t, size_t> dimensions;
+        size_t most = 0;
+        for (const auto& row : rows){
+            size_t seen = ++dimensions[row.vector.size()];
+            if (seen > most){
+                most = seen;
+                dim = row.vector.size();
+            }
+        }
+        row_stride = (dim + floats_per_line - 1) / floats_per_line * floats_per_line;
+
+        // the row-based indexes are built before the rows are taken apart
+        columns = AttributeColumn::build(attribute_names, rows);
+        lexical = LexicalIndex(rows);
+
+        // aligned operator new rather than std::aligned_alloc, which MSVC lacks
+        size_t bytes = std::max(alignment, count * row_stride * sizeof(float));
+        float* data = static_cast<float*>(::operator new(bytes, std::align_val_t{alignment}));
+        matrix.reset(data);
+        std::fill(data, data + bytes / sizeof(float), 0.0f);
+
+        // normalize once at build, so cosine costs one dot product per row at query time
+        row_ids.reserve(count);
+        norms.reserve(count);
+        for (size_t i = 0; i < count; i++){
+            const auto& vec = rows[i].vector;
+            row_ids.push_back(rows[i].id);
+            ids[rows[i].id]++;
+
+            double norm = 0;
+            for (double v : vec){
+                norm += v * v;
+            }
+            norm = std::sqrt(norm);
+            norms.push_back(norm);
+
+            if (vec.size() != dim){
+                odd_vectors.emplace(i, vec);
+                continue;
+            }
+            float* out = data + i * row_stride;
+            for (size_t d = 0; d < dim; d++){
+                out[d] = norm > 0 ? static_cast<float>(vec[d] / norm) : 0.0f;
+            }
+        }
+        normalized = true;
+        if (!odd_vectors.empty()){
+            LOG_WARNING("Catalog segment: ", odd_vectors.size(), " of ", count, " rows have a vector of another dimension than ",
+                dim, ", vector search skips them");
+        }
+
+        // text columns, then attribute columns, each stored contiguously
+        size_t attributes = attribute_names.size();
+        size_t total = 0;
+        for (const auto& row : rows){
+            total += row.fname.size() + row.link.size() + row.desc.size();
+            for (const auto& value : row.attributes){
+                total += value.size();
+            }
+        }
+        arena.reserve(total);
+        offsets.assign(text_fields + attributes, std::vector<uint64_t>());
+        for (size_t column = 0; column < offsets.size(); column++){
+            auto& column_offsets = offsets[column];
+            column_offsets.reserve(count + 1);
+            column_offsets.push_back(arena.size());
+            for (const auto& row : rows){
+                if (column == 0){
+                    arena += row.fname;
+                } else if (column == 1){
+                    arena += row.link;
+                } else if (column == 2){
+                    arena += row.desc;
+                } else if (column - text_fields < row.attributes.size()){
+                    arena += row.attributes[column - text_fields];
+                }
+                column_offsets.push_back(arena.size());
+            }
+        }
+
+        // a catalog usually has one embedding model
+        std::unordered_map<std::string, uint32_t> interned;
+        model_codes.reserve(count);
+        for (const auto& row : rows){
+            auto [it, inserted] = interned.emplace(row.embedding_model, static_cast<uint32_t>(models.size()));
+            if (inserted){
+                models.push_back(row.embedding_model);
+            }
+            model_codes.push_back(it->second);
+        }
+    }
+
+    const float* Segment::vector(size_t i) const {
+        if (!odd_vectors.empty() && odd_vectors.count(i)){
+            return nullptr;
+        }
+        return matrix.get() + i * row_stride;
+    }
+
+    std::string_view Segment::column_text(size_t column, size_t i) const {
+        const auto& column_offsets = offsets[column];
+        return std::string_view(arena.data() + column_offsets[i], column_offsets[i + 1] - column_offsets[i]);
+    }
+
+    CSVRow Segment::row(size_t i, bool with_vector) const {
+        CSVRow result(std::string(text(TextField::Fname, i)), std::string(text(TextField::Link, i)), row_ids[i],
+            std::string(text(TextField::Desc, i)), embedding_model(i), {});
+
+        result.attributes.reserve(offsets.size() - text_fields);
+        for (size_t column = 0; column + text_fields < offsets.size(); column++){
+            result.attributes.emplace_back(attribute(column, i));
+        }
+
+        if (with_vector){
+            auto odd = odd_vectors.find(i);
+            if (odd != odd_vectors.end()){
+                result.vector = odd->second;
+            } else {
+                const float* unit = vector(i);
+                result.vector.resize(dim);
+                for (size_t d = 0; d < dim; d++){
+                    result.vector[d] = unit[d] * norms[i];
+                }
+            }
+        }
+        return result;
+    }
+
+}
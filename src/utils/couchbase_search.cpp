@@ -6,9 +6,14 @@
 */
 
 #include "utils/couchbase_search.h"
+#include <algorithm>
 #include <iostream>
 #include "httplib.h"
 #include "json.hpp"
+#include "mcp_cancellation.h"
+#include "mcp_logger.h"
+#include "mcp_metrics.h"
+#include "mcp_tracing.h"
 
 // from https://docs.couchbase.com/server/current/vector-search/run-vector-search-rest-api.html
 // To run a Vector search with the REST API:
@@ -28,15 +33,14 @@ CouchbaseVectorSearch::CouchbaseVectorSearch(const std::string& usr, const std::
 }
 
 std::string CouchbaseVectorSearch::vector_search(const std::string& field, int k=3) { // field to search on Couchbase DB
+    mcp::span search_span("couchbase.vector_search", field);
     std::string base_url = (port == 18094 ? "https://" : "http://") + hostname + ":" + std::to_string(port);
 
     // only for Debugging
     // std::cout << "Connecting to: " << base_url << std::endl;
     // std::cout << "Using credentials: " << username << " / " << password << std::endl;
 
-    std::cout << "Field: " << field << std::endl;
-    std::cout << "K: " << k << std::endl;
-    std::cout << "Query vector size: " << query.size() << std::endl;
+    LOG_DEBUG("Field: ", field, " K: ", k, " Query vector size: ", query.size());
     
     httplib::Client client(base_url);
 
@@ -46,9 +50,11 @@ std::string CouchbaseVectorSearch::vector_search(const std::string& field, int k
     #endif
 
     client.set_basic_auth(username, password);
-    client.set_connection_timeout(30, 0);
-    client.set_read_timeout(60, 0);
-    client.set_write_timeout(60, 0);
+    // the search gets what is left of the request's deadline
+    mcp::cancellation_token cancel = mcp::cancellation_token::current();
+    client.set_connection_timeout(std::max(std::chrono::milliseconds(1), cancel.remaining(std::chrono::seconds(30))));
+    client.set_read_timeout(std::max(std::chrono::milliseconds(1), cancel.remaining(std::chrono::seconds(60))));
+    client.set_write_timeout(std::max(std::chrono::milliseconds(1), cancel.remaining(std::chrono::seconds(60))));
     
     // curl -s -XPUT -H "Content-Type: application/json" \
     // -u ${CB_USERNAME}:${CB_PASSWORD} http://${CB_HOSTNAME}:8094/api/bucket/${BUCKET_NAME}/scope/${SCOPE_NAME}/index/${INDEX_NAME}/query -d
@@ -97,12 +103,23 @@ std::string CouchbaseVectorSearch::vector_search(const std::string& field, int k
     // std::cout << "Generated JSON: " << json_payload << std::endl;
     // return payload.dump(2); // to check payload
 
-    auto result = client.Post(path, header, json_payload, "application/json");
+    auto& registry = mcp::metrics_registry::instance();
+    auto& errors = registry.get_counter("mcp_backend_errors_total", "Failed backend calls", {{"backend", "couchbase"}});
+    httplib::Result result;
+    {
+        // a cancelled request closes the socket instead of waiting for the search
+        mcp::cancellation_callback abort(cancel, [&client](){ client.stop(); });
+        mcp::scoped_timer timer(registry.get_histogram("mcp_backend_request_duration", "Backend call latency", {{"backend", "couchbase"}}));
+        result = client.Post(path, header, json_payload, "application/json");
+    }
+    cancel.throw_if_cancelled();
     if (!result) {
+        errors.add();
         return "Error: Failed to connect to server";
     }
     
     if (result->status != 200) {
+        errors.add();
         return "Error: HTTP " + std::to_string(result->status) + " - " + result->body;
     }
 
@@ -6,6 +6,8 @@
 */
 
 #include "utils/csv_parser.h"
+#include "mcp_json_writer.h"
+#include "mcp_tracing.h"
 #include <algorithm>
 #include <Eigen/Dense>
 #include <iostream>
@@ -14,6 +16,7 @@
 namespace csv{
 
     std::vector<CSVRow> parse_csv_with_scores(const std::string& filepath, const std::vector<double>& query_vector){
+        mcp::span scan_span("csv.scan", filepath);
         std::vector<CSVRow> dataset;
         std::ifstream file(filepath);
         std::string line;
@@ -56,6 +59,7 @@ namespace csv{
             int id = std::stoi(row[2]);
             std::vector<double> vec = parse_str_to_vector(row[5]);
             dataset.emplace_back(row[0], row[1], id, row[3], row[4], vec);
+            dataset.back().attributes.assign(row.begin() + std::min<size_t>(row.size(), 6), row.end());
             row_num++;
         }
         file.close();
@@ -63,6 +67,17 @@ namespace csv{
         return dataset;
     }
 
+    std::vector<std::string> parse_attribute_names(const std::string& filepath){
+        std::ifstream file(filepath);
+        std::string line;
+        if (!std::getline(file, line)){
+            return {};
+        }
+
+        auto header = line_parser(line);
+        return std::vector<std::string>(header.begin() + std::min<size_t>(header.size(), 6), header.end());
+    }
+
     std::vector<std::string> line_parser(const std::string& line){
         std::vector<std::string> row;
         std::string temp; // temp placeholder within loop
@@ -124,37 +139,29 @@ namespace csv{
         return stream.str();
     }
 
-    std::string dataset_to_json(const std::vector<CSVRow>& dataset) {
-        std::stringstream json;
-        
-        json << "{\n";
-        json << "  \"results\": [\n";
+    std::string dataset_to_json(const std::vector<CSVRow>& dataset, const std::vector<std::string>& attribute_names) {
+        // about 200 bytes per result before attributes
+        std::string json;
+        json.reserve(64 + dataset.size() * 256);
         
-        for (size_t i = 0; i < dataset.size(); ++i) {
-            const auto& row = dataset[i];
-            
-            json << "    {\n";
-            // json << "      \"index\": " << i << ",\n";
-            json << "      \"id\": " << row.id << ",\n";
-            // json << "      \"filename\": \"" << row.fname << "\",\n";
-            json << "      \"description\": \"" << row.desc << "\",\n";
-            json << "      \"score\": " << row.score << ",\n";
-            json << "      \"link\": \"" << row.link << "\",\n";
-            // json << "      \"embedding_model\": \"" << row.embedding_model << "\"\n";
-            json << "    }";
-            
-            // Add comma if not the last element
-            if (i < dataset.size() - 1) {
-                json << ",";
+        mcp::json_writer writer(json);
+        writer.begin_object().key("results").begin_array();
+        for (const auto& row : dataset) {
+            writer.begin_object()
+                .key("id").value(row.id)
+                .key("description").value(row.desc)
+                .key("score").value(row.score)
+                .key("link").value(row.link);
+            for (size_t j = 0; j < attribute_names.size() && j < row.attributes.size(); ++j) {
+                writer.key(attribute_names[j]).value(row.attributes[j]);
             }
-            json << "\n";
+            writer.end_object();
         }
+        writer.end_array()
+            .key("count").value(static_cast<uint64_t>(dataset.size()))
+            .end_object();
         
-        json << "  ],\n";
-        json << "  \"count\": " << dataset.size() << "\n";
-        json << "}";
-        
-        return json.str();
+        return json;
     }
 
     std::vector<CSVRow> get_top_k(std::vector<CSVRow>& dataset, int k){
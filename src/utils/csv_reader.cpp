@@ -0,0 +1,345 @@
+/**
+* @file csv_reader.cpp
+* @brief Fast catalog ingestion: memory-mapped file, zero-copy RFC 4180 tokenizer, from_chars float parsing, parallel chunks
+* @date 2026-10-19 Monday
+*/
+
+#include "utils/csv_reader.h"
+#include "mcp_tracing.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define CSV_READER_MMAP
+#endif
+
+namespace csv {
+
+    namespace {
+        // below this a chunk is not worth a thread
+        const size_t min_chunk_size = 4 << 20;
+
+        bool is_separator(char c){
+            return c == ' ' || c == ',' || c == '[' || c == ']' || c == '\t' || c == '\r' || c == '\n';
+        }
+
+        std::string_view trim(std::string_view text){
+            while (!text.empty() && (text.front() == ' ' || text.front() == '\t')){
+                text.remove_prefix(1);
+            }
+            while (!text.empty() && (text.back() == ' ' || text.back() == '\t')){
+                text.remove_suffix(1);
+            }
+            return text;
+        }
+
+        // rows of one chunk, or the first error in it
+        struct Chunk{
+            std::string_view text;
+            std::vector<CSVRow> rows;
+            std::string error;
+            // offset in text of the malformed record
+            size_t error_at = 0;
+        };
+
+        void parse_chunk(Chunk& chunk){
+            std::vector<Field> fields;
+            std::vector<double> vec;
+            std::string_view rest = chunk.text;
+
+            while (!rest.empty()){
+                chunk.error_at = chunk.text.size() - rest.size();
+                size_t consumed = split_record(rest, fields);
+                rest.remove_prefix(consumed);
+
+                // blank line
+                if (fields.size() == 1 && fields[0].text.empty()){
+                    continue;
+                }
+
+                if (fields.size() < 6){
+                    chunk.error = "expected at least 6 fields, got " + std::to_string(fields.size());
+                    return;
+                }
+
+                std::string_view id_text = trim(fields[2].text);
+                int id = 0;
+                auto result = std::from_chars(id_text.data(), id_text.data() + id_text.size(), id);
+                if (result.ec != std::errc() || result.ptr != id_text.data() + id_text.size()){
+                    chunk.error = "id is not an integer: '" + std::string(id_text) + "'";
+                    return;
+                }
+
+                if (!parse_vector(fields[5].text, vec)){
+                    chunk.error = "vector does not parse";
+                    return;
+                }
+
+                chunk.rows.emplace_back(fields[0].str(), fields[1].str(), id, fields[3].str(), fields[4].str(), vec);
+                auto& attributes = chunk.rows.back().attributes;
+                attributes.reserve(fields.size() - 6);
+                for (size_t i = 6; i < fields.size(); i++){
+                    attributes.push_back(fields[i].str());
+                }
+            }
+        }
+    }
+
+    MappedFile::MappedFile(const std::string& filepath){
+#ifdef CSV_READER_MMAP
+        int fd = ::open(filepath.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0){
+            throw std::runtime_error("Cannot open file: " + filepath);
+        }
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0){
+            void* addr = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr != MAP_FAILED){
+                madvise(addr, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+                data = static_cast<const char*>(addr);
+                length = static_cast<size_t>(info.st_size);
+                mapped = true;
+            }
+        }
+        ::close(fd);
+        if (mapped){
+            return;
+        }
+#endif
+        // empty files, special files and platforms without mmap
+        std::ifstream file(filepath, std::ios::binary);
+        if (!file){
+            throw std::runtime_error("Cannot open file: " + filepath);
+        }
+        std::ostringstream contents;
+        contents << file.rdbuf();
+        buffer = contents.str();
+        data = buffer.data();
+        length = buffer.size();
+    }
+
+    MappedFile::~MappedFile(){
+#ifdef CSV_READER_MMAP
+        if (mapped){
+            munmap(const_cast<char*>(data), length);
+        }
+#endif
+    }
+
+    std::string Field::str() const {
+        if (!escaped){
+            return std::string(text);
+        }
+        std::string value;
+        value.reserve(text.size());
+        for (size_t i = 0; i < text.size(); i++){
+            value += text[i];
+            if (text[i] == '"' && i + 1 < text.size() && text[i + 1] == '"'){
+                i++;
+            }
+        }
+        return value;
+    }
+
+    size_t split_record(std::string_view input, std::vector<Field>& fields){
+        fields.clear();
+        size_t i = 0;
+        size_t n = input.size();
+
+        while (true){
+            Field field;
+            if (i < n && input[i] == '"'){
+                size_t start = ++i;
+                // jump from quote to quote, a doubled quote is an escaped one
+                while (i < n){
+                    const void* quote = std::memchr(input.data() + i, '"', n - i);
+                    if (!quote){
+                        i = n;
+                        break;
+                    }
+                    i = static_cast<const char*>(quote) - input.data();
+                    if (i + 1 < n && input[i + 1] == '"'){
+                        field.escaped = true;
+                        i += 2;
+                        continue;
+                    }
+                    break;
+                }
+                field.text = input.substr(start, std::min(i, n) - start);
+                if (i < n){
+                    i++;
+                }
+                // text between the closing quote and the delimiter is dropped
+                while (i < n && input[i] != ',' && input[i] != '\n' && input[i] != '\r'){
+                    i++;
+                }
+            } else {
+                size_t start = i;
+                while (i < n && input[i] != ',' && input[i] != '\n' && input[i] != '\r'){
+                    i++;
+                }
+                field.text = input.substr(start, i - start);
+            }
+            fields.push_back(field);
+
+            if (i < n && input[i] == ','){
+                i++;
+                continue;
+            }
+            if (i < n && input[i] == '\r'){
+                i++;
+            }
+            if (i < n && input[i] == '\n'){
+                i++;
+            }
+            return i;
+        }
+    }
+
+    bool parse_vector(std::string_view text, std::vector<double>& out){
+        out.clear();
+        // about 10 characters per component in data-prep output
+        out.reserve(text.size() / 10 + 1);
+
+        const char* p = text.data();
+        const char* end = p + text.size();
+        while (p < end){
+            if (is_separator(*p)){
+                p++;
+                continue;
+            }
+            double value;
+#if defined(__cpp_lib_to_chars)
+            auto result = std::from_chars(p, end, value);
+            if (result.ec != std::errc()){
+                return false;
+            }
+            p = result.ptr;
+#else
+            // strtod needs a terminated string
+            char number[64];
+            size_t len = 0;
+            while (p + len < end && !is_separator(p[len]) && len < sizeof(number) - 1){
+                number[len] = p[len];
+                len++;
+            }
+            number[len] = '\0';
+            char* parsed_end = nullptr;
+            value = std::strtod(number, &parsed_end);
+            if (parsed_end == number){
+                return false;
+            }
+            p += parsed_end - number;
+#endif
+            out.push_back(value);
+        }
+        return true;
+    }
+
+    std::vector<CSVRow> read_catalog(const std::string& filepath, unsigned threads){
+        mcp::span read_span("csv.read", filepath);
+        MappedFile file(filepath);
+        std::string_view body = file.view();
+
+        // skip the header
+        std::vector<Field> fields;
+        body.remove_prefix(split_record(body, fields));
+
+        if (threads == 0){
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        size_t count = std::max<size_t>(1, std::min<size_t>(threads, body.size() / min_chunk_size));
+
+        // a chunk boundary must be a newline outside quotes, so the quote parity
+        // at each raw boundary comes from counting quotes in the chunks before it
+        std::vector<size_t> raw(count + 1);
+        for (size_t c = 0; c <= count; c++){
+            raw[c] = body.size() * c / count;
+        }
+        std::vector<size_t> quotes(count, 0);
+        std::vector<std::thread> workers;
+        for (size_t c = 0; c < count; c++){
+            auto count_quotes = [&, c](){
+                quotes[c] = std::count(body.begin() + raw[c], body.begin() + raw[c + 1], '"');
+            };
+            if (c + 1 == count){
+                count_quotes();
+            } else {
+                workers.emplace_back(count_quotes);
+            }
+        }
+        for (auto& worker : workers){
+            worker.join();
+        }
+        workers.clear();
+
+        std::vector<size_t> bounds(count + 1);
+        bounds[0] = 0;
+        bounds[count] = body.size();
+        size_t parity = 0;
+        for (size_t c = 1; c < count; c++){
+            parity ^= quotes[c - 1] & 1;
+            if (bounds[c - 1] >= raw[c]){
+                // the previous chunk's record ran past this boundary, leave this chunk empty
+                bounds[c] = bounds[c - 1];
+                continue;
+            }
+            bool quoted = parity;
+            size_t i = raw[c];
+            while (i < body.size() && !(body[i] == '\n' && !quoted)){
+                if (body[i] == '"'){
+                    quoted = !quoted;
+                }
+                i++;
+            }
+            bounds[c] = std::min(i + 1, body.size());
+        }
+
+        std::vector<Chunk> chunks(count);
+        for (size_t c = 0; c < count; c++){
+            chunks[c].text = body.substr(bounds[c], bounds[c + 1] - bounds[c]);
+            if (c + 1 == count){
+                parse_chunk(chunks[c]);
+            } else {
+                workers.emplace_back(parse_chunk, std::ref(chunks[c]));
+            }
+        }
+        for (auto& worker : workers){
+            worker.join();
+        }
+
+        size_t total = 0;
+        for (const auto& chunk : chunks){
+            if (!chunk.error.empty()){
+                // quoted newlines and blank lines make records and lines differ, so the lines before it are counted
+                std::string_view before = file.view().substr(0, chunk.text.data() - file.view().data() + chunk.error_at);
+                size_t line = std::count(before.begin(), before.end(), '\n') + 1;
+                throw std::runtime_error("Malformed row at line " + std::to_string(line)
+                    + " in " + filepath + ": " + chunk.error);
+            }
+            total += chunk.rows.size();
+        }
+
+        std::vector<CSVRow> rows;
+        rows.reserve(total);
+        for (auto& chunk : chunks){
+            std::move(chunk.rows.begin(), chunk.rows.end(), std::back_inserter(rows));
+        }
+        return rows;
+    }
+
+}
@@ -0,0 +1,164 @@
+/**
+* @file lexical_index.cpp
+* @brief In-memory inverted index with BM25 scoring over garment descriptions and filenames
+* @date 2026-10-19 Monday
+*/
+
+#include "utils/lexical_index.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+
+namespace csv {
+
+    namespace {
+        // the text a row is indexed by
+        std::vector<std::string> row_terms(const CSVRow& row){
+            std::vector<std::string> terms = LexicalIndex::tokenize(row.desc);
+            std::vector<std::string> file_terms = LexicalIndex::tokenize(row.fname);
+            terms.insert(terms.end(), file_terms.begin(), file_terms.end());
+            return terms;
+        }
+
+        // query terms counted once each
+        std::vector<std::string> unique_terms(std::vector<std::string> terms){
+            std::sort(terms.begin(), terms.end());
+            terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+            return terms;
+        }
+    }
+
+    LexicalIndex::LexicalIndex(const std::vector<CSVRow>& rows){
+        lengths.reserve(rows.size());
+        uint64_t total = 0;
+        for (size_t doc = 0; doc < rows.size(); doc++){
+            std::vector<std::string> terms = row_terms(rows[doc]);
+            lengths.push_back(static_cast<uint32_t>(terms.size()));
+            total += terms.size();
+
+            // documents are added in order, so each list stays sorted and a repeat is always the last entry
+            for (auto& term : terms){
+                auto& list = postings[std::move(term)];
+                if (!list.empty() && list.back().doc == doc){
+                    list.back().tf++;
+                } else {
+                    list.push_back(Posting{static_cast<uint32_t>(doc), 1});
+                }
+            }
+        }
+        average_length = rows.empty() ? 0 : static_cast<double>(total) / rows.size();
+    }
+
+    std::vector<std::string> LexicalIndex::tokenize(const std::string& text){
+        std::vector<std::string> terms;
+        std::string word;
+
+        auto flush = [&terms, &word](){
+            if (word.empty()){
+                return;
+            }
+            terms.push_back(word);
+            // parts of joined words, "v-neck" -> "v", "neck"
+            if (word.find_first_of("-_") != std::string::npos){
+                std::string part;
+                for (char c : word){
+                    if (c == '-' || c == '_'){
+                        if (!part.empty()){
+                            terms.push_back(part);
+                        }
+                        part.clear();
+                    } else {
+                        part += c;
+                    }
+                }
+                if (!part.empty()){
+                    terms.push_back(part);
+                }
+            }
+            word.clear();
+        };
+
+        for (char c : text){
+            unsigned char uc = static_cast<unsigned char>(c);
+            if (std::isalnum(uc) || ((c == '-' || c == '_') && !word.empty())){
+                word += static_cast<char>(std::tolower(uc));
+            } else {
+                flush();
+            }
+        }
+        flush();
+
+        // trailing joiners as in "t-shirt-" carry no meaning
+        for (auto& term : terms){
+            while (!term.empty() && (term.back() == '-' || term.back() == '_')){
+                term.pop_back();
+            }
+        }
+        terms.erase(std::remove(terms.begin(), terms.end(), std::string()), terms.end());
+        return terms;
+    }
+
+    double LexicalIndex::idf(const std::string& term) const {
+        auto it = postings.find(term);
+        if (it == postings.end()){
+            return 0;
+        }
+        double n = static_cast<double>(lengths.size());
+        double df = static_cast<double>(it->second.size());
+        // the +1 inside the log (as in Lucene) keeps very common terms from scoring negative
+        return std::log(1.0 + (n - df + 0.5) / (df + 0.5));
+    }
+
+    double LexicalIndex::term_score(double idf, uint32_t tf, uint32_t length) const {
+        double norm = average_length > 0 ? length / average_length : 1.0;
+        return idf * (tf * (k1 + 1)) / (tf + k1 * (1 - b + b * norm));
+    }
+
+    std::vector<std::pair<size_t, double>> LexicalIndex::score(const std::vector<std::string>& terms) const {
+        std::vector<double> scores(lengths.size(), 0.0);
+        std::vector<size_t> touched;
+
+        for (const auto& term : unique_terms(terms)){
+            auto it = postings.find(term);
+            if (it == postings.end()){
+                continue;
+            }
+            double weight = idf(term);
+            for (const auto& posting : it->second){
+                if (scores[posting.doc] == 0.0){
+                    touched.push_back(posting.doc);
+                }
+                scores[posting.doc] += term_score(weight, posting.tf, lengths[posting.doc]);
+            }
+        }
+
+        std::sort(touched.begin(), touched.end());
+        std::vector<std::pair<size_t, double>> result;
+        result.reserve(touched.size());
+        for (size_t doc : touched){
+            result.emplace_back(doc, scores[doc]);
+        }
+        return result;
+    }
+
+    double LexicalIndex::score(const std::vector<std::string>& terms, const CSVRow& row) const {
+        std::vector<std::string> doc = row_terms(row);
+        double total = 0;
+        for (const auto& term : unique_terms(terms)){
+            uint32_t tf = static_cast<uint32_t>(std::count(doc.begin(), doc.end(), term));
+            if (tf == 0){
+                continue;
+            }
+            // a term unknown to the index is as rare as a term in a single document
+            double weight = idf(term);
+            if (weight == 0){
+                double n = static_cast<double>(lengths.size());
+                weight = std::log(1.0 + (n + 0.5) / 1.5);
+            }
+            total += term_score(weight, tf, static_cast<uint32_t>(doc.size()));
+        }
+        return total;
+    }
+
+}
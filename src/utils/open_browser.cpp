@@ -1,25 +1,104 @@
 /**
 * @file open_browser.cpp
-* @brief Opening the browser
+* @brief Opening the browser, and the sinks that deliver try-on outputs
 * @author Nikhil Kapila
 * @date 2025-06-26 18:46:09 Thursday
 */
 
 #include "utils/open_browser.h"
+#include "mcp_logger.h"
+#include "mcp_task.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
 #include <string>
 
+#if defined(__linux__) || defined(__APPLE__)
+#include <spawn.h>
+#include <sys/wait.h>
+extern char** environ;
+#elif defined(_WIN32)
+#include <windows.h>
+#include <shellapi.h>
+#endif
+
 namespace browser {
-    void openURL(const std::string& url){
-        #ifdef _WIN32_
-            std::string command = "start " + url;
-            system(command.c_str());
-        #elif __APPLE__
-            std::string command = "open " + url;
-            system(command.c_str());
-        #elif __linux__
-            std::string command = "xdg-open " + url;
-            system(command.c_str());
+    bool is_web_url(const std::string& url){
+        size_t scheme_end = url.find("://");
+        if (scheme_end == std::string::npos || scheme_end + 3 >= url.size()){
+            return false;
+        }
+        std::string scheme = url.substr(0, scheme_end);
+        std::transform(scheme.begin(), scheme.end(), scheme.begin(), [](unsigned char c){ return std::tolower(c); });
+        if (scheme != "http" && scheme != "https"){
+            return false;
+        }
+        // control characters and spaces have no place in a link and could split it for the opener
+        return std::none_of(url.begin(), url.end(), [](unsigned char c){ return c <= 0x20 || c == 0x7f; });
+    }
+
+    bool openURL(const std::string& url){
+        // anything else could be a local file, another handler, or an option to the opener
+        if (!is_web_url(url)){
+            LOG_WARNING("Not opening ", url, ": only http and https links are opened");
+            return false;
+        }
+        #if defined(__linux__) || defined(__APPLE__)
+            #ifdef __APPLE__
+                const char* opener = "open";
+            #else
+                const char* opener = "xdg-open";
+            #endif
+            // no shell, so the url is never interpreted as a command
+            char* argv[] = {const_cast<char*>(opener), const_cast<char*>(url.c_str()), nullptr};
+            pid_t pid;
+            int rc = posix_spawnp(&pid, opener, nullptr, nullptr, argv, environ);
+            if (rc != 0){
+                LOG_WARNING("Cannot launch ", opener, ": ", std::strerror(rc));
+                return false;
+            }
+            int status = 0;
+            waitpid(pid, &status, 0);
+            return true;
+        #elif defined(_WIN32)
+            // the url goes to the default handler as is, no command line is built or parsed
+            int length = MultiByteToWideChar(CP_UTF8, 0, url.c_str(), -1, nullptr, 0);
+            if (length == 0){
+                LOG_WARNING("Not opening ", url, ": not valid UTF-8");
+                return false;
+            }
+            std::wstring wide(length, L'\0');
+            MultiByteToWideChar(CP_UTF8, 0, url.c_str(), -1, &wide[0], length);
+            HINSTANCE rc = ShellExecuteW(nullptr, L"open", wide.c_str(), nullptr, nullptr, SW_SHOWNORMAL);
+            if (reinterpret_cast<INT_PTR>(rc) <= 32){
+                LOG_WARNING("Cannot open ", url, ": ShellExecute error ", reinterpret_cast<INT_PTR>(rc));
+                return false;
+            }
+            return true;
+        #else
+            return false;
         #endif
+    }
+
+    void LaunchSink::deliver(const std::string& /*session_id*/, const std::string& url){
+        // spawning and reaping the launcher stays off the handler's thread
+        mcp::executor::instance().post_blocking([url](){
+            openURL(url);
+        });
+    }
+
+    void HeadlessSink::deliver(const std::string& session_id, const std::string& url){
+        LOG_DEBUG("Session ID: ", session_id, " try-on output: ", url);
+    }
+
+    CallbackSink::CallbackSink(std::function<void(const std::string&, const std::string&)> callback)
+        : callback(std::move(callback)) {
+    }
 
+    void CallbackSink::deliver(const std::string& session_id, const std::string& url){
+        mcp::executor::instance().post([callback = callback, session_id, url](){
+            callback(session_id, url);
+        });
     }
-}
\ No newline at end of file
+}
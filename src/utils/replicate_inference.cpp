@@ -6,14 +6,34 @@
 */
 
 #include "utils/replicate_inference.h"
+#include <algorithm>
+#include <cctype>
 #include <iostream>
+#include <random>
+#include <thread>
 #include "httplib.h"
 #include "json.hpp"
+#include "mcp_logger.h"
+#include "mcp_metrics.h"
+#include "mcp_tracing.h"
 
 // curl request from docs, https://replicate.com/cuuupid/idm-vton/api
 // curl --silent --show-error https://api.replicate.com/v1/predictions \ --request POST \ --header "Authorization: Bearer $REPLICATE_API_TOKEN" \ --header "Content-Type: application/json" \ --header "Prefer: wait" \ --data @- <<-EOM { "version": "0513734a452173b8173e907e3a59d19a36266e55b48528559432bd21c7d7e985", "input": { "garm_img": "https://replicate.delivery/pbxt/KgwTlZyFx5aUU3gc5gMiKuD5nNPTgliMlLUWx160G4z99YjO/sweater.webp", "human_img": "https://replicate.delivery/pbxt/KgwTlhCMvDagRrcVzZJbuozNJ8esPqiNAIJS3eMgHrYuHmW4/KakaoTalk_Photo_2024-04-04-21-44-45.png", "garment_des": "cute pink top" } } EOM
 
 namespace ri{
+    namespace {
+        // series resolved once instead of on every call, like record_sse_event in the server
+        mcp::counter& backend_errors(){
+            static mcp::counter& errors = mcp::metrics_registry::instance().get_counter("mcp_backend_errors_total", "Failed backend calls", {{"backend", "replicate"}});
+            return errors;
+        }
+
+        mcp::histogram& backend_duration(){
+            static mcp::histogram& duration = mcp::metrics_registry::instance().get_histogram("mcp_backend_request_duration", "Backend call latency", {{"backend", "replicate"}});
+            return duration;
+        }
+    }
+
     // constructor
     ReplicateInference::ReplicateInference(const std::string& version): 
     version(version) {
@@ -58,13 +78,30 @@ namespace ri{
 
     // curl request from docs, https://replicate.com/cuuupid/idm-vton/api
     // curl --silent --show-error https://api.replicate.com/v1/predictions \ --request POST \ --header "Authorization: Bearer $REPLICATE_API_TOKEN" \ --header "Content-Type: application/json" \ --header "Prefer: wait" \ --data @- <<-EOM { "version": "0513734a452173b8173e907e3a59d19a36266e55b48528559432bd21c7d7e985", "input": { "garm_img": "https://replicate.delivery/pbxt/KgwTlZyFx5aUU3gc5gMiKuD5nNPTgliMlLUWx160G4z99YjO/sweater.webp", "human_img": "https://replicate.delivery/pbxt/KgwTlhCMvDagRrcVzZJbuozNJ8esPqiNAIJS3eMgHrYuHmW4/KakaoTalk_Photo_2024-04-04-21-44-45.png", "garment_des": "cute pink top" } } EOM
+    // stop a prediction nobody is waiting for, failures are only logged
+    static void cancel_prediction(const std::string& api_key, const std::string& id){
+        if (id.empty()){
+            return;
+        }
+        httplib::Headers headers = {
+            {"Authorization", "Bearer " + api_key}
+        };
+        httplib::Result result = ReplicateClient::shared().request([&](httplib::Client& client){
+            return client.Post("/v1/predictions/" + id + "/cancel", headers, "", "application/json");
+        }, true);
+        if (!result || result->status != 200){
+            LOG_WARNING("Cannot cancel prediction ", id, ": ", result ? "HTTP " + std::to_string(result->status) : httplib::to_string(result.error()));
+            return;
+        }
+        LOG_INFO("Cancelled prediction ", id);
+        mcp::metrics_registry::instance().get_counter("replicate_predictions_cancelled_total", "Predictions cancelled with their request").add();
+    }
+
     std::string ReplicateInference::perform_inference(const std::string& api_key){
-        std::string base_url = "https://api.replicate.com";
+        mcp::span inference_span("replicate.inference", version);
         std::string path = "/v1/predictions";
-        
-        httplib::Client client(base_url);
-        client.set_connection_timeout(30, 0);
-        client.set_read_timeout(60, 0 );
+        mcp::cancellation_token cancel = mcp::cancellation_token::current();
+        cancel.throw_if_cancelled();
         
         // build json from input map
         nlohmann::json inputs_json;
@@ -74,10 +111,16 @@ namespace ri{
             }, v);
         }
 
+        // a short wait returns the prediction id soon enough to cancel it; quick predictions still finish in one call.
+        // It ends a couple of seconds before the deadline, so the id is back in time to cancel a prediction that runs over
+        auto wait = std::chrono::duration_cast<std::chrono::seconds>(cancel.remaining(std::chrono::seconds(12))) - std::chrono::seconds(2);
+        if (wait < std::chrono::seconds(1)){
+            throw mcp::mcp_exception(mcp::error_code::request_timeout, "Not enough time left to run a prediction");
+        }
         httplib::Headers headers = {
         {"Authorization", "Bearer " + api_key},
         {"Content-Type", "application/json"},
-        {"Prefer", "wait"}
+        {"Prefer", "wait=" + std::to_string(wait.count())}
         };
 
         nlohmann::json payload = {
@@ -88,27 +131,275 @@ namespace ri{
         std::string json_payload = payload.dump();
         // std::cout << "Generated JSON: " << json_payload << std::endl;
 
-        auto result = client.Post(path, headers, json_payload, "application/json");
+        auto& errors = backend_errors();
+        // each try creates a paid prediction, so only what never reached replicate is retried;
+        // not aborted on cancellation, the response has the id to cancel
+        httplib::Result result = ReplicateClient::shared().request([&](httplib::Client& client){
+            return client.Post(path, headers, json_payload, "application/json");
+        }, false);
         
         if (!result) {
-            return "Error: Failed to connect to server";
+            errors.add();
+            throw std::runtime_error("Replicate request failed: " + httplib::to_string(result.error()));
         }
 
         if (result->status!= 200 && result->status!=201){
-            return "Error: HTTP " + std::to_string(result->status) + " - " + result->body;
+            errors.add();
+            throw std::runtime_error("Replicate request failed: HTTP " + std::to_string(result->status) + " - " + result->body);
         }
 
         std::string jsonresp = result->body;
-        std::cout << "Returned response:\n" << jsonresp;
+        LOG_DEBUG("Returned response:\n", jsonresp);
+
+        nlohmann::json res = nlohmann::json::parse(jsonresp, nullptr, false);
 
-        nlohmann::json res = nlohmann::json::parse(jsonresp);
+        // still running after the wait: poll it, and cancel it if our caller goes away
+        std::string id = res.is_object() ? res.value("id", std::string()) : "";
+        httplib::Headers poll_headers = {
+            {"Authorization", "Bearer " + api_key}
+        };
+        while (res.is_object() && (res.value("status", "") == "starting" || res.value("status", "") == "processing")){
+            if (cancel.wait_for(std::chrono::seconds(1))){
+                cancel_prediction(api_key, id);
+                cancel.throw_if_cancelled();
+            }
+            result = ReplicateClient::shared().request([&](httplib::Client& client){
+                return client.Get(path + "/" + id, poll_headers);
+            }, true, cancel);
+            if (cancel.is_cancelled()){
+                cancel_prediction(api_key, id);
+                cancel.throw_if_cancelled();
+            }
+            if (!result || result->status != 200){
+                errors.add();
+                throw std::runtime_error("Replicate prediction " + id + " could not be polled: "
+                    + (result ? "HTTP " + std::to_string(result->status) : httplib::to_string(result.error())));
+            }
+            jsonresp = result->body;
+            res = nlohmann::json::parse(jsonresp, nullptr, false);
+        }
 
-        if (res.contains("status")){
-            if (res["status"] == "succeeded"){
-                return res["output"];
+        if (!res.is_object() || !res.contains("status")){
+            errors.add();
+            throw std::runtime_error("Replicate returned an unexpected response: " + jsonresp);
+        }
+        if (res["status"] != "succeeded" || !res["output"].is_string()){
+            errors.add();
+            throw std::runtime_error("Replicate prediction " + id + " did not succeed: "
+                + res["status"].dump() + (res.contains("error") ? " " + res["error"].dump() : ""));
+        }
+        return res["output"];
+    }
+
+    std::string upload_file(const std::string& api_key, const std::string& bytes, const std::string& mime_type,
+        const std::string& filename){
+        mcp::span upload_span("replicate.upload", filename);
+
+        httplib::Headers headers = {
+            {"Authorization", "Bearer " + api_key}
+        };
+        httplib::MultipartFormDataItems items = {
+            {"content", bytes, filename, mime_type}
+        };
+
+        // a repeated upload only leaves a spare copy behind
+        httplib::Result result = ReplicateClient::shared().request([&](httplib::Client& client){
+            return client.Post("/v1/files", headers, items);
+        }, true);
+
+        if (!result || (result->status != 200 && result->status != 201)){
+            backend_errors().add();
+            throw std::runtime_error(result ? "Replicate upload failed: HTTP " + std::to_string(result->status) + " - " + result->body
+                : "Replicate upload failed: " + httplib::to_string(result.error()));
+        }
+
+        nlohmann::json res = nlohmann::json::parse(result->body, nullptr, false);
+        if (!res.is_object() || !res.contains("urls") || !res["urls"].contains("get")){
+            throw std::runtime_error("Replicate upload returned no URL: " + result->body);
+        }
+        return res["urls"]["get"].get<std::string>();
+    }
+
+    TokenBucket::TokenBucket(double rate, double burst):
+    rate(rate), burst(burst), tokens(burst), last(std::chrono::steady_clock::now()) {
+    }
+
+    void TokenBucket::set_rate(double new_rate, double new_burst){
+        std::lock_guard<std::mutex> lock(mutex);
+        rate = new_rate;
+        burst = new_burst;
+        tokens = std::min(tokens, burst);
+    }
+
+    std::chrono::milliseconds TokenBucket::acquire(){
+        double wait_seconds = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (rate <= 0){
+                return std::chrono::milliseconds(0);
+            }
+            auto now = std::chrono::steady_clock::now();
+            // last is in the future while paused
+            if (now > last){
+                tokens = std::min(burst, tokens + std::chrono::duration<double>(now - last).count() * rate);
+                last = now;
+            }
+            // take the token now, whoever comes next waits behind us
+            tokens -= 1;
+            if (tokens < 0){
+                wait_seconds = -tokens / rate;
+            }
+            wait_seconds += std::chrono::duration<double>(last - now).count();
+        }
+        auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::duration<double>(wait_seconds));
+        if (wait.count() > 0){
+            std::this_thread::sleep_for(wait);
+        }
+        return wait;
+    }
+
+    void TokenBucket::pause(std::chrono::milliseconds delay){
+        std::lock_guard<std::mutex> lock(mutex);
+        auto resume = std::chrono::steady_clock::now() + delay;
+        if (resume > last){
+            // nothing saved up survives a pause
+            tokens = std::min(tokens, 0.0);
+            last = resume;
+        }
+    }
+
+    std::chrono::milliseconds backoff_delay(const RetryPolicy& policy, int attempt, double jitter){
+        double ceiling = static_cast<double>(policy.base_delay.count());
+        for (int i = 1; i < attempt && ceiling < policy.max_delay.count(); ++i){
+            ceiling *= 2;
+        }
+        ceiling = std::min(ceiling, static_cast<double>(policy.max_delay.count()));
+        return std::chrono::milliseconds(static_cast<long long>(ceiling * jitter));
+    }
+
+    std::chrono::milliseconds parse_retry_after(const std::string& value){
+        if (value.empty() || value.size() > 9 || !std::all_of(value.begin(), value.end(), [](unsigned char c){ return std::isdigit(c); })){
+            // an HTTP date, or garbage: the caller falls back to its own backoff
+            return std::chrono::milliseconds(-1);
+        }
+        return std::chrono::seconds(std::stol(value));
+    }
+
+    ReplicateClient::ReplicateClient(const std::string& base_url):
+    base_url(base_url), limiter(10, 10) {
+    }
+
+    ReplicateClient& ReplicateClient::shared(){
+        static ReplicateClient client("https://api.replicate.com");
+        return client;
+    }
+
+    void ReplicateClient::configure(double rate, double burst, size_t new_max_idle, const RetryPolicy& new_policy){
+        limiter.set_rate(rate, burst);
+        std::lock_guard<std::mutex> lock(mutex);
+        max_idle = new_max_idle;
+        policy = new_policy;
+        if (idle.size() > max_idle){
+            idle.erase(idle.begin(), idle.begin() + (idle.size() - max_idle));
+        }
+    }
+
+    std::unique_ptr<httplib::Client> ReplicateClient::checkout(){
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!idle.empty()){
+                auto client = std::move(idle.back());
+                idle.pop_back();
+                return client;
+            }
+        }
+        auto client = std::make_unique<httplib::Client>(base_url);
+        client->set_keep_alive(true);
+        return client;
+    }
+
+    void ReplicateClient::checkin(std::unique_ptr<httplib::Client> client){
+        std::lock_guard<std::mutex> lock(mutex);
+        if (idle.size() < max_idle){
+            idle.push_back(std::move(client));
+        }
+    }
+
+    httplib::Result ReplicateClient::request(const std::function<httplib::Result(httplib::Client&)>& send, bool replayable,
+        const mcp::cancellation_token& cancel){
+        RetryPolicy retry;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            retry = policy;
+        }
+        auto& duration = backend_duration();
+        thread_local std::mt19937 rng(std::random_device{}());
+        std::uniform_real_distribution<double> jitter(0.0, 1.0);
+
+        for (int attempt = 1; ; ++attempt){
+            limiter.acquire();
+            if (cancel.is_cancelled()){
+                return httplib::Result(nullptr, httplib::Error::Canceled);
+            }
+            auto client = checkout();
+            // no attempt outlives the caller's deadline; Prefer: wait holds a response for up to a minute
+            client->set_connection_timeout(std::max(std::chrono::milliseconds(1), cancel.remaining(std::chrono::seconds(30))));
+            client->set_read_timeout(std::max(std::chrono::milliseconds(1), cancel.remaining(std::chrono::seconds(60))));
+            httplib::Result result;
+            {
+                // closing the socket makes the blocked call return with an error
+                mcp::cancellation_callback abort(cancel, [&client](){ client->stop(); });
+                mcp::scoped_timer timer(duration);
+                result = send(*client);
+            }
+            if (cancel.is_cancelled()){
+                return result;
+            }
+
+            bool retry_this = false;
+            std::chrono::milliseconds retry_after(-1);
+            std::string reason;
+            if (!result){
+                httplib::Error error = result.error();
+                // these fail before the request is written, so nothing reached the server
+                bool unsent = error == httplib::Error::Connection || error == httplib::Error::ConnectionTimeout
+                    || error == httplib::Error::SSLConnection || error == httplib::Error::ProxyConnection;
+                retry_this = unsent || replayable;
+                reason = "transport";
+                // the connection is in an unknown state, start over with a new one
+                client.reset();
+            } else if (result->status == 429 || result->status == 503){
+                // rejected before any work was done
+                retry_this = true;
+                retry_after = parse_retry_after(result->get_header_value("Retry-After"));
+                reason = std::to_string(result->status);
+            } else if (result->status >= 500 && replayable){
+                retry_this = true;
+                reason = std::to_string(result->status);
+            }
+            if (client){
+                checkin(std::move(client));
+            }
+
+            if (!retry_this || attempt >= retry.max_attempts || retry_after > retry.max_delay){
+                return result;
+            }
+
+            std::chrono::milliseconds delay = retry_after.count() >= 0 ? retry_after : backoff_delay(retry, attempt, jitter(rng));
+            if (result && result->status == 429){
+                // hold back every caller, not just this one
+                limiter.pause(delay);
+            }
+            // a retry that would start after the deadline is not worth waiting for
+            if (cancel.remaining(delay) < delay){
+                return result;
+            }
+            // looked up only on the retry path, the reason varies
+            mcp::metrics_registry::instance().get_counter("mcp_backend_retries_total", "Retried backend calls", {{"backend", "replicate"}, {"reason", reason}}).add();
+            LOG_WARNING("Replicate call failed (", reason, "), retrying in ", delay.count(), " ms, attempt ", attempt + 1, "/", retry.max_attempts);
+            if (cancel.wait_for(delay)){
+                return result;
             }
-        } else {
-            return "Parsing failed. Returning raw response.\n" + jsonresp;
         }
     }
 }
@@ -0,0 +1,311 @@
+/**
+* @file tryon_jobs.cpp
+* @brief Try-on predictions shared by their inputs: speculative queue, per-session budget, result cache
+* @date 2026-10-19 Monday
+*/
+
+#include "utils/tryon_jobs.h"
+#include "mcp_logger.h"
+#include "mcp_metrics.h"
+#include "mcp_task.h"
+
+#include <algorithm>
+
+namespace vto {
+
+    namespace {
+        mcp::counter& speculative_counter(const std::string& outcome){
+            return mcp::metrics_registry::instance().get_counter("openvto_speculative_tryons_total", "Speculative try-ons by outcome", {{"outcome", outcome}});
+        }
+    }
+
+    std::string TryOnRequest::key() const {
+        return human_img + '\n' + garm_img + '\n' + category;
+    }
+
+    TryOnJobs::TryOnJobs(Runner runner, TryOnLimits limits) : runner(std::move(runner)), limits(limits) {
+    }
+
+    TryOnJobs::~TryOnJobs(){
+        std::vector<std::shared_ptr<Job>> stop;
+        std::unique_lock<std::mutex> lock(mutex);
+        for (const auto& [key, job] : by_key){
+            if (job->state == Job::QUEUED || job->state == Job::RUNNING){
+                stop.push_back(job);
+            }
+        }
+        for (const auto& job : stop){
+            drop(job);
+        }
+        queue.clear();
+        lock.unlock();
+
+        for (const auto& job : stop){
+            job->cancel.cancel("Try-on cache closed");
+        }
+        // running jobs refer to this object
+        lock.lock();
+        idle.wait(lock, [this](){ return running == 0; });
+    }
+
+    std::shared_ptr<TryOnJobs::Job> TryOnJobs::usable(const std::string& key){
+        auto it = by_key.find(key);
+        if (it == by_key.end()){
+            return nullptr;
+        }
+        if (it->second->state == Job::DONE && std::chrono::steady_clock::now() - it->second->finished > limits.ttl){
+            by_key.erase(it);
+            return nullptr;
+        }
+        return it->second;
+    }
+
+    void TryOnJobs::trim(){
+        auto now = std::chrono::steady_clock::now();
+        for (auto it = by_key.begin(); it != by_key.end() && by_key.size() > limits.max_results; ){
+            bool expired = it->second->state == Job::DONE && now - it->second->finished > limits.ttl;
+            it = expired ? by_key.erase(it) : std::next(it);
+        }
+        for (auto it = by_key.begin(); it != by_key.end() && by_key.size() > limits.max_results; ){
+            it = it->second->state == Job::DONE ? by_key.erase(it) : std::next(it);
+        }
+    }
+
+    void TryOnJobs::drop(const std::shared_ptr<Job>& job){
+        job->state = Job::CANCELLED;
+        auto it = by_key.find(job->key);
+        if (it != by_key.end() && it->second == job){
+            by_key.erase(it);
+        }
+    }
+
+    void TryOnJobs::leave(const std::shared_ptr<Job>& job){
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            // a speculative one stays for its session to pick
+            if (--job->waiters > 0 || job->state != Job::RUNNING || !job->session_id.empty()){
+                return;
+            }
+            drop(job);
+        }
+        job->cancel.cancel("Try-on no longer needed");
+    }
+
+    void TryOnJobs::start(const std::shared_ptr<Job>& job, bool speculative){
+        job->state = Job::RUNNING;
+        job->speculative_slot = speculative;
+        if (speculative){
+            speculative_running++;
+        }
+        running++;
+        mcp::executor::instance().post_blocking([this, job](){
+            execute(job);
+        });
+    }
+
+    void TryOnJobs::execute(const std::shared_ptr<Job>& job){
+        std::string output;
+        std::exception_ptr error;
+        {
+            // the job's own token, so cancelling a waiting request never cancels the prediction
+            mcp::cancellation_scope scope(job->cancel.token());
+            try {
+                output = runner(job->request);
+            } catch (...) {
+                error = std::current_exception();
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!error && job->state == Job::RUNNING){
+                job->state = Job::DONE;
+                job->finished = std::chrono::steady_clock::now();
+            } else if (job->state == Job::RUNNING){
+                // a later request tries again
+                job->state = Job::FAILED;
+                auto it = by_key.find(job->key);
+                if (it != by_key.end() && it->second == job){
+                    by_key.erase(it);
+                }
+            }
+            if (job->speculative_slot){
+                speculative_running--;
+            }
+        }
+        if (error){
+            job->promise.set_exception(error);
+        } else {
+            job->promise.set_value(output);
+        }
+        pump();
+
+        // the destructor may run once this is seen, nothing is touched after it
+        std::lock_guard<std::mutex> lock(mutex);
+        running--;
+        idle.notify_all();
+    }
+
+    void TryOnJobs::pump(){
+        std::lock_guard<std::mutex> lock(mutex);
+        while (speculative_running < limits.workers && !queue.empty()){
+            auto job = queue.front();
+            queue.pop_front();
+            if (job->state != Job::QUEUED){
+                continue;
+            }
+            speculative_counter("started").add();
+            LOG_INFO("Session ID: ", job->session_id, " Speculative try-on of ", job->request.garm_img);
+            start(job, true);
+        }
+    }
+
+    void TryOnJobs::cancel_speculative(const std::string& session_id, const std::string& keep_key){
+        std::vector<std::shared_ptr<Job>> stop;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.erase(std::remove_if(queue.begin(), queue.end(), [&](const std::shared_ptr<Job>& job){
+                if (job->state != Job::QUEUED || job->session_id != session_id || job->key == keep_key){
+                    return false;
+                }
+                drop(job);
+                // never billed
+                spent[session_id]--;
+                speculative_counter("cancelled").add();
+                return true;
+            }), queue.end());
+
+            // running ones were billed, but stopping them ends the prediction early
+            for (const auto& [key, job] : by_key){
+                if (job->state == Job::RUNNING && job->session_id == session_id && key != keep_key){
+                    stop.push_back(job);
+                }
+            }
+            for (const auto& job : stop){
+                drop(job);
+                speculative_counter("cancelled").add();
+            }
+        }
+        // callbacks stop the prediction's HTTP calls, outside the lock
+        for (const auto& job : stop){
+            job->cancel.cancel("Speculative try-on no longer needed");
+        }
+    }
+
+    void TryOnJobs::close_session(const std::string& session_id){
+        cancel_speculative(session_id);
+        std::lock_guard<std::mutex> lock(mutex);
+        spent.erase(session_id);
+    }
+
+    int TryOnJobs::budget_spent(const std::string& session_id){
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = spent.find(session_id);
+        return it == spent.end() ? 0 : it->second;
+    }
+
+    void TryOnJobs::speculate(const std::string& session_id, const std::vector<TryOnRequest>& requests){
+        // a new search replaces the guesses made for the previous one
+        cancel_speculative(session_id);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            int& session_spent = spent[session_id];
+            for (const auto& request : requests){
+                if (session_spent >= limits.budget){
+                    LOG_DEBUG("Session ID: ", session_id, " Speculative try-on budget used up");
+                    break;
+                }
+                std::string key = request.key();
+                if (usable(key)){
+                    continue;
+                }
+                auto job = std::make_shared<Job>();
+                job->key = key;
+                job->request = request;
+                job->session_id = session_id;
+                by_key[key] = job;
+                queue.push_back(job);
+                session_spent++;
+            }
+            trim();
+        }
+        pump();
+    }
+
+    std::string TryOnJobs::run(const std::string& session_id, const TryOnRequest& request){
+        std::string key = request.key();
+        // the user picked this one, the other guesses will not be needed
+        cancel_speculative(session_id, key);
+
+        std::shared_ptr<Job> job;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = usable(key);
+            if (job && job->state == Job::QUEUED){
+                // take it off the speculative queue, it is the user's try-on now
+                auto session_spent = spent.find(job->session_id);
+                if (session_spent != spent.end()){
+                    session_spent->second--;
+                }
+                job->session_id.clear();
+                start(job, false);
+            } else if (job){
+                speculative_counter(job->session_id.empty() ? "reused" : "hit").add();
+                LOG_INFO("Session ID: ", session_id, " Try-on of ", request.garm_img, " already ", job->state == Job::DONE ? "done" : "running");
+                // a speculative one is the user's now, its session moving on no longer cancels it
+                job->session_id.clear();
+            } else {
+                job = std::make_shared<Job>();
+                job->key = key;
+                job->request = request;
+                by_key[key] = job;
+                trim();
+                start(job, false);
+            }
+            job->waiters++;
+        }
+
+        // a cancelled caller stops waiting, the prediction goes on while others wait
+        mcp::cancellation_token cancel = mcp::cancellation_token::current();
+        try {
+            while (job->output.wait_for(std::chrono::milliseconds(100)) != std::future_status::ready){
+                cancel.throw_if_cancelled();
+            }
+        } catch (...) {
+            leave(job);
+            throw;
+        }
+        leave(job);
+        // rethrows a failed prediction
+        return job->output.get();
+    }
+
+    TryOnHistory::TryOnHistory(size_t max_entries) : max_entries(max_entries) {
+    }
+
+    void TryOnHistory::record(const std::string& session_id, const std::string& link, const mcp::cancellation_token& cancel){
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = chains.find(session_id);
+        if (it == chains.end()){
+            // checked under the lock close() takes: either close() comes after and drops the chain, or the cancel is seen here
+            if (cancel.is_cancelled()){
+                return;
+            }
+            it = chains.emplace(session_id, std::vector<std::string>()).first;
+        }
+        it->second.push_back(link);
+        if (it->second.size() > max_entries){
+            it->second.erase(it->second.begin());
+        }
+    }
+
+    std::string TryOnHistory::last(const std::string& session_id){
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = chains.find(session_id);
+        return it == chains.end() || it->second.empty() ? std::string() : it->second.back();
+    }
+
+    void TryOnHistory::close(const std::string& session_id){
+        std::lock_guard<std::mutex> lock(mutex);
+        chains.erase(session_id);
+    }
+}
@@ -10,12 +10,1134 @@
 #include "mcp_message.h"
 #include "mcp_client.h"
 #include "mcp_server.h"
+#include "mcp_metrics.h"
+#include "mcp_tracing.h"
+#include "mcp_json_writer.h"
+#include "mcp_cancellation.h"
+#include "mcp_registry.h"
+#include "utils/catalog.h"
+#include "utils/csv_reader.h"
+#include "utils/blob_store.h"
+#include "utils/open_browser.h"
+#include "utils/replicate_inference.h"
+#include "utils/tryon_jobs.h"
 #include "mcp_tool.h"
 #include "mcp_sse_client.h"
 
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <map>
+#include <set>
+
 using namespace mcp;
 using json = nlohmann::ordered_json;
 
+// Test the logger
+class LoggerTest : public ::testing::Test {
+protected:
+    void TearDown() override {
+        // Restore defaults for the other tests
+        logger::instance().set_async(false);
+        logger::instance().set_file("");
+        set_log_level(log_level::info);
+        std::remove(path_.c_str());
+    }
+
+    std::string read_log() {
+        std::ifstream file(path_);
+        std::stringstream ss;
+        ss << file.rdbuf();
+        return ss.str();
+    }
+
+    std::string path_ = "mcp_logger_test.log";
+};
+
+// Test that queued lines reach the file sink after flush, without color codes
+TEST_F(LoggerTest, AsyncFileSink) {
+    std::remove(path_.c_str());
+    ASSERT_TRUE(logger::instance().set_file(path_));
+    logger::instance().set_async(true);
+    
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([t]() {
+            for (int i = 0; i < 100; ++i) {
+                LOG_INFO("logger test thread ", t, " line ", i);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    logger::instance().flush();
+    
+    std::string contents = read_log();
+    EXPECT_NE(contents.find("[INFO] logger test thread 3 line 99"), std::string::npos);
+    EXPECT_EQ(contents.find("\033["), std::string::npos);
+    
+    // Other environments may log concurrently, count only this test's lines
+    size_t lines = 0;
+    for (size_t pos = contents.find("logger test thread"); pos != std::string::npos; pos = contents.find("logger test thread", pos + 1)) {
+        ++lines;
+    }
+    EXPECT_EQ(lines, 400u);
+}
+
+// Test that disabled levels are skipped without evaluating their arguments
+TEST_F(LoggerTest, DisabledLevel) {
+    ASSERT_TRUE(logger::instance().set_file(path_));
+    set_log_level(log_level::warning);
+    
+    int evaluated = 0;
+    auto count = [&evaluated]() { return ++evaluated; };
+    LOG_INFO("skipped ", count());
+    LOG_WARNING("written ", count());
+    
+    EXPECT_EQ(evaluated, 1);
+    std::string contents = read_log();
+    EXPECT_EQ(contents.find("skipped"), std::string::npos);
+    EXPECT_NE(contents.find("[WARNING] written 1"), std::string::npos);
+}
+
+// Test that histogram buckets cover every value with bounded relative error
+TEST(MetricsTest, HistogramBuckets) {
+    for (uint64_t v : {0ull, 1ull, 15ull, 16ull, 17ull, 1000ull, 123456ull, 1ull << 39}) {
+        size_t index = histogram::bucket_index(v);
+        EXPECT_LE(histogram::bucket_lower_bound(index), v);
+        EXPECT_GE(histogram::bucket_upper_bound(index), v);
+        if (v >= 16) {
+            double width = static_cast<double>(histogram::bucket_upper_bound(index) - histogram::bucket_lower_bound(index));
+            EXPECT_LE(width / v, 1.0 / 16);
+        }
+    }
+    EXPECT_EQ(histogram::bucket_index(~0ull), histogram::bucket_count - 1);
+}
+
+// Test that quantiles are estimated within the bucket precision
+TEST(MetricsTest, HistogramQuantiles) {
+    histogram h;
+    for (uint64_t v = 1; v <= 10000; ++v) {
+        h.record(v);
+    }
+    EXPECT_EQ(h.count(), 10000u);
+    EXPECT_EQ(h.sum(), 10000u * 10001u / 2);
+    EXPECT_NEAR(h.quantile(0.5), 5000, 5000 * 0.07);
+    EXPECT_NEAR(h.quantile(0.99), 9900, 9900 * 0.07);
+    EXPECT_EQ(histogram().quantile(0.5), 0);
+}
+
+// Test the Prometheus text format
+TEST(MetricsTest, Serialize) {
+    auto& registry = metrics_registry::instance();
+    registry.get_counter("mcp_test_events_total", "Test events", {{"kind", "a\"b"}}).add(3);
+    registry.get_gauge("mcp_test_depth", "Test depth").set(-2);
+    registry.get_histogram("mcp_test_latency", "Test latency").record(std::chrono::milliseconds(2));
+    EXPECT_THROW(registry.get_gauge("mcp_test_events_total", "Wrong type"), std::logic_error);
+    
+    std::string text = registry.serialize();
+    EXPECT_NE(text.find("# TYPE mcp_test_events_total counter\n"), std::string::npos);
+    EXPECT_NE(text.find("mcp_test_events_total{kind=\"a\\\"b\"} 3\n"), std::string::npos);
+    EXPECT_NE(text.find("mcp_test_depth -2\n"), std::string::npos);
+    EXPECT_NE(text.find("# TYPE mcp_test_latency_seconds summary\n"), std::string::npos);
+    EXPECT_NE(text.find("mcp_test_latency_seconds_count 1\n"), std::string::npos);
+}
+
+// Test that nested spans share a trace and context crosses threads explicitly
+TEST(TracingTest, NestedSpans) {
+    tracer::instance().set_enabled(true);
+    uint64_t trace_id = 0;
+    {
+        span outer("outer");
+        trace_id = tracer::current().trace_id;
+        {
+            span inner("inner", "detail");
+        }
+        
+        trace_context context = tracer::current();
+        std::thread([context]() {
+            trace_scope scope(context);
+            span remote("remote");
+        }).join();
+    }
+    EXPECT_FALSE(tracer::current().valid());
+    
+    auto spans = tracer::instance().snapshot(trace_id);
+    ASSERT_EQ(spans.size(), 3u);
+    EXPECT_STREQ(spans[0].name, "outer");
+    EXPECT_EQ(spans[0].parent_id, 0u);
+    EXPECT_EQ(spans[1].parent_id, spans[0].span_id);
+    EXPECT_EQ(spans[1].detail, "detail");
+    EXPECT_EQ(spans[2].parent_id, spans[0].span_id);
+    EXPECT_NE(spans[2].thread, spans[0].thread);
+    EXPECT_LE(spans[0].start_ns, spans[1].start_ns);
+    EXPECT_GE(spans[0].end_ns, spans[2].end_ns);
+    
+    json trace = json::parse(tracer::to_chrome_json(spans));
+    ASSERT_EQ(trace["traceEvents"].size(), 3u);
+    EXPECT_EQ(trace["traceEvents"][1]["ph"], "X");
+    EXPECT_EQ(trace["traceEvents"][1]["name"], "inner");
+    EXPECT_EQ(trace["traceEvents"][1]["args"]["trace_id"], trace_id);
+}
+
+// Test that nothing is recorded while tracing is disabled
+TEST(TracingTest, Disabled) {
+    tracer::instance().set_enabled(false);
+    {
+        span ignored("ignored");
+        EXPECT_FALSE(tracer::current().valid());
+    }
+    for (const auto& record : tracer::instance().snapshot()) {
+        EXPECT_STRNE(record.name, "ignored");
+    }
+}
+
+// Test that the writer escapes strings, formats numbers and matches the parsed document
+TEST(JsonWriterTest, WritesValidJson) {
+    std::string out = "data: ";
+    json_writer writer(out);
+    writer.begin_object()
+        .key("text").value("say \"hi\"\\\n\t\x01")
+        .key("numbers").begin_array().value(-3).value(uint64_t{1} << 63).value(0.1).value(1e300).end_array()
+        .key("nan").value(std::nan(""))
+        .key("empty").begin_object().end_object()
+        .end_object();
+    EXPECT_EQ(out.substr(0, 6), "data: ");
+    EXPECT_NE(out.find("\\u0001"), std::string::npos);
+
+    json parsed = json::parse(out.substr(6));
+    EXPECT_EQ(parsed["text"], "say \"hi\"\\\n\t\x01");
+    EXPECT_EQ(parsed["numbers"][1].get<uint64_t>(), uint64_t{1} << 63);
+    EXPECT_EQ(parsed["numbers"][2].get<double>(), 0.1);
+    EXPECT_TRUE(parsed["nan"].is_null());
+
+    // A parsed document is written back unchanged, keys in order
+    json document = {{"jsonrpc", "2.0"}, {"id", 7}, {"result", {{"content", json::array({{{"type", "text"}, {"text", "ünï"}}})}, {"isError", false}}}};
+    std::string text;
+    json_writer(text).value(document);
+    EXPECT_EQ(text, document.dump());
+
+    // Search results with quotes in their descriptions stay valid
+    csv::CSVRow row("a.jpg", "https://example.com/a.jpg", 1, "12\" \"boyfriend\" jeans", "nomic-embed-text", {});
+    row.score = 0.5;
+    row.attributes = {"denim"};
+    json results = json::parse(csv::dataset_to_json({row}, {"fabric"}));
+    EXPECT_EQ(results["results"][0]["description"], "12\" \"boyfriend\" jeans");
+    EXPECT_EQ(results["results"][0]["fabric"], "denim");
+    EXPECT_EQ(results["count"], 1);
+}
+
+// Test the local catalog and its reloads
+class CatalogTest : public ::testing::Test {
+protected:
+    void TearDown() override {
+        std::remove(path_.c_str());
+    }
+
+    // Write a catalog whose rows point along the given 2-d directions
+    void write_catalog(const std::vector<std::pair<int, std::string>>& rows) {
+        std::string partial = path_ + ".partial";
+        {
+            std::ofstream out(partial);
+            out << "fname,link,id,desc,embedding_model,vector\n";
+            for (const auto& [id, vec] : rows) {
+                out << "img_" << id << ".jpg,https://example.com/" << id << ".jpg," << id
+                    << ",\"Garment " << id << "\",nomic-embed-text,\"" << vec << "\"\n";
+            }
+        }
+        std::rename(partial.c_str(), path_.c_str());
+    }
+
+    std::string path_ = "mcp_catalog_test.csv";
+};
+
+// Test that a reload publishes a new version while held versions stay intact
+TEST_F(CatalogTest, ReloadSwapsVersion) {
+    write_catalog({{1, "[1.0, 0.0]"}, {2, "[0.0, 1.0]"}, {3, "[0.7, 0.7]"}});
+    csv::CatalogStore store(path_);
+    EXPECT_EQ(store.current()->size(), 0u);
+    
+    auto first = store.reload();
+    auto results = store.current()->search({1.0, 0.0}, 2);
+    ASSERT_EQ(results.size(), 2u);
+    EXPECT_EQ(results[0].id, 1);
+    EXPECT_EQ(results[1].id, 3);
+    EXPECT_EQ(store.current()->search({1.0, 0.0}, 10).size(), 3u);
+    
+    write_catalog({{4, "[1.0, 0.1]"}});
+    auto second = store.reload();
+    EXPECT_GT(second->get_version(), first->get_version());
+    EXPECT_EQ(store.current(), second);
+    EXPECT_EQ(first->size(), 3u);
+    EXPECT_EQ(store.current()->search({1.0, 0.0}, 5)[0].id, 4);
+    
+    // A failed reload keeps the current version
+    EXPECT_THROW(store.reload("missing_catalog.csv"), std::runtime_error);
+    EXPECT_EQ(store.current(), second);
+}
+
+// Test that the watcher reloads a replaced file
+TEST_F(CatalogTest, WatchReloadsOnChange) {
+    write_catalog({{1, "[1.0, 0.0]"}});
+    csv::CatalogStore store(path_);
+    store.reload();
+    uint64_t version = store.current()->get_version();
+    store.watch();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    
+    write_catalog({{1, "[1.0, 0.0]"}, {2, "[0.0, 1.0]"}});
+    for (int i = 0; i < 50 && store.current()->get_version() == version; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    EXPECT_GT(store.current()->get_version(), version);
+    EXPECT_EQ(store.current()->size(), 2u);
+    store.stop_watching();
+}
+
+// Test that upserts and deletes are visible at once and survive compaction
+TEST_F(CatalogTest, UpsertDeleteAndCompact) {
+    write_catalog({{1, "[1.0, 0.0]"}, {2, "[0.0, 1.0]"}, {3, "[0.7, 0.7]"}});
+    csv::CatalogStore store(path_);
+    store.set_compaction_threshold(0);
+    auto loaded = store.reload();
+    
+    store.upsert({csv::CSVRow("img_2.jpg", "https://example.com/2b.jpg", 2, "Garment 2b", "nomic-embed-text", {1.0, 0.05})});
+    store.upsert({csv::CSVRow("img_5.jpg", "https://example.com/5.jpg", 5, "Garment 5", "nomic-embed-text", {0.0, 1.0})});
+    auto changed = store.remove({1, 42});
+    EXPECT_EQ(changed->size(), 3u);
+    EXPECT_EQ(changed->pending_changes(), 3u);
+    EXPECT_FALSE(changed->contains(1));
+    EXPECT_TRUE(changed->contains(5));
+    
+    auto results = changed->search({1.0, 0.0}, 3);
+    ASSERT_EQ(results.size(), 3u);
+    EXPECT_EQ(results[0].id, 2);
+    EXPECT_EQ(results[0].link, "https://example.com/2b.jpg");
+    EXPECT_EQ(results[1].id, 3);
+    EXPECT_EQ(results[2].id, 5);
+    
+    // Held versions do not see later changes
+    EXPECT_EQ(loaded->size(), 3u);
+    EXPECT_TRUE(loaded->contains(1));
+    
+    // Vectors must match the catalog's dimension
+    EXPECT_THROW(store.upsert({csv::CSVRow("x.jpg", "x", 9, "x", "x", {1.0, 0.0, 0.0})}), std::invalid_argument);
+    
+    auto compacted = store.compact();
+    EXPECT_EQ(compacted->pending_changes(), 0u);
+    EXPECT_NE(compacted->get_main(), changed->get_main());
+    auto after = compacted->search({1.0, 0.0}, 3);
+    ASSERT_EQ(after.size(), 3u);
+    for (size_t i = 0; i < after.size(); ++i) {
+        EXPECT_EQ(after[i].id, results[i].id);
+    }
+    
+    // A deleted id can be added back
+    store.upsert({csv::CSVRow("img_1.jpg", "https://example.com/1.jpg", 1, "Garment 1", "nomic-embed-text", {2.0, 0.0})});
+    EXPECT_EQ(store.current()->search({1.0, 0.0}, 1)[0].id, 1);
+    EXPECT_EQ(store.current()->size(), 4u);
+}
+
+// Test that a background compaction keeps changes made while it runs
+TEST_F(CatalogTest, BackgroundCompaction) {
+    write_catalog({{1, "[1.0, 0.0]"}});
+    csv::CatalogStore store(path_);
+    store.reload();
+    store.set_compaction_threshold(8);
+    
+    for (int id = 100; id < 200; ++id) {
+        store.upsert({csv::CSVRow("img.jpg", "link", id, "desc", "nomic-embed-text", {0.0, 1.0})});
+        if (id % 3 == 0) {
+            store.remove({id - 1});
+        }
+    }
+    for (int i = 0; i < 50 && store.current()->pending_changes() >= 8; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    
+    auto catalog = store.current();
+    EXPECT_LT(catalog->pending_changes(), 8u);
+    EXPECT_EQ(catalog->size(), 1u + 100u - 33u);
+    EXPECT_TRUE(catalog->contains(199));
+    EXPECT_FALSE(catalog->contains(101));
+    EXPECT_TRUE(catalog->contains(102));
+}
+
+// Test that filters restrict the scan and apply to delta rows too
+TEST_F(CatalogTest, FilteredSearch) {
+    {
+        std::ofstream out(path_);
+        out << "fname,link,id,desc,embedding_model,vector,category,price,color\n";
+        out << "a.jpg,a,1,\"Shirt\",nomic-embed-text,\"[1.0, 0.0]\",upper_body,20,blue\n";
+        out << "b.jpg,b,2,\"Jeans\",nomic-embed-text,\"[0.9, 0.1]\",lower_body,45,black\n";
+        out << "c.jpg,c,3,\"Chinos\",nomic-embed-text,\"[0.8, 0.2]\",Lower_Body,80,blue\n";
+        out << "d.jpg,d,4,\"Shorts\",nomic-embed-text,\"[0.7, 0.3]\",lower_body,,red\n";
+    }
+    csv::CatalogStore store(path_);
+    auto catalog = store.reload();
+    ASSERT_EQ(catalog->attribute_names(), (std::vector<std::string>{"category", "price", "color"}));
+    EXPECT_EQ(catalog->get_main()->columns[0].type, csv::AttributeType::String);
+    EXPECT_EQ(catalog->get_main()->columns[1].type, csv::AttributeType::Number);
+    
+    auto ids = [&](const std::string& filter, int k = 10) {
+        std::vector<int> result;
+        for (const auto& row : store.current()->search({1.0, 0.0}, k, filter)) {
+            result.push_back(row.id);
+        }
+        return result;
+    };
+    
+    EXPECT_EQ(ids("category = lower_body", 2), (std::vector<int>{2, 3}));
+    EXPECT_EQ(ids("CATEGORY = 'LOWER_BODY' and price < 50"), (std::vector<int>{2}));
+    EXPECT_EQ(ids("color IN (blue, \"black\") AND NOT category = upper_body"), (std::vector<int>{2, 3}));
+    EXPECT_EQ(ids("price >= 45 OR color = red"), (std::vector<int>{2, 3, 4}));
+    EXPECT_EQ(ids("(price != 45)"), (std::vector<int>{1, 3}));
+    EXPECT_EQ(ids("color = green"), (std::vector<int>{}));
+    
+    EXPECT_THROW(ids("size = m"), std::invalid_argument);
+    EXPECT_THROW(ids("category < lower_body"), std::invalid_argument);
+    EXPECT_THROW(ids("price = cheap"), std::invalid_argument);
+    EXPECT_THROW(ids("(category = lower_body"), std::invalid_argument);
+    EXPECT_THROW(ids("category = lower_body price"), std::invalid_argument);
+    
+    // Upserted rows are filtered by the same expression
+    csv::CSVRow row("e.jpg", "e", 5, "Skirt", "nomic-embed-text", {1.0, 0.0});
+    row.attributes = {"lower_body", "10", "green"};
+    store.upsert({row});
+    EXPECT_EQ(ids("category = lower_body AND price < 50"), (std::vector<int>{5, 2}));
+    store.remove({2});
+    EXPECT_EQ(ids("category = lower_body AND price < 50"), (std::vector<int>{5}));
+    store.compact();
+    EXPECT_EQ(ids("category = lower_body AND price < 50"), (std::vector<int>{5}));
+}
+
+// Test BM25 ranking, lexical search and rank fusion
+TEST_F(CatalogTest, LexicalAndHybridSearch) {
+    {
+        std::ofstream out(path_);
+        out << "fname,link,id,desc,embedding_model,vector\n";
+        out << "tee_01.jpg,a,1,\"Red cotton t-shirt, crew neck\",nomic-embed-text,\"[1.0, 0.0]\"\n";
+        out << "tee_02.jpg,b,2,\"Blue V-neck t-shirt SKU AB-1234\",nomic-embed-text,\"[0.9, 0.1]\"\n";
+        out << "jeans_01.jpg,c,3,\"Slim fit jeans\",nomic-embed-text,\"[0.0, 1.0]\"\n";
+        out << "jeans_02.jpg,d,4,\"Relaxed jeans, blue wash\",nomic-embed-text,\"[0.1, 0.9]\"\n";
+    }
+    csv::CatalogStore store(path_);
+    store.reload();
+    auto catalog = store.current();
+    
+    EXPECT_EQ(csv::LexicalIndex::tokenize("Blue V-neck, SKU ab-1234!"),
+        (std::vector<std::string>{"blue", "v-neck", "v", "neck", "sku", "ab-1234", "ab", "1234"}));
+    
+    auto ids = [](const std::vector<csv::CSVRow>& rows) {
+        std::vector<int> result;
+        for (const auto& row : rows) {
+            result.push_back(row.id);
+        }
+        return result;
+    };
+    
+    EXPECT_EQ(ids(catalog->search_lexical("ab-1234", 5)), (std::vector<int>{2}));
+    EXPECT_EQ(ids(catalog->search_lexical("V NECK", 5)), (std::vector<int>{2, 1}));
+    EXPECT_EQ(ids(catalog->search_lexical("jeans_02.jpg", 5))[0], 4);
+    EXPECT_TRUE(catalog->search_lexical("linen", 5).empty());
+    
+    // Rare terms outweigh common ones
+    auto blue = catalog->search_lexical("blue jeans", 5);
+    ASSERT_FALSE(blue.empty());
+    EXPECT_EQ(blue[0].id, 4);
+    EXPECT_GT(blue[0].score, blue[1].score);
+    
+    // The vector ranking alone puts 4 third, the keyword match pulls it to the top
+    EXPECT_EQ(ids(catalog->search({1.0, 0.0}, 4)), (std::vector<int>{1, 2, 4, 3}));
+    EXPECT_EQ(ids(catalog->search_hybrid({1.0, 0.0}, "relaxed", 4)), (std::vector<int>{4, 1, 2, 3}));
+    
+    // Delta rows are searchable by keyword before compaction
+    store.upsert({csv::CSVRow("sock.jpg", "e", 5, "Wool socks SKU ZX-9", "nomic-embed-text", {0.5, 0.5})});
+    EXPECT_EQ(ids(store.current()->search_lexical("zx-9", 5)), (std::vector<int>{5}));
+}
+
+// Test that a row embedded with another dimension is neither returned nor credited in rank fusion
+TEST_F(CatalogTest, MismatchedVectorsNeverRank) {
+    write_catalog({{1, "[1.0, 0.0]"}, {2, "[0.0, 1.0]"}, {3, "[1.0, 0.0, 0.0]"}});
+    csv::CatalogStore store(path_);
+    auto catalog = store.reload();
+    
+    auto ids = [](const std::vector<csv::CSVRow>& rows) {
+        std::vector<int> result;
+        for (const auto& row : rows) {
+            result.push_back(row.id);
+        }
+        return result;
+    };
+    EXPECT_EQ(ids(catalog->search({0.0, 1.0}, 10)), (std::vector<int>{2, 1}));
+    EXPECT_EQ(ids(catalog->search_hybrid({0.0, 1.0}, "1", 10)), (std::vector<int>{1, 2}));
+}
+
+// Test that the segment takes the most common dimension, so a malformed first row hides only itself
+TEST_F(CatalogTest, MostCommonDimension) {
+    write_catalog({{1, "[1.0]"}, {2, "[1.0, 0.0]"}, {3, "[0.0, 1.0]"}});
+    csv::CatalogStore store(path_);
+    auto catalog = store.reload();
+    EXPECT_EQ(catalog->dimension(), 2u);
+    EXPECT_EQ(catalog->get_main()->vector(0), nullptr);
+    
+    auto results = catalog->search({1.0, 0.0}, 10);
+    ASSERT_EQ(results.size(), 2u);
+    EXPECT_EQ(results[0].id, 2);
+    EXPECT_EQ(results[1].id, 3);
+}
+
+// Test that vectors are normalized at build and every metric stays exact to float precision
+TEST_F(CatalogTest, SimilarityMetrics) {
+    write_catalog({{1, "[3.0, 0.0]"}, {2, "[0.6, 0.8]"}, {3, "[0.0, 0.5]"}});
+    csv::CatalogStore store(path_);
+    auto catalog = store.reload();
+    ASSERT_TRUE(catalog->get_main()->normalized);
+    EXPECT_DOUBLE_EQ(catalog->get_main()->norms[0], 3.0);
+    
+    // Query length does not change cosine scores
+    auto cosine = catalog->search({0.0, 2.0}, 3);
+    ASSERT_EQ(cosine.size(), 3u);
+    EXPECT_EQ(cosine[0].id, 3);
+    EXPECT_NEAR(cosine[0].score, 1.0, 1e-6);
+    EXPECT_NEAR(cosine[1].score, 0.8, 1e-6);
+    
+    auto dot = catalog->search({0.0, 2.0}, 3, "", csv::Metric::Dot);
+    EXPECT_EQ(dot[0].id, 2);
+    EXPECT_NEAR(dot[0].score, 1.6, 1e-6);
+    EXPECT_NEAR(dot[1].score, 1.0, 1e-6);
+    
+    auto l2 = catalog->search({0.0, 2.0}, 3, "", csv::Metric::L2);
+    EXPECT_EQ(l2[0].id, 2);
+    EXPECT_NEAR(l2[0].score, -std::sqrt(1.8), 1e-6);
+    EXPECT_NEAR(l2[1].score, -1.5, 1e-6);
+    EXPECT_NEAR(l2[2].score, -std::sqrt(13.0), 1e-6);
+    
+    // Delta rows and compaction keep the original lengths
+    store.upsert({csv::CSVRow("d.jpg", "d", 4, "d", "nomic-embed-text", {0.0, 4.0})});
+    EXPECT_NEAR(store.current()->search({0.0, 1.0}, 1, "", csv::Metric::Dot)[0].score, 4.0, 1e-6);
+    auto compacted = store.compact();
+    EXPECT_NEAR(compacted->search({0.0, 1.0}, 1, "", csv::Metric::Dot)[0].score, 4.0, 1e-6);
+    EXPECT_NEAR(compacted->search({1.0, 0.0}, 1, "", csv::Metric::Dot)[0].score, 3.0, 1e-6);
+    
+    EXPECT_EQ(csv::parse_metric("l2"), csv::Metric::L2);
+    EXPECT_THROW(csv::parse_metric("manhattan"), std::invalid_argument);
+}
+
+// Test that the main segment is columnar and search copies out only the results
+TEST_F(CatalogTest, ColumnarSegment) {
+    write_catalog({{1, "[1.0, 0.0, 0.0]"}, {2, "[0.0, 2.0, 0.0]"}, {3, "[0.0, 0.0, 3.0]"}});
+    csv::CatalogStore store(path_);
+    auto catalog = store.reload();
+    const auto& segment = *catalog->get_main();
+
+    // Rows start on 64-byte boundaries and the model is stored once
+    EXPECT_EQ(segment.dimension(), 3u);
+    EXPECT_EQ(segment.stride() % 16, 0u);
+    for (size_t i = 0; i < segment.size(); i++) {
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(segment.vector(i)) % 64, 0u);
+        EXPECT_EQ(&segment.embedding_model(i), &segment.embedding_model(0));
+    }
+    EXPECT_EQ(segment.id(1), 2);
+    EXPECT_EQ(segment.text(csv::TextField::Desc, 2), "Garment 3");
+
+    // Results carry metadata but no vector, rows() restores the loaded vectors
+    auto results = catalog->search({0.0, 1.0, 0.0}, 1);
+    ASSERT_EQ(results.size(), 1u);
+    EXPECT_EQ(results[0].id, 2);
+    EXPECT_EQ(results[0].embedding_model, "nomic-embed-text");
+    EXPECT_TRUE(results[0].vector.empty());
+    EXPECT_EQ(catalog->rows()[1].vector, (std::vector<double>{0.0, 2.0, 0.0}));
+}
+
+// Test the content hash against the FIPS 180-2 vectors and the MIME sniffing
+TEST(BlobStoreTest, HashAndMime) {
+    EXPECT_EQ(blob::content_hash(""), "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    EXPECT_EQ(blob::content_hash("abc"), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    EXPECT_EQ(blob::content_hash("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"),
+        "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+    EXPECT_EQ(blob::content_hash(std::string(1000000, 'a')),
+        "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+    
+    EXPECT_EQ(blob::sniff_mime(std::string("\x89PNG\r\n\x1a\n....", 12)), "image/png");
+    EXPECT_EQ(blob::sniff_mime(std::string("RIFF\x10\0\0\0WEBPVP8 ", 16)), "image/webp");
+    EXPECT_EQ(blob::sniff_mime("plain"), "application/octet-stream");
+}
+
+// Test that blobs are deduplicated, evicted least recently used first unless pinned, shown only to the sessions they are shared with, and found again after a restart
+TEST(BlobStoreTest, LruOnDisk) {
+    std::string dir = "mcp_blob_test";
+    std::filesystem::remove_all(dir);
+    std::vector<std::string> added, evicted;
+    {
+        blob::BlobStore store(dir, 10);
+        store.set_callbacks(
+            [&added](const std::string& hash, const std::string&) { added.push_back(hash); },
+            [&evicted](const std::string& hash) { evicted.push_back(hash); });
+        
+        std::string a = store.put("aaaa", "https://example.com/a.png");
+        EXPECT_EQ(store.put("aaaa"), a);
+        EXPECT_EQ(store.lookup("https://example.com/a.png"), a);
+        // another URL serving it is reported, so its readers can be allowed
+        EXPECT_EQ(store.put("aaaa", "https://example.com/copy.png"), a);
+        std::string b = store.put("bbbb");
+        store.pin(b);
+        
+        // a is the least recently used unpinned blob once c goes over the capacity
+        std::string c = store.put("cccc");
+        EXPECT_EQ(evicted, std::vector<std::string>{a});
+        EXPECT_EQ(added, (std::vector<std::string>{a, a, b, c}));
+        EXPECT_EQ(store.lookup("https://example.com/a.png"), "");
+        EXPECT_EQ(store.size(), 8u);
+        
+        std::string bytes;
+        EXPECT_FALSE(store.get(a, bytes));
+        ASSERT_TRUE(store.get(b, bytes));
+        EXPECT_EQ(bytes, "bbbb");
+        
+        blob::BlobResource resource(store, c, "c");
+        EXPECT_EQ(resource.get_uri(), "blob://" + c);
+        EXPECT_EQ(resource.read()["blob"], base64::encode("cccc", 4));
+        
+        // only the sessions it was shared with see it, until it is shared with everyone
+        EXPECT_FALSE(resource.visible_to("s"));
+        resource.allow("s");
+        EXPECT_TRUE(resource.visible_to("s"));
+        EXPECT_FALSE(resource.visible_to("t"));
+        resource.revoke("s");
+        EXPECT_FALSE(resource.visible_to("s"));
+        resource.allow("");
+        EXPECT_TRUE(resource.visible_to("t"));
+    }
+    
+    blob::BlobStore reopened(dir, 10);
+    EXPECT_EQ(reopened.size(), 8u);
+    EXPECT_EQ(reopened.hashes().size(), 2u);
+    std::filesystem::remove_all(dir);
+}
+
+// Test that downloads are limited to http and https on public addresses
+TEST(BlobStoreTest, DownloadRefusesPrivateHosts) {
+    for (std::string url : {"file:///etc/passwd", "ftp://example.com/a.png", "http://user@example.com/a.png"}) {
+        EXPECT_THROW(blob::download(url, 1000), std::runtime_error) << url;
+    }
+    
+    // loopback, metadata service, private and shared ranges, also as IPv6
+    for (std::string url : {"http://127.0.0.1:8080/a.png", "http://localhost/a.png", "http://169.254.169.254/latest/meta-data/",
+        "http://10.1.2.3/a.png", "http://100.64.0.1/a.png", "http://[::1]/a.png", "https://[::ffff:192.168.0.1]/a.png"}) {
+        try {
+            blob::download(url, 1000);
+            FAIL() << "expected a refusal of " << url;
+        } catch (const std::runtime_error& e) {
+            EXPECT_NE(std::string(e.what()).find("not a public address"), std::string::npos) << e.what();
+        }
+    }
+}
+
+// Prediction stand-in for the try-on tests: garments in held run until released or cancelled
+struct FakePredictions {
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::set<std::string> held;
+    std::map<std::string, int> started;
+    std::map<std::string, int> cancelled;
+    
+    std::string run(const vto::TryOnRequest& request) {
+        cancellation_token token = cancellation_token::current();
+        std::unique_lock<std::mutex> lock(mutex);
+        started[request.garm_img]++;
+        changed.notify_all();
+        while (held.count(request.garm_img) && !token.is_cancelled()) {
+            changed.wait_for(lock, std::chrono::milliseconds(10));
+        }
+        if (token.is_cancelled()) {
+            cancelled[request.garm_img]++;
+            changed.notify_all();
+            lock.unlock();
+            token.throw_if_cancelled();
+        }
+        return "out:" + request.garm_img;
+    }
+    
+    void release(const std::string& garm) {
+        std::lock_guard<std::mutex> lock(mutex);
+        held.erase(garm);
+        changed.notify_all();
+    }
+    
+    int count(std::map<std::string, int>& counts, const std::string& garm) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return counts[garm];
+    }
+    
+    bool wait_for(std::map<std::string, int>& counts, const std::string& garm) {
+        std::unique_lock<std::mutex> lock(mutex);
+        return changed.wait_for(lock, std::chrono::seconds(5), [&]() { return counts[garm] > 0; });
+    }
+};
+
+vto::TryOnRequest garment_tryon(const std::string& garm) {
+    return vto::TryOnRequest{"human.png", garm, "desc", "upper_body"};
+}
+
+// Test that only http and https links are opened, so a link cannot name a file, a handler or an option
+TEST(BrowserTest, OpensOnlyWebLinks) {
+    EXPECT_TRUE(browser::is_web_url("https://replicate.delivery/out.png"));
+    EXPECT_TRUE(browser::is_web_url("HTTP://localhost:8080/out.png"));
+    EXPECT_FALSE(browser::is_web_url("-h"));
+    EXPECT_FALSE(browser::is_web_url("--new-window=https://example.com"));
+    EXPECT_FALSE(browser::is_web_url("file:///etc/passwd"));
+    EXPECT_FALSE(browser::is_web_url("javascript://alert(1)"));
+    EXPECT_FALSE(browser::is_web_url("https://"));
+    EXPECT_FALSE(browser::is_web_url("https://example.com/a\" & calc"));
+    EXPECT_FALSE(browser::is_web_url("https://example.com/a\nb"));
+    
+    // refused before anything is launched
+    EXPECT_FALSE(browser::openURL("--version"));
+    EXPECT_FALSE(browser::openURL("file:///etc/passwd"));
+}
+
+// Test that speculation stays within the budget, and that a new search cancels the running guess and refunds the queued one
+TEST(TryOnJobsTest, BudgetAndCancel) {
+    FakePredictions fake;
+    fake.held = {"a", "b", "c"};
+    vto::TryOnLimits limits;
+    limits.budget = 2;
+    vto::TryOnJobs jobs([&fake](const vto::TryOnRequest& request) { return fake.run(request); }, limits);
+    
+    jobs.speculate("s", {garment_tryon("a"), garment_tryon("b"), garment_tryon("c")});
+    EXPECT_EQ(jobs.budget_spent("s"), 2);
+    ASSERT_TRUE(fake.wait_for(fake.started, "a"));
+    
+    jobs.speculate("s", {});
+    EXPECT_TRUE(fake.wait_for(fake.cancelled, "a"));
+    EXPECT_EQ(fake.count(fake.started, "b"), 0);
+    EXPECT_EQ(jobs.budget_spent("s"), 1);
+    
+    jobs.close_session("s");
+    EXPECT_EQ(jobs.budget_spent("s"), 0);
+}
+
+// Test that a tool call takes over a queued speculative try-on, and that the other guesses are cancelled
+TEST(TryOnJobsTest, TakeOverQueued) {
+    FakePredictions fake;
+    fake.held = {"a"};
+    vto::TryOnJobs jobs([&fake](const vto::TryOnRequest& request) { return fake.run(request); });
+    
+    jobs.speculate("s", {garment_tryon("a"), garment_tryon("b")});
+    ASSERT_TRUE(fake.wait_for(fake.started, "a"));
+    EXPECT_EQ(jobs.budget_spent("s"), 2);
+    
+    // b runs for the user without waiting for the speculative worker, and is refunded
+    EXPECT_EQ(jobs.run("s", garment_tryon("b")), "out:b");
+    EXPECT_TRUE(fake.wait_for(fake.cancelled, "a"));
+    EXPECT_EQ(fake.count(fake.started, "b"), 1);
+    EXPECT_EQ(jobs.budget_spent("s"), 1);
+}
+
+// Test that results are shared across sessions until they expire
+TEST(TryOnJobsTest, ResultsExpire) {
+    FakePredictions fake;
+    vto::TryOnLimits limits;
+    limits.ttl = std::chrono::milliseconds(100);
+    vto::TryOnJobs jobs([&fake](const vto::TryOnRequest& request) { return fake.run(request); }, limits);
+    
+    EXPECT_EQ(jobs.run("s", garment_tryon("a")), "out:a");
+    EXPECT_EQ(jobs.run("t", garment_tryon("a")), "out:a");
+    EXPECT_EQ(fake.count(fake.started, "a"), 1);
+    
+    std::this_thread::sleep_for(std::chrono::milliseconds(150));
+    EXPECT_EQ(jobs.run("s", garment_tryon("a")), "out:a");
+    EXPECT_EQ(fake.count(fake.started, "a"), 2);
+}
+
+// Test that a cancelled caller stops waiting while the prediction goes on for the others
+TEST(TryOnJobsTest, CallerCancelKeepsPrediction) {
+    FakePredictions fake;
+    fake.held = {"a"};
+    vto::TryOnJobs jobs([&fake](const vto::TryOnRequest& request) { return fake.run(request); });
+    
+    cancellation_source caller;
+    auto first = std::async(std::launch::async, [&]() {
+        cancellation_scope scope(caller.token());
+        return jobs.run("s", garment_tryon("a"));
+    });
+    ASSERT_TRUE(fake.wait_for(fake.started, "a"));
+    auto second = std::async(std::launch::async, [&]() { return jobs.run("t", garment_tryon("a")); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    
+    caller.cancel("gone");
+    EXPECT_THROW(first.get(), mcp_exception);
+    fake.release("a");
+    EXPECT_EQ(second.get(), "out:a");
+    EXPECT_EQ(fake.count(fake.started, "a"), 1);
+    EXPECT_EQ(fake.count(fake.cancelled, "a"), 0);
+}
+
+// Test that a prediction is cancelled once its last waiter is, and that the next call starts it again
+TEST(TryOnJobsTest, LastWaiterCancels) {
+    FakePredictions fake;
+    fake.held = {"a"};
+    vto::TryOnJobs jobs([&fake](const vto::TryOnRequest& request) { return fake.run(request); });
+    
+    cancellation_source caller;
+    auto first = std::async(std::launch::async, [&]() {
+        cancellation_scope scope(caller.token());
+        return jobs.run("s", garment_tryon("a"));
+    });
+    ASSERT_TRUE(fake.wait_for(fake.started, "a"));
+    
+    caller.cancel("gone");
+    EXPECT_THROW(first.get(), mcp_exception);
+    EXPECT_TRUE(fake.wait_for(fake.cancelled, "a"));
+    
+    fake.release("a");
+    EXPECT_EQ(jobs.run("s", garment_tryon("a")), "out:a");
+    EXPECT_EQ(fake.count(fake.started, "a"), 2);
+}
+
+// Test that sessions keep separate try-on chains and that a closed session's chain is not brought back
+TEST(TryOnHistoryTest, SessionsStayIsolated) {
+    vto::TryOnHistory history(2);
+    std::vector<std::thread> sessions;
+    for (const std::string session : {"a", "b"}) {
+        sessions.emplace_back([&history, session]() {
+            for (int i = 0; i < 100; ++i) {
+                history.record(session, session + std::to_string(i));
+            }
+        });
+    }
+    for (auto& session : sessions) {
+        session.join();
+    }
+    EXPECT_EQ(history.last("a"), "a99");
+    EXPECT_EQ(history.last("b"), "b99");
+    EXPECT_EQ(history.last("c"), "");
+    
+    // closing cancels the session's requests, a late output of one of them is dropped
+    cancellation_source closing;
+    closing.cancel("Session closed");
+    history.close("a");
+    history.record("a", "late", closing.token());
+    EXPECT_EQ(history.last("a"), "");
+    history.record("b", "b100", closing.token());
+    EXPECT_EQ(history.last("b"), "b100");
+}
+
+// Test that cancelling runs the callbacks once, wakes waiters, and that scopes nest
+TEST(CancellationTest, TokenCallbacksAndScope) {
+    cancellation_source source;
+    cancellation_token token = source.token();
+    EXPECT_FALSE(cancellation_token().is_cancelled());
+    EXPECT_FALSE(cancellation_token::current().is_cancelled());
+    
+    int calls = 0;
+    cancellation_callback kept(token, [&calls]() { calls++; });
+    uint64_t removed = token.on_cancel([&calls]() { calls += 100; });
+    token.remove(removed);
+    
+    {
+        cancellation_scope scope(token);
+        EXPECT_FALSE(cancellation_token::current().is_cancelled());
+        std::thread canceller([&source]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            source.cancel("stop");
+        });
+        EXPECT_TRUE(cancellation_token::current().wait_for(std::chrono::seconds(5)));
+        canceller.join();
+        EXPECT_THROW(cancellation_token::current().throw_if_cancelled(), mcp_exception);
+    }
+    EXPECT_FALSE(cancellation_token::current().is_cancelled());
+    
+    EXPECT_EQ(calls, 1);
+    EXPECT_EQ(token.reason(), "stop");
+    EXPECT_FALSE(source.cancel("again"));
+    
+    // registered after the fact, runs at once
+    EXPECT_EQ(token.on_cancel([&calls]() { calls++; }), 0u);
+    EXPECT_EQ(calls, 2);
+}
+
+// Test that a deadline bounds the remaining budget and cancels the token with a timeout
+TEST(CancellationTest, Deadline) {
+    cancellation_source source;
+    cancellation_token token = source.token();
+    EXPECT_EQ(token.remaining(std::chrono::seconds(30)), std::chrono::seconds(30));
+    
+    source.set_deadline(std::chrono::steady_clock::now() + std::chrono::milliseconds(200));
+    EXPECT_LE(token.remaining(std::chrono::seconds(30)), std::chrono::milliseconds(200));
+    EXPECT_EQ(token.remaining(std::chrono::milliseconds(10)), std::chrono::milliseconds(10));
+    EXPECT_TRUE(token.wait_for(std::chrono::seconds(5)));
+    EXPECT_EQ(token.code(), error_code::request_timeout);
+    EXPECT_EQ(token.remaining(std::chrono::seconds(30)), std::chrono::milliseconds(0));
+    try {
+        token.throw_if_cancelled();
+        FAIL() << "expected a timeout";
+    } catch (const mcp_exception& e) {
+        EXPECT_EQ(e.code(), error_code::request_timeout);
+    }
+}
+
+// Test that completing drops the deadline timer and that a cancelled timer never runs
+TEST(CancellationTest, CompleteDropsDeadline) {
+    cancellation_source source;
+    cancellation_token token = source.token();
+    source.set_deadline(std::chrono::steady_clock::now() + std::chrono::milliseconds(100));
+    source.complete();
+    EXPECT_FALSE(token.wait_for(std::chrono::milliseconds(300)));
+    EXPECT_FALSE(token.is_cancelled());
+    
+    std::atomic<int> runs{0};
+    uint64_t id = executor::instance().post_after(std::chrono::milliseconds(50), [&runs]() { runs++; });
+    EXPECT_TRUE(executor::instance().cancel_timer(id));
+    EXPECT_FALSE(executor::instance().cancel_timer(id));
+    id = executor::instance().post_after(std::chrono::milliseconds(0), [&runs]() { runs++; });
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    EXPECT_EQ(runs.load(), 1);
+    EXPECT_FALSE(executor::instance().cancel_timer(id));
+}
+
+// Test the backoff bounds, Retry-After parsing, and that the token bucket holds callers to its rate
+TEST(ReplicateClientTest, BackoffAndRateLimit) {
+    ri::RetryPolicy policy;
+    policy.base_delay = std::chrono::milliseconds(100);
+    policy.max_delay = std::chrono::milliseconds(1000);
+    EXPECT_EQ(ri::backoff_delay(policy, 1, 0.5).count(), 50);
+    EXPECT_EQ(ri::backoff_delay(policy, 3, 0.999).count(), 399);
+    EXPECT_EQ(ri::backoff_delay(policy, 20, 0.5).count(), 500);
+    EXPECT_EQ(ri::backoff_delay(policy, 2, 0.0).count(), 0);
+    
+    EXPECT_EQ(ri::parse_retry_after("7").count(), 7000);
+    EXPECT_LT(ri::parse_retry_after("").count(), 0);
+    EXPECT_LT(ri::parse_retry_after("Wed, 21 Oct 2026 07:28:00 GMT").count(), 0);
+    
+    // a burst of 2 goes through at once, the next 2 wait 1/20 s each
+    ri::TokenBucket bucket(20, 2);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 4; ++i) {
+        bucket.acquire();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    EXPECT_GE(elapsed, std::chrono::milliseconds(90));
+    EXPECT_LT(elapsed, std::chrono::milliseconds(1000));
+}
+
+// Test that 429 is retried after Retry-After on a reused connection, and that a prediction is not replayed after a 500
+TEST(ReplicateClientTest, RetriesThrottledRequests) {
+    httplib::Server backend;
+    std::atomic<int> calls{0};
+    backend.Post("/throttled", [&calls](const httplib::Request&, httplib::Response& res) {
+        if (calls++ == 0) {
+            res.status = 429;
+            res.set_header("Retry-After", "0");
+        } else {
+            res.set_content("{}", "application/json");
+        }
+    });
+    backend.Post("/broken", [&calls](const httplib::Request&, httplib::Response& res) {
+        calls++;
+        res.status = 500;
+    });
+    int port = backend.bind_to_any_port("localhost");
+    std::thread thread([&backend]() { backend.listen_after_bind(); });
+    backend.wait_until_ready();
+    
+    {
+        // closes its kept-alive connections when it goes out of scope
+        ri::ReplicateClient client("http://localhost:" + std::to_string(port));
+        ri::RetryPolicy policy;
+        policy.base_delay = std::chrono::milliseconds(10);
+        client.configure(1000, 10, 2, policy);
+        auto post = [](const std::string& path) {
+            return [path](httplib::Client& c) { return c.Post(path, "{}", "application/json"); };
+        };
+        
+        auto result = client.request(post("/throttled"), false);
+        // no ASSERT here, the server thread must be joined
+        EXPECT_EQ(result ? result->status : -1, 200);
+        EXPECT_EQ(calls, 2);
+        
+        calls = 0;
+        result = client.request(post("/broken"), false);
+        EXPECT_EQ(result ? result->status : -1, 500);
+        EXPECT_EQ(calls, 1);
+        
+        calls = 0;
+        result = client.request(post("/broken"), true);
+        EXPECT_EQ(calls, policy.max_attempts);
+    }
+        
+    backend.stop();
+    thread.join();
+}
+
+// Test the zero-copy tokenizer on RFC 4180 quoting
+TEST(CsvReaderTest, SplitRecordAndParseVector) {
+    std::vector<csv::Field> fields;
+    std::string input = "a,\"He said \"\"hi\"\", twice\",\"multi\nline\",\r\nnext";
+    size_t consumed = csv::split_record(input, fields);
+    ASSERT_EQ(fields.size(), 4u);
+    EXPECT_EQ(fields[0].str(), "a");
+    EXPECT_TRUE(fields[1].escaped);
+    EXPECT_EQ(fields[1].str(), "He said \"hi\", twice");
+    EXPECT_EQ(fields[2].str(), "multi\nline");
+    EXPECT_EQ(fields[3].str(), "");
+    EXPECT_EQ(input.substr(consumed), "next");
+    
+    std::vector<double> vec;
+    ASSERT_TRUE(csv::parse_vector("[0.5, -1.25e-2,3]", vec));
+    EXPECT_EQ(vec, (std::vector<double>{0.5, -0.0125, 3.0}));
+    EXPECT_FALSE(csv::parse_vector("[0.5, abc]", vec));
+}
+
+// Test that parallel chunks give the same rows as a single pass
+TEST(CsvReaderTest, ReadCatalogInChunks) {
+    std::string path = "mcp_reader_test.csv";
+    {
+        std::ofstream out(path);
+        out << "fname,link,id,desc,embedding_model,vector,color\n";
+        // enough rows for several 4 MB chunks, with quoted newlines and commas to trip naive splitting
+        for (int id = 0; id < 40000; ++id) {
+            out << "img_" << id << ".jpg,https://example.com/" << id << ".jpg," << id
+                << ",\"Garment " << id << ",\nwith \"\"quotes\"\"\",nomic-embed-text,\"[";
+            for (int d = 0; d < 24; ++d) {
+                out << (d ? ", " : "") << (id % 7) * 0.125 + d;
+            }
+            out << "]\",blue\n";
+        }
+    }
+    
+    auto single = csv::read_catalog(path, 1);
+    auto parallel = csv::read_catalog(path, 3);
+    ASSERT_EQ(single.size(), 40000u);
+    ASSERT_EQ(parallel.size(), single.size());
+    for (size_t i = 0; i < single.size(); i += 997) {
+        EXPECT_EQ(parallel[i].id, static_cast<int>(i));
+        EXPECT_EQ(parallel[i].desc, single[i].desc);
+        EXPECT_EQ(parallel[i].vector, single[i].vector);
+    }
+    EXPECT_EQ(parallel[5].desc, "Garment 5,\nwith \"quotes\"");
+    EXPECT_EQ(parallel[5].vector[1], 5 * 0.125 + 1);
+    EXPECT_EQ(parallel.back().attributes, (std::vector<std::string>{"blue"}));
+    
+    {
+        std::ofstream out(path);
+        out << "fname,link,id,desc,embedding_model,vector\n";
+        // the error names the line, past a quoted newline and a blank line
+        out << "a.jpg,a,1,\"A\nA\",m,\"[1.0]\"\n";
+        out << "\n";
+        out << "b.jpg,b,two,B,m,\"[1.0]\"\n";
+    }
+    try {
+        csv::read_catalog(path);
+        FAIL() << "Expected a malformed row error";
+    } catch (const std::runtime_error& e) {
+        EXPECT_NE(std::string(e.what()).find("line 5"), std::string::npos) << e.what();
+    }
+    std::remove(path.c_str());
+}
+
+// Test bitmap bookkeeping at word boundaries
+TEST(BitmapTest, SetFlipAndIterate) {
+    csv::Bitmap all(130, true);
+    EXPECT_EQ(all.count(), 130u);
+    all.flip();
+    EXPECT_EQ(all.count(), 0u);
+    
+    csv::Bitmap some(130, false);
+    some.set(0);
+    some.set(64);
+    some.set(129);
+    std::vector<size_t> seen;
+    some.for_each([&](size_t i) { seen.push_back(i); });
+    EXPECT_EQ(seen, (std::vector<size_t>{0, 64, 129}));
+    some.flip();
+    EXPECT_EQ(some.count(), 127u);
+    EXPECT_FALSE(some.test(64));
+}
+
+// Test that concurrent updates of a sharded_map are not lost and that erasing while another thread iterates is safe
+TEST(RegistryTest, ShardedMapConcurrentUpdateAndErase) {
+    sharded_map<int, int> counters;
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 4; ++t) {
+        writers.emplace_back([&counters]() {
+            for (int i = 0; i < 1000; ++i) {
+                counters.update(i % 10, [](int& value) { value++; });
+            }
+        });
+    }
+    for (auto& writer : writers) {
+        writer.join();
+    }
+    for (int key = 0; key < 10; ++key) {
+        int value = 0;
+        EXPECT_TRUE(counters.find(key, value));
+        EXPECT_EQ(value, 400);
+    }
+    
+    std::atomic<bool> stop{false};
+    std::thread eraser([&counters, &stop]() {
+        for (int i = 0; !stop.load(); ++i) {
+            counters.erase(i % 10);
+            counters.insert_or_assign(i % 10, i);
+            counters.erase_if(10 + i % 10, [](int) { return true; });
+        }
+    });
+    size_t visited = 0;
+    for (int round = 0; round < 1000; ++round) {
+        counters.for_each([&visited](int key, int /* value */) {
+            EXPECT_LT(key, 10);
+            visited++;
+        });
+    }
+    stop = true;
+    eraser.join();
+    EXPECT_GT(visited, 0u);
+    EXPECT_LE(counters.size(), 10u);
+}
+
+// Test that readers see only whole versions while a writer publishes, and keep the version they hold
+TEST(RegistryTest, SnapshotConcurrentReadAndPublish) {
+    rcu_snapshot<std::vector<int>> snapshot;
+    std::shared_ptr<const std::vector<int>> held = snapshot.load();
+    
+    std::atomic<bool> stop{false};
+    std::atomic<bool> torn{false};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; ++t) {
+        readers.emplace_back([&snapshot, &stop, &torn]() {
+            while (!stop.load()) {
+                auto version = snapshot.load();
+                for (size_t i = 0; i < version->size(); ++i) {
+                    if ((*version)[i] != static_cast<int>(i)) {
+                        torn = true;
+                    }
+                }
+            }
+        });
+    }
+    for (int i = 0; i < 2000; ++i) {
+        if (i % 2 == 0) {
+            snapshot.update([](std::vector<int>& values) { values.push_back(static_cast<int>(values.size())); });
+        } else {
+            auto next = std::make_shared<std::vector<int>>(*snapshot.load());
+            next->push_back(static_cast<int>(next->size()));
+            snapshot.publish(std::move(next));
+        }
+    }
+    stop = true;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    EXPECT_FALSE(torn.load());
+    EXPECT_EQ(snapshot.load()->size(), 2000u);
+    EXPECT_TRUE(held->empty());
+}
+
 // Test message format
 class MessageFormatTest : public ::testing::Test {
 protected:
@@ -658,6 +1780,569 @@ TEST_F(ToolsTest, CallTool) {
     EXPECT_EQ(tool_result["content"][0]["text"], "Current weather in New York:\nTemperature: 72°F\nConditions: Partly cloudy");
 }
 
+// Async tools test environment
+class AsyncToolsEnvironment : public ::testing::Environment {
+public:
+    void SetUp() override {
+        // Set up test environment
+        server_ = std::make_unique<server>("localhost", 8084);
+        
+        // Register a callback-based tool that completes from another thread
+        tool echo_tool = tool_builder("delayed_echo")
+            .with_description("Echo the input after a short delay")
+            .with_string_param("text", "Text to echo")
+            .build();
+        server_->register_tool(echo_tool, [](const json& params, const std::string& /* session_id */, completion_handler done) {
+            std::string text = params["text"];
+            executor::instance().post_after(std::chrono::milliseconds(50), [text, done]() {
+                done(json::array({{{"type", "text"}, {"text", text}}}), nullptr);
+            });
+        });
+
+#ifdef MCP_HAS_COROUTINES
+        // Register a coroutine tool that suspends without holding a worker
+        tool sleepy_tool = tool_builder("sleepy_echo")
+            .with_description("Echo the input after sleeping in a coroutine")
+            .with_string_param("text", "Text to echo")
+            .build();
+        server_->register_tool(sleepy_tool, [](const json& params, const std::string& /* session_id */) -> task<json> {
+            co_await sleep_for(std::chrono::milliseconds(50));
+            co_return json::array({{{"type", "text"}, {"text", params["text"]}}});
+        });
+#endif
+        
+        // Start server (non-blocking mode)
+        server_->start(false);
+    }
+
+    void TearDown() override {
+        // Clean up test environment
+        server_->stop();
+        server_.reset();
+    }
+
+private:
+    static std::unique_ptr<server> server_;
+};
+
+// Static member variable definition
+std::unique_ptr<server> AsyncToolsEnvironment::server_;
+
+// Test asynchronous tools
+class AsyncToolsTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        // Each test gets its own session
+        client_ = std::make_unique<sse_client>("localhost", 8084);
+    }
+
+    void TearDown() override {
+        client_.reset();
+    }
+
+    std::unique_ptr<sse_client> client_;
+};
+
+// Test calling a callback-based tool
+TEST_F(AsyncToolsTest, CallAsyncTool) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    ASSERT_TRUE(client_->initialize("TestClient", "1.0.0"));
+    json tool_result = client_->call_tool("delayed_echo", {{"text", "hello"}});
+    
+    EXPECT_FALSE(tool_result["isError"]);
+    EXPECT_EQ(tool_result["content"][0]["text"], "hello");
+}
+
+#ifdef MCP_HAS_COROUTINES
+// Test calling a coroutine tool
+TEST_F(AsyncToolsTest, CallCoroutineTool) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    ASSERT_TRUE(client_->initialize("TestClient", "1.0.0"));
+    json tool_result = client_->call_tool("sleepy_echo", {{"text", "world"}});
+    
+    EXPECT_FALSE(tool_result["isError"]);
+    EXPECT_EQ(tool_result["content"][0]["text"], "world");
+}
+#endif
+
+// Streamable HTTP test environment
+class StreamableHttpEnvironment : public ::testing::Environment {
+public:
+    void SetUp() override {
+        // Set up test environment
+        server_ = std::make_unique<server>("localhost", 8085, "MCP Server", "0.0.1", "/sse", "/mcp", transport_mode::streamable_http);
+        server_->set_direct_response_timeout(std::chrono::milliseconds(100));
+        server_->enable_metrics();
+        server_->enable_tracing();
+        
+        // Register a tool that outlives the direct response timeout
+        tool slow_tool = tool_builder("slow_echo")
+            .with_description("Echo the input after a long delay")
+            .with_string_param("text", "Text to echo")
+            .build();
+        server_->register_tool(slow_tool, [](const json& params, const std::string& /* session_id */, completion_handler done) {
+            std::string text = params["text"];
+            executor::instance().post_after(std::chrono::milliseconds(500), [text, done]() {
+                done(json::array({{{"type", "text"}, {"text", text}}}), nullptr);
+            });
+        });
+        
+        // Register a tool that runs until its request is cancelled
+        tool cancellable_tool = tool_builder("wait_for_cancel")
+            .with_description("Wait up to five seconds, or until cancelled")
+            .build();
+        auto wait_for_cancel = [](const json& /* params */, const std::string& /* session_id */) -> json {
+            cancellation_token token = cancellation_token::current();
+            token.wait_for(std::chrono::seconds(5));
+            token.throw_if_cancelled();
+            return json::array({{{"type", "text"}, {"text", "not cancelled"}}});
+        };
+        server_->register_tool(cancellable_tool, wait_for_cancel);
+        
+        // The same tool with a deadline shorter than its wait
+        tool deadline_tool = tool_builder("wait_for_deadline")
+            .with_description("Wait up to five seconds, or until the deadline")
+            .build();
+        server_->register_tool(deadline_tool, wait_for_cancel);
+        server_->set_tool_timeout("wait_for_deadline", std::chrono::milliseconds(300));
+        
+        // A tool that never answers, past its deadline the server answers for it
+        tool stuck_tool = tool_builder("unanswered")
+            .with_description("Drop the completion handler without calling it")
+            .build();
+        server_->register_tool(stuck_tool, [](const json& /* params */, const std::string& /* session_id */, completion_handler /* done */) {});
+        server_->set_tool_timeout("unanswered", std::chrono::milliseconds(300));
+        
+        // A tool that answers and then throws, only the answer may reach the client
+        tool throwing_tool = tool_builder("throws_after_answer")
+            .with_description("Call the completion handler, then throw")
+            .build();
+        server_->register_tool(throwing_tool, [](const json& /* params */, const std::string& /* session_id */, completion_handler done) {
+            done(json::array({{{"type", "text"}, {"text", "answered"}}}), nullptr);
+            throw std::runtime_error("thrown after answering");
+        });
+        
+        // Record the sessions whose state is cleaned up
+        server_->register_session_cleanup("slow_echo", [](const std::string& session_id) {
+            closed_sessions_.insert_or_assign(session_id, true);
+        });
+        
+        // Start server (non-blocking mode)
+        server_->start(false);
+    }
+
+    void TearDown() override {
+        // Clean up test environment
+        server_->stop();
+        server_.reset();
+    }
+
+    static std::unique_ptr<server>& GetServer() {
+        return server_;
+    }
+
+    static bool was_cleaned_up(const std::string& session_id) {
+        return closed_sessions_.contains(session_id);
+    }
+
+private:
+    static std::unique_ptr<server> server_;
+    static sharded_map<std::string, bool> closed_sessions_;
+};
+
+// Static member variable definition
+std::unique_ptr<server> StreamableHttpEnvironment::server_;
+sharded_map<std::string, bool> StreamableHttpEnvironment::closed_sessions_;
+
+// Test Streamable HTTP transport
+class StreamableHttpTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        http_ = std::make_unique<httplib::Client>("localhost", 8085);
+        http_->set_read_timeout(5, 0);
+    }
+
+    void TearDown() override {
+        http_.reset();
+    }
+
+    // Create a session and return its id
+    std::string initialize() {
+        json init = request::create("initialize", {
+            {"protocolVersion", MCP_VERSION},
+            {"clientInfo", {{"name", "TestClient"}, {"version", "1.0.0"}}},
+            {"capabilities", json::object()}
+        }).to_json();
+        auto res = http_->Post("/mcp", accept_both_, init.dump(), "application/json");
+        if (!res || res->status != 200) {
+            return "";
+        }
+        std::string session_id = res->get_header_value("Mcp-Session-Id");
+        
+        httplib::Headers headers = accept_both_;
+        headers.emplace("Mcp-Session-Id", session_id);
+        res = http_->Post("/mcp", headers, request::create_notification("initialized").to_json().dump(), "application/json");
+        if (!res || res->status != 202) {
+            return "";
+        }
+        return session_id;
+    }
+
+    std::unique_ptr<httplib::Client> http_;
+    httplib::Headers accept_both_ = {{"Accept", "application/json, text/event-stream"}};
+};
+
+// Test that initialize is answered directly and creates a session
+TEST_F(StreamableHttpTest, InitializeReturnsJson) {
+    json init = request::create("initialize", {
+        {"protocolVersion", MCP_VERSION},
+        {"clientInfo", {{"name", "TestClient"}, {"version", "1.0.0"}}},
+        {"capabilities", json::object()}
+    }).to_json();
+    auto res = http_->Post("/mcp", accept_both_, init.dump(), "application/json");
+    
+    ASSERT_TRUE(res);
+    EXPECT_EQ(res->status, 200);
+    EXPECT_EQ(res->get_header_value("Content-Type"), "application/json");
+    EXPECT_FALSE(res->get_header_value("Mcp-Session-Id").empty());
+    
+    json response = json::parse(res->body);
+    EXPECT_EQ(response["id"], init["id"]);
+    EXPECT_EQ(response["result"]["protocolVersion"], MCP_VERSION);
+}
+
+// Test that notifications are acknowledged with 202 and requests need a session
+TEST_F(StreamableHttpTest, NotificationsAndSessions) {
+    std::string session_id = initialize();
+    ASSERT_FALSE(session_id.empty());
+    
+    httplib::Headers headers = accept_both_;
+    headers.emplace("Mcp-Session-Id", session_id);
+    auto res = http_->Post("/mcp", headers, request::create_notification("initialized").to_json().dump(), "application/json");
+    ASSERT_TRUE(res);
+    EXPECT_EQ(res->status, 202);
+    
+    res = http_->Post("/mcp", accept_both_, request::create("tools/list").to_json().dump(), "application/json");
+    ASSERT_TRUE(res);
+    EXPECT_EQ(res->status, 400);
+    
+    httplib::Headers unknown = accept_both_;
+    unknown.emplace("Mcp-Session-Id", "unknown-session");
+    res = http_->Post("/mcp", unknown, request::create("tools/list").to_json().dump(), "application/json");
+    ASSERT_TRUE(res);
+    EXPECT_EQ(res->status, 404);
+}
+
+// Test that a long-running request is upgraded to an SSE stream
+TEST_F(StreamableHttpTest, SlowRequestUpgradesToSse) {
+    std::string session_id = initialize();
+    ASSERT_FALSE(session_id.empty());
+    
+    httplib::Headers headers = accept_both_;
+    headers.emplace("Mcp-Session-Id", session_id);
+    json call = request::create("tools/call", {{"name", "slow_echo"}, {"arguments", {{"text", "later"}}}}).to_json();
+    auto res = http_->Post("/mcp", headers, call.dump(), "application/json");
+    
+    ASSERT_TRUE(res);
+    EXPECT_EQ(res->status, 200);
+    EXPECT_EQ(res->get_header_value("Content-Type"), "text/event-stream");
+    
+    const std::string data_prefix = "data: ";
+    auto pos = res->body.find(data_prefix);
+    ASSERT_NE(pos, std::string::npos);
+    auto end = res->body.find("\r\n", pos);
+    json response = json::parse(res->body.substr(pos + data_prefix.size(), end - pos - data_prefix.size()));
+    EXPECT_EQ(response["id"], call["id"]);
+    EXPECT_EQ(response["result"]["content"][0]["text"], "later");
+}
+
+// Test that a batch is answered with one response per request
+TEST_F(StreamableHttpTest, BatchRequest) {
+    std::string session_id = initialize();
+    ASSERT_FALSE(session_id.empty());
+    
+    httplib::Headers headers = accept_both_;
+    headers.emplace("Mcp-Session-Id", session_id);
+    json list = request::create("tools/list").to_json();
+    json call = request::create("tools/call", {{"name", "slow_echo"}, {"arguments", {{"text", "batched"}}}}).to_json();
+    json batch = json::array({list, request::create_notification("initialized").to_json(), call});
+    
+    // Accept JSON only so the combined responses come back in the body
+    httplib::Headers json_only = {{"Accept", "application/json"}, {"Mcp-Session-Id", session_id}};
+    auto res = http_->Post("/mcp", json_only, batch.dump(), "application/json");
+    ASSERT_TRUE(res);
+    EXPECT_EQ(res->status, 200);
+    
+    json responses = json::parse(res->body);
+    ASSERT_TRUE(responses.is_array());
+    ASSERT_EQ(responses.size(), 2);
+    for (const auto& response : responses) {
+        if (response["id"] == list["id"]) {
+            EXPECT_EQ(response["result"]["tools"][0]["name"], "slow_echo");
+        } else {
+            EXPECT_EQ(response["id"], call["id"]);
+            EXPECT_EQ(response["result"]["content"][0]["text"], "batched");
+        }
+    }
+    
+    // A batch of notifications is only acknowledged
+    res = http_->Post("/mcp", headers, json::array({request::create_notification("initialized").to_json()}).dump(), "application/json");
+    ASSERT_TRUE(res);
+    EXPECT_EQ(res->status, 202);
+    
+    // An empty batch is a single error
+    res = http_->Post("/mcp", headers, "[]", "application/json");
+    ASSERT_TRUE(res);
+    json error = json::parse(res->body);
+    EXPECT_EQ(error["error"]["code"], static_cast<int>(error_code::invalid_request));
+}
+
+// Test that deleting a session ends it and cleans up its state
+TEST_F(StreamableHttpTest, DeleteSession) {
+    std::string session_id = initialize();
+    ASSERT_FALSE(session_id.empty());
+    
+    httplib::Headers headers = {{"Mcp-Session-Id", session_id}};
+    auto res = http_->Delete("/mcp", headers);
+    ASSERT_TRUE(res);
+    EXPECT_EQ(res->status, 200);
+    EXPECT_TRUE(StreamableHttpEnvironment::was_cleaned_up(session_id));
+    
+    headers.emplace("Accept", "application/json, text/event-stream");
+    res = http_->Post("/mcp", headers, request::create("tools/list").to_json().dump(), "application/json");
+    ASSERT_TRUE(res);
+    EXPECT_EQ(res->status, 404);
+}
+
+// Test that notifications/cancelled stops a running tool and its call is answered with request_cancelled
+TEST_F(StreamableHttpTest, CancelRequest) {
+    std::string session_id = initialize();
+    ASSERT_FALSE(session_id.empty());
+    
+    httplib::Headers headers = {{"Accept", "application/json"}, {"Mcp-Session-Id", session_id}};
+    json call = request::create("tools/call", {{"name", "wait_for_cancel"}, {"arguments", json::object()}}).to_json();
+    auto start = std::chrono::steady_clock::now();
+    auto pending = std::async(std::launch::async, [&]() {
+        httplib::Client client("localhost", 8085);
+        client.set_read_timeout(10, 0);
+        return client.Post("/mcp", headers, call.dump(), "application/json");
+    });
+    
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    json cancel = request::create_notification("cancelled", {{"requestId", call["id"]}, {"reason", "User gave up"}}).to_json();
+    auto res = http_->Post("/mcp", headers, cancel.dump(), "application/json");
+    ASSERT_TRUE(res);
+    EXPECT_EQ(res->status, 202);
+    
+    auto reply = pending.get();
+    ASSERT_TRUE(reply);
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(3));
+    json response = json::parse(reply->body);
+    EXPECT_EQ(response["id"], call["id"]);
+    EXPECT_EQ(response["error"]["code"], static_cast<int>(error_code::request_cancelled));
+    EXPECT_EQ(response["error"]["message"], "User gave up");
+}
+
+// Test that a call running past its tool's deadline is answered with a timeout error
+TEST_F(StreamableHttpTest, RequestDeadline) {
+    std::string session_id = initialize();
+    ASSERT_FALSE(session_id.empty());
+    
+    httplib::Headers headers = {{"Accept", "application/json"}, {"Mcp-Session-Id", session_id}};
+    json call = request::create("tools/call", {{"name", "wait_for_deadline"}, {"arguments", json::object()}}).to_json();
+    auto start = std::chrono::steady_clock::now();
+    httplib::Client client("localhost", 8085);
+    client.set_read_timeout(10, 0);
+    auto res = client.Post("/mcp", headers, call.dump(), "application/json");
+    ASSERT_TRUE(res);
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(3));
+    
+    json response = json::parse(res->body);
+    EXPECT_EQ(response["id"], call["id"]);
+    EXPECT_EQ(response["error"]["code"], static_cast<int>(error_code::request_timeout));
+    EXPECT_EQ(response["error"]["message"], "Deadline exceeded");
+}
+
+// Test that a handler that never answers does not hold the POST past its deadline
+TEST_F(StreamableHttpTest, UnansweredRequestTimesOut) {
+    std::string session_id = initialize();
+    ASSERT_FALSE(session_id.empty());
+    
+    httplib::Headers headers = {{"Accept", "application/json"}, {"Mcp-Session-Id", session_id}};
+    json call = request::create("tools/call", {{"name", "unanswered"}, {"arguments", json::object()}}).to_json();
+    auto start = std::chrono::steady_clock::now();
+    httplib::Client client("localhost", 8085);
+    client.set_read_timeout(10, 0);
+    auto res = client.Post("/mcp", headers, call.dump(), "application/json");
+    ASSERT_TRUE(res);
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+    
+    json response = json::parse(res->body);
+    EXPECT_EQ(response["id"], call["id"]);
+    EXPECT_EQ(response["error"]["code"], static_cast<int>(error_code::request_timeout));
+}
+
+// Test that a stream whose consumer falls too far behind is closed instead of buffering
+TEST(EventDispatcherTest, ClosesWhenFull) {
+    event_dispatcher dispatcher(2);
+    EXPECT_TRUE(dispatcher.send_event("a"));
+    EXPECT_TRUE(dispatcher.send_event("b"));
+    EXPECT_FALSE(dispatcher.send_event("c"));
+    EXPECT_TRUE(dispatcher.is_closed());
+    EXPECT_EQ(dispatcher.pending(), 2u);
+}
+
+// Test that a session over its in-flight limit is turned away until its request is answered
+TEST_F(StreamableHttpTest, AdmissionControl) {
+    std::string session_id = initialize();
+    ASSERT_FALSE(session_id.empty());
+    StreamableHttpEnvironment::GetServer()->set_admission_limits(0, 0, 1);
+    
+    httplib::Headers headers = {{"Accept", "application/json"}, {"Mcp-Session-Id", session_id}};
+    json call = request::create("tools/call", {{"name", "wait_for_cancel"}, {"arguments", json::object()}}).to_json();
+    auto pending = std::async(std::launch::async, [&]() {
+        httplib::Client client("localhost", 8085);
+        client.set_read_timeout(10, 0);
+        return client.Post("/mcp", headers, call.dump(), "application/json");
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    
+    json second = request::create("tools/call", {{"name", "slow_echo"}, {"arguments", {{"text", "later"}}}}).to_json();
+    auto res = http_->Post("/mcp", headers, second.dump(), "application/json");
+    EXPECT_TRUE(res && res->status == 503);
+    if (res && res->status == 503) {
+        EXPECT_EQ(res->get_header_value("Retry-After"), "1");
+        json response = json::parse(res->body);
+        EXPECT_EQ(response["id"], second["id"]);
+        EXPECT_EQ(response["error"]["code"], static_cast<int>(error_code::server_overloaded));
+    }
+    
+    // Notifications are always accepted
+    json cancel = request::create_notification("cancelled", {{"requestId", call["id"]}}).to_json();
+    res = http_->Post("/mcp", headers, cancel.dump(), "application/json");
+    EXPECT_TRUE(res && res->status == 202);
+    auto reply = pending.get();
+    EXPECT_TRUE(reply && reply->status == 200);
+    
+    // Answered, so the session has room again
+    res = http_->Post("/mcp", headers, second.dump(), "application/json");
+    StreamableHttpEnvironment::GetServer()->set_admission_limits(0, 0, 0);
+    ASSERT_TRUE(res);
+    EXPECT_EQ(res->status, 200);
+    
+    res = http_->Get("/metrics");
+    ASSERT_TRUE(res);
+    EXPECT_NE(res->body.find("mcp_requests_shed_total{reason=\"session_in_flight\"} 1"), std::string::npos);
+}
+
+// Test that a handler that completes and then throws is answered, and counted, once
+TEST_F(StreamableHttpTest, CompleteThenThrow) {
+    std::string session_id = initialize();
+    ASSERT_FALSE(session_id.empty());
+    
+    auto tool_calls = [this](const std::string& status) {
+        auto res = http_->Get("/metrics");
+        std::string series = "mcp_requests_total{method=\"tools/call\",status=\"" + status + "\"} ";
+        size_t at = res ? res->body.find(series) : std::string::npos;
+        return at == std::string::npos ? 0.0 : std::stod(res->body.substr(at + series.size()));
+    };
+    double ok_before = tool_calls("ok");
+    double errors_before = tool_calls("error");
+    
+    httplib::Headers headers = {{"Accept", "application/json"}, {"Mcp-Session-Id", session_id}};
+    json call = request::create("tools/call", {{"name", "throws_after_answer"}, {"arguments", json::object()}}).to_json();
+    auto res = http_->Post("/mcp", headers, call.dump(), "application/json");
+    ASSERT_TRUE(res);
+    EXPECT_EQ(res->status, 200);
+    json response = json::parse(res->body);
+    EXPECT_EQ(response["id"], call["id"]);
+    EXPECT_FALSE(response["result"]["isError"]);
+    EXPECT_EQ(response["result"]["content"][0]["text"], "answered");
+    
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    EXPECT_EQ(tool_calls("ok"), ok_before + 1);
+    EXPECT_EQ(tool_calls("error"), errors_before);
+}
+
+// Test that unknown sessions are rejected before admission and a shed batch still delivers its cancellations
+TEST_F(StreamableHttpTest, AdmissionAfterSessionCheck) {
+    std::string session_id = initialize();
+    ASSERT_FALSE(session_id.empty());
+    
+    httplib::Headers headers = {{"Accept", "application/json"}, {"Mcp-Session-Id", session_id}};
+    json call = request::create("tools/call", {{"name", "wait_for_cancel"}, {"arguments", json::object()}}).to_json();
+    auto pending = std::async(std::launch::async, [&]() {
+        httplib::Client client("localhost", 8085);
+        client.set_read_timeout(10, 0);
+        return client.Post("/mcp", headers, call.dump(), "application/json");
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    StreamableHttpEnvironment::GetServer()->set_admission_limits(0, 1, 0);
+    
+    json second = request::create("tools/call", {{"name", "slow_echo"}, {"arguments", {{"text", "later"}}}}).to_json();
+    httplib::Headers unknown = {{"Accept", "application/json"}, {"Mcp-Session-Id", "no-such-session"}};
+    auto res = http_->Post("/mcp", unknown, second.dump(), "application/json");
+    ASSERT_TRUE(res);
+    EXPECT_EQ(res->status, 404);
+    
+    // The request is shed, the cancellation next to it is not
+    json batch = json::array({second, request::create_notification("cancelled", {{"requestId", call["id"]}}).to_json()});
+    res = http_->Post("/mcp", headers, batch.dump(), "application/json");
+    ASSERT_TRUE(res);
+    EXPECT_EQ(res->status, 503);
+    auto reply = pending.get();
+    ASSERT_TRUE(reply);
+    EXPECT_EQ(reply->status, 200);
+    EXPECT_EQ(json::parse(reply->body)["error"]["code"], static_cast<int>(error_code::request_cancelled));
+    
+    // A batch of notifications alone is never shed
+    json notifications = json::array({request::create_notification("cancelled", {{"requestId", 12345}}).to_json()});
+    res = http_->Post("/mcp", headers, notifications.dump(), "application/json");
+    StreamableHttpEnvironment::GetServer()->set_admission_limits(0, 0, 0);
+    ASSERT_TRUE(res);
+    EXPECT_EQ(res->status, 202);
+}
+    
+// Test that requests are counted on the metrics endpoint
+TEST_F(StreamableHttpTest, MetricsEndpoint) {
+    std::string session_id = initialize();
+    ASSERT_FALSE(session_id.empty());
+    
+    auto res = http_->Get("/metrics");
+    ASSERT_TRUE(res);
+    EXPECT_EQ(res->status, 200);
+    EXPECT_NE(res->body.find("mcp_requests_total{method=\"initialize\",status=\"ok\"}"), std::string::npos);
+    EXPECT_NE(res->body.find("mcp_http_requests_total{transport=\"streamable_http\",status=\"200\"}"), std::string::npos);
+    EXPECT_NE(res->body.find("mcp_sessions_active "), std::string::npos);
+}
+
+// Test that a request's spans are exported as one trace
+TEST_F(StreamableHttpTest, TraceEndpoint) {
+    tracer::instance().set_enabled(true);
+    std::string session_id = initialize();
+    ASSERT_FALSE(session_id.empty());
+    
+    httplib::Headers headers = {{"Accept", "application/json"}, {"Mcp-Session-Id", session_id}};
+    json call = request::create("tools/call", {{"name", "slow_echo"}, {"arguments", {{"text", "traced"}}}}).to_json();
+    auto res = http_->Post("/mcp", headers, call.dump(), "application/json");
+    ASSERT_TRUE(res);
+    
+    res = http_->Get("/trace?slowest=1");
+    ASSERT_TRUE(res);
+    EXPECT_EQ(res->status, 200);
+    
+    json trace = json::parse(res->body);
+    std::set<std::string> names;
+    for (const auto& event : trace["traceEvents"]) {
+        names.insert(event["name"].get<std::string>());
+        EXPECT_EQ(event["args"]["trace_id"], trace["traceEvents"][0]["args"]["trace_id"]);
+    }
+    for (const char* name : {"http.post", "json.parse", "queue.wait", "request", "tool"}) {
+        EXPECT_EQ(names.count(name), 1u) << name;
+    }
+}
+
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
     
@@ -666,6 +2351,8 @@ int main(int argc, char **argv) {
     ::testing::AddGlobalTestEnvironment(new VersioningEnvironment());
     ::testing::AddGlobalTestEnvironment(new PingEnvironment());
     ::testing::AddGlobalTestEnvironment(new ToolsEnvironment());
+    ::testing::AddGlobalTestEnvironment(new AsyncToolsEnvironment());
+    ::testing::AddGlobalTestEnvironment(new StreamableHttpEnvironment());
     
     return RUN_ALL_TESTS();
 } 
\ No newline at end of file